@@ -0,0 +1,57 @@
+#ifndef IOG_BENCH_H
+#define IOG_BENCH_H
+
+#include <stdio.h>
+
+/** @file iog_bench.h */
+
+typedef void (*iog_bench_func_t)(FILE *stream); ///< Definition of benchmark group function
+
+/** @struct IogBenchGroup_t
+ * Defines named group of benchmarks
+ */
+struct IogBenchGroup_t {
+  const char       *name; ///< Name used to select group from command line
+  iog_bench_func_t  func; ///< Function that runs and reports group
+};
+
+double iog_bench_now_ns (); ///< Monotonic time in nanoseconds
+double iog_bench_start  (); ///< Reset allocation and peak RSS counters, return time of measure start
+
+size_t iog_bench_max_size (); ///< Largest stack size benchmarks may build (--max-size)
+
+/// Print group title (only in text output)
+void iog_bench_group (FILE *stream, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+/// Print one result: name, parameter, ns and allocations per operation, peak RSS and extra counter
+void iog_bench_report (FILE *stream, const char *name, size_t param,
+    size_t ops, double elapsed_ns, const char *extra_name, double extra);
+
+/// Same as iog_bench_report, but allocations are counted by caller
+void iog_bench_report_allocs (FILE *stream, const char *name, size_t param,
+    size_t ops, double elapsed_ns, double allocs, const char *extra_name, double extra);
+
+double iog_bench_allocs (); ///< Memlib allocs and resizes since last iog_bench_start
+
+/// Prevent compiler from throwing away benchmark result
+template <typename T>
+inline void iog_bench_keep (const T &value) {
+  asm volatile("" : : "g"(&value) : "memory");
+}
+
+void iog_bench_policy (FILE *stream); ///< Capacity policy on oscillating push/pop traces
+void iog_bench_growth (FILE *stream); ///< Filling large stacks from empty
+void iog_bench_bulk   (FILE *stream); ///< Single ops against push_n/pop_n
+void iog_bench_verify (FILE *stream); ///< Cost of each verify level and of tracked checksum
+void iog_bench_small  (FILE *stream); ///< Lifecycle of short-lived small stacks
+void iog_bench_seg    (FILE *stream); ///< Growth latency of contiguous and segmented stacks
+void iog_bench_ops    (FILE *stream); ///< Push, peek and pop across stack sizes
+void iog_bench_lf     (FILE *stream); ///< Shared stack throughput from 1 to N threads
+void iog_bench_ws     (FILE *stream); ///< Work-stealing scheduler from 1 to N workers
+void iog_bench_alloc  (FILE *stream); ///< Stack memory from pool against arena reset
+void iog_bench_mapped (FILE *stream); ///< Restart of file-backed stack against rebuild
+void iog_bench_dump   (FILE *stream); ///< Text dump against window dump and binary image
+void iog_bench_vm     (FILE *stream); ///< Expression evaluation by per-op API against stack machine
+void iog_bench_agg    (FILE *stream); ///< Tracked min/max/sum against vector scans
+
+#endif // IOG_BENCH_H
@@ -0,0 +1,93 @@
+#include <stdio.h>
+
+#include "iog_bench.h"
+#include "iog_stack.h"
+#include "iog_simd.h"
+
+static const size_t AGG_OPS     = 1000000; ///< Push/pop pairs of tracking overhead
+static const size_t AGG_QUERIES = 1000;    ///< Queries per measure
+
+/**
+ * Push/pop pairs on stack of given size with and without tracked aggregates.
+ * @param[out] stream pointer to stream for prints
+ * @param[in]  size   stack size under pairs
+ * @param[in]  track  1 to track aggregates
+ */
+static void iog_bench_agg_overhead (FILE *stream, size_t size, int track) {
+  IogStack_t stk = {};
+  iog_stack_init(&stk);
+  for (size_t i = 0; i < size; i++)
+    iog_stack_push(&stk, (iog_stack_value_t) (i % 1000));
+  iog_stack_track_aggregates(&stk, track);
+
+  iog_stack_value_t value = 0;
+  double start = iog_bench_start();
+  for (size_t i = 0; i < AGG_OPS; i++) {
+    iog_stack_push(&stk, (iog_stack_value_t) (i % 2000));
+    iog_stack_pop(&stk, &value);
+  }
+  iog_bench_keep(value);
+  iog_bench_report(stream, track ? "agg/push_pop_tracked" : "agg/push_pop_plain", size, 2 * AGG_OPS,
+                   iog_bench_now_ns() - start, "size", (double) stk.size);
+
+  iog_stack_destroy(&stk);
+}
+
+/**
+ * Compares tracked min and sum with scans by each kernel set and search of value.
+ * @param[out] stream pointer to stream for prints
+ */
+void iog_bench_agg (FILE *stream) {
+  iog_bench_group(stream, "agg: tracked aggregates against scans (best isa: %s)",
+                  iog_simd_isa_name(iog_simd_select(IOG_SIMD_AVX2)));
+
+  iog_bench_agg_overhead(stream, 1000, 0);
+  iog_bench_agg_overhead(stream, 1000, 1);
+
+  for (size_t size = 1000; size <= iog_bench_max_size() && size <= 10000000; size *= 10) {
+    IogStack_t stk = {};
+    iog_stack_init(&stk);
+    for (size_t i = 0; i < size; i++)
+      iog_stack_push(&stk, (iog_stack_value_t) ((i * 37) % 1001));
+
+    iog_stack_value_t value = 0;
+    size_t queries = (size >= 1000000) ? AGG_QUERIES / 100 : AGG_QUERIES;
+
+    for (int isa = IOG_SIMD_SCALAR; isa <= IOG_SIMD_AVX2; isa++) {
+      if (iog_simd_select((IogSimdIsa) isa) != isa)
+        continue;
+
+      char name[64] = "";
+      double start = iog_bench_start();
+      for (size_t i = 0; i < queries; i++) {
+        iog_stack_min(&stk, &value);
+        iog_bench_keep(value);
+      }
+      snprintf(name, sizeof(name), "agg/min_scan_%s", iog_simd_isa_name((IogSimdIsa) isa));
+      iog_bench_report(stream, name, size, queries, iog_bench_now_ns() - start, "min", (double) value);
+
+      size_t depth = 0;
+      start = iog_bench_start();
+      for (size_t i = 0; i < queries; i++) {
+        iog_stack_find(&stk, 0, &depth);
+        iog_bench_keep(depth);
+      }
+      snprintf(name, sizeof(name), "agg/find_%s", iog_simd_isa_name((IogSimdIsa) isa));
+      iog_bench_report(stream, name, size, queries, iog_bench_now_ns() - start, "depth", (double) depth);
+    }
+    iog_simd_select(IOG_SIMD_AVX2);
+
+    iog_stack_track_aggregates(&stk, 1);
+    double start = iog_bench_start();
+    for (size_t i = 0; i < queries; i++) {
+      iog_stack_min(&stk, &value);
+      iog_bench_keep(value);
+      iog_stack_sum(&stk, &value);
+      iog_bench_keep(value);
+    }
+    iog_bench_report(stream, "agg/min_sum_tracked", size, 2 * queries, iog_bench_now_ns() - start,
+                     "sum", (double) value);
+
+    iog_stack_destroy(&stk);
+  }
+}
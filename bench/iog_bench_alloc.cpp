@@ -0,0 +1,75 @@
+#include <stdio.h>
+
+#include "iog_bench.h"
+#include "iog_stack.h"
+#include "iog_memlib.h"
+
+static const size_t ALLOC_BATCH_STACKS = 64;     ///< Stacks living during one request
+static const size_t ALLOC_MIN_TOTAL    = 20000000; ///< Pushes made by each variant
+
+/**
+ * Simulates requests: each batch grows ALLOC_BATCH_STACKS stacks to size elements,
+ * then releases them. Stacks take memory from thread pool if arena is NULL,
+ * otherwise from arena, which is released by destroys or by one reset.
+ * @param[out] stream  pointer to stream for prints
+ * @param[in]  name    name of result
+ * @param[in]  arena   arena bound to stacks (can be NULL)
+ * @param[in]  size    elements pushed to each stack
+ * @param[in]  destroy if 0 then stacks are dropped by arena reset without destroy
+ */
+static void iog_bench_batches (FILE *stream, const char *name, IogMemArena_t *arena, size_t size, int destroy) {
+  // array is allocated before counters are reset, so it isn't measured
+  IogStack_t *stks = (IogStack_t *) iog_recalloc(NULL, 0, ALLOC_BATCH_STACKS, sizeof(IogStack_t));
+  if (stks == NULL)
+    return;
+
+  IogStackPolicy_t policy = IOG_STACK_DEFAULT_POLICY;
+  policy.arena = arena;
+
+  size_t batches = ALLOC_MIN_TOTAL / (ALLOC_BATCH_STACKS * size) + 1;
+
+  double start = iog_bench_start();
+  for (size_t b = 0; b < batches; b++) {
+    for (size_t s = 0; s < ALLOC_BATCH_STACKS; s++) {
+      iog_stack_init(&stks[s], &policy);
+
+      for (size_t i = 0; i < size; i++)
+        iog_stack_push(&stks[s], (iog_stack_value_t) i);
+    }
+
+    for (size_t s = 0; s < ALLOC_BATCH_STACKS; s++) {
+      if (destroy)
+        iog_stack_destroy(&stks[s]);
+      else
+        stks[s] = {};
+    }
+
+    if (arena != NULL)
+      iog_arena_reset(arena);
+  }
+  double elapsed = iog_bench_now_ns() - start;
+
+  iog_bench_report(stream, name, size, batches * ALLOC_BATCH_STACKS * size, elapsed, NULL, 0);
+
+  iog_free_sized(stks, ALLOC_BATCH_STACKS, sizeof(IogStack_t));
+}
+
+/**
+ * Compares thread pool (default) with arena released per batch.
+ * Plain realloc baseline is the same bench built with -D IOG_MEM_USE_POOL=0.
+ * @param[out] stream pointer to stream for prints
+ */
+void iog_bench_alloc (FILE *stream) {
+  iog_bench_group(stream, "alloc: batches of %lu stacks, pool %d", ALLOC_BATCH_STACKS, IOG_MEM_USE_POOL);
+
+  IogMemArena_t arena = {};
+  iog_arena_init(&arena);
+
+  for (size_t size = 16; size <= 4096; size *= 16) {
+    iog_bench_batches(stream, "alloc/pool_destroy",  NULL,   size, 1);
+    iog_bench_batches(stream, "alloc/arena_destroy", &arena, size, 1);
+    iog_bench_batches(stream, "alloc/arena_reset",   &arena, size, 0);
+  }
+
+  iog_arena_destroy(&arena);
+}
@@ -0,0 +1,65 @@
+#include <stdio.h>
+
+#include "iog_bench.h"
+#include "iog_stack.h"
+
+static const size_t BULK_TOTAL_VALUES = 10000000;
+static const size_t BULK_MAX_CHUNK    = 4096;
+
+/**
+ * Pushes and pops chunks one value at a time, with push_n/pop_n,
+ * and undoes pushed chunk by rollback to mark.
+ * @param[out] stream pointer to stream for prints
+ */
+void iog_bench_bulk (FILE *stream) {
+  iog_bench_group(stream, "bulk: chunked producer/consumer, single ops vs push_n/pop_n vs rollback");
+
+  static iog_stack_value_t chunk_values[BULK_MAX_CHUNK] = {};
+  for (size_t i = 0; i < BULK_MAX_CHUNK; i++)
+    chunk_values[i] = (iog_stack_value_t) i;
+
+  for (size_t chunk = 4; chunk <= BULK_MAX_CHUNK; chunk *= 8) {
+    size_t rounds = BULK_TOTAL_VALUES / chunk;
+
+    IogStack_t stk = {};
+    iog_stack_init(&stk);
+
+    double start = iog_bench_start();
+    for (size_t r = 0; r < rounds; r++) {
+      for (size_t i = 0; i < chunk; i++)
+        iog_stack_push(&stk, chunk_values[i]);
+
+      for (size_t i = 0; i < chunk; i++)
+        iog_stack_pop(&stk, &chunk_values[chunk - 1 - i]);
+    }
+    double elapsed = iog_bench_now_ns() - start;
+
+    iog_bench_report(stream, "bulk/single_push_pop", chunk, 2 * rounds * chunk, elapsed, NULL, 0);
+
+    start = iog_bench_start();
+    for (size_t r = 0; r < rounds; r++) {
+      iog_stack_push_n(&stk, chunk_values, chunk);
+      iog_stack_pop_n (&stk, chunk_values, chunk);
+    }
+    elapsed = iog_bench_now_ns() - start;
+
+    iog_bench_report(stream, "bulk/push_n_pop_n", chunk, 2 * rounds * chunk, elapsed, NULL, 0);
+
+    IogStackMark_t mark = {};
+
+    start = iog_bench_start();
+    for (size_t r = 0; r < rounds; r++) {
+      iog_stack_mark(&stk, &mark);
+
+      for (size_t i = 0; i < chunk; i++)
+        iog_stack_push(&stk, chunk_values[i]);
+
+      iog_stack_rollback(&stk, &mark);
+    }
+    elapsed = iog_bench_now_ns() - start;
+
+    iog_bench_report(stream, "bulk/push_rollback", chunk, 2 * rounds * chunk, elapsed, NULL, 0);
+
+    iog_stack_destroy(&stk);
+  }
+}
@@ -0,0 +1,63 @@
+#include <stdio.h>
+
+#include "iog_bench.h"
+#include "iog_stack.h"
+
+static const size_t DUMP_TEXT_MAX_SIZE = 1000000; ///< Full text dump is too slow above this
+static const size_t DUMP_WINDOW        = 16;      ///< Values printed from each end by window dump
+
+/**
+ * Compares full text dump with window dump and binary image save and load
+ * of the same stack, all written to real file.
+ * @param[out] stream pointer to stream for prints
+ */
+void iog_bench_dump (FILE *stream) {
+  iog_bench_group(stream, "dump: text dump against window dump and binary save/load");
+
+  for (size_t size = 10000; size <= iog_bench_max_size(); size *= 10) {
+    IogStack_t stk = {};
+    iog_stack_init(&stk);
+    for (size_t i = 0; i < size; i++)
+      iog_stack_push(&stk, (iog_stack_value_t) i);
+
+    FILE *file = tmpfile();
+    if (file == NULL) {
+      iog_stack_destroy(&stk);
+      return;
+    }
+
+    double start = 0;
+    if (size <= DUMP_TEXT_MAX_SIZE) {
+      start = iog_bench_start();
+      iog_stack_dump_f(&stk, file, "stk", __FILE__, __LINE__, __PRETTY_FUNCTION__);
+      fflush(file);
+      iog_bench_report(stream, "dump/text_full", size, 1, iog_bench_now_ns() - start,
+                       "bytes", (double) ftell(file));
+      rewind(file);
+    }
+
+    start = iog_bench_start();
+    iog_stack_dump_window_f(&stk, file, DUMP_WINDOW);
+    fflush(file);
+    iog_bench_report(stream, "dump/text_window", size, 1, iog_bench_now_ns() - start,
+                     "bytes", (double) ftell(file));
+    rewind(file);
+
+    start = iog_bench_start();
+    iog_stack_save_f(&stk, file);
+    fflush(file);
+    iog_bench_report(stream, "dump/binary_save", size, 1, iog_bench_now_ns() - start,
+                     "bytes", (double) ftell(file));
+    rewind(file);
+
+    IogStack_t loaded = {};
+    start = iog_bench_start();
+    iog_stack_load_f(&loaded, file);
+    iog_bench_report(stream, "dump/binary_load", size, 1, iog_bench_now_ns() - start,
+                     "size", (double) loaded.size);
+
+    iog_stack_destroy(&loaded);
+    iog_stack_destroy(&stk);
+    fclose(file);
+  }
+}
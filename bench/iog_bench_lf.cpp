@@ -0,0 +1,105 @@
+#include <stdio.h>
+
+#include <mutex>
+#include <thread>
+
+#include "iog_bench.h"
+#include "iog_stack.h"
+#include "iog_lf_stack.h"
+
+static const size_t LF_OPS_PER_THREAD = 1000000;
+static const size_t LF_MAX_THREADS    = 16;
+
+/// Stack shared by benchmark threads
+struct IogBenchShared_t {
+  IogStack_t   locked; ///< Contiguous stack behind mutex
+  std::mutex   mutex;  ///< Lock of contiguous stack
+  IogLfStack_t lf;     ///< Lock-free stack
+};
+
+/**
+ * Push/pop pairs on contiguous stack, every operation takes mutex.
+ */
+static void iog_bench_locked_worker (IogBenchShared_t *shared) {
+  iog_stack_value_t value = 0;
+
+  for (size_t i = 0; i < LF_OPS_PER_THREAD / 2; i++) {
+    {
+      std::lock_guard<std::mutex> lock(shared->mutex);
+      iog_stack_push(&shared->locked, (iog_stack_value_t) i);
+    }
+    {
+      std::lock_guard<std::mutex> lock(shared->mutex);
+      iog_stack_pop(&shared->locked, &value);
+    }
+  }
+
+  iog_bench_keep(value);
+}
+
+/**
+ * Push/pop pairs on lock-free stack.
+ */
+static void iog_bench_lf_worker (IogBenchShared_t *shared) {
+  iog_stack_value_t value = 0;
+
+  for (size_t i = 0; i < LF_OPS_PER_THREAD / 2; i++) {
+    iog_lf_stack_push(&shared->lf, (iog_stack_value_t) i);
+    iog_lf_stack_pop(&shared->lf, &value);
+  }
+
+  iog_bench_keep(value);
+}
+
+/**
+ * Runs threads_num threads with worker, reports time per operation of all threads together.
+ */
+static void iog_bench_threads (FILE *stream, const char *name, size_t threads_num,
+    void (*worker)(IogBenchShared_t *), IogBenchShared_t *shared) {
+  std::thread threads[LF_MAX_THREADS];
+
+  double start = iog_bench_start();
+  for (size_t t = 0; t < threads_num; t++)
+    threads[t] = std::thread(worker, shared);
+
+  for (size_t t = 0; t < threads_num; t++)
+    threads[t].join();
+  double elapsed = iog_bench_now_ns() - start;
+
+  iog_bench_report(stream, name, threads_num, threads_num * LF_OPS_PER_THREAD, elapsed,
+      "Mops/s", (double) (threads_num * LF_OPS_PER_THREAD) / elapsed * 1e3);
+}
+
+/**
+ * Mutex-wrapped contiguous stack against lock-free stack with and without elimination,
+ * from 1 thread up to number of cores (at least 2 threads, to show contention).
+ * @param[out] stream pointer to stream for prints
+ */
+void iog_bench_lf (FILE *stream) {
+  size_t max_threads = std::thread::hardware_concurrency();
+  if (max_threads < 2)
+    max_threads = 2;
+  if (max_threads > LF_MAX_THREADS)
+    max_threads = LF_MAX_THREADS;
+
+  iog_bench_group(stream, "lf: shared stack throughput, push/pop pairs from 1 to %lu threads", max_threads);
+
+  static IogBenchShared_t shared;
+
+  for (size_t threads_num = 1; threads_num <= max_threads; threads_num *= 2) {
+    iog_stack_init(&shared.locked);
+    iog_bench_threads(stream, "lf/mutex_stack", threads_num, iog_bench_locked_worker, &shared);
+    iog_stack_destroy(&shared.locked);
+
+    iog_lf_stack_init(&shared.lf);
+    iog_bench_threads(stream, "lf/treiber", threads_num, iog_bench_lf_worker, &shared);
+    iog_lf_stack_destroy(&shared.lf);
+
+    iog_lf_stack_init(&shared.lf, 1);
+    iog_bench_threads(stream, "lf/treiber_elimination", threads_num, iog_bench_lf_worker, &shared);
+    iog_lf_stack_destroy(&shared.lf);
+
+    if (threads_num < max_threads && threads_num * 2 > max_threads)
+      threads_num = max_threads / 2;
+  }
+}
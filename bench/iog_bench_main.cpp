@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+#include "iog_bench.h"
+#include "iog_stack.h"
+#include "iog_memlib.h"
+
+static const IogBenchGroup_t BENCH_GROUPS[] = {
+  {"ops",    iog_bench_ops},
+  {"policy", iog_bench_policy},
+  {"growth", iog_bench_growth},
+  {"bulk",   iog_bench_bulk},
+  {"verify", iog_bench_verify},
+  {"small",  iog_bench_small},
+  {"seg",    iog_bench_seg},
+  {"lf",     iog_bench_lf},
+  {"ws",     iog_bench_ws},
+  {"alloc",  iog_bench_alloc},
+  {"mapped", iog_bench_mapped},
+  {"dump",   iog_bench_dump},
+  {"vm",     iog_bench_vm},
+  {"agg",    iog_bench_agg},
+};
+
+static const size_t BENCH_GROUPS_NUM = sizeof(BENCH_GROUPS) / sizeof(BENCH_GROUPS[0]);
+
+static const size_t BENCH_DEFAULT_MAX_SIZE = 100000000;
+
+static int    BENCH_JSON         = 0; ///< Print results as JSON instead of text table
+static size_t BENCH_MAX_SIZE     = BENCH_DEFAULT_MAX_SIZE;
+static size_t BENCH_RESULTS_NUM  = 0; ///< Results printed, to place commas in JSON
+
+/**
+ * @return monotonic time in nanoseconds
+ */
+double iog_bench_now_ns () {
+  timespec ts = {};
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (double) ts.tv_sec * 1e9 + (double) ts.tv_nsec;
+}
+
+/**
+ * Zeroes memlib counters of this thread and resets peak RSS (Linux only),
+ * so next report counts only measured part.
+ * @return monotonic time in nanoseconds
+ */
+double iog_bench_start () {
+  iog_mem_stats_reset();
+
+#ifdef __linux__
+  FILE *clear_refs = fopen("/proc/self/clear_refs", "w");
+  if (clear_refs != NULL) {
+    fputs("5", clear_refs);
+    fclose(clear_refs);
+  }
+#endif // __linux__
+
+  return iog_bench_now_ns();
+}
+
+/**
+ * @return peak resident set size in KB since last iog_bench_start (since start of process
+ *         where it can't be reset), 0 if unknown
+ */
+static size_t iog_bench_peak_rss_kb () {
+#ifdef __linux__
+  FILE *status = fopen("/proc/self/status", "r");
+  if (status != NULL) {
+    char line[256] = "";
+    size_t peak = 0;
+
+    while (fgets(line, sizeof(line), status) != NULL)
+      if (sscanf(line, "VmHWM: %lu kB", &peak) == 1)
+        break;
+
+    fclose(status);
+    return peak;
+  }
+#endif // __linux__
+
+#if defined(__unix__) || defined(__APPLE__)
+  rusage usage = {};
+  getrusage(RUSAGE_SELF, &usage);
+
+#ifdef __APPLE__
+  return (size_t) usage.ru_maxrss / 1024;
+#else
+  return (size_t) usage.ru_maxrss;
+#endif
+#else
+  return 0;
+#endif
+}
+
+/**
+ * @return largest stack size benchmarks may build
+ */
+size_t iog_bench_max_size () {
+  return BENCH_MAX_SIZE;
+}
+
+/**
+ * @param[out] stream pointer to stream for prints
+ * @param[in]  format printf format of title
+ */
+void iog_bench_group (FILE *stream, const char *format, ...) {
+  if (BENCH_JSON)
+    return;
+
+  va_list args;
+  va_start(args, format);
+
+  fprintf(stream, "# ");
+  vfprintf(stream, format, args);
+  fprintf(stream, "\n");
+
+  va_end(args);
+}
+
+/**
+ * @return memlib allocs and resizes made by this thread since last iog_bench_start
+ */
+double iog_bench_allocs () {
+  const IogMemStats_t *mem = iog_mem_stats();
+
+  return (double) (mem->allocs + mem->resizes);
+}
+
+/**
+ * Allocations are memlib allocs and resizes since last iog_bench_start.
+ * @param[out] stream     pointer to stream for prints
+ * @param[in]  name       name of benchmark
+ * @param[in]  param      benchmark parameter (usually stack size)
+ * @param[in]  ops        number of measured operations
+ * @param[in]  elapsed_ns measured time in nanoseconds
+ * @param[in]  extra_name name of extra counter (can be NULL)
+ * @param[in]  extra      value of extra counter
+ */
+void iog_bench_report (FILE *stream, const char *name, size_t param,
+    size_t ops, double elapsed_ns, const char *extra_name, double extra) {
+  iog_bench_report_allocs(stream, name, param, ops, elapsed_ns, iog_bench_allocs(), extra_name, extra);
+}
+
+/**
+ * @param[out] stream     pointer to stream for prints
+ * @param[in]  name       name of benchmark
+ * @param[in]  param      benchmark parameter (usually stack size)
+ * @param[in]  ops        number of measured operations
+ * @param[in]  elapsed_ns measured time in nanoseconds
+ * @param[in]  allocs     allocations made by measured operations
+ * @param[in]  extra_name name of extra counter (can be NULL)
+ * @param[in]  extra      value of extra counter
+ */
+void iog_bench_report_allocs (FILE *stream, const char *name, size_t param,
+    size_t ops, double elapsed_ns, double allocs, const char *extra_name, double extra) {
+  double ns_per_op     = elapsed_ns / (double) ops;
+  double allocs_per_op = allocs / (double) ops;
+  size_t peak_rss_kb   = iog_bench_peak_rss_kb();
+
+  if (BENCH_JSON) {
+    fprintf(stream, "%s\n    {\"name\": \"%s\", \"param\": %lu, \"ops\": %lu, \"ns_per_op\": %.3lf, "
+                    "\"allocs_per_op\": %.6lf, \"peak_rss_kb\": %lu",
+        (BENCH_RESULTS_NUM > 0) ? "," : "", name, param, ops, ns_per_op, allocs_per_op, peak_rss_kb);
+
+    if (extra_name != NULL)
+      fprintf(stream, ", \"%s\": %lg", extra_name, extra);
+
+    fprintf(stream, "}");
+  } else {
+    fprintf(stream, "%-32s %12lu %12.2lf ns/op %10.4lf allocs/op %9lu KB rss",
+        name, param, ns_per_op, allocs_per_op, peak_rss_kb);
+
+    if (extra_name != NULL)
+      fprintf(stream, "  %s %lg", extra_name, extra);
+
+    fprintf(stream, "\n");
+  }
+
+  fflush(stream);
+  BENCH_RESULTS_NUM++;
+}
+
+/**
+ * Runs all benchmark groups or only groups named in arguments.
+ * Options: --json prints results as JSON document, --max-size N limits stack sizes.
+ */
+int main (const int argc, const char *argv[]) {
+  int groups_named = 0;
+
+  for (int j = 1; j < argc; j++) {
+    if (strcmp(argv[j], "--json") == 0) {
+      BENCH_JSON = 1;
+    } else if (strcmp(argv[j], "--max-size") == 0 && j + 1 < argc) {
+      BENCH_MAX_SIZE = strtoul(argv[++j], NULL, 10);
+    } else {
+      groups_named = 1;
+    }
+  }
+
+  if (BENCH_JSON)
+    fprintf(stdout, "{\n  \"verify_level\": %d,\n  \"inline_capacity\": %d,\n  \"stats\": %d,\n"
+                    "  \"max_size\": %lu,\n  \"results\": [",
+        IOG_STACK_VERIFY_LEVEL, IOG_STACK_INLINE_CAPACITY, IOG_STACK_STATS, BENCH_MAX_SIZE);
+
+  for (size_t i = 0; i < BENCH_GROUPS_NUM; i++) {
+    int selected = !groups_named;
+
+    for (int j = 1; j < argc; j++)
+      if (strcmp(argv[j], BENCH_GROUPS[i].name) == 0)
+        selected = 1;
+
+    if (selected)
+      BENCH_GROUPS[i].func(stdout);
+  }
+
+  if (BENCH_JSON)
+    fprintf(stdout, "\n  ]\n}\n");
+
+  return 0;
+}
@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "iog_bench.h"
+#include "iog_stack.h"
+
+static const size_t MAPPED_REOPENS = 1000; ///< Reopens timed for one size
+
+/**
+ * Fills file-backed stack once, then compares restart by reopening the file
+ * with rebuilding the same stack on heap.
+ * @param[out] stream pointer to stream for prints
+ */
+void iog_bench_mapped (FILE *stream) {
+  iog_bench_group(stream, "mapped: restart of file-backed stack against rebuild on heap");
+
+  char path[] = "/tmp/iog_bench_mapped_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0)
+    return;
+  close(fd);
+
+  for (size_t size = 10000; size <= iog_bench_max_size(); size *= 100) {
+    IogStack_t stk = {};
+    iog_stack_value_t value = 0;
+
+    double start = iog_bench_start();
+    iog_stack_open_mapped(&stk, path);
+    for (size_t i = stk.size; i < size; i++)
+      iog_stack_push(&stk, (iog_stack_value_t) i);
+    iog_stack_sync(&stk);
+    iog_stack_destroy(&stk);
+    iog_bench_report(stream, "mapped/build_sync", size, size, iog_bench_now_ns() - start, NULL, 0);
+
+    start = iog_bench_start();
+    for (size_t r = 0; r < MAPPED_REOPENS; r++) {
+      iog_stack_open_mapped(&stk, path);
+      iog_stack_peek(&stk, &value);
+      iog_bench_keep(value);
+      iog_stack_destroy(&stk);
+    }
+    iog_bench_report(stream, "mapped/reopen_peek", size, MAPPED_REOPENS, iog_bench_now_ns() - start, NULL, 0);
+
+    start = iog_bench_start();
+    iog_stack_init(&stk);
+    for (size_t i = 0; i < size; i++)
+      iog_stack_push(&stk, (iog_stack_value_t) i);
+    iog_stack_destroy(&stk);
+    iog_bench_report(stream, "mapped/heap_rebuild", size, 1, iog_bench_now_ns() - start, NULL, 0);
+  }
+
+  unlink(path);
+}
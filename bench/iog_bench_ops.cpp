@@ -0,0 +1,174 @@
+#include <stdio.h>
+
+#include <atomic>
+#include <thread>
+
+#include "iog_bench.h"
+#include "iog_stack.h"
+
+static const size_t OPS_SIZES[]      = {4, 100, 10000, 1000000, 100000000};
+static const size_t OPS_SIZES_NUM    = sizeof(OPS_SIZES) / sizeof(OPS_SIZES[0]);
+static const size_t OPS_MIN_TOTAL    = 10000000; ///< Small sizes repeat cycle to reach this number of ops
+static const size_t OPS_MIN_TIMED    = 10000;    ///< Smaller phases are too short to time separately
+
+static const size_t SHARE_SIZE        = 10000; ///< Stack size at top of writer cycle
+static const size_t SHARE_MAX_READERS = 2;     ///< Reader threads of shared stack
+static const size_t SHARE_TOP         = 16;    ///< Top values copied by every read
+
+/**
+ * Pushes size values, peeks size times and pops back to empty, rounds times on the same stack,
+ * so grow and shrink both happen every round. Phases are timed separately only if they are
+ * long enough to hide timer overhead, otherwise whole cycle is reported.
+ * @param[out] stream pointer to stream for prints
+ * @param[in]  size   stack size at top of cycle
+ * @param[in]  rounds number of cycles
+ */
+static void iog_bench_cycles (FILE *stream, size_t size, size_t rounds) {
+  IogStack_t stk = {};
+  iog_stack_init(&stk);
+
+  int timed = (size >= OPS_MIN_TIMED);
+
+  iog_stack_value_t value = 0;
+  double push_ns = 0, peek_ns = 0, pop_ns = 0;
+  double push_allocs = 0;
+
+  double cycle_start = iog_bench_start();
+  for (size_t r = 0; r < rounds; r++) {
+    double allocs = timed ? iog_bench_allocs() : 0;
+    double start  = timed ? iog_bench_now_ns() : 0;
+    for (size_t i = 0; i < size; i++)
+      iog_stack_push(&stk, (iog_stack_value_t) i);
+
+    if (timed) {
+      push_ns     += iog_bench_now_ns() - start;
+      push_allocs += iog_bench_allocs() - allocs;
+      start        = iog_bench_now_ns();
+    }
+
+    for (size_t i = 0; i < size; i++) {
+      iog_stack_peek(&stk, &value);
+      iog_bench_keep(value);
+    }
+
+    if (timed) {
+      peek_ns += iog_bench_now_ns() - start;
+      start    = iog_bench_now_ns();
+    }
+
+    for (size_t i = 0; i < size; i++)
+      iog_stack_pop(&stk, &value);
+
+    if (timed)
+      pop_ns += iog_bench_now_ns() - start;
+  }
+  double cycle_ns = iog_bench_now_ns() - cycle_start;
+
+  iog_bench_keep(value);
+
+  if (timed) {
+    double pop_allocs = iog_bench_allocs() - push_allocs;
+
+    iog_bench_report_allocs(stream, "ops/push", size, rounds * size, push_ns, push_allocs, NULL, 0);
+    iog_bench_report_allocs(stream, "ops/peek", size, rounds * size, peek_ns, 0,           NULL, 0);
+    iog_bench_report_allocs(stream, "ops/pop",  size, rounds * size, pop_ns,  pop_allocs,  NULL, 0);
+  } else {
+    iog_bench_report(stream, "ops/push_peek_pop", size, 3 * rounds * size, cycle_ns, NULL, 0);
+  }
+
+  iog_stack_destroy(&stk);
+}
+
+/**
+ * Reads shared stack until writer is done, sums time of reads.
+ */
+static void iog_bench_share_reader (const IogStack_t *stk, std::atomic<int> *writer_done,
+    double *read_ns, size_t *reads) {
+  IogStackView_t view = {};
+  iog_stack_value_t top[SHARE_TOP] = {};
+
+  while (!writer_done->load(std::memory_order_relaxed)) {
+    double start = iog_bench_now_ns();
+    iog_stack_read_shared(stk, &view, top, SHARE_TOP);
+    *read_ns += iog_bench_now_ns() - start;
+    (*reads)++;
+  }
+
+  iog_bench_keep(view);
+}
+
+/**
+ * Push/pop cycles of writer on plain stack, on shared stack without readers and with
+ * readers_num readers copying top values, reports writer time and mean read latency.
+ * @param[out] stream      pointer to stream for prints
+ * @param[in]  shared      1 - share stack with readers
+ * @param[in]  readers_num number of reader threads (only if shared)
+ */
+static void iog_bench_share (FILE *stream, int shared, size_t readers_num) {
+  IogStack_t stk = {};
+  iog_stack_init(&stk);
+  if (shared)
+    iog_stack_share(&stk, 1);
+
+  std::atomic<int> writer_done(0);
+  std::thread readers[SHARE_MAX_READERS];
+  double read_ns[SHARE_MAX_READERS] = {};
+  size_t reads[SHARE_MAX_READERS]   = {};
+
+  for (size_t t = 0; t < readers_num; t++)
+    readers[t] = std::thread(iog_bench_share_reader, &stk, &writer_done, &read_ns[t], &reads[t]);
+
+  size_t rounds = OPS_MIN_TOTAL / SHARE_SIZE;
+  iog_stack_value_t value = 0;
+
+  double start = iog_bench_start();
+  for (size_t r = 0; r < rounds; r++) {
+    for (size_t i = 0; i < SHARE_SIZE; i++)
+      iog_stack_push(&stk, (iog_stack_value_t) i);
+
+    for (size_t i = 0; i < SHARE_SIZE; i++)
+      iog_stack_pop(&stk, &value);
+  }
+  double elapsed = iog_bench_now_ns() - start;
+
+  writer_done.store(1);
+
+  double total_read_ns = 0;
+  size_t total_reads   = 0;
+  for (size_t t = 0; t < readers_num; t++) {
+    readers[t].join();
+
+    total_read_ns += read_ns[t];
+    total_reads   += reads[t];
+  }
+
+  iog_bench_keep(value);
+
+  iog_bench_report(stream, shared ? "ops/shared_push_pop" : "ops/plain_push_pop", readers_num,
+      2 * rounds * SHARE_SIZE, elapsed, "read_ns", total_reads ? total_read_ns / (double) total_reads : 0);
+
+  iog_stack_share(&stk, 0);
+  iog_stack_destroy(&stk);
+}
+
+/**
+ * Runs push/peek/pop cycles for sizes from 4 to iog_bench_max_size(), then writer cycles
+ * on shared stack.
+ * @param[out] stream pointer to stream for prints
+ */
+void iog_bench_ops (FILE *stream) {
+  iog_bench_group(stream, "ops: push, peek and pop cycles from empty stack to size");
+
+  for (size_t s = 0; s < OPS_SIZES_NUM && OPS_SIZES[s] <= iog_bench_max_size(); s++) {
+    size_t size   = OPS_SIZES[s];
+    size_t rounds = (size < OPS_MIN_TOTAL) ? OPS_MIN_TOTAL / size : 1;
+
+    iog_bench_cycles(stream, size, rounds);
+  }
+
+  iog_bench_group(stream, "ops: push/pop of writer on stack shared with 0 to %lu seqlock readers", SHARE_MAX_READERS);
+
+  iog_bench_share(stream, 0, 0);
+  for (size_t readers_num = 0; readers_num <= SHARE_MAX_READERS; readers_num++)
+    iog_bench_share(stream, 1, readers_num);
+}
@@ -0,0 +1,98 @@
+#include <stdio.h>
+
+#include "iog_bench.h"
+#include "iog_stack.h"
+
+static const size_t OSCILLATION_OPS = 1000000;
+
+/// Shrink to exactly size when size <= capacity / 4 (no headroom, as before policies)
+static const IogStackPolicy_t EXACT_POLICY = {2.0, 4, 1, INIT_STACK_DATA_CAPACITY, 0, 0, NULL};
+
+/// Default policy but memory is never released
+static const IogStackPolicy_t NEVER_SHRINK_POLICY = {2.0, 4, 2, INIT_STACK_DATA_CAPACITY, 1, 0, NULL};
+
+/**
+ * Fills stack to size, pops until the first shrink, then alternates push/pop
+ * sequences of given width around that point, counting capacity changes.
+ */
+static void iog_bench_oscillate (FILE *stream, const char *name,
+    const IogStackPolicy_t *policy, size_t size, size_t width) {
+  IogStack_t stk = {};
+  iog_stack_init(&stk, policy);
+
+  for (size_t i = 0; i < size; i++)
+    iog_stack_push(&stk, (iog_stack_value_t) i);
+
+  iog_stack_value_t value = 0;
+  size_t full_capacity = stk.capacity;
+  while (stk.size > 0 && stk.capacity == full_capacity)
+    iog_stack_pop(&stk, &value);
+
+  size_t reallocs = 0;
+  size_t ops = 0;
+
+  double start = iog_bench_start();
+  while (ops < OSCILLATION_OPS) {
+    for (size_t i = 0; i < width; i++, ops++) {
+      size_t old_capacity = stk.capacity;
+      iog_stack_push(&stk, value);
+      reallocs += (stk.capacity != old_capacity);
+    }
+
+    for (size_t i = 0; i < width; i++, ops++) {
+      size_t old_capacity = stk.capacity;
+      iog_stack_pop(&stk, &value);
+      reallocs += (stk.capacity != old_capacity);
+    }
+  }
+  double elapsed = iog_bench_now_ns() - start;
+
+  iog_bench_keep(value);
+  iog_bench_report(stream, name, size, ops, elapsed, "reallocs/op", (double) reallocs / (double) ops);
+
+  iog_stack_destroy(&stk);
+}
+
+/**
+ * Compares exact, default and never-shrink policies on oscillating traces.
+ * Amortized O(1) means ns/op and reallocs/op stay flat while size grows.
+ * @param[out] stream pointer to stream for prints
+ */
+void iog_bench_policy (FILE *stream) {
+  iog_bench_group(stream, "policy: oscillating push/pop around shrink boundary");
+
+  for (size_t size = 16; size <= 1 << 20; size *= 16) {
+    iog_bench_oscillate(stream, "policy/exact/osc1",        &EXACT_POLICY,             size, 1);
+    iog_bench_oscillate(stream, "policy/exact/osc_quarter", &EXACT_POLICY,             size, size / 4);
+    iog_bench_oscillate(stream, "policy/default/osc1",      &IOG_STACK_DEFAULT_POLICY, size, 1);
+    iog_bench_oscillate(stream, "policy/default/osc_quarter", &IOG_STACK_DEFAULT_POLICY, size, size / 4);
+    iog_bench_oscillate(stream, "policy/never_shrink/osc1", &NEVER_SHRINK_POLICY,      size, 1);
+  }
+}
+
+/**
+ * Fills empty stack up to size, so cost is dominated by reallocations of large buffers.
+ * @param[out] stream pointer to stream for prints
+ */
+void iog_bench_growth (FILE *stream) {
+  iog_bench_group(stream, "growth: push from empty stack up to size");
+
+  for (size_t size = 1000; size <= iog_bench_max_size(); size *= 10) {
+    IogStack_t stk = {};
+    iog_stack_init(&stk);
+
+    size_t reallocs = 0;
+
+    double start = iog_bench_start();
+    for (size_t i = 0; i < size; i++) {
+      size_t old_capacity = stk.capacity;
+      iog_stack_push(&stk, (iog_stack_value_t) i);
+      reallocs += (stk.capacity != old_capacity);
+    }
+    double elapsed = iog_bench_now_ns() - start;
+
+    iog_bench_report(stream, "growth/push_fill", size, size, elapsed, "reallocs", (double) reallocs);
+
+    iog_stack_destroy(&stk);
+  }
+}
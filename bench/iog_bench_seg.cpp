@@ -0,0 +1,203 @@
+#include <stdio.h>
+
+#include "iog_bench.h"
+#include "iog_stack.h"
+#include "iog_seg_stack.h"
+
+static const size_t SEG_BRANCHES      = 1000; ///< Branch points in backtracking trace
+static const size_t SEG_BRANCH_PUSHES = 3;    ///< Elements pushed by each branch
+static const size_t SEG_SPILL_BLOCKS  = 8;    ///< Memory budget of spill measure in default blocks
+
+/**
+ * Backtracking trace: every branch starts from the same state of size elements
+ * and pushes few values. Contiguous stack copies whole state per branch,
+ * segmented stack restores snapshot and copies at most its top block.
+ * @param[out] stream pointer to stream for prints
+ * @param[in]  size   elements in branch point state
+ */
+static void iog_bench_branches (FILE *stream, size_t size) {
+  IogStack_t base = {};
+  iog_stack_init(&base);
+  for (size_t i = 0; i < size; i++)
+    iog_stack_push(&base, (iog_stack_value_t) i);
+
+  double start = iog_bench_start();
+  for (size_t b = 0; b < SEG_BRANCHES; b++) {
+    IogStack_t branch = {};
+    iog_stack_init(&branch);
+    iog_stack_push_n(&branch, base.data, base.size);
+
+    for (size_t i = 0; i < SEG_BRANCH_PUSHES; i++)
+      iog_stack_push(&branch, (iog_stack_value_t) b);
+
+    iog_stack_destroy(&branch);
+  }
+  double elapsed = iog_bench_now_ns() - start;
+
+  iog_bench_report(stream, "seg/copy_branch", size, SEG_BRANCHES, elapsed, NULL, 0);
+  iog_stack_destroy(&base);
+
+  IogSegStack_t seg = {};
+  iog_seg_stack_init(&seg);
+  iog_seg_stack_set_verify_level(&seg, IOG_VERIFY_OFF);
+  for (size_t i = 0; i < size; i++)
+    iog_seg_stack_push(&seg, (iog_stack_value_t) i);
+
+  IogSegSnapshot_t snapshot = {};
+  iog_seg_stack_snapshot(&seg, &snapshot);
+
+  start = iog_bench_start();
+  for (size_t b = 0; b < SEG_BRANCHES; b++) {
+    iog_seg_stack_restore(&seg, &snapshot);
+
+    for (size_t i = 0; i < SEG_BRANCH_PUSHES; i++)
+      iog_seg_stack_push(&seg, (iog_stack_value_t) b);
+  }
+  elapsed = iog_bench_now_ns() - start;
+
+  iog_bench_report(stream, "seg/snapshot_branch", size, SEG_BRANCHES, elapsed, NULL, 0);
+
+  iog_seg_snapshot_release(&snapshot);
+  iog_seg_stack_destroy(&seg);
+}
+
+/**
+ * Fills segmented stack and pops it back to empty, with all blocks in memory or
+ * with small budget. Peak RSS shows memory bound, waits show pops that outran file reads.
+ * @param[out] stream pointer to stream for prints
+ * @param[in]  size   elements pushed and popped
+ * @param[in]  budget memory budget in bytes (0 - no budget)
+ */
+static void iog_bench_spill (FILE *stream, size_t size, size_t budget) {
+  IogSegStack_t seg = {};
+  iog_seg_stack_init(&seg);
+  iog_seg_stack_set_verify_level(&seg, IOG_VERIFY_OFF);
+  iog_seg_stack_set_budget(&seg, budget);
+
+  iog_stack_value_t value = 0;
+  double start = iog_bench_start();
+  for (size_t i = 0; i < size; i++)
+    iog_seg_stack_push(&seg, (iog_stack_value_t) i);
+  for (size_t i = 0; i < size; i++)
+    iog_seg_stack_pop(&seg, &value);
+  double elapsed = iog_bench_now_ns() - start;
+  iog_bench_keep(value);
+
+  double waits = (seg.spill != NULL) ? (double) seg.spill->waits : 0;
+  iog_bench_report(stream, budget ? "seg/spill_push_pop" : "seg/resident_push_pop", size, 2 * size,
+                   elapsed, "waits", waits);
+
+  iog_seg_stack_destroy(&seg);
+}
+
+/**
+ * Fills segmented stack with packing and pops it back to empty. Values are evenly spaced
+ * timestamps (kind 0), random walk of sensor reading (kind 1) or random fractions (kind 2).
+ * Bytes per value count compressed blocks and raw blocks of chain.
+ * @param[out] stream pointer to stream for prints
+ * @param[in]  size   elements pushed and popped
+ * @param[in]  kind   kind of values
+ */
+static void iog_bench_pack (FILE *stream, size_t size, int kind) {
+  static const char *const FILL_NAMES[]  = {"seg/pack_fill_time",  "seg/pack_fill_walk",  "seg/pack_fill_random"};
+  static const char *const DRAIN_NAMES[] = {"seg/pack_drain_time", "seg/pack_drain_walk", "seg/pack_drain_random"};
+
+  IogSegStack_t seg = {};
+  iog_seg_stack_init(&seg);
+  iog_seg_stack_set_verify_level(&seg, IOG_VERIFY_OFF);
+  iog_seg_stack_set_packing(&seg, 1);
+
+  unsigned state = 1;
+  iog_stack_value_t value = 20.0;
+
+  double start = iog_bench_start();
+  for (size_t i = 0; i < size; i++) {
+    state = state * 1103515245 + 12345;
+
+    if (kind == 0)
+      value = 1.7e9 + (iog_stack_value_t) i * 0.25;
+    else if (kind == 1)
+      value += (iog_stack_value_t) ((int) (state >> 16) % 3 - 1) * 0.5;
+    else
+      value = (iog_stack_value_t) (state >> 8) / (1 << 24);
+
+    iog_seg_stack_push(&seg, value);
+  }
+  double elapsed = iog_bench_now_ns() - start;
+
+  size_t raw_blocks = seg.blocksNum - seg.packedNum;
+  double bytes = (double) (seg.packedWords * sizeof(iog_uint64_t) +
+                           raw_blocks * seg.blockCapacity * sizeof(iog_stack_value_t));
+  iog_bench_report(stream, FILL_NAMES[kind], size, size, elapsed, "bytes_per_value", bytes / (double) size);
+
+  start = iog_bench_start();
+  for (size_t i = 0; i < size; i++)
+    iog_seg_stack_pop(&seg, &value);
+  elapsed = iog_bench_now_ns() - start;
+  iog_bench_keep(value);
+
+  iog_bench_report(stream, DRAIN_NAMES[kind], size, size, elapsed, NULL, 0);
+
+  iog_seg_stack_destroy(&seg);
+}
+
+/**
+ * Fills contiguous and segmented stacks from empty, reporting mean and worst single push.
+ * @param[out] stream pointer to stream for prints
+ */
+void iog_bench_seg (FILE *stream) {
+  iog_bench_group(stream, "seg: growth latency, branching, memory budget and packing of contiguous vs segmented stack");
+
+  for (size_t size = 100000; size <= iog_bench_max_size(); size *= 10) {
+    IogStack_t stk = {};
+    iog_stack_init(&stk);
+
+    double worst = 0;
+    double start = iog_bench_start();
+    for (size_t i = 0; i < size; i++) {
+      if (stk.size == stk.capacity) {
+        double grow_start = iog_bench_now_ns();
+        iog_stack_push(&stk, (iog_stack_value_t) i);
+        double grow_time = iog_bench_now_ns() - grow_start;
+
+        worst = (grow_time > worst) ? grow_time : worst;
+      } else {
+        iog_stack_push(&stk, (iog_stack_value_t) i);
+      }
+    }
+    double elapsed = iog_bench_now_ns() - start;
+
+    iog_bench_report(stream, "seg/contiguous_fill", size, size, elapsed, "worst_push_ns", worst);
+    iog_stack_destroy(&stk);
+
+    IogSegStack_t seg = {};
+    iog_seg_stack_init(&seg);
+    iog_seg_stack_set_verify_level(&seg, IOG_VERIFY_OFF);
+
+    worst = 0;
+    start = iog_bench_start();
+    for (size_t i = 0; i < size; i++) {
+      if (seg.topSize == seg.blockCapacity) {
+        double grow_start = iog_bench_now_ns();
+        iog_seg_stack_push(&seg, (iog_stack_value_t) i);
+        double grow_time = iog_bench_now_ns() - grow_start;
+
+        worst = (grow_time > worst) ? grow_time : worst;
+      } else {
+        iog_seg_stack_push(&seg, (iog_stack_value_t) i);
+      }
+    }
+    elapsed = iog_bench_now_ns() - start;
+
+    iog_bench_report(stream, "seg/segmented_fill", size, size, elapsed, "worst_push_ns", worst);
+    iog_seg_stack_destroy(&seg);
+
+    iog_bench_branches(stream, size);
+
+    iog_bench_spill(stream, size, 0);
+    iog_bench_spill(stream, size, SEG_SPILL_BLOCKS * IOG_SEG_DEFAULT_BLOCK_CAPACITY * sizeof(iog_stack_value_t));
+
+    for (int kind = 0; kind < 3; kind++)
+      iog_bench_pack(stream, size, kind);
+  }
+}
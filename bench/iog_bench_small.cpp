@@ -0,0 +1,36 @@
+#include <stdio.h>
+
+#include "iog_bench.h"
+#include "iog_stack.h"
+
+static const size_t SMALL_STACKS_NUM = 2000000;
+
+/**
+ * Creates short-lived stacks with few elements: init, pushes, pops, destroy.
+ * @param[out] stream pointer to stream for prints
+ */
+void iog_bench_small (FILE *stream) {
+  iog_bench_group(stream, "small: lifecycle of short-lived stacks (inline capacity %d)", IOG_STACK_INLINE_CAPACITY);
+
+  for (size_t elems = 1; elems <= 16; elems *= 2) {
+    iog_stack_value_t value = 0;
+
+    double start = iog_bench_start();
+    for (size_t s = 0; s < SMALL_STACKS_NUM; s++) {
+      IogStack_t stk = {};
+      iog_stack_init(&stk);
+
+      for (size_t i = 0; i < elems; i++)
+        iog_stack_push(&stk, (iog_stack_value_t) i);
+
+      for (size_t i = 0; i < elems; i++)
+        iog_stack_pop(&stk, &value);
+
+      iog_stack_destroy(&stk);
+    }
+    double elapsed = iog_bench_now_ns() - start;
+
+    iog_bench_keep(value);
+    iog_bench_report(stream, "small/init_push_pop_destroy", elems, SMALL_STACKS_NUM, elapsed, NULL, 0);
+  }
+}
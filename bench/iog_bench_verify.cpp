@@ -0,0 +1,133 @@
+#include <stdio.h>
+
+#include "iog_bench.h"
+#include "iog_stack.h"
+#include "iog_simd.h"
+
+static const size_t VERIFY_OPS = 10000000;
+
+static const IogStackVerifyLevel VERIFY_LEVELS[] = {IOG_VERIFY_OFF, IOG_VERIFY_CANARIES, IOG_VERIFY_FULL};
+static const char *VERIFY_NAMES[] = {
+  "verify/off/push_pop", "verify/canaries/push_pop", "verify/full/push_pop"
+};
+
+/**
+ * Measures push+peek+pop with tracked checksum, then full rescan of
+ * iog_stack_verify_checksum with every kernel set.
+ * @param[out] stream pointer to stream for prints
+ */
+static void iog_bench_verify_checksum (FILE *stream) {
+  for (size_t size = 16; size <= 1 << 20; size *= 256) {
+    IogStack_t stk = {};
+    iog_stack_init(&stk);
+    iog_stack_set_verify_level(&stk, IOG_VERIFY_OFF);
+
+    for (size_t i = 0; i < size; i++)
+      iog_stack_push(&stk, (iog_stack_value_t) i);
+    iog_stack_track_checksum(&stk, 1);
+
+    iog_stack_value_t value = 0;
+
+    double start = iog_bench_start();
+    for (size_t i = 0; i < VERIFY_OPS; i++) {
+      iog_stack_push(&stk, value);
+      iog_stack_peek(&stk, &value);
+      iog_stack_pop (&stk, &value);
+    }
+    double elapsed = iog_bench_now_ns() - start;
+
+    iog_bench_keep(value);
+    iog_bench_report(stream, "verify/checksum/push_pop", size, 3 * VERIFY_OPS, elapsed, NULL, 0);
+
+    iog_stack_destroy(&stk);
+  }
+
+  for (size_t size = 1000000; size <= iog_bench_max_size(); size *= 10) {
+    IogStack_t stk = {};
+    iog_stack_init(&stk);
+    iog_stack_set_verify_level(&stk, IOG_VERIFY_OFF);
+
+    for (size_t i = 0; i < size; i++)
+      iog_stack_push(&stk, (iog_stack_value_t) i);
+    iog_stack_track_checksum(&stk, 1);
+
+    for (int isa = IOG_SIMD_SCALAR; isa <= IOG_SIMD_AVX2; isa++) {
+      if (iog_simd_select((IogSimdIsa) isa) != isa)
+        continue;
+
+      double start = iog_bench_start();
+      IogStackReturnCode err = iog_stack_verify_checksum(&stk);
+      double elapsed = iog_bench_now_ns() - start;
+
+      char name[64] = "";
+      snprintf(name, sizeof(name), "verify/checksum_rescan_%s", iog_simd_isa_name((IogSimdIsa) isa));
+      iog_bench_report(stream, name, size, 1, elapsed, "err", (double) err);
+    }
+    iog_simd_select(IOG_SIMD_AVX2);
+
+    iog_stack_destroy(&stk);
+  }
+}
+
+/**
+ * Measures push+peek+pop at fixed size for every verify level.
+ * @param[out] stream pointer to stream for prints
+ */
+void iog_bench_verify (FILE *stream) {
+  iog_bench_group(stream, "verify: cost of verify levels (compiled max %d)", IOG_STACK_VERIFY_LEVEL);
+
+  for (size_t size = 16; size <= 1 << 20; size *= 256) {
+    for (size_t l = 0; l < sizeof(VERIFY_LEVELS) / sizeof(VERIFY_LEVELS[0]); l++) {
+      IogStack_t stk = {};
+      iog_stack_init(&stk);
+      iog_stack_set_verify_level(&stk, VERIFY_LEVELS[l]);
+
+      for (size_t i = 0; i < size; i++)
+        iog_stack_push(&stk, (iog_stack_value_t) i);
+
+      iog_stack_value_t value = 0;
+
+      double start = iog_bench_start();
+      for (size_t i = 0; i < VERIFY_OPS; i++) {
+        iog_stack_push(&stk, value);
+        iog_stack_peek(&stk, &value);
+        iog_stack_pop (&stk, &value);
+      }
+      double elapsed = iog_bench_now_ns() - start;
+
+      iog_bench_keep(value);
+      iog_bench_report(stream, VERIFY_NAMES[l], size, 3 * VERIFY_OPS, elapsed, NULL, 0);
+
+      iog_stack_destroy(&stk);
+    }
+  }
+
+  IogStackPolicy_t guarded = IOG_STACK_DEFAULT_POLICY;
+  guarded.guardPages = 1;
+
+  for (size_t size = 16; size <= 1 << 20; size *= 256) {
+    IogStack_t stk = {};
+    iog_stack_init(&stk, &guarded);
+    iog_stack_set_verify_level(&stk, IOG_VERIFY_CANARIES);
+
+    for (size_t i = 0; i < size; i++)
+      iog_stack_push(&stk, (iog_stack_value_t) i);
+
+    iog_stack_value_t value = 0;
+
+    double start = iog_bench_start();
+    for (size_t i = 0; i < VERIFY_OPS; i++) {
+      iog_stack_push(&stk, value);
+      iog_stack_peek(&stk, &value);
+      iog_stack_pop (&stk, &value);
+    }
+    double elapsed = iog_bench_now_ns() - start;
+
+    iog_bench_keep(value);
+    iog_bench_report(stream, "verify/guard_pages/push_pop", size, 3 * VERIFY_OPS, elapsed, NULL, 0);
+
+    iog_stack_destroy(&stk);
+  }
+
+  iog_bench_verify_checksum(stream);
+}
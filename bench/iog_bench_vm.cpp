@@ -0,0 +1,116 @@
+#include <stdio.h>
+
+#include "iog_bench.h"
+#include "iog_stack.h"
+#include "iog_vm.h"
+
+static const size_t VM_EXPRESSIONS = 1000000; ///< Evaluations timed for one case
+static const size_t VM_LOOP_COUNT  = 10000000; ///< Iterations of counting loop
+
+/// ((x * 3 + 2) * x - 7) / (x + 1) * (x - 5)
+static const char *VM_EXPRESSION_SOURCE =
+  "load 0\n push 3\n mul\n push 2\n add\n load 0\n mul\n push 7\n sub\n"
+  "load 0\n push 1\n add\n div\n load 0\n push 5\n sub\n mul\n halt\n";
+
+static const char *VM_LOOP_SOURCE =
+  "  push 0\n  load 0\n"
+  "loop:\n  dup\n  jz end\n  swap\n  over\n  add\n  swap\n  push 1\n  sub\n  jmp loop\n"
+  "end:\n  pop\n  halt\n";
+
+static const IogStackVerifyLevel VM_LEVELS[] = {IOG_VERIFY_OFF, IOG_VERIFY_FULL};
+
+/**
+ * Interpreter loop the library replaces: every operand goes through
+ * iog_stack_pop and iog_stack_push with their own checks.
+ * @param[in]  program pointer to linked straight-line program
+ * @param[out] stack   pointer to stack
+ * @param[in]  x       argument of LOAD
+ * @return value at HALT
+ */
+static iog_stack_value_t iog_bench_vm_naive (const IogVmProgram_t *program, IogStack_t *stack, iog_stack_value_t x) {
+  iog_stack_value_t a = 0;
+  iog_stack_value_t b = 0;
+
+  for (size_t i = 0; i < program->size; i++) {
+    const IogVmInstr_t *instr = &program->code[i];
+
+    switch (instr->op) {
+      case IOG_VM_PUSH: iog_stack_push(stack, instr->value); break;
+      case IOG_VM_LOAD: iog_stack_push(stack, x);            break;
+
+      case IOG_VM_ADD: iog_stack_pop(stack, &b); iog_stack_pop(stack, &a); iog_stack_push(stack, a + b); break;
+      case IOG_VM_SUB: iog_stack_pop(stack, &b); iog_stack_pop(stack, &a); iog_stack_push(stack, a - b); break;
+      case IOG_VM_MUL: iog_stack_pop(stack, &b); iog_stack_pop(stack, &a); iog_stack_push(stack, a * b); break;
+      case IOG_VM_DIV: iog_stack_pop(stack, &b); iog_stack_pop(stack, &a); iog_stack_push(stack, a / b); break;
+
+      case IOG_VM_HALT:
+        iog_stack_pop(stack, &a);
+        return a;
+
+      default:
+        break;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * Evaluates same expression by naive per-op loop and by iog_vm_run at each verify level,
+ * then runs counting loop to show cost of one dispatched instruction.
+ * @param[out] stream pointer to stream for prints
+ */
+void iog_bench_vm (FILE *stream) {
+  iog_bench_group(stream, "vm: expression evaluation by per-op API against stack machine");
+
+  IogVmProgram_t expression = {};
+  IogVmProgram_t loop = {};
+  if (iog_vm_assemble(&expression, VM_EXPRESSION_SOURCE) != OK || iog_vm_assemble(&loop, VM_LOOP_SOURCE) != OK)
+    return;
+
+  for (size_t l = 0; l < sizeof(VM_LEVELS) / sizeof(VM_LEVELS[0]); l++) {
+    const char *level_name = (VM_LEVELS[l] == IOG_VERIFY_OFF) ? "off" : "full";
+    char name[64] = {};
+
+    IogStack_t stk = {};
+    iog_stack_init(&stk);
+    iog_stack_set_verify_level(&stk, VM_LEVELS[l]);
+
+    iog_stack_value_t sum = 0;
+    double start = iog_bench_start();
+    for (size_t i = 0; i < VM_EXPRESSIONS; i++)
+      sum += iog_bench_vm_naive(&expression, &stk, (iog_stack_value_t) i);
+    iog_bench_keep(sum);
+
+    snprintf(name, sizeof(name), "vm/%s/naive_expr", level_name);
+    iog_bench_report(stream, name, expression.size, VM_EXPRESSIONS, iog_bench_now_ns() - start, NULL, 0);
+
+    iog_stack_value_t result = 0;
+    sum = 0;
+    start = iog_bench_start();
+    for (size_t i = 0; i < VM_EXPRESSIONS; i++) {
+      iog_stack_value_t x = (iog_stack_value_t) i;
+      iog_vm_run(&expression, &stk, &x, 1, &result);
+      iog_stack_pop(&stk, &result);
+      sum += result;
+    }
+    iog_bench_keep(sum);
+
+    snprintf(name, sizeof(name), "vm/%s/vm_expr", level_name);
+    iog_bench_report(stream, name, expression.size, VM_EXPRESSIONS, iog_bench_now_ns() - start, NULL, 0);
+
+    iog_stack_value_t count = (iog_stack_value_t) VM_LOOP_COUNT;
+    start = iog_bench_start();
+    iog_vm_run(&loop, &stk, &count, 1, &result);
+    iog_bench_keep(result);
+
+    // 10 instructions and 2 blocks per iteration
+    snprintf(name, sizeof(name), "vm/%s/vm_loop_instr", level_name);
+    iog_bench_report(stream, name, loop.size, 12 * VM_LOOP_COUNT, iog_bench_now_ns() - start, NULL, 0);
+
+    iog_stack_destroy(&stk);
+  }
+
+  iog_vm_program_destroy(&expression);
+  iog_vm_program_destroy(&loop);
+}
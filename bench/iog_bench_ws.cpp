@@ -0,0 +1,125 @@
+#include <stdio.h>
+
+#include <atomic>
+#include <thread>
+
+#include "iog_bench.h"
+#include "iog_ws_deque.h"
+
+static const int    WS_TREE_DEPTH   = 30;  ///< Task n spawns n-1 and n-2, tasks below 2 are leaves
+static const size_t WS_MAX_WORKERS  = 16;
+static const size_t WS_FLUSH_TASKS  = 1024; ///< Worker publishes done tasks this often
+
+/// State shared by scheduler workers
+struct IogBenchScheduler_t {
+  IogWsDeque_t deques[WS_MAX_WORKERS]; ///< Deque owned by each worker
+  size_t workers;                      ///< Amount of workers
+  size_t total;                        ///< Tasks in whole tree
+  std::atomic<size_t> done;            ///< Finished tasks published by workers
+  std::atomic<size_t> steals;          ///< Successful steals
+};
+
+/**
+ * Runs own tasks LIFO, steals from random victims when own deque is empty.
+ */
+static void iog_bench_ws_worker (IogBenchScheduler_t *sched, size_t me) {
+  IogWsDeque_t *own = &sched->deques[me];
+
+  size_t local_done   = 0;
+  size_t local_steals = 0;
+  size_t victim = me;
+
+  iog_stack_value_t task = 0;
+
+  while (sched->done.load(std::memory_order_relaxed) < sched->total) {
+    IogStackReturnCode err = iog_ws_deque_pop(own, &task);
+
+    if (err != OK) {
+      sched->done.fetch_add(local_done, std::memory_order_relaxed);
+      local_done = 0;
+
+      victim = (victim * 7 + 3) % sched->workers;
+      if (victim == me || iog_ws_deque_steal(&sched->deques[victim], &task) != OK)
+        continue;
+
+      local_steals++;
+    }
+
+    if (task >= 2) {
+      iog_ws_deque_push(own, task - 1);
+      iog_ws_deque_push(own, task - 2);
+    }
+
+    if (++local_done == WS_FLUSH_TASKS) {
+      sched->done.fetch_add(local_done, std::memory_order_relaxed);
+      local_done = 0;
+    }
+  }
+
+  sched->done.fetch_add(local_done, std::memory_order_relaxed);
+  sched->steals.fetch_add(local_steals, std::memory_order_relaxed);
+}
+
+/**
+ * @return amount of tasks in tree of given depth
+ */
+static size_t iog_bench_ws_tree_size (int depth) {
+  size_t prev = 1, cur = 1;
+
+  for (int n = 2; n <= depth; n++) {
+    size_t next = 1 + cur + prev;
+    prev = cur;
+    cur  = next;
+  }
+
+  return cur;
+}
+
+/**
+ * Fibonacci-shaped task tree, root starts in deque of worker 0, others get work only by stealing.
+ * @param[out] stream pointer to stream for prints
+ */
+void iog_bench_ws (FILE *stream) {
+  size_t max_workers = std::thread::hardware_concurrency();
+  if (max_workers < 2)
+    max_workers = 2;
+  if (max_workers > WS_MAX_WORKERS)
+    max_workers = WS_MAX_WORKERS;
+
+  iog_bench_group(stream, "ws: work-stealing scheduler on task tree, 1 to %lu workers", max_workers);
+
+  static IogBenchScheduler_t sched;
+
+  for (size_t workers = 1; workers <= max_workers; workers *= 2) {
+    sched.workers = workers;
+    sched.total   = iog_bench_ws_tree_size(WS_TREE_DEPTH);
+    sched.done.store(0);
+    sched.steals.store(0);
+
+    for (size_t w = 0; w < workers; w++) {
+      iog_ws_deque_init(&sched.deques[w]);
+      iog_ws_deque_set_verify_level(&sched.deques[w], IOG_VERIFY_OFF);
+    }
+
+    iog_ws_deque_push(&sched.deques[0], (iog_stack_value_t) WS_TREE_DEPTH);
+
+    std::thread threads[WS_MAX_WORKERS];
+
+    double start = iog_bench_start();
+    for (size_t w = 0; w < workers; w++)
+      threads[w] = std::thread(iog_bench_ws_worker, &sched, w);
+
+    for (size_t w = 0; w < workers; w++)
+      threads[w].join();
+    double elapsed = iog_bench_now_ns() - start;
+
+    iog_bench_report(stream, "ws/task_tree", workers, sched.total, elapsed,
+        "steals", (double) sched.steals.load());
+
+    for (size_t w = 0; w < workers; w++)
+      iog_ws_deque_destroy(&sched.deques[w]);
+
+    if (workers < max_workers && workers * 2 > max_workers)
+      workers = max_workers / 2;
+  }
+}
@@ -10,7 +10,7 @@
 #ifdef IOG_NDEBUG
 
 /// If not debug mode, then ignore asserts
-#define IOG_ASSERT(x) ()
+#define IOG_ASSERT(x) {}
 
 #else // IOG_NDEBUG
 
@@ -0,0 +1,100 @@
+#ifndef IOG_LF_STACK_H
+#define IOG_LF_STACK_H
+
+#include <stdio.h>
+
+#include <atomic>
+
+#include "iog_stack_return_codes.h"
+#include "iog_stack.h"
+
+/** @file iog_lf_stack.h
+ * Lock-free stack shared by many threads: Treiber stack (CAS on top pointer),
+ * popped nodes are reclaimed with hazard pointers. Optional elimination array lets
+ * colliding push and pop exchange value without touching top.
+ */
+
+/// Macros calls dump function with extra information about calling.
+#define IOG_LF_STACK_DUMP(stack) {                                                     \
+  iog_lf_stack_dump_f(stack, stdout, #stack, __FILE__, __LINE__, __PRETTY_FUNCTION__); \
+}
+
+const size_t IOG_LF_MAX_THREADS    = 64;   ///< Threads that may use lock-free stacks at the same time
+const size_t IOG_LF_CACHE_LINE     = 64;   ///< Shared fields are padded to this size
+const size_t IOG_LF_ELIM_SLOTS     = 8;    ///< Size of elimination array
+const size_t IOG_LF_ELIM_SPINS     = 128;  ///< Push waits for pop in elimination slot this many spins
+const size_t IOG_LF_MAX_FREE_NODES = 1024; ///< Reusable nodes cached by one thread
+
+/// Retired nodes of one thread before scan of hazard pointers
+const size_t IOG_LF_SCAN_THRESHOLD = 2 * IOG_LF_MAX_THREADS;
+
+const iog_canary_t NODE_CANARY_CONST = 0x1234DEAD; ///< Constant for node canary mask
+
+/** @struct IogLfNode_t
+ * Node of lock-free stack
+ */
+struct IogLfNode_t {
+  std::atomic<IogLfNode_t *> next; ///< Node below (NULL for bottom node), read by pops racing with reuse
+  iog_canary_t               canary; ///< Node canary equal constant + node pointer
+  iog_stack_value_t          value;  ///< Stored value
+};
+
+/** @struct IogLfThreadSlot_t
+ * Reclamation state of one thread, only hazard is read by other threads.
+ */
+struct alignas(IOG_LF_CACHE_LINE) IogLfThreadSlot_t {
+  std::atomic<IogLfNode_t *> hazard; ///< Node this thread reads now, others can't reuse it
+
+  IogLfNode_t *retired;    ///< Popped nodes, reused only after scan (linked by next)
+  size_t       retiredNum; ///< Amount of retired nodes
+  IogLfNode_t *free;       ///< Nodes safe to reuse by push (linked by next)
+  size_t       freeNum;    ///< Amount of free nodes
+};
+
+/** @struct IogLfElimSlot_t
+ * Slot of elimination array: node offered by push, marker after pop took it
+ */
+struct alignas(IOG_LF_CACHE_LINE) IogLfElimSlot_t {
+  std::atomic<IogLfNode_t *> offer; ///< NULL, offered node or taken marker
+};
+
+/** @struct IogLfStack_t
+ * Defines lock-free stack structure.
+ * Init, destroy, verify, dump and set_verify_level need exclusive access,
+ * push and pop may be called from any threads at the same time.
+ */
+struct IogLfStack_t {
+  iog_canary_t firstStackCanary;    ///< First stack canary equal constant + pointer
+
+  alignas(IOG_LF_CACHE_LINE) std::atomic<IogLfNode_t *> top; ///< Top node
+
+  alignas(IOG_LF_CACHE_LINE) iog_flag_t isInitialized; ///< Flag of initialization
+  iog_flag_t          elimination; ///< If 1 then colliding push and pop use elimination array
+  IogStackVerifyLevel verifyLevel; ///< Checks run by stack operations
+
+  IogLfThreadSlot_t threads[IOG_LF_MAX_THREADS]; ///< Reclamation state by thread index
+  IogLfElimSlot_t   elim[IOG_LF_ELIM_SLOTS];     ///< Elimination array
+
+  iog_canary_t secondStackCanary;   ///< Second stack canary equal constant + pointer
+};
+
+//--------------------- PUBLIC FUNCTIONS --------------------------------------------
+
+/// Initialize empty stack, elimination 1 turns on elimination backoff
+IogStackReturnCode iog_lf_stack_init    (IogLfStack_t *stack, iog_flag_t elimination = 0);
+IogStackReturnCode iog_lf_stack_destroy (IogLfStack_t *stack); ///< Free all nodes
+
+IogStackReturnCode iog_lf_stack_push (IogLfStack_t *stack, iog_stack_value_t value);  ///< Add value to stack
+IogStackReturnCode iog_lf_stack_pop  (IogLfStack_t *stack, iog_stack_value_t *value); ///< Read and remove value
+
+/// Print all stack info to stream (file), no other thread may use stack
+IogStackReturnCode iog_lf_stack_dump_f (const IogLfStack_t *stack, FILE *stream,
+    const char *stk_name, const char *file_name, int line_num, const char *function_name);
+
+/// Verify stack and canaries of every node, no other thread may use stack
+IogStackReturnCode iog_lf_stack_verify (const IogLfStack_t *stack);
+
+/// Choose checks run by operations of this stack (clamped by IOG_STACK_VERIFY_LEVEL)
+IogStackReturnCode iog_lf_stack_set_verify_level (IogLfStack_t *stack, IogStackVerifyLevel level);
+
+#endif // IOG_LF_STACK_H
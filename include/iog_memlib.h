@@ -1,9 +1,109 @@
 #ifndef IOG_MEMLIB_H
 #define IOG_MEMLIB_H
 
+#include <stddef.h>
+
 /** @file iog_memlib.h */
 
-/// Reallocate memory
+/// Heap blocks of iog_mem_resize of this size and larger are page-mapped, so they can be resized by mremap
+const size_t IOG_MEM_MAP_THRESHOLD = 256 * 1024;
+
+#ifndef IOG_MEM_USE_POOL
+/// If 1 then small blocks of iog_mem_resize come from thread pool instead of realloc
+#define IOG_MEM_USE_POOL 1
+#endif // IOG_MEM_USE_POOL
+
+const size_t IOG_MEM_MIN_CLASS_BYTES   = 32;          ///< Smallest size class
+const size_t IOG_MEM_CLASSES_NUM       = 48;          ///< Size classes are 32 << i bytes
+const size_t IOG_MEM_POOL_MAX_BYTES    = 64 * 1024;   ///< Larger blocks bypass thread pool
+const size_t IOG_MEM_POOL_CACHE_NUM    = 64;          ///< Blocks of one class cached by thread
+const size_t IOG_MEM_ARENA_CHUNK_BYTES = 1024 * 1024; ///< Default size of arena chunk
+
+struct IogMemArenaChunk_t;
+
+/** @struct IogMemArena_t
+ * Region allocator: blocks are bump-allocated from chunks and rounded to size class,
+ * released blocks are reused by class. Reset takes back every block at once,
+ * so stacks allocated from arena must not be used after reset.
+ * Arena isn't thread safe, bind it to one thread or guard it.
+ */
+struct IogMemArena_t {
+  IogMemArenaChunk_t *chunks;  ///< Chain of chunks, kept by reset
+  IogMemArenaChunk_t *current; ///< Chunk of bump pointer
+  char *cursor;                ///< Next free byte in current chunk
+  char *end;                   ///< End of current chunk
+  size_t chunkBytes;           ///< Size of regular chunk
+  IogMemArenaChunk_t *large;   ///< Own chunks of blocks larger than chunkBytes / 4, freed by reset
+  void *freeLists[IOG_MEM_CLASSES_NUM]; ///< Released blocks by class (linked through first word)
+};
+
+/** @struct IogMemStats_t
+ * Counters of memlib calls made by current thread.
+ */
+struct IogMemStats_t {
+  unsigned long long allocs;      ///< New blocks (iog_recalloc from NULL, iog_guarded_alloc)
+  unsigned long long resizes;     ///< Resizes of existing blocks
+  unsigned long long frees;       ///< Released blocks
+  unsigned long long bytesCopied; ///< Bytes copied because block couldn't be resized in place
+};
+
+/// Reallocate memory, zeroing only the new tail (block comes from malloc, free() can release it)
 void *iog_recalloc(void *ptr, size_t old_num, size_t new_num, size_t elem_size);
 
+/// Free memory allocated by iog_recalloc (free() counted in memlib stats)
+void  iog_free_sized(void *ptr, size_t num, size_t elem_size);
+
+/// Allocate zeroed block that ends exactly at PROT_NONE guard page (NULL if unsupported)
+void *iog_guarded_alloc  (size_t bytes);
+/// Move guarded block to new guarded block of other size
+void *iog_guarded_resize (void *ptr, size_t old_bytes, size_t new_bytes);
+/// Free block allocated by iog_guarded_alloc
+void  iog_guarded_free   (void *ptr, size_t bytes);
+
+/// Open or create file for mapping, *bytes gets its current size (-1 on error or if unsupported)
+int   iog_file_open   (const char *path, size_t *bytes);
+/// Set file size to bytes and map it shared (NULL on error)
+void *iog_file_map    (int fd, size_t bytes);
+/// Resize file and its mapping, pages stay in file so nothing is copied
+void *iog_file_remap  (int fd, void *ptr, size_t old_bytes, size_t new_bytes);
+/// Write dirty pages of mapping to file (0 on success)
+int   iog_file_sync   (void *ptr, size_t bytes);
+/// Unmap file and close it
+void  iog_file_close  (int fd, void *ptr, size_t bytes);
+
+/// Create temporary file removed on close, dir NULL means TMPDIR or /tmp (-1 on error or if unsupported)
+int iog_file_temp     (const char *dir);
+/// Write bytes at offset of file (0 on success), doesn't move file position
+int iog_file_write_at (int fd, const void *ptr, size_t bytes, size_t offset);
+/// Read bytes at offset of file (0 on success), doesn't move file position
+int iog_file_read_at  (int fd, void *ptr, size_t bytes, size_t offset);
+
+/// Size class (power of 2, at least IOG_MEM_MIN_CLASS_BYTES) that fits bytes
+size_t iog_mem_class_bytes (size_t bytes);
+
+void *iog_pool_alloc (size_t bytes);            ///< Zeroed block of class size from pool of current thread
+void  iog_pool_free  (void *ptr, size_t bytes); ///< Return block to pool of current thread
+void  iog_pool_trim  ();                        ///< Free blocks cached by current thread
+
+/// Prepare empty arena, chunks are allocated on demand
+void  iog_arena_init    (IogMemArena_t *arena, size_t chunk_bytes = IOG_MEM_ARENA_CHUNK_BYTES);
+void *iog_arena_alloc   (IogMemArena_t *arena, size_t bytes);            ///< Zeroed block of class size
+void  iog_arena_free    (IogMemArena_t *arena, void *ptr, size_t bytes); ///< Keep block for reuse
+void  iog_arena_reset   (IogMemArena_t *arena); ///< Take back all blocks at once
+void  iog_arena_destroy (IogMemArena_t *arena); ///< Free all chunks
+
+/// Arena used by stacks initialized later in current thread (NULL - pool and heap)
+void           iog_mem_bind_arena  (IogMemArena_t *arena);
+IogMemArena_t *iog_mem_bound_arena (); ///< Arena bound to current thread
+
+/// Bytes usable in block allocated by iog_mem_resize for bytes
+size_t iog_mem_usable (const IogMemArena_t *arena, size_t bytes);
+/// Resize block of arena (or pool/heap if arena is NULL), zeroing only the new tail (if zero_tail)
+void  *iog_mem_resize (IogMemArena_t *arena, void *ptr, size_t old_bytes, size_t new_bytes, int zero_tail = 1);
+/// Free block allocated by iog_mem_resize with the same arena
+void   iog_mem_free   (IogMemArena_t *arena, void *ptr, size_t bytes);
+
+const IogMemStats_t *iog_mem_stats       (); ///< Counters of current thread
+void                 iog_mem_stats_reset (); ///< Zero counters of current thread
+
 #endif // IOG_MEMLIB_H
@@ -0,0 +1,55 @@
+#ifndef IOG_PACK_H
+#define IOG_PACK_H
+
+#include <stddef.h>
+
+#include "iog_stack_return_codes.h"
+#include "iog_stack.h"
+
+/** @file iog_pack.h
+ * Lossless compression of runs of stack values into 64-bit words, like in Gorilla
+ * time series storage. Stream starts with mode bit and first value, every next value
+ * is coded against previous one. XOR mode writes only changed bits between leading and
+ * trailing zeros of xor, so slowly changing readings pack well. DELTA mode writes
+ * delta of delta of value bits, so evenly spaced timestamps cost one bit per value.
+ */
+
+/** @enum IogPackMode
+ * Defines coding of values after the first one
+ */
+enum IogPackMode {
+  IOG_PACK_XOR   = 0, ///< Xor with previous value
+  IOG_PACK_DELTA = 1, ///< Delta of delta of value bits
+};
+
+/** @struct IogPackWriter_t
+ * Writer of bit stream, high bits of word go first
+ */
+struct IogPackWriter_t {
+  iog_uint64_t *words; ///< Output words
+  size_t bits;         ///< Bits written
+  iog_uint64_t acc;    ///< Bits of unfinished word
+};
+
+/** @struct IogPackReader_t
+ * Reader of bit stream with bounds check
+ */
+struct IogPackReader_t {
+  const iog_uint64_t *words; ///< Input words
+  size_t bitsNum;            ///< Bits in input
+  size_t bits;               ///< Bits read
+  iog_flag_t isBad;          ///< Read went past input
+};
+
+//--------------------- PUBLIC FUNCTIONS --------------------------------------------
+
+/// Words of data[0..n) in smaller coding, mode gets that coding
+size_t iog_pack_size (const iog_stack_value_t *data, size_t n, IogPackMode *mode);
+
+/// Write data[0..n) to words in mode coding, returns amount of words written
+size_t iog_pack_encode (const iog_stack_value_t *data, size_t n, IogPackMode mode, iog_uint64_t *words);
+
+/// Read n values from words[0..words_num), ERR_BAD_IMAGE if stream is truncated or broken
+IogStackReturnCode iog_pack_decode (const iog_uint64_t *words, size_t words_num, iog_stack_value_t *data, size_t n);
+
+#endif // IOG_PACK_H
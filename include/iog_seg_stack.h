@@ -0,0 +1,142 @@
+#ifndef IOG_SEG_STACK_H
+#define IOG_SEG_STACK_H
+
+#include <stdio.h>
+
+#include "iog_stack_return_codes.h"
+#include "iog_stack.h"
+
+/** @file iog_seg_stack.h
+ * Segmented stack: data is a chain of fixed-size blocks, so growth never copies elements,
+ * push and pop are O(1) in the worst case and element addresses stay stable.
+ * Blocks are reference counted: snapshots and forks share the chain in O(1),
+ * shared top block is copied on first write, lower blocks are never written.
+ * Stack with memory budget keeps only top blocks in memory: older blocks are written to
+ * temporary file by background thread and read back ahead of pops that approach them.
+ * Stack with packing keeps blocks below top two compressed (iog_pack.h), block is
+ * decompressed only when pops reach it.
+ */
+
+/// Macros calls dump function with extra information about calling.
+#define IOG_SEG_STACK_DUMP(stack) {                                                     \
+  iog_seg_stack_dump_f(stack, stdout, #stack, __FILE__, __LINE__, __PRETTY_FUNCTION__); \
+}
+
+const size_t IOG_SEG_DEFAULT_BLOCK_CAPACITY = 4096; ///< Elements in one block by default
+const size_t IOG_SEG_MAX_SPARE_BLOCKS       = 2;    ///< Emptied blocks kept for next growth
+
+const size_t IOG_SEG_SPILL_PREFETCH     = 2; ///< Blocks right below top kept in memory (read back ahead of pops)
+const size_t IOG_SEG_SPILL_MIN_RESIDENT = IOG_SEG_SPILL_PREFETCH + 2; ///< Smallest budget in blocks
+const size_t IOG_SEG_SPILL_SLACK        = 1; ///< Blocks over budget before push waits for file writes
+
+const size_t IOG_SEG_PACK_WARM = 2; ///< Top blocks never compressed, so oscillation on boundary doesn't repack
+
+/** @struct IogSegBlock_t
+ * Header of block, followed by data[blockCapacity] and second data canary.
+ */
+struct IogSegBlock_t {
+  IogSegBlock_t *prev;          ///< Block with older elements (NULL for bottom block)
+  size_t refs;                  ///< Stacks, snapshots and upper blocks pointing to block
+  iog_flag_t isSpilled;         ///< 1 if block is header without data, data is in spill file
+  size_t packedWords;           ///< Words of compressed data instead of elements (0 - block isn't compressed)
+  iog_flag_t isIncompressible;  ///< 1 if packing didn't shrink block, cleared when block becomes top again
+  iog_canary_t firstDataCanary; ///< Canary before data, equal constant + data pointer
+};
+
+struct IogSegSpillWorker_t;
+
+/** @struct IogSegSpill_t
+ * Memory budget of segmented stack. Blocks of chain are also kept in table from bottom,
+ * blocks[0..spilledNum) are in file and chain holds header-only blocks in their place.
+ * File slot of block i is [first canary][data][second canary] at i * slot size, like data
+ * of IogStack_t, but canaries are keyed by file offset, so block read back to any
+ * address is verified before it is linked. Budget counts blocks of chain, not spare ones.
+ */
+struct IogSegSpill_t {
+  int fd;                      ///< Temporary file of spilled blocks
+  size_t maxResident;          ///< Blocks of chain allowed in memory
+  IogSegBlock_t **blocks;      ///< Blocks of chain from bottom
+  size_t blocksCapacity;       ///< Capacity of blocks table
+  size_t spilledNum;           ///< Blocks at bottom that are in file
+  iog_uint64_t spills;         ///< Blocks written to file
+  iog_uint64_t loads;          ///< Blocks read back
+  iog_uint64_t waits;          ///< Times stack operation waited for file
+  IogSegSpillWorker_t *worker; ///< Background thread of file reads and writes
+};
+
+/** @struct IogSegStack_t
+ * Defines segmented stack structure
+ */
+struct IogSegStack_t {
+  iog_canary_t firstStackCanary;  ///< First stack canary equal constant + pointer
+
+  IogSegBlock_t *top;             ///< Block with top element
+  iog_stack_value_t *topData;     ///< Data of top block
+  size_t topSize;                 ///< Amount of valuable elements in top block
+
+  IogSegBlock_t *spare;           ///< List of cached empty blocks (linked by prev)
+  size_t spareNum;                ///< Amount of cached blocks
+
+  iog_flag_t isInitialized;       ///< Flag of initialization
+  size_t size;                    ///< Amount of valuable elements in all blocks
+  size_t blockCapacity;           ///< Elements in one block
+  size_t blocksNum;               ///< Amount of blocks in chain (without spare)
+  IogStackVerifyLevel verifyLevel; ///< Checks run by stack operations
+  IogSegSpill_t *spill;           ///< Memory budget (NULL - all blocks are in memory)
+  iog_flag_t isPacking;           ///< Blocks below IOG_SEG_PACK_WARM top ones are compressed
+  size_t packedNum;               ///< Compressed blocks in chain
+  size_t packedWords;             ///< Words of compressed data in chain
+
+  iog_canary_t secondStackCanary; ///< Second stack canary equal constant + pointer
+};
+
+/** @struct IogSegSnapshot_t
+ * Saved state of segmented stack, holds reference to its chain of blocks.
+ */
+struct IogSegSnapshot_t {
+  IogSegBlock_t *top;   ///< Top block at snapshot time
+  size_t topSize;       ///< Elements of top block in snapshot
+  size_t size;          ///< Stack size at snapshot time
+  size_t blocksNum;     ///< Blocks in chain
+  size_t blockCapacity; ///< Elements in one block
+};
+
+//--------------------- PUBLIC FUNCTIONS --------------------------------------------
+
+/// Initialize stack with blocks of block_capacity elements
+IogStackReturnCode iog_seg_stack_init    (IogSegStack_t *stack, size_t block_capacity = IOG_SEG_DEFAULT_BLOCK_CAPACITY);
+IogStackReturnCode iog_seg_stack_destroy (IogSegStack_t *stack); ///< Free all blocks
+
+IogStackReturnCode iog_seg_stack_push (IogSegStack_t *stack, iog_stack_value_t value);  ///< Add value to stack
+IogStackReturnCode iog_seg_stack_pop  (IogSegStack_t *stack, iog_stack_value_t *value); ///< Read and remove value
+IogStackReturnCode iog_seg_stack_peek (const IogSegStack_t *stack, iog_stack_value_t *value); ///< Read value
+
+/// Get stable pointer to element at depth (0 - top), valid until element is popped
+IogStackReturnCode iog_seg_stack_at (const IogSegStack_t *stack, size_t depth, const iog_stack_value_t **ptr);
+
+/// Save stack state in O(1), blocks are shared until one side writes to them
+IogStackReturnCode iog_seg_stack_snapshot (IogSegStack_t *stack, IogSegSnapshot_t *snapshot);
+/// Return stack to saved state in O(1), snapshot stays valid
+IogStackReturnCode iog_seg_stack_restore  (IogSegStack_t *stack, const IogSegSnapshot_t *snapshot);
+/// Drop reference of snapshot, frees blocks used only by it
+IogStackReturnCode iog_seg_snapshot_release (IogSegSnapshot_t *snapshot);
+/// Initialize clone as O(1) copy of stack, both copy shared top block on first write
+IogStackReturnCode iog_seg_stack_fork (IogSegStack_t *stack, IogSegStack_t *clone);
+
+/// Keep at most budget_bytes of blocks in memory, older blocks go to temporary file in dir (0 - no budget)
+IogStackReturnCode iog_seg_stack_set_budget (IogSegStack_t *stack, size_t budget_bytes, const char *dir = NULL);
+
+/// Keep blocks below top two compressed (1) or decompress all of them (0)
+IogStackReturnCode iog_seg_stack_set_packing (IogSegStack_t *stack, iog_flag_t on);
+
+/// Print all stack info to stream (file)
+IogStackReturnCode iog_seg_stack_dump_f (const IogSegStack_t *stack, FILE *stream,
+    const char *stk_name, const char *file_name, int line_num, const char *function_name);
+
+IogStackReturnCode iog_seg_stack_verify     (const IogSegStack_t *stack); ///< Verify stack and top block
+IogStackReturnCode iog_seg_stack_verify_all (const IogSegStack_t *stack); ///< Verify canaries of every block
+
+/// Choose checks run by operations of this stack (clamped by IOG_STACK_VERIFY_LEVEL)
+IogStackReturnCode iog_seg_stack_set_verify_level (IogSegStack_t *stack, IogStackVerifyLevel level);
+
+#endif // IOG_SEG_STACK_H
@@ -0,0 +1,84 @@
+#ifndef IOG_SIMD_H
+#define IOG_SIMD_H
+
+#include <stddef.h>
+#include <string.h>
+
+#include "iog_stack.h"
+
+/** @file iog_simd.h
+ * Reductions and search over arrays of stack values. Kernels for SSE2 and AVX2
+ * are chosen at first call by cpu features, other targets use scalar loops.
+ * Vector kernels keep several accumulators, so sum is added in other order than
+ * by plain loop and may differ in last bits. Min and max of data with NaN are unspecified.
+ * Checksum is integer arithmetic, so every kernel gives the same result.
+ */
+
+#ifndef IOG_SIMD
+#define IOG_SIMD 1 ///< Use vector kernels where cpu supports them (0 - always scalar)
+#endif // IOG_SIMD
+
+/** @enum IogSimdIsa
+ * Defines instruction set of kernels
+ */
+enum IogSimdIsa {
+  IOG_SIMD_SCALAR = 0, ///< Plain loops
+  IOG_SIMD_SSE2   = 1, ///< 128-bit vectors
+  IOG_SIMD_AVX2   = 2, ///< 256-bit vectors
+};
+
+/** @struct IogSimdKernels_t
+ * Functions of one instruction set
+ */
+struct IogSimdKernels_t {
+  IogSimdIsa isa; ///< Instruction set of kernels
+
+  iog_stack_value_t (*min) (const iog_stack_value_t *data, size_t n); ///< Smallest value
+  iog_stack_value_t (*max) (const iog_stack_value_t *data, size_t n); ///< Largest value
+  iog_stack_value_t (*sum) (const iog_stack_value_t *data, size_t n); ///< Sum of values
+
+  size_t (*findLast) (const iog_stack_value_t *data, size_t n, iog_stack_value_t value); ///< Last equal index
+
+  iog_uint64_t (*checksum) (const iog_stack_value_t *data, size_t n, size_t first_index); ///< Sum of checksum terms
+};
+
+const iog_uint64_t IOG_SIMD_CHECKSUM_STEP = 0x9E3779B97F4A7C15; ///< Position key is index * step
+const iog_uint64_t IOG_SIMD_CHECKSUM_KEY  = 0x85EBCA6BC2B2AE35; ///< Halves of this are added to halves of keyed value
+
+//--------------------- PUBLIC FUNCTIONS --------------------------------------------
+
+iog_stack_value_t iog_simd_min (const iog_stack_value_t *data, size_t n); ///< Smallest of data[0..n), n > 0
+iog_stack_value_t iog_simd_max (const iog_stack_value_t *data, size_t n); ///< Largest of data[0..n), n > 0
+iog_stack_value_t iog_simd_sum (const iog_stack_value_t *data, size_t n); ///< Sum of data[0..n)
+
+/// Index of last value equal to value in data[0..n), n if there is none
+size_t iog_simd_find_last (const iog_stack_value_t *data, size_t n, iog_stack_value_t value);
+
+/// Sum of checksum terms of data[0..n), data[i] is at index first_index + i
+iog_uint64_t iog_simd_checksum (const iog_stack_value_t *data, size_t n, size_t first_index);
+
+/// Use best kernels not above isa, returns chosen instruction set
+IogSimdIsa  iog_simd_select   (IogSimdIsa isa);
+const char *iog_simd_isa_name (IogSimdIsa isa); ///< Name of instruction set
+
+/**
+ * Value bits are xored with position key, then 32-bit halves of result (each plus half
+ * of IOG_SIMD_CHECKSUM_KEY) are multiplied and added to it, like in NH hash. Equal values
+ * at other slots give other terms, so moved or swapped values are caught too.
+ * Terms are added mod 2^64, so push and pop update checksum of stack in O(1).
+ * @param[in] value stack value
+ * @param[in] index slot of value
+ * @return checksum term
+ */
+static inline iog_uint64_t iog_simd_checksum_term (iog_stack_value_t value, size_t index) {
+  iog_uint64_t bits = 0;
+  memcpy(&bits, &value, sizeof(bits));
+
+  iog_uint64_t keyed = bits ^ ((iog_uint64_t) index * IOG_SIMD_CHECKSUM_STEP);
+  iog_uint64_t low   = (unsigned) (keyed + IOG_SIMD_CHECKSUM_KEY);
+  iog_uint64_t high  = (unsigned) ((keyed >> 32) + (IOG_SIMD_CHECKSUM_KEY >> 32));
+
+  return keyed + low * high;
+}
+
+#endif // IOG_SIMD_H
@@ -1,6 +1,8 @@
 #ifndef IOG_STACK_H
 #define IOG_STACK_H
 
+#include <atomic>
+
 #include "iog_stack_return_codes.h"
 
 /* @file iog_stack.h */
@@ -23,6 +25,121 @@
   iog_stack_dump_f(stack, stdout, #stack, __FILE__, __LINE__, __PRETTY_FUNCTION__); \
 }
 
+#ifndef IOG_STACK_VERIFY_LEVEL
+#ifdef IOG_NDEBUG
+#define IOG_STACK_VERIFY_LEVEL 1 ///< Max verify level compiled in (1 - off, 2 - canaries, 3 - full)
+#else
+#define IOG_STACK_VERIFY_LEVEL 3 ///< Max verify level compiled in (1 - off, 2 - canaries, 3 - full)
+#endif
+#endif // IOG_STACK_VERIFY_LEVEL
+
+#ifndef IOG_STACK_DEFAULT_VERIFY_LEVEL
+/// Verify level of stacks that didn't choose own level
+#define IOG_STACK_DEFAULT_VERIFY_LEVEL IOG_STACK_VERIFY_LEVEL
+#endif // IOG_STACK_DEFAULT_VERIFY_LEVEL
+
+/** @enum IogStackVerifyLevel
+ * Defines which checks stack operations run.
+ * Explicit iog_stack_verify call always runs full check.
+ * Underlying type is fixed, so any int is a valid value and setters can reject it.
+ */
+enum IogStackVerifyLevel : int {
+  IOG_VERIFY_DEFAULT  = 0, ///< Use IOG_STACK_DEFAULT_VERIFY_LEVEL
+  IOG_VERIFY_OFF      = 1, ///< No checks
+  IOG_VERIFY_CANARIES = 2, ///< Only stack and data canaries
+  IOG_VERIFY_FULL     = 3, ///< All checks of iog_stack_verify
+};
+
+#ifndef IOG_STACK_INLINE_CAPACITY
+/// Number of elements stored inside IogStack_t before data spills to heap (0 - no inline buffer)
+#define IOG_STACK_INLINE_CAPACITY 4
+#endif // IOG_STACK_INLINE_CAPACITY
+
+#ifndef IOG_STACK_STATS
+/// Stats collected by stacks (0 - none, 1 - operation counters, 2 - counters and verify cycles)
+#define IOG_STACK_STATS 1
+#endif // IOG_STACK_STATS
+
+#if IOG_STACK_STATS > 0
+#define IOG_STACK_STAT(expr) expr ///< Evaluate stats update only if stats are compiled in
+#else
+#define IOG_STACK_STAT(expr)
+#endif // IOG_STACK_STATS
+
+/// Add n to stats counter (counters are read by readers of shared stack)
+#define IOG_STACK_STAT_ADD(counter, n)     IOG_STACK_STAT( iog_relaxed_store(&(counter), (counter) + (n)) )
+/// Raise high-water mark of stats to value
+#define IOG_STACK_STAT_MAX(counter, value) IOG_STACK_STAT( if ((counter) < (value)) iog_relaxed_store(&(counter), (value)) )
+
+#ifndef IOG_STACK_POISON
+#if defined(__SANITIZE_ADDRESS__)
+#define IOG_STACK_POISON 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define IOG_STACK_POISON 1
+#endif
+#endif
+#endif // IOG_STACK_POISON
+
+#ifndef IOG_STACK_POISON
+/// If 1 then free slots [size, capacity) are poisoned for AddressSanitizer (on by default in ASan builds)
+#define IOG_STACK_POISON 0
+#endif // IOG_STACK_POISON
+
+#if IOG_STACK_POISON
+#include <sanitizer/asan_interface.h>
+#define IOG_STACK_IS_POISONED(ptr) __asan_address_is_poisoned(ptr) ///< Is address poisoned by ASan
+#else
+#define IOG_STACK_IS_POISONED(ptr) 0
+#endif // IOG_STACK_POISON
+
+/// Macros prints stack stats as one line of JSON to stdout
+#define IOG_STACK_DUMP_STATS(stack) {            \
+  iog_stack_dump_stats_f(stack, stdout, #stack); \
+}
+
+#ifdef __GNUC__
+#define IOG_LIKELY(x)   __builtin_expect(!!(x), 1) ///< Hint that condition is usually true
+#define IOG_UNLIKELY(x) __builtin_expect(!!(x), 0) ///< Hint that condition is usually false
+#define IOG_COLD        __attribute__((cold, noinline)) ///< Mark rarely called function
+#else
+#define IOG_LIKELY(x)   (x)
+#define IOG_UNLIKELY(x) (x)
+#define IOG_COLD
+#endif
+
+/**
+ * Store to field that readers of shared stack load. Relaxed atomic store is plain store
+ * in machine code, but compiler can't tear it and ThreadSanitizer knows it is atomic.
+ * @param[out] field pointer to field
+ * @param[in]  value new value
+ */
+template <typename T, typename V>
+static inline void iog_relaxed_store (T *field, V value) {
+  T stored = value;
+#ifdef __GNUC__
+  __atomic_store(field, &stored, __ATOMIC_RELAXED);
+#else
+  *field = stored;
+#endif
+}
+
+/**
+ * Load of field stored by iog_relaxed_store in other thread.
+ * @param[in] field pointer to field
+ * @return value of field
+ */
+template <typename T>
+static inline T iog_relaxed_load (const T *field) {
+  T value;
+#ifdef __GNUC__
+  __atomic_load(field, &value, __ATOMIC_RELAXED);
+#else
+  value = *field;
+#endif
+  return value;
+}
+
 typedef double             iog_stack_value_t; ///< Definition of stack element type
 typedef unsigned char      iog_flag_t;        ///< Definition of flag type;
 typedef unsigned long long iog_uint64_t;      ///< Definition of my uint64_t
@@ -32,6 +149,166 @@ const size_t        INIT_STACK_DATA_CAPACITY = 4;          ///< Constant with in
 const iog_canary_t  DATA_CANARY_CONST        = 0x1234DEAD; ///< Constant for data canary mask
 const iog_canary_t  STACK_CANARY_CONST       = 0x1234DEAD; ///< Constant for stack canary mask
 
+/**
+ * Exact comparison of values: stack stores values and doesn't compute them,
+ * so value read back must be the very one that was written.
+ * @param[in] a first value
+ * @param[in] b second value
+ * @return 1 if values are equal (NaN isn't equal to anything), else 0
+ */
+static inline int iog_value_equal (iog_stack_value_t a, iog_stack_value_t b) {
+#ifdef __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wfloat-equal"
+#endif
+  return a == b;
+#ifdef __GNUC__
+#pragma GCC diagnostic pop
+#endif
+}
+
+struct IogMemArena_t;
+
+/** @struct IogStackPolicy_t
+ * Defines how stack capacity grows and shrinks.
+ * Stack shrinks when size <= capacity / shrinkDivisor and new capacity is
+ * size * shrinkHeadroom, so push right after shrink never reallocates.
+ */
+struct IogStackPolicy_t {
+  double     growFactor;     ///< Capacity multiplier when stack is full (> 1)
+  size_t     shrinkDivisor;  ///< Shrink when size <= capacity / shrinkDivisor
+  size_t     shrinkHeadroom; ///< Capacity after shrink equals size * shrinkHeadroom
+  size_t     minCapacity;    ///< Capacity never goes below this value
+  iog_flag_t neverShrink;    ///< If 1 then memory is released only by destroy
+  iog_flag_t guardPages;     ///< If 1 then data ends at PROT_NONE page instead of second data canary
+  IogMemArena_t *arena;      ///< Arena of data (NULL - arena bound to thread by init, else pool and heap)
+};
+
+/// Policy used when init gets NULL: doubling, shrink at 1/4 to half of capacity
+const IogStackPolicy_t IOG_STACK_DEFAULT_POLICY = {2.0, 4, 2, INIT_STACK_DATA_CAPACITY, 0, 0, NULL};
+
+const iog_uint64_t IOG_STACK_MAP_MAGIC        = 0x4B43415453474F49; ///< "IOGSTACK" in little endian
+const iog_uint64_t IOG_STACK_MAP_VERSION      = 1;                  ///< Layout version of mapped file
+const size_t       IOG_STACK_MAP_HEADER_BYTES = 4096;               ///< Superblock area, data starts page-aligned
+
+/** @struct IogStackSuperblock_t
+ * Header of mapped stack file, followed by [first data canary][data][second data canary].
+ * Data canaries of mapped stack are keyed by canarySeed and capacity instead of data address,
+ * so they stay valid when file is mapped at other address.
+ */
+struct IogStackSuperblock_t {
+  iog_uint64_t magic;        ///< IOG_STACK_MAP_MAGIC
+  iog_uint64_t version;      ///< IOG_STACK_MAP_VERSION
+  iog_uint64_t valueBytes;   ///< sizeof(iog_stack_value_t) of build that created file
+  iog_uint64_t canarySeed;   ///< Random key of data canaries, chosen when file is created
+  iog_uint64_t size;         ///< Stack size at last sync or resize
+  iog_uint64_t capacity;     ///< Capacity of data in file
+  iog_canary_t superCanary;  ///< Constant + hash of fields above
+};
+
+const iog_uint64_t IOG_STACK_IMAGE_MAGIC   = 0x474D495453474F49; ///< "IOGSTIMG" in little endian
+const iog_uint64_t IOG_STACK_IMAGE_VERSION = 1;                  ///< Layout version of stack image
+
+/** @struct IogStackImageHeader_t
+ * Header of binary stack image, followed by data[size] and tail canary
+ * equal constant + dataHash. Image keeps values only, so it is loaded into any stack.
+ */
+struct IogStackImageHeader_t {
+  iog_uint64_t magic;        ///< IOG_STACK_IMAGE_MAGIC
+  iog_uint64_t version;      ///< IOG_STACK_IMAGE_VERSION
+  iog_uint64_t valueBytes;   ///< sizeof(iog_stack_value_t) of build that saved image
+  iog_uint64_t size;         ///< Amount of values in image
+  iog_uint64_t dataHash;     ///< Hash of data[size]
+  iog_canary_t headCanary;   ///< Constant + hash of fields above
+};
+
+/** @struct IogStackMark_t
+ * Savepoint of stack, see iog_stack_mark.
+ */
+struct IogStackMark_t {
+  size_t size;  ///< Stack size at mark
+  size_t depth; ///< Marks outstanding before this one
+};
+
+/** @struct IogStackExtremum_t
+ * Entry of monotonic min or max stack
+ */
+struct IogStackExtremum_t {
+  iog_stack_value_t value; ///< New minimum (maximum) at time of push
+  size_t size;             ///< Stack size right after value was pushed
+};
+
+/** @struct IogStackAggregates_t
+ * Auxiliary stacks of aggregate tracking. Value gets entry in mins (maxs) only if it is
+ * new minimum (maximum), so top entry is answer. Entries remember stack size, so
+ * truncating stack to any size drops them without looking at removed values.
+ * sums[i] is sum of data[0..i], so sum doesn't drift after pops.
+ */
+struct IogStackAggregates_t {
+  IogStackExtremum_t *mins; ///< Monotonic stack of minimums
+  size_t minsNum;           ///< Entries in mins
+  IogStackExtremum_t *maxs; ///< Monotonic stack of maximums
+  size_t maxsNum;           ///< Entries in maxs
+  iog_stack_value_t *sums;  ///< Prefix sums of data
+  size_t size;              ///< Stack size aggregates are up to date with
+  size_t capacity;          ///< Capacity of each of three arrays
+};
+
+/** @struct IogStackStats_t
+ * Counters of one stack. Only owner thread writes them, so updates are plain
+ * increments cheap enough to leave on, stored relaxed for readers of shared stack.
+ */
+struct IogStackStats_t {
+  iog_uint64_t pushes;       ///< Pushed elements (push_n counts every element)
+  iog_uint64_t pops;         ///< Popped elements
+  iog_uint64_t reallocs;     ///< Resizes of data buffer
+  iog_uint64_t bytesCopied;  ///< Bytes copied by resizes
+  iog_uint64_t shrinks;      ///< Resizes made by iog_stack_free_rest
+  iog_uint64_t maxSize;      ///< High-water mark of size
+  iog_uint64_t maxCapacity;  ///< High-water mark of capacity
+  iog_uint64_t verifyCalls;  ///< Calls of iog_stack_verify and iog_stack_verify_canaries
+  iog_uint64_t verifyCycles; ///< CPU cycles spent in verify (only if IOG_STACK_STATS > 1)
+  iog_uint64_t verifyFailures[NR_RETURN_CODE]; ///< Failed verifies by returned code
+};
+
+/** @struct IogStackRetired_t
+ * Data buffer replaced while stack was shared, freed after readers leave
+ */
+struct IogStackRetired_t {
+  iog_canary_t *buffer; ///< Buffer with data canaries
+  size_t bytes;         ///< Size of buffer
+};
+
+/** @struct IogStackShare_t
+ * Seqlock of stack read by other threads. Writer makes version odd before it changes
+ * size, capacity, data or stats and even after, reader retries copy if version was odd
+ * or changed. Readers are counted in one of two epochs, buffers replaced by writer are
+ * freed only after epoch that was current when they were replaced has no readers.
+ */
+struct IogStackShare_t {
+  alignas(64) std::atomic<iog_uint64_t> version; ///< Odd while writer changes stack
+  alignas(64) std::atomic<unsigned> epoch;       ///< Epoch new readers are counted in (0 or 1)
+  std::atomic<size_t> readers[2];                ///< Readers inside iog_stack_read_shared by epoch
+  std::atomic<iog_uint64_t> retries;             ///< Copies repeated by readers
+
+  IogStackRetired_t *retired; ///< Replaced buffers (writer only), pending ones go first
+  size_t retiredNum;          ///< Amount of retired buffers
+  size_t retiredCapacity;     ///< Capacity of retired array
+  size_t pendingNum;          ///< Buffers retired before last epoch switch
+  iog_uint64_t freed;         ///< Retired buffers freed after readers left
+};
+
+/** @struct IogStackView_t
+ * Consistent copy of stack state taken by reader thread
+ */
+struct IogStackView_t {
+  iog_uint64_t version;  ///< Version of stack the copy belongs to
+  size_t size;           ///< Amount of elements
+  size_t capacity;       ///< Capacity of data
+  size_t topNum;         ///< Top values copied (min of asked amount and size)
+  IogStackStats_t stats; ///< Operation counters (zeros if IOG_STACK_STATS is 0)
+};
+
 /** @struct IogStack_t
  * Defines stack structure
  */
@@ -45,36 +322,270 @@ struct IogStack_t {
   iog_flag_t isInitialized;       ///< Flag of initialization
   size_t size;                    ///< Amount of valuable elements in data
   size_t capacity;                ///< Size of allocated memory for data
+  IogStackPolicy_t policy;        ///< Growth and shrink policy
+  IogStackVerifyLevel verifyLevel; ///< Checks run by stack operations
+  iog_flag_t fastPath;            ///< 1 if initialized, verify level is off, aggregates and checksum aren't tracked
+  size_t shrinkSize;              ///< Pop to this size or less may shrink data
+  size_t marksNum;                ///< Outstanding marks, data isn't shrunk while there are any
+
+  IogStackSuperblock_t *superblock; ///< Start of mapped file (NULL if data isn't mapped)
+  int mapFd;                      ///< Descriptor of mapped file (-1 if data isn't mapped)
+
+  IogStackAggregates_t *aggregates; ///< Min, max and sum tracking (NULL if turned off)
+
+  iog_flag_t   trackChecksum;     ///< 1 if checksum of data is kept
+  iog_uint64_t checksum;          ///< Sum of checksum terms of data[0..checksumSize) mod 2^64
+  size_t       checksumSize;      ///< Values covered by checksum (less than size only while data is written directly)
+
+  IogStackShare_t *share;         ///< Seqlock for reader threads (NULL if stack isn't shared)
+
+#if IOG_STACK_INLINE_CAPACITY > 0
+  /// Data canaries and first IOG_STACK_INLINE_CAPACITY elements, guarded by stack canaries
+  iog_canary_t inlineBuffer[IOG_STACK_INLINE_CAPACITY + 2];
+#endif // IOG_STACK_INLINE_CAPACITY
+
+#if IOG_STACK_STATS > 0
+  mutable IogStackStats_t stats;  ///< Counters, also updated by const checks
+#endif // IOG_STACK_STATS
                             
   iog_canary_t secondStackCanary; ///< Second stack canary equal constant + pointer
 };
 
+static_assert(sizeof(iog_canary_t) == sizeof(iog_stack_value_t),
+              "data buffer layout expects canary and element of the same size");
+static_assert(IOG_STACK_INLINE_CAPACITY == 0 || IOG_STACK_INLINE_CAPACITY >= INIT_STACK_DATA_CAPACITY,
+              "inline buffer must fit INIT_STACK_DATA_CAPACITY elements");
+
 //--------------------- PUBLIC FUNCTIONS --------------------------------------------
 
-IogStackReturnCode iog_stack_init    (IogStack_t *stack); ///< Initialize stack
+/// Initialize stack, NULL policy means IOG_STACK_DEFAULT_POLICY
+IogStackReturnCode iog_stack_init    (IogStack_t *stack, const IogStackPolicy_t *policy = NULL);
 IogStackReturnCode iog_stack_destroy (IogStack_t *stack); ///< Free stack data from memory
 
-IogStackReturnCode iog_stack_push (IogStack_t *stack, iog_stack_value_t value);  ///< Add value to stack
-IogStackReturnCode iog_stack_pop  (IogStack_t *stack, iog_stack_value_t *value); ///< Read and remove value from stack
+/// Open stack stored in file (create if file is empty), data is paged in lazily
+IogStackReturnCode iog_stack_open_mapped (IogStack_t *stack, const char *path, const IogStackPolicy_t *policy = NULL);
+IogStackReturnCode iog_stack_sync        (IogStack_t *stack); ///< Write size and dirty pages of mapped stack to file
+
+static inline IogStackReturnCode iog_stack_push (IogStack_t *stack, iog_stack_value_t value);  ///< Add value to stack
+static inline IogStackReturnCode iog_stack_pop  (IogStack_t *stack, iog_stack_value_t *value); ///< Read and remove value from stack
+
+static inline IogStackReturnCode iog_stack_peek (const IogStack_t *stack, iog_stack_value_t *value); ///< Read value from stack
+
+/// Add n values to stack, values[n-1] becomes top
+IogStackReturnCode iog_stack_push_n (IogStack_t *stack, const iog_stack_value_t *values, size_t n);
+/// Read and remove n top values, values[n-1] gets old top
+IogStackReturnCode iog_stack_pop_n  (IogStack_t *stack, iog_stack_value_t *values, size_t n);
+/// Read n top values, values[n-1] gets top
+IogStackReturnCode iog_stack_peek_n (const IogStack_t *stack, iog_stack_value_t *values, size_t n);
 
-IogStackReturnCode iog_stack_peek (const IogStack_t *stack, iog_stack_value_t *value); ///< Read value from stack
+IogStackReturnCode iog_stack_reserve (IogStack_t *stack, size_t min_capacity); ///< Grow capacity to fit min_capacity
+
+/// Save current size as savepoint, marks nest
+IogStackReturnCode iog_stack_mark     (IogStack_t *stack, IogStackMark_t *mark);
+/// Drop values pushed after mark, release mark and marks made after it
+IogStackReturnCode iog_stack_rollback (IogStack_t *stack, const IogStackMark_t *mark);
+/// Keep values pushed after mark, release mark and marks made after it
+IogStackReturnCode iog_stack_commit   (IogStack_t *stack, const IogStackMark_t *mark);
                                                                                
+/// Keep min, max and sum up to date on every push and pop (on = 1) or stop it (on = 0)
+IogStackReturnCode iog_stack_track_aggregates (IogStack_t *stack, int on);
+
+/// Smallest value, O(1) if aggregates are tracked, vectorized scan otherwise
+IogStackReturnCode iog_stack_min (const IogStack_t *stack, iog_stack_value_t *value);
+/// Largest value, O(1) if aggregates are tracked, vectorized scan otherwise
+IogStackReturnCode iog_stack_max (const IogStack_t *stack, iog_stack_value_t *value);
+/// Sum of values, O(1) if aggregates are tracked, vectorized scan otherwise
+IogStackReturnCode iog_stack_sum (const IogStack_t *stack, iog_stack_value_t *value);
+/// Depth (0 - top) of value nearest to top, ERR_VALUE_NOT_FOUND if there is none
+IogStackReturnCode iog_stack_find (const IogStack_t *stack, iog_stack_value_t value, size_t *depth);
+
+/// Keep checksum of values up to date on every push and pop (on = 1) or stop it (on = 0)
+IogStackReturnCode iog_stack_track_checksum (IogStack_t *stack, int on);
+/// Verify stack and rescan data against tracked checksum, ERR_BAD_CHECKSUM if data was changed behind stack
+IogStackReturnCode iog_stack_verify_checksum (const IogStack_t *stack);
+
+/// Remove data[first_changing..size) from checksum before it is written directly (by iog_vm_run)
+IogStackReturnCode iog_stack_data_changing (IogStack_t *stack, size_t first_changing);
+/// Update aggregates and checksum after data[first_changed..size) was written directly (by iog_vm_run)
+IogStackReturnCode iog_stack_data_changed (IogStack_t *stack, size_t first_changed);
+int iog_stack_is_checked (const IogStack_t *stack); ///< Do operations of stack run checks
+
+/// Write stack as binary image: header, data[0..size) and tail canary
+IogStackReturnCode iog_stack_save_f (const IogStack_t *stack, FILE *stream);
+/// Initialize stack from image written by iog_stack_save_f, NULL policy means IOG_STACK_DEFAULT_POLICY
+IogStackReturnCode iog_stack_load_f (IogStack_t *stack, FILE *stream, const IogStackPolicy_t *policy = NULL);
+
+/// Let other threads read stack by iog_stack_read_shared (on = 1) or stop it (on = 0, no reader may be inside)
+IogStackReturnCode iog_stack_share (IogStack_t *stack, int on);
+/// Any thread: copy size, capacity, stats and up to top_max top values (top[topNum-1] gets top) of shared stack
+IogStackReturnCode iog_stack_read_shared (const IogStack_t *stack, IogStackView_t *view,
+    iog_stack_value_t *top, size_t top_max);
+
 /// Print all stack info to stream (file)
 IogStackReturnCode iog_stack_dump_f (const IogStack_t *stack, FILE *stream,
     const char *stk_name, const char *file_name, int line_num, const char *function_name);  
+/// Print size and only window_size bottom and top values as plain text without colors
+IogStackReturnCode iog_stack_dump_window_f (const IogStack_t *stack, FILE *stream, size_t window_size);
                                                                      
 IogStackReturnCode iog_stack_dump   (const IogStack_t *stack);  ///< Print all stack info to stdin 
 IogStackReturnCode iog_stack_verify (const IogStack_t *stack);  ///< Verify stack
+IogStackReturnCode iog_stack_verify_canaries (const IogStack_t *stack); ///< Verify only canaries
+
+/// Choose checks run by operations of this stack (clamped by IOG_STACK_VERIFY_LEVEL)
+IogStackReturnCode iog_stack_set_verify_level (IogStack_t *stack, IogStackVerifyLevel level);
 
 IogStackReturnCode iog_stack_update_canaries (IogStack_t *stack); ///< Calculates stack canaries
 
+IogStackReturnCode iog_stack_policy_check (const IogStackPolicy_t *policy); ///< Validate policy
+
+/// Copy stack counters to stats (zeros if IOG_STACK_STATS is 0)
+IogStackReturnCode iog_stack_stats       (const IogStack_t *stack, IogStackStats_t *stats);
+IogStackReturnCode iog_stack_stats_reset (IogStack_t *stack); ///< Zero stack counters
+
+/// Print stack counters to stream as one line of JSON
+IogStackReturnCode iog_stack_dump_stats_f (const IogStack_t *stack, FILE *stream, const char *stk_name);
+
+
+//--------------------- SLOW PATHS --------------------------------------------------
+
+/// Push with checks and growth, called when inline push can't handle the case
+IOG_COLD IogStackReturnCode iog_stack_push_slow (IogStack_t *stack, iog_stack_value_t value);
+/// Pop with checks and shrink, called when inline pop can't handle the case
+IOG_COLD IogStackReturnCode iog_stack_pop_slow  (IogStack_t *stack, iog_stack_value_t *value);
+/// Peek with checks, called when inline peek can't handle the case
+IOG_COLD IogStackReturnCode iog_stack_peek_slow (const IogStack_t *stack, iog_stack_value_t *value);
+
+//--------------------- INLINE FAST PATHS -------------------------------------------
+
+/**
+ * Free slots aren't cleared, in ASan builds they are poisoned instead, so reads of
+ * popped values are reported. Inline buffer isn't poisoned: it lives inside stack,
+ * which is copied and reused by value. Without IOG_STACK_POISON does nothing.
+ * @param[in] stack  pointer to stack
+ * @param[in] from   first slot
+ * @param[in] to     slot after last
+ * @param[in] poison 1 - poison slots, 0 - make them addressable
+ */
+static inline void iog_stack_poison_slots (const IogStack_t *stack, size_t from, size_t to, int poison) {
+#if IOG_STACK_POISON
+  // readers of shared stack may copy slots just freed by writer
+  if (stack->data == NULL || to <= from || stack->share != NULL)
+    return;
+
+#if IOG_STACK_INLINE_CAPACITY > 0
+  if (stack->firstDataCanary == stack->inlineBuffer)
+    return;
+#endif // IOG_STACK_INLINE_CAPACITY
 
-//--------------------- PRIVATE FUNCTIONS --------------------------------------------
+  if (poison)
+    ASAN_POISON_MEMORY_REGION(stack->data + from, (to - from) * sizeof(iog_stack_value_t));
+  else
+    ASAN_UNPOISON_MEMORY_REGION(stack->data + from, (to - from) * sizeof(iog_stack_value_t));
+#else
+  (void) stack;
+  (void) from;
+  (void) to;
+  (void) poison;
+#endif // IOG_STACK_POISON
+}
+
+/**
+ * Writer side of seqlock: makes version odd. Section inside other section (resize during push)
+ * doesn't touch version. Stack without readers only checks share pointer.
+ * @param[out] stack pointer to stack
+ * @return 1 if section was opened by this call
+ */
+static inline int iog_stack_write_begin (IogStack_t *stack) {
+  IogStackShare_t *share = stack->share;
+  if (IOG_LIKELY(share == NULL))
+    return 0;
+
+  iog_uint64_t version = share->version.load(std::memory_order_relaxed);
+  if (version & 1)
+    return 0;
+
+  share->version.store(version + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  return 1;
+}
+
+/**
+ * Makes version even again if section was opened by iog_stack_write_begin.
+ * @param[out] stack  pointer to stack
+ * @param[in]  opened result of iog_stack_write_begin
+ */
+static inline void iog_stack_write_end (IogStack_t *stack, int opened) {
+  if (opened) {
+    IogStackShare_t *share = stack->share;
+    share->version.store(share->version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+}
+
+/**
+ * Stores value without checks if stack is on fast path and has free capacity,
+ * otherwise calls iog_stack_push_slow. Shared stack pays two version stores.
+ * @param[out] stack pointer to stack (can't be NULL)
+ * @param[in]  value new stack value
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static inline IogStackReturnCode iog_stack_push (IogStack_t *stack, iog_stack_value_t value) {
+  if (IOG_LIKELY(stack != NULL && stack->fastPath && stack->size < stack->capacity)) {
+    int opened = iog_stack_write_begin(stack);
+
+    iog_stack_poison_slots(stack, stack->size, stack->size + 1, 0);
+    iog_relaxed_store(&stack->data[stack->size], value);
+    iog_relaxed_store(&stack->size, stack->size + 1);
+
+    IOG_STACK_STAT_ADD( stack->stats.pushes, 1 );
+    IOG_STACK_STAT_MAX( stack->stats.maxSize, stack->size );
+
+    iog_stack_write_end(stack, opened);
 
-/// Reallocates data of stack
-static IogStackReturnCode iog_stack_allocate_data (IogStack_t *stack, size_t new_capacity);
+    return OK;
+  }
 
-static IogStackReturnCode iog_stack_allocate_more (IogStack_t *stack); ///< Allocates more memory for data
-static IogStackReturnCode iog_stack_free_rest     (IogStack_t *stack); ///< Free all memory after stack size.
+  return iog_stack_push_slow(stack, value);
+}
+
+/**
+ * Loads top value without checks if stack is on fast path and pop can't shrink data,
+ * otherwise calls iog_stack_pop_slow.
+ * @param[out] stack pointer to stack
+ * @param[out] value pointer to variable in which want to write (can't be null)
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static inline IogStackReturnCode iog_stack_pop (IogStack_t *stack, iog_stack_value_t *value) {
+  if (IOG_LIKELY(stack != NULL && stack->fastPath && stack->size > stack->shrinkSize + 1)) {
+    int opened = iog_stack_write_begin(stack);
+
+    iog_relaxed_store(&stack->size, stack->size - 1);
+    *value = stack->data[stack->size];
+    iog_stack_poison_slots(stack, stack->size, stack->size + 1, 1);
+
+    IOG_STACK_STAT_ADD( stack->stats.pops, 1 );
+
+    iog_stack_write_end(stack, opened);
+
+    return OK;
+  }
+
+  return iog_stack_pop_slow(stack, value);
+}
+
+/**
+ * @param[in]  stack pointer to stack (can't be NULL)
+ * @param[out] value pointer to variable in which want to write
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static inline IogStackReturnCode iog_stack_peek (const IogStack_t *stack, iog_stack_value_t *value) {
+  if (IOG_LIKELY(stack != NULL && stack->fastPath && stack->size > 0)) {
+    *value = stack->data[stack->size - 1];
+
+    return OK;
+  }
+
+  return iog_stack_peek_slow(stack, value);
+}
 
 #endif // IOG_STACK_H
@@ -33,7 +33,34 @@ enum IogStackReturnCode {
 
   ERR_TEST_FAILED                  = 16,
 
-  NR_RETURN_CODE                   = 17, ///< Last return code
+  ERR_INVALID_POLICY               = 17,
+  ERR_INVALID_VERIFY_LEVEL         = 18,
+
+  ERR_TOO_MANY_THREADS             = 19,
+  ERR_STEAL_LOST                   = 20, ///< Other thread took element first, steal may be retried
+
+  ERR_CANT_OPEN_FILE               = 21,
+  ERR_BAD_SUPERBLOCK               = 22, ///< Mapped file isn't a stack or was written by other build
+  ERR_CANT_SYNC_FILE               = 23,
+
+  ERR_INVALID_MARK                 = 24, ///< Mark was already released or stack was popped below it
+
+  ERR_CANT_WRITE_FILE              = 25,
+  ERR_BAD_IMAGE                    = 26, ///< Stack image or compressed block is truncated, corrupted or written by other build
+
+  ERR_BAD_BYTECODE                 = 27, ///< Program isn't linked, has unknown opcode or bad jump
+
+  ERR_VALUE_NOT_FOUND              = 28,
+
+  ERR_BAD_CHECKSUM                 = 29, ///< Data doesn't match checksum, it was written not by stack operations
+
+  ERR_BLOCK_SPILLED                = 30, ///< Block is in spill file, or stack with memory budget can't share blocks
+
+  ERR_BLOCK_PACKED                 = 31, ///< Block is compressed, or stack with packing can't share blocks
+
+  ERR_STACK_NOT_SHARED             = 32, ///< Stack isn't shared with readers, or its mapped or guarded data can't be
+
+  NR_RETURN_CODE                   = 33, ///< Last return code
 };
 
 #endif // RETURN_CODES_H
@@ -19,5 +19,29 @@ IogStackReturnCode iog_check_second_stack_canary (const IogStack_t *stack);
 IogStackReturnCode iog_check_first_data_canary   (const IogStack_t *stack);
 IogStackReturnCode iog_check_second_data_canary  (const IogStack_t *stack);
 
+IogStackReturnCode iog_check_policy_hysteresis   (); ///< Test that boundary oscillation doesn't reallocate
+IogStackReturnCode iog_check_recalloc_tail       (); ///< Test that resize keeps data and zeroes new tail
+IogStackReturnCode iog_check_bulk_ops            (); ///< Test push_n/pop_n/peek_n against single ops
+IogStackReturnCode iog_check_verify_levels       (); ///< Test what each verify level catches
+IogStackReturnCode iog_check_tstack_types        (); ///< Test IogTStack_t with integer, struct and string
+IogStackReturnCode iog_check_inline_storage      (); ///< Test spill from inline buffer to heap and back
+IogStackReturnCode iog_check_seg_stack           (); ///< Test segmented stack order, stable pointers, canaries
+IogStackReturnCode iog_check_guard_pages         (); ///< Test that write past guarded data traps
+IogStackReturnCode iog_check_stack_stats         (); ///< Test operation counters and stats dump
+IogStackReturnCode iog_check_lf_stack            (); ///< Test lock-free stack from several threads
+IogStackReturnCode iog_check_ws_deque            (); ///< Test work-stealing deque with thieves
+IogStackReturnCode iog_check_mem_arena           (); ///< Test size classes, thread pool and arena reset
+IogStackReturnCode iog_check_mapped_stack        (); ///< Test restore of file-backed stack and its checks
+IogStackReturnCode iog_check_seg_snapshot        (); ///< Test snapshot, restore and fork of segmented stack
+IogStackReturnCode iog_check_mark_rollback       (); ///< Test nested marks and rollback without reallocation
+IogStackReturnCode iog_check_pop_poisoning       (); ///< Test pop leaves free slots untouched and poisoned
+IogStackReturnCode iog_check_save_load           (); ///< Test binary image round trip, corrupted images and window dump
+IogStackReturnCode iog_check_vm                  (); ///< Test assembler, blocks, growth and errors of stack machine
+IogStackReturnCode iog_check_aggregates          (); ///< Test tracked min, max, sum and vector reductions
+IogStackReturnCode iog_check_checksum            (); ///< Test checksum updates, corruption detection and kernels
+IogStackReturnCode iog_check_seg_spill           (); ///< Test memory budget, file round trip and slot corruption
+IogStackReturnCode iog_check_seg_pack            (); ///< Test value coding and compressed cold blocks of segmented stack
+IogStackReturnCode iog_check_stack_share         (); ///< Test seqlock reads of stack grown and shrunk by writer thread
+
 
 #endif // IOG_STACK_TESTS_H
@@ -0,0 +1,595 @@
+#ifndef IOG_TSTACK_H
+#define IOG_TSTACK_H
+
+#include <stdio.h>
+#include <string.h>
+
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "iog_stack.h"
+#include "iog_memlib.h"
+#include "iog_assert.h"
+#include "cli_colors.h"
+
+/** @file iog_tstack.h
+ * Type-generic stack with the same canaries, verify levels and policy as IogStack_t.
+ * Data buffer is [canary][padding][T * capacity][padding][canary], paddings keep
+ * alignment of T and canaries. Trivially copyable types are moved with memcpy and
+ * resized in place by iog_mem_resize, other types are moved one by one.
+ */
+
+/// Macros calls dump function with extra information about calling.
+#define IOG_TSTACK_DUMP(stack) {                                                     \
+  iog_tstack_dump_f(stack, stdout, #stack, __FILE__, __LINE__, __PRETTY_FUNCTION__); \
+}
+
+/** @struct IogStackFormat
+ * Prints one element in dump. Specialize it for own types,
+ * by default element is printed as hex bytes.
+ */
+template <typename T>
+struct IogStackFormat {
+  static void print (FILE *stream, const T &value) {
+    const unsigned char *bytes = (const unsigned char *) &value;
+
+    fprintf(stream, "0x");
+    for (size_t i = 0; i < sizeof(T); i++)
+      fprintf(stream, "%02x", bytes[i]);
+  }
+};
+
+/// Defines IogStackFormat for type that is printed with one printf format
+#define IOG_STACK_FORMAT(type, format)                   \
+template <>                                              \
+struct IogStackFormat<type> {                            \
+  static void print (FILE *stream, const type &value) {  \
+    fprintf(stream, format, value);                      \
+  }                                                      \
+};
+
+IOG_STACK_FORMAT(double,             "%lg")
+IOG_STACK_FORMAT(float,              "%g")
+IOG_STACK_FORMAT(int,                "%d")
+IOG_STACK_FORMAT(long,               "%ld")
+IOG_STACK_FORMAT(long long,          "%lld")
+IOG_STACK_FORMAT(unsigned,           "%u")
+IOG_STACK_FORMAT(unsigned long,      "%lu")
+IOG_STACK_FORMAT(unsigned long long, "%llu")
+
+/** @struct IogTStack_t
+ * Defines stack of T, fields have the same meaning as in IogStack_t
+ */
+template <typename T>
+struct IogTStack_t {
+  static_assert(alignof(T) <= alignof(max_align_t), "over-aligned types aren't supported");
+
+  iog_canary_t firstStackCanary;  ///< First stack canary equal constant + pointer
+
+  iog_canary_t *firstDataCanary;  ///< Pointer to first data canary
+  T *data;                        ///< Pointer to array with data
+  iog_canary_t *secondDataCanary; ///< Pointer to second data canary
+
+  iog_flag_t isInitialized;       ///< Flag of initialization
+  size_t size;                    ///< Amount of valuable elements in data
+  size_t capacity;                ///< Size of allocated memory for data
+  IogStackPolicy_t policy;        ///< Growth and shrink policy
+  IogStackVerifyLevel verifyLevel; ///< Checks run by stack operations
+  iog_flag_t fastPath;            ///< 1 if initialized and verify level is off, so push skips checks
+  size_t shrinkSize;              ///< Pop to this size or less may shrink data
+
+  iog_canary_t secondStackCanary; ///< Second stack canary equal constant + pointer
+};
+
+//--------------------- PRIVATE FUNCTIONS --------------------------------------------
+
+/**
+ * @param[in] value number to round
+ * @param[in] align power of two
+ * @return value rounded up to align
+ */
+constexpr size_t iog_tstack_align_up (size_t value, size_t align) {
+  return (value + align - 1) / align * align;
+}
+
+/// Offset of data from first data canary
+template <typename T>
+constexpr size_t iog_tstack_data_offset () {
+  return iog_tstack_align_up(sizeof(iog_canary_t), alignof(T));
+}
+
+/// Offset of second data canary from first data canary
+template <typename T>
+constexpr size_t iog_tstack_second_canary_offset (size_t capacity) {
+  return iog_tstack_align_up(iog_tstack_data_offset<T>() + capacity * sizeof(T), alignof(iog_canary_t));
+}
+
+/// Bytes of data buffer with both canaries
+template <typename T>
+constexpr size_t iog_tstack_data_bytes (size_t capacity) {
+  return iog_tstack_second_canary_offset<T>(capacity) + sizeof(iog_canary_t);
+}
+
+/**
+ * @param[in] stack pointer to stack
+ * @return stack verify level with default resolved and clamped by IOG_STACK_VERIFY_LEVEL
+ */
+template <typename T>
+int iog_tstack_effective_verify_level (const IogTStack_t<T> *stack) {
+  int level = stack->verifyLevel;
+  if (level == IOG_VERIFY_DEFAULT)
+    level = IOG_STACK_DEFAULT_VERIFY_LEVEL;
+
+  if (level > IOG_STACK_VERIFY_LEVEL)
+    level = IOG_STACK_VERIFY_LEVEL;
+
+  return level;
+}
+
+template <typename T> IogStackReturnCode iog_tstack_verify          (const IogTStack_t<T> *stack);
+template <typename T> IogStackReturnCode iog_tstack_verify_canaries (const IogTStack_t<T> *stack);
+template <typename T> IogStackReturnCode iog_tstack_update_canaries (IogTStack_t<T> *stack);
+template <typename T> IogStackReturnCode iog_tstack_destroy         (IogTStack_t<T> *stack);
+
+/**
+ * Runs checks chosen by stack verify level, see iog_stack_check.
+ * @param[in] stack pointer to stack
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+template <typename T>
+IogStackReturnCode iog_tstack_check (const IogTStack_t<T> *stack) {
+  IOG_CHECK_STACK_NULL( stack );
+
+#if IOG_STACK_VERIFY_LEVEL > 1
+  int level = iog_tstack_effective_verify_level(stack);
+
+  if (level >= IOG_VERIFY_FULL)
+    return iog_tstack_verify(stack);
+
+  if (level == IOG_VERIFY_CANARIES)
+    return iog_tstack_verify_canaries(stack);
+#endif // IOG_STACK_VERIFY_LEVEL > 1
+
+  return OK;
+}
+
+/**
+ * Allocates max( new_capacity, INIT_STACK_DATA_CAPACITY ), canaries must be updated by caller.
+ * @param[in] stack        pointer to stack
+ * @param[in] new_capacity new capacity of stack data
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+template <typename T>
+IogStackReturnCode iog_tstack_allocate_data (IogTStack_t<T> *stack, size_t new_capacity) {
+  IOG_CHECK_STACK_NULL(stack);
+
+  if (new_capacity < INIT_STACK_DATA_CAPACITY)
+    new_capacity = INIT_STACK_DATA_CAPACITY;
+
+  size_t old_bytes = (stack->firstDataCanary != NULL) ? iog_tstack_data_bytes<T>(stack->capacity) : 0;
+  size_t new_bytes = iog_tstack_data_bytes<T>(new_capacity);
+
+  char *new_buffer = NULL;
+
+  if constexpr (std::is_trivially_copyable<T>::value) {
+    if (stack->firstDataCanary != NULL)
+      *stack->firstDataCanary = 0;
+
+    if (stack->secondDataCanary != NULL)
+      *stack->secondDataCanary = 0;
+
+    new_buffer = (char *) iog_mem_resize(stack->policy.arena, stack->firstDataCanary, old_bytes, new_bytes);
+
+    if (new_buffer == NULL) {
+      if (stack->data != NULL)
+        iog_tstack_update_canaries(stack);
+
+      return ERR_CANT_ALLOCATE_DATA;
+    }
+  } else {
+    new_buffer = (char *) iog_mem_resize(stack->policy.arena, NULL, 0, new_bytes);
+
+    if (new_buffer == NULL)
+      return ERR_CANT_ALLOCATE_DATA;
+
+    T *new_data = (T *) (new_buffer + iog_tstack_data_offset<T>());
+    for (size_t i = 0; i < stack->size; i++) {
+      new (new_data + i) T(std::move(stack->data[i]));
+      stack->data[i].~T();
+    }
+
+    iog_mem_free(stack->policy.arena, stack->firstDataCanary, old_bytes);
+  }
+
+  stack->firstDataCanary  = (iog_canary_t *) new_buffer;
+  stack->data             = (T *) (new_buffer + iog_tstack_data_offset<T>());
+  stack->secondDataCanary = (iog_canary_t *) (new_buffer + iog_tstack_second_canary_offset<T>(new_capacity));
+
+  stack->capacity = new_capacity;
+  stack->shrinkSize = (stack->policy.neverShrink || new_capacity <= stack->policy.minCapacity) ?
+                      0 : new_capacity / stack->policy.shrinkDivisor;
+
+  return OK;
+}
+
+/**
+ * Resizes data to fit min_capacity by policy.growFactor, or shrinks it by policy.shrinkHeadroom.
+ * @param[in] stack        pointer to stack
+ * @param[in] min_capacity required capacity
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+template <typename T>
+IogStackReturnCode iog_tstack_resize (IogTStack_t<T> *stack, size_t min_capacity) {
+  size_t new_capacity = stack->capacity;
+
+  if (min_capacity > new_capacity) {
+    while (new_capacity < min_capacity) {
+      size_t next_capacity = (size_t) ((double) new_capacity * stack->policy.growFactor);
+
+      new_capacity = (next_capacity > new_capacity) ? next_capacity : new_capacity + 1;
+    }
+  } else {
+    new_capacity = stack->size * stack->policy.shrinkHeadroom;
+    if (new_capacity < stack->policy.minCapacity)
+      new_capacity = stack->policy.minCapacity;
+
+    if (new_capacity >= stack->capacity)
+      return OK;
+  }
+
+  if (iog_tstack_allocate_data(stack, new_capacity) != OK)
+    return ERR_CANT_ALLOCATE_DATA;
+
+  iog_tstack_update_canaries(stack);
+
+  IOG_RETURN_IF_ERROR( iog_tstack_check(stack) );
+
+  return OK;
+}
+
+/**
+ * Inline push skips checks only if this flag is set.
+ * @param[out] stack pointer to stack
+ */
+template <typename T>
+void iog_tstack_update_fast_path (IogTStack_t<T> *stack) {
+  stack->fastPath = stack->isInitialized && iog_tstack_effective_verify_level(stack) <= IOG_VERIFY_OFF;
+}
+
+//--------------------- PUBLIC FUNCTIONS --------------------------------------------
+
+/**
+ * @param[in] stack pointer to stack
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+template <typename T>
+IogStackReturnCode iog_tstack_update_canaries (IogTStack_t<T> *stack) {
+  IOG_CHECK_STACK_NULL( stack );
+
+  stack->firstStackCanary  = STACK_CANARY_CONST + (iog_canary_t) stack;
+  stack->secondStackCanary = STACK_CANARY_CONST + (iog_canary_t) stack;
+
+  if (stack->data == NULL)
+    return ERR_STACK_DATA_NULLPTR;
+
+  *stack->firstDataCanary  = DATA_CANARY_CONST + (iog_canary_t) stack->data;
+  *stack->secondDataCanary = DATA_CANARY_CONST + (iog_canary_t) stack->data;
+
+  return OK;
+}
+
+/**
+ * Allocates data with max(INIT_STACK_DATA_CAPACITY, policy->minCapacity) elements
+ * from policy->arena. Guard pages aren't supported, policy with guardPages is rejected.
+ * @param[out] stack  pointer to stack
+ * @param[in]  policy growth and shrink policy (if NULL then IOG_STACK_DEFAULT_POLICY)
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+template <typename T>
+IogStackReturnCode iog_tstack_init (IogTStack_t<T> *stack, const IogStackPolicy_t *policy = NULL) {
+  IOG_CHECK_STACK_NULL( stack );
+
+  if (stack->isInitialized)
+    return ERR_STACK_ALREADY_INITIALIZED;
+
+  if (policy == NULL)
+    policy = &IOG_STACK_DEFAULT_POLICY;
+
+  IOG_RETURN_IF_ERROR( iog_stack_policy_check(policy) );
+  if (policy->guardPages)
+    return ERR_INVALID_POLICY;
+
+  stack->policy = *policy;
+  if (stack->policy.minCapacity < INIT_STACK_DATA_CAPACITY)
+    stack->policy.minCapacity = INIT_STACK_DATA_CAPACITY;
+
+  if (stack->policy.arena == NULL)
+    stack->policy.arena = iog_mem_bound_arena();
+
+  stack->size = 0;
+  stack->verifyLevel = IOG_VERIFY_DEFAULT;
+
+  IogStackReturnCode alloc_err = iog_tstack_allocate_data(stack, stack->policy.minCapacity);
+  if (alloc_err != OK) {
+    iog_tstack_destroy(stack);
+    return alloc_err;
+  }
+
+  iog_tstack_update_canaries(stack);
+
+  stack->isInitialized = 1;
+  iog_tstack_update_fast_path(stack);
+
+  IOG_RETURN_IF_ERROR( iog_tstack_check(stack) );
+
+  return OK;
+}
+
+/**
+ * Destroys elements, frees data and resets stack to zero
+ * @param[out] stack pointer to stack
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+template <typename T>
+IogStackReturnCode iog_tstack_destroy (IogTStack_t<T> *stack) {
+  IOG_CHECK_STACK_NULL( stack );
+
+  if constexpr (!std::is_trivially_destructible<T>::value) {
+    for (size_t i = 0; i < stack->size; i++)
+      stack->data[i].~T();
+  }
+
+  if (stack->firstDataCanary != NULL)
+    iog_mem_free(stack->policy.arena, stack->firstDataCanary, iog_tstack_data_bytes<T>(stack->capacity));
+
+  stack->data = NULL;
+  stack->firstDataCanary  = NULL;
+  stack->secondDataCanary = NULL;
+
+  stack->firstStackCanary  = 0;
+  stack->secondStackCanary = 0;
+
+  stack->size = 0;
+  stack->capacity = 0;
+  stack->isInitialized = 0;
+  stack->verifyLevel = IOG_VERIFY_DEFAULT;
+  stack->fastPath = 0;
+  stack->shrinkSize = 0;
+
+  return OK;
+}
+
+/**
+ * Moves value to the end of data, grows data if it's full.
+ * Value is taken by copy, so it may be element of the same stack.
+ * @param[out] stack pointer to stack (can't be NULL)
+ * @param[in]  value new stack value
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+template <typename T>
+IogStackReturnCode iog_tstack_push (IogTStack_t<T> *stack, T value) {
+  if (IOG_UNLIKELY(stack == NULL || !stack->fastPath || stack->size == stack->capacity)) {
+    IOG_RETURN_IF_ERROR( iog_tstack_check(stack) );
+
+    if (stack->size == stack->capacity) {
+      IOG_RETURN_IF_ERROR( iog_tstack_resize(stack, stack->capacity + 1) );
+    }
+  }
+
+  if constexpr (std::is_trivially_copyable<T>::value)
+    memcpy((void *) (stack->data + stack->size), &value, sizeof(T));
+  else
+    new (stack->data + stack->size) T(std::move(value));
+
+  stack->size++;
+
+  return OK;
+}
+
+/**
+ * Moves top value to *value and removes it, shrinks data by policy.
+ * @param[out] stack pointer to stack
+ * @param[out] value pointer to variable in which want to write (can't be null)
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+template <typename T>
+IogStackReturnCode iog_tstack_pop (IogTStack_t<T> *stack, T *value) {
+  IOG_ASSERT(value);
+
+  IOG_RETURN_IF_ERROR( iog_tstack_check(stack) );
+
+  if (stack->size == 0)
+    return ERR_STACK_UNDERFLOW;
+
+  stack->size--;
+
+  if constexpr (std::is_trivially_copyable<T>::value) {
+    memcpy((void *) value, stack->data + stack->size, sizeof(T));
+    memset((void *) (stack->data + stack->size), 0, sizeof(T));
+  } else {
+    *value = std::move(stack->data[stack->size]);
+    stack->data[stack->size].~T();
+  }
+
+  if (stack->size <= stack->shrinkSize) {
+    IOG_RETURN_IF_ERROR( iog_tstack_resize(stack, stack->size) );
+  }
+
+  return OK;
+}
+
+/**
+ * @param[in]  stack pointer to stack (can't be NULL)
+ * @param[out] value pointer to variable in which want to write
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+template <typename T>
+IogStackReturnCode iog_tstack_peek (const IogTStack_t<T> *stack, T *value) {
+  IOG_ASSERT(value);
+
+  IOG_RETURN_IF_ERROR( iog_tstack_check(stack) );
+
+  if (stack->size == 0)
+    return ERR_STACK_UNDERFLOW;
+
+  *value = stack->data[stack->size - 1];
+
+  return OK;
+}
+
+/**
+ * Checks nullptrs, overflowing, intialization and canaries, like iog_stack_verify.
+ * @param[in] stack pointer to stack
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+template <typename T>
+IogStackReturnCode iog_tstack_verify (const IogTStack_t<T> *stack) {
+  IOG_CHECK_STACK_NULL( stack );
+
+  if ((stack->firstStackCanary - STACK_CANARY_CONST) != (iog_canary_t) stack)
+    return ERR_DEAD_FIRST_CANARY;
+
+  if ((stack->secondStackCanary - STACK_CANARY_CONST) != (iog_canary_t) stack)
+    return ERR_DEAD_SECOND_CANARY;
+
+  if (!stack->isInitialized)
+    return ERR_STACK_ISNT_INITIALIZED;
+
+  if (stack->size > stack->capacity)
+    return ERR_STACK_OVERFLOW;
+
+  if (stack->capacity < INIT_STACK_DATA_CAPACITY)
+    return ERR_STACK_CAPACITY_UNDERFLOW;
+
+  if (stack->data == NULL)
+    return ERR_STACK_DATA_NULLPTR;
+
+  if (stack->firstDataCanary == NULL)
+    return ERR_FIRST_DATA_CANARY_NULLPTR;
+
+  if (stack->secondDataCanary == NULL)
+    return ERR_SECOND_DATA_CANARY_NULLPTR;
+
+  if ((*stack->firstDataCanary - DATA_CANARY_CONST) != (iog_canary_t) stack->data)
+    return ERR_DEAD_FIRST_DATA_CANARY;
+
+  if ((*stack->secondDataCanary - DATA_CANARY_CONST) != (iog_canary_t) stack->data)
+    return ERR_DEAD_SECOND_DATA_CANARY;
+
+  return OK;
+}
+
+/**
+ * Checks only stack and data canaries.
+ * @param[in] stack pointer to stack
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+template <typename T>
+IogStackReturnCode iog_tstack_verify_canaries (const IogTStack_t<T> *stack) {
+  IOG_CHECK_STACK_NULL( stack );
+
+  if ((stack->firstStackCanary - STACK_CANARY_CONST) != (iog_canary_t) stack)
+    return ERR_DEAD_FIRST_CANARY;
+
+  if ((stack->secondStackCanary - STACK_CANARY_CONST) != (iog_canary_t) stack)
+    return ERR_DEAD_SECOND_CANARY;
+
+  if (stack->firstDataCanary == NULL)
+    return ERR_FIRST_DATA_CANARY_NULLPTR;
+
+  if (stack->secondDataCanary == NULL)
+    return ERR_SECOND_DATA_CANARY_NULLPTR;
+
+  if ((*stack->firstDataCanary - DATA_CANARY_CONST) != (iog_canary_t) stack->data)
+    return ERR_DEAD_FIRST_DATA_CANARY;
+
+  if ((*stack->secondDataCanary - DATA_CANARY_CONST) != (iog_canary_t) stack->data)
+    return ERR_DEAD_SECOND_DATA_CANARY;
+
+  return OK;
+}
+
+/**
+ * @param[out] stack pointer to stack
+ * @param[in]  level new verify level
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+template <typename T>
+IogStackReturnCode iog_tstack_set_verify_level (IogTStack_t<T> *stack, IogStackVerifyLevel level) {
+  IOG_RETURN_IF_ERROR( iog_tstack_verify(stack) );
+
+  if (level < IOG_VERIFY_DEFAULT || level > IOG_VERIFY_FULL)
+    return ERR_INVALID_VERIFY_LEVEL;
+
+  stack->verifyLevel = level;
+  iog_tstack_update_fast_path(stack);
+
+  return OK;
+}
+
+/**
+ * Prints stack like iog_stack_dump_f, elements are printed by IogStackFormat<T>.
+ * @param[in]  stack         pointer to stack
+ * @param[out] stream        pointer to stream for prints
+ * @param[in]  stk_name      name of dumping stack
+ * @param[in]  file_name     name of file from that called dump
+ * @param[in]  line_num      number of line from that called dump
+ * @param[in]  function_name name of function from that called dump
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+template <typename T>
+IogStackReturnCode iog_tstack_dump_f (const IogTStack_t<T> *stack, FILE *stream,
+      const char *stk_name, const char *file_name, int line_num, const char *function_name) {
+  IOG_ASSERT(stream);
+
+  fprintf(stream, BLACK("------------ STACK DUMP ------------" "\n"));
+  fprintf(stream, BLUE("Called from %s:%d: %s\n"), file_name, line_num, function_name);
+
+  if (stack == NULL) {
+    fprintf(stream, BLACK("IogTStack_t %s (null)") " {}\n", stk_name);
+    return ERR_STACK_NULLPTR;
+  }
+
+  fprintf(stream, BLACK("IogTStack_t %s (%p, element %lu bytes) {\n"), stk_name, (const void *) stack, sizeof(T));
+
+  fprintf(stream, BLACK("  .firstStackCanary  = 0x%llx")  "\n",  stack->firstStackCanary);
+  fprintf(stream, BLACK("  .isInitialized     = %d")    "\n",  (int) stack->isInitialized);
+  fprintf(stream, BLACK("  .size              = %lu")   "\n",  stack->size);
+  fprintf(stream, BLACK("  .capacity          = %lu")   "\n",  stack->capacity);
+  fprintf(stream, BLACK("  .verifyLevel       = %d")    "\n",  (int) stack->verifyLevel);
+
+  fprintf(stream, BLACK("  .firstDataCanary  = %p")  "\n",  (const void *) stack->firstDataCanary);
+  if (stack->firstDataCanary != NULL)
+    fprintf(stream, BLACK("  *firstDataCanary  = 0x%llx")  "\n",  *stack->firstDataCanary);
+
+  fprintf(stream, BLACK("  .data[%lu] (%p)" " = ["), stack->capacity, (const void *) stack->data);
+
+  if (stack->data != NULL) {
+    fprintf(stream, "\n");
+    for (size_t i = 0; i < stack->capacity; i++) {
+      fprintf(stream, BLACK("    [%lu]: "), i);
+
+      if (i < stack->size || std::is_trivially_copyable<T>::value)
+        IogStackFormat<T>::print(stream, stack->data[i]);
+      else
+        fprintf(stream, "-");
+
+      fprintf(stream, "\n");
+    }
+  }
+
+  fprintf(stream, BLACK("  ]\n"));
+
+  fprintf(stream, BLACK("  .secondDataCanary  = %p")  "\n",  (const void *) stack->secondDataCanary);
+  if (stack->secondDataCanary != NULL)
+    fprintf(stream, BLACK("  *secondDataCanary  = 0x%llx")  "\n",  *stack->secondDataCanary);
+
+  fprintf(stream, BLACK("  .secondStackCanary = 0x%llx")  "\n",  stack->secondStackCanary);
+  fprintf(stream, BLACK("}\n"));
+  fprintf(stream, BLACK("------------------------------------\n"));
+
+  return OK;
+}
+
+#endif // IOG_TSTACK_H
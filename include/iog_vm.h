@@ -0,0 +1,107 @@
+#ifndef IOG_VM_H
+#define IOG_VM_H
+
+#include <stdio.h>
+
+#include "iog_stack_return_codes.h"
+#include "iog_stack.h"
+
+/** @file iog_vm.h
+ * Stack machine on top of IogStack_t: operands live in stack data, top value is kept
+ * in register. Link splits bytecode into basic blocks and puts IOG_VM_BLOCK before each,
+ * it checks stack depth and capacity for whole block once, so other instructions run
+ * without checks. Stack is verified only at block entry (if its verify level isn't off).
+ */
+
+#ifndef IOG_VM_THREADED
+#if defined(__GNUC__)
+#define IOG_VM_THREADED 1 ///< Dispatch by computed goto (GNU extension)
+#else
+#define IOG_VM_THREADED 0 ///< Dispatch by switch
+#endif
+#endif // IOG_VM_THREADED
+
+/// Macros calls dump function with extra information about calling.
+#define IOG_VM_PROGRAM_DUMP(program) {                                                     \
+  iog_vm_program_dump_f(program, stdout, #program, __FILE__, __LINE__, __PRETTY_FUNCTION__); \
+}
+
+const size_t IOG_VM_MAX_LABEL_LEN = 32; ///< Longest label name of assembler
+
+/** @enum IogVmOpcode
+ * Defines instructions. Stack effect is written as (before -- after), top is on the right.
+ */
+enum IogVmOpcode {
+  IOG_VM_HALT  = 0,  ///< Stop, result gets top value (stack isn't changed)
+  IOG_VM_BLOCK = 1,  ///< Start of basic block, added by link
+  IOG_VM_PUSH  = 2,  ///< ( -- value)
+  IOG_VM_LOAD  = 3,  ///< ( -- args[index])
+  IOG_VM_POP   = 4,  ///< (a -- )
+  IOG_VM_DUP   = 5,  ///< (a -- a a)
+  IOG_VM_SWAP  = 6,  ///< (a b -- b a)
+  IOG_VM_OVER  = 7,  ///< (a b -- a b a)
+  IOG_VM_ADD   = 8,  ///< (a b -- a+b)
+  IOG_VM_SUB   = 9,  ///< (a b -- a-b)
+  IOG_VM_MUL   = 10, ///< (a b -- a*b)
+  IOG_VM_DIV   = 11, ///< (a b -- a/b)
+  IOG_VM_NEG   = 12, ///< (a -- -a)
+  IOG_VM_LT    = 13, ///< (a b -- a<b)
+  IOG_VM_EQ    = 14, ///< (a b -- a==b)
+  IOG_VM_JMP   = 15, ///< Go to index
+  IOG_VM_JZ    = 16, ///< (a -- ), go to index if a is 0
+  IOG_VM_JNZ   = 17, ///< (a -- ), go to index if a isn't 0
+
+  IOG_VM_NR_OPCODE = 18, ///< Amount of opcodes
+};
+
+/** @struct IogVmInstr_t
+ * One instruction of bytecode
+ */
+struct IogVmInstr_t {
+  IogVmOpcode op;          ///< Opcode
+  size_t index;            ///< Jump target, argument index (LOAD) or values needed by block (BLOCK)
+  size_t grow;             ///< Values block may add above entry size (BLOCK)
+  iog_stack_value_t value; ///< Constant (PUSH)
+};
+
+/** @struct IogVmProgram_t
+ * Defines bytecode program
+ */
+struct IogVmProgram_t {
+  IogVmInstr_t *code; ///< Array of instructions
+  size_t size;        ///< Amount of instructions
+  size_t capacity;    ///< Capacity of code array
+  size_t argsNum;     ///< Arguments used by LOAD (after link)
+  iog_flag_t isLinked; ///< Flag of link, linked program can be run but not changed
+};
+
+/** @struct IogVmLabel_t
+ * Label of assembler source
+ */
+struct IogVmLabel_t {
+  char name[IOG_VM_MAX_LABEL_LEN + 1]; ///< Name without colon
+  size_t index;                        ///< Index of next instruction
+};
+
+//--------------------- PUBLIC FUNCTIONS --------------------------------------------
+
+IogStackReturnCode iog_vm_program_init    (IogVmProgram_t *program); ///< Initialize empty program
+IogStackReturnCode iog_vm_program_destroy (IogVmProgram_t *program); ///< Free code
+
+/// Append instruction, jump targets are indexes of emitted instructions
+IogStackReturnCode iog_vm_emit (IogVmProgram_t *program, IogVmOpcode op, size_t index = 0, iog_stack_value_t value = 0);
+/// Check program, split it into basic blocks and compute their stack use
+IogStackReturnCode iog_vm_link (IogVmProgram_t *program);
+
+/// Emit and link program written in text, error_line gets line of first error
+IogStackReturnCode iog_vm_assemble (IogVmProgram_t *program, const char *source, size_t *error_line = NULL);
+
+/// Run program on stack, result gets top value at HALT (may be NULL)
+IogStackReturnCode iog_vm_run (const IogVmProgram_t *program, IogStack_t *stack,
+    const iog_stack_value_t *args, size_t args_num, iog_stack_value_t *result);
+
+/// Print program listing to stream (file)
+IogStackReturnCode iog_vm_program_dump_f (const IogVmProgram_t *program, FILE *stream,
+    const char *prog_name, const char *file_name, int line_num, const char *function_name);
+
+#endif // IOG_VM_H
@@ -0,0 +1,184 @@
+#ifndef IOG_WS_DEQUE_H
+#define IOG_WS_DEQUE_H
+
+#include <stdio.h>
+
+#include <atomic>
+
+#include "iog_stack_return_codes.h"
+#include "iog_stack.h"
+
+/** @file iog_ws_deque.h
+ * Work-stealing deque (Chase-Lev): owner thread pushes and pops at bottom like IogStack_t,
+ * other threads steal oldest elements from top with one CAS. Circular buffer grows
+ * by owner only, old buffers stay readable for thieves until destroy.
+ */
+
+/// Macros calls dump function with extra information about calling.
+#define IOG_WS_DEQUE_DUMP(deque) {                                                     \
+  iog_ws_deque_dump_f(deque, stdout, #deque, __FILE__, __LINE__, __PRETTY_FUNCTION__); \
+}
+
+const size_t IOG_WS_DEFAULT_CAPACITY = 64; ///< Initial capacity of buffer by default
+
+typedef long long iog_ws_index_t; ///< Definition of deque index type (only grows)
+
+typedef std::atomic<iog_stack_value_t> iog_ws_slot_t; ///< Element slot, read by thieves while owner writes
+
+static_assert(sizeof(iog_ws_slot_t) == sizeof(iog_stack_value_t) && iog_ws_slot_t::is_always_lock_free,
+              "deque buffer layout expects lock-free slots of element size");
+
+/** @struct IogWsBuffer_t
+ * Header of circular buffer, followed by data[capacity] and second data canary.
+ */
+struct IogWsBuffer_t {
+  IogWsBuffer_t *prev;          ///< Smaller buffer replaced by this one (kept for thieves)
+  size_t capacity;              ///< Amount of slots, power of 2
+  iog_canary_t firstDataCanary; ///< Canary before data, equal constant + data pointer
+};
+
+/** @struct IogWsDeque_t
+ * Defines work-stealing deque structure.
+ * Push and pop may be called only by owner thread, steal by any thread.
+ * Init, destroy, verify, dump and set_verify_level need exclusive access.
+ */
+struct IogWsDeque_t {
+  iog_canary_t firstStackCanary; ///< First stack canary equal constant + pointer
+
+  alignas(64) std::atomic<iog_ws_index_t> top; ///< Index of oldest element, moved by steal
+  alignas(64) std::atomic<iog_ws_index_t> bottom; ///< Index after newest element, moved by owner
+  std::atomic<IogWsBuffer_t *> buffer;         ///< Current buffer
+
+  iog_flag_t isInitialized;        ///< Flag of initialization
+  IogStackVerifyLevel verifyLevel; ///< Checks run by deque operations
+  iog_flag_t fastPath;             ///< 1 if initialized and verify level is off, so inline ops skip checks
+
+  iog_canary_t secondStackCanary; ///< Second stack canary equal constant + pointer
+};
+
+//--------------------- PUBLIC FUNCTIONS --------------------------------------------
+
+/// Initialize empty deque, capacity is rounded up to power of 2
+IogStackReturnCode iog_ws_deque_init    (IogWsDeque_t *deque, size_t capacity = IOG_WS_DEFAULT_CAPACITY);
+IogStackReturnCode iog_ws_deque_destroy (IogWsDeque_t *deque); ///< Free all buffers
+
+static inline IogStackReturnCode iog_ws_deque_push (IogWsDeque_t *deque, iog_stack_value_t value);  ///< Owner: add value
+static inline IogStackReturnCode iog_ws_deque_pop  (IogWsDeque_t *deque, iog_stack_value_t *value); ///< Owner: take newest
+
+/// Any thread: take oldest value (ERR_STEAL_LOST if other thread took it first)
+IogStackReturnCode iog_ws_deque_steal (IogWsDeque_t *deque, iog_stack_value_t *value);
+
+/// Approximate amount of elements (exact if no thread modifies deque)
+size_t iog_ws_deque_size (const IogWsDeque_t *deque);
+
+/// Print all deque info to stream (file)
+IogStackReturnCode iog_ws_deque_dump_f (const IogWsDeque_t *deque, FILE *stream,
+    const char *dq_name, const char *file_name, int line_num, const char *function_name);
+
+IogStackReturnCode iog_ws_deque_verify (const IogWsDeque_t *deque); ///< Verify deque, buffer and canaries
+
+/// Choose checks run by operations of this deque (clamped by IOG_STACK_VERIFY_LEVEL)
+IogStackReturnCode iog_ws_deque_set_verify_level (IogWsDeque_t *deque, IogStackVerifyLevel level);
+
+//--------------------- SLOW PATHS --------------------------------------------------
+
+/// Push with checks and growth, called when inline push can't handle the case
+IOG_COLD IogStackReturnCode iog_ws_deque_push_slow (IogWsDeque_t *deque, iog_stack_value_t value);
+/// Pop with checks, called when deque isn't on fast path
+IOG_COLD IogStackReturnCode iog_ws_deque_pop_slow  (IogWsDeque_t *deque, iog_stack_value_t *value);
+
+//--------------------- INLINE FAST PATHS -------------------------------------------
+
+/**
+ * @param[in] buffer pointer to buffer
+ * @return pointer to first slot of buffer
+ */
+static inline iog_ws_slot_t *iog_ws_buffer_data (IogWsBuffer_t *buffer) {
+  return (iog_ws_slot_t *) (buffer + 1);
+}
+
+/**
+ * Slots of const buffer are only loaded (by dump and verify).
+ * @param[in] buffer pointer to buffer
+ * @return pointer to first slot of buffer
+ */
+static inline const iog_ws_slot_t *iog_ws_buffer_data (const IogWsBuffer_t *buffer) {
+  return (const iog_ws_slot_t *) (buffer + 1);
+}
+
+/**
+ * Owner pop without checks: claims bottom element, races with thieves by CAS only for last one.
+ * @param[out] deque pointer to deque (can't be NULL)
+ * @param[out] value pointer to variable in which want to write
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static inline IogStackReturnCode iog_ws_deque_take (IogWsDeque_t *deque, iog_stack_value_t *value) {
+  iog_ws_index_t bottom = deque->bottom.load(std::memory_order_relaxed) - 1;
+  IogWsBuffer_t *buffer = deque->buffer.load(std::memory_order_relaxed);
+
+  deque->bottom.store(bottom, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+
+  iog_ws_index_t top = deque->top.load(std::memory_order_relaxed);
+
+  if (IOG_UNLIKELY(top > bottom)) {
+    deque->bottom.store(bottom + 1, std::memory_order_relaxed);
+    return ERR_STACK_UNDERFLOW;
+  }
+
+  *value = iog_ws_buffer_data(buffer)[(size_t) bottom & (buffer->capacity - 1)].load(std::memory_order_relaxed);
+
+  if (top == bottom) {
+    IogStackReturnCode err = OK;
+
+    if (!deque->top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+      err = ERR_STACK_UNDERFLOW;
+
+    deque->bottom.store(bottom + 1, std::memory_order_relaxed);
+    return err;
+  }
+
+  return OK;
+}
+
+/**
+ * Stores value without checks if deque is on fast path and buffer has free slot,
+ * otherwise calls iog_ws_deque_push_slow.
+ * @param[out] deque pointer to deque (can't be NULL)
+ * @param[in]  value new value
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static inline IogStackReturnCode iog_ws_deque_push (IogWsDeque_t *deque, iog_stack_value_t value) {
+  if (IOG_LIKELY(deque != NULL && deque->fastPath)) {
+    iog_ws_index_t bottom = deque->bottom.load(std::memory_order_relaxed);
+    iog_ws_index_t top    = deque->top.load(std::memory_order_acquire);
+    IogWsBuffer_t *buffer = deque->buffer.load(std::memory_order_relaxed);
+
+    if (IOG_LIKELY(bottom - top < (iog_ws_index_t) buffer->capacity)) {
+      iog_ws_buffer_data(buffer)[(size_t) bottom & (buffer->capacity - 1)].store(value, std::memory_order_relaxed);
+
+      std::atomic_thread_fence(std::memory_order_release);
+      deque->bottom.store(bottom + 1, std::memory_order_relaxed);
+
+      return OK;
+    }
+  }
+
+  return iog_ws_deque_push_slow(deque, value);
+}
+
+/**
+ * Takes newest value without checks if deque is on fast path,
+ * otherwise calls iog_ws_deque_pop_slow.
+ * @param[out] deque pointer to deque (can't be NULL)
+ * @param[out] value pointer to variable in which want to write (can't be null)
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static inline IogStackReturnCode iog_ws_deque_pop (IogWsDeque_t *deque, iog_stack_value_t *value) {
+  if (IOG_LIKELY(deque != NULL && deque->fastPath))
+    return iog_ws_deque_take(deque, value);
+
+  return iog_ws_deque_pop_slow(deque, value);
+}
+
+#endif // IOG_WS_DEQUE_H
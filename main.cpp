@@ -37,6 +37,29 @@ int main(const int argc, const char *argv[]) {
   printf(MAGENTA("---------------- START TESTS -----------------\n"));
 
   iog_stack_canaries_check(&stk);
+  iog_check_policy_hysteresis();
+  iog_check_recalloc_tail();
+  iog_check_bulk_ops();
+  iog_check_verify_levels();
+  iog_check_tstack_types();
+  iog_check_inline_storage();
+  iog_check_seg_stack();
+  iog_check_guard_pages();
+  iog_check_stack_stats();
+  iog_check_lf_stack();
+  iog_check_ws_deque();
+  iog_check_mem_arena();
+  iog_check_mapped_stack();
+  iog_check_seg_snapshot();
+  iog_check_mark_rollback();
+  iog_check_pop_poisoning();
+  iog_check_save_load();
+  iog_check_vm();
+  iog_check_aggregates();
+  iog_check_checksum();
+  iog_check_seg_spill();
+  iog_check_seg_pack();
+  iog_check_stack_share();
 
   printf(MAGENTA("---------------- END TESTS -----------------\n"));
 
@@ -0,0 +1,529 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "iog_assert.h"
+#include "iog_lf_stack.h"
+#include "cli_colors.h"
+#include "iog_memlib.h"
+
+/// Index of thread slot, released when thread exits
+struct IogLfThreadIndex_t {
+  int index; ///< Index in IogLfStack_t.threads (-1 if not taken yet)
+
+  ~IogLfThreadIndex_t();
+};
+
+static std::atomic<iog_flag_t> IOG_LF_INDEX_BUSY[IOG_LF_MAX_THREADS] = {}; ///< Taken thread indexes
+static thread_local IogLfThreadIndex_t IOG_LF_THREAD = {-1};
+
+/// Marker left in elimination slot by pop that took offered node
+static IogLfNode_t IOG_LF_TAKEN = {};
+
+/**
+ * Node lists stay in thread slots of stacks, next thread with this index reuses them.
+ */
+IogLfThreadIndex_t::~IogLfThreadIndex_t() {
+  if (index >= 0)
+    IOG_LF_INDEX_BUSY[index].store(0, std::memory_order_release);
+}
+
+//--------------------- PRIVATE FUNCTIONS --------------------------------------------
+
+static IogStackReturnCode iog_lf_stack_check (const IogLfStack_t *stack); ///< Checks by verify level
+static int                iog_lf_stack_level (const IogLfStack_t *stack); ///< Effective verify level
+
+static int iog_lf_thread_index (); ///< Index of current thread in thread slots (-1 if all are busy)
+
+static IogLfNode_t *iog_lf_node_get    (IogLfThreadSlot_t *slot); ///< Take free node or allocate
+static void         iog_lf_node_put    (IogLfThreadSlot_t *slot, IogLfNode_t *node); ///< Cache or free node
+static void         iog_lf_node_retire (IogLfStack_t *stack, IogLfThreadSlot_t *slot, IogLfNode_t *node);
+static void         iog_lf_scan        (IogLfStack_t *stack, IogLfThreadSlot_t *slot); ///< Reuse unprotected nodes
+static void         iog_lf_free_list   (IogLfNode_t *node); ///< Free linked list of nodes
+
+static int iog_lf_eliminate_push (IogLfStack_t *stack, IogLfNode_t *node); ///< Give node to colliding pop
+/// Take node of colliding push
+static int iog_lf_eliminate_pop  (IogLfStack_t *stack, IogLfThreadSlot_t *slot, iog_stack_value_t *value);
+static size_t iog_lf_random_slot (); ///< Random index in elimination array
+
+//--------------------- PUBLIC FUNCTIONS --------------------------------------------
+
+/**
+ * Turns isInitialized flag to 1, stack starts empty without allocations.
+ * @param[out] stack       pointer to stack
+ * @param[in]  elimination 1 to exchange values of colliding push and pop in elimination array
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_lf_stack_init (IogLfStack_t *stack, iog_flag_t elimination) {
+  IOG_CHECK_STACK_NULL( stack );
+
+  if (stack->isInitialized)
+    return ERR_STACK_ALREADY_INITIALIZED;
+
+  stack->top.store(NULL, std::memory_order_relaxed);
+
+  for (size_t i = 0; i < IOG_LF_MAX_THREADS; i++) {
+    stack->threads[i].hazard.store(NULL, std::memory_order_relaxed);
+    stack->threads[i].retired    = NULL;
+    stack->threads[i].retiredNum = 0;
+    stack->threads[i].free       = NULL;
+    stack->threads[i].freeNum    = 0;
+  }
+
+  for (size_t i = 0; i < IOG_LF_ELIM_SLOTS; i++)
+    stack->elim[i].offer.store(NULL, std::memory_order_relaxed);
+
+  stack->elimination = elimination ? 1 : 0;
+  stack->verifyLevel = IOG_VERIFY_DEFAULT;
+
+  stack->firstStackCanary  = STACK_CANARY_CONST + (iog_canary_t) stack;
+  stack->secondStackCanary = STACK_CANARY_CONST + (iog_canary_t) stack;
+
+  stack->isInitialized = 1;
+  std::atomic_thread_fence(std::memory_order_release);
+
+  IOG_RETURN_IF_ERROR( iog_lf_stack_check(stack) );
+
+  return OK;
+}
+
+/**
+ * Frees nodes in stack and nodes cached by all threads, resets stack to zero.
+ * No other thread may use stack.
+ * @param[out] stack pointer to stack
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_lf_stack_destroy (IogLfStack_t *stack) {
+  IOG_CHECK_STACK_NULL( stack );
+
+  iog_lf_free_list(stack->top.load(std::memory_order_acquire));
+  stack->top.store(NULL, std::memory_order_relaxed);
+
+  for (size_t i = 0; i < IOG_LF_MAX_THREADS; i++) {
+    iog_lf_free_list(stack->threads[i].retired);
+    iog_lf_free_list(stack->threads[i].free);
+
+    stack->threads[i].hazard.store(NULL, std::memory_order_relaxed);
+    stack->threads[i].retired    = NULL;
+    stack->threads[i].retiredNum = 0;
+    stack->threads[i].free       = NULL;
+    stack->threads[i].freeNum    = 0;
+  }
+
+  for (size_t i = 0; i < IOG_LF_ELIM_SLOTS; i++)
+    stack->elim[i].offer.store(NULL, std::memory_order_relaxed);
+
+  stack->firstStackCanary  = 0;
+  stack->secondStackCanary = 0;
+
+  stack->isInitialized = 0;
+  stack->elimination   = 0;
+  stack->verifyLevel   = IOG_VERIFY_DEFAULT;
+
+  return OK;
+}
+
+/**
+ * Links new node on top by CAS. If CAS fails and elimination is on,
+ * offers node to colliding pop before retrying.
+ * @param[out] stack pointer to stack (can't be NULL)
+ * @param[in]  value new stack value
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_lf_stack_push (IogLfStack_t *stack, iog_stack_value_t value) {
+  IOG_RETURN_IF_ERROR( iog_lf_stack_check(stack) );
+
+  int index = iog_lf_thread_index();
+  if (index < 0)
+    return ERR_TOO_MANY_THREADS;
+
+  IogLfNode_t *node = iog_lf_node_get(&stack->threads[index]);
+  if (node == NULL)
+    return ERR_CANT_ALLOCATE_DATA;
+
+  node->value  = value;
+  node->canary = NODE_CANARY_CONST + (iog_canary_t) node;
+
+  IogLfNode_t *top = stack->top.load(std::memory_order_relaxed);
+
+  while (true) {
+    node->next.store(top, std::memory_order_relaxed);
+
+    if (stack->top.compare_exchange_weak(top, node, std::memory_order_release, std::memory_order_relaxed))
+      return OK;
+
+    if (stack->elimination && iog_lf_eliminate_push(stack, node))
+      return OK;
+
+    top = stack->top.load(std::memory_order_relaxed);
+  }
+}
+
+/**
+ * Protects top by hazard pointer, unlinks it by CAS and retires node.
+ * If CAS fails and elimination is on, tries to take value of colliding push.
+ * @param[out] stack pointer to stack (can't be NULL)
+ * @param[out] value pointer to variable in which want to write (can't be null)
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_lf_stack_pop (IogLfStack_t *stack, iog_stack_value_t *value) {
+  IOG_ASSERT(value);
+
+  IOG_RETURN_IF_ERROR( iog_lf_stack_check(stack) );
+
+  int index = iog_lf_thread_index();
+  if (index < 0)
+    return ERR_TOO_MANY_THREADS;
+
+  IogLfThreadSlot_t *slot = &stack->threads[index];
+
+  while (true) {
+    IogLfNode_t *top = stack->top.load(std::memory_order_acquire);
+    if (top == NULL)
+      return ERR_STACK_UNDERFLOW;
+
+    // top may be freed between load and hazard store, so it must be read again
+    slot->hazard.store(top, std::memory_order_seq_cst);
+    if (stack->top.load(std::memory_order_seq_cst) != top)
+      continue;
+
+    IogLfNode_t *next = top->next.load(std::memory_order_relaxed);
+
+    if (stack->top.compare_exchange_strong(top, next, std::memory_order_acquire, std::memory_order_relaxed)) {
+      slot->hazard.store(NULL, std::memory_order_release);
+
+      // corrupted node is leaked, its memory can't be trusted
+      if (iog_lf_stack_level(stack) >= IOG_VERIFY_CANARIES &&
+          top->canary != NODE_CANARY_CONST + (iog_canary_t) top)
+        return ERR_DEAD_FIRST_DATA_CANARY;
+
+      *value = top->value;
+      iog_lf_node_retire(stack, slot, top);
+
+      return OK;
+    }
+
+    slot->hazard.store(NULL, std::memory_order_release);
+
+    if (stack->elimination && iog_lf_eliminate_pop(stack, slot, value))
+      return OK;
+  }
+}
+
+/**
+ * @param[in]  stack         pointer to stack
+ * @param[out] stream        pointer to stream for prints
+ * @param[in]  stk_name      name of dumping stack
+ * @param[in]  file_name     name of file from that called dump
+ * @param[in]  line_num      number of line from that called dump
+ * @param[in]  function_name name of function from that called dump
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_lf_stack_dump_f (const IogLfStack_t *stack, FILE *stream,
+      const char *stk_name, const char *file_name, int line_num, const char *function_name) {
+  IOG_ASSERT(stream);
+
+  fprintf(stream, BLACK("------------ STACK DUMP ------------" "\n"));
+  fprintf(stream, BLUE("Called from %s:%d: %s\n"),
+     file_name, line_num, function_name
+  );
+
+  if (stack == NULL) {
+    fprintf(stream, BLACK("IogLfStack_t %s (null)") " {}\n", stk_name);
+    return ERR_STACK_NULLPTR;
+  }
+
+  fprintf(stream, BLACK("IogLfStack_t %s (%p) {\n"), stk_name, (const void *) stack);
+
+  fprintf(stream, BLACK("  .firstStackCanary  = 0x%llx")  "\n",  stack->firstStackCanary);
+  fprintf(stream, BLACK("  .isInitialized     = %d")    "\n",  (int) stack->isInitialized);
+  fprintf(stream, BLACK("  .elimination       = %d")    "\n",  (int) stack->elimination);
+  fprintf(stream, BLACK("  .verifyLevel       = %d")    "\n",  (int) stack->verifyLevel);
+
+  for (size_t i = 0; i < IOG_LF_MAX_THREADS; i++) {
+    const IogLfThreadSlot_t *slot = &stack->threads[i];
+
+    if (slot->retiredNum > 0 || slot->freeNum > 0)
+      fprintf(stream, BLACK("  .threads[%lu]        = {retired %lu, free %lu}") "\n",
+          i, slot->retiredNum, slot->freeNum);
+  }
+
+  size_t depth = 0;
+  for (const IogLfNode_t *node = stack->top.load(std::memory_order_acquire); node != NULL; node = node->next.load(std::memory_order_relaxed)) {
+    fprintf(stream, BLACK("    [%lu] (%p): %lg, canary - const = 0x%llx\n"),
+        depth, (const void *) node, node->value, node->canary - NODE_CANARY_CONST);
+    depth++;
+  }
+
+  fprintf(stream, BLACK("  .secondStackCanary = 0x%llx")  "\n",  stack->secondStackCanary);
+  fprintf(stream, BLACK("}\n"));
+  fprintf(stream, BLACK("------------------------------------\n"));
+
+  return OK;
+}
+
+/**
+ * Checks stack canaries, initialization and canary of every node, costs O(size).
+ * @param[in] stack pointer to stack
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_lf_stack_verify (const IogLfStack_t *stack) {
+  IOG_CHECK_STACK_NULL( stack );
+
+  if ((stack->firstStackCanary - STACK_CANARY_CONST) != (iog_canary_t) stack)
+    return ERR_DEAD_FIRST_CANARY;
+
+  if ((stack->secondStackCanary - STACK_CANARY_CONST) != (iog_canary_t) stack)
+    return ERR_DEAD_SECOND_CANARY;
+
+  if (!stack->isInitialized)
+    return ERR_STACK_ISNT_INITIALIZED;
+
+  for (const IogLfNode_t *node = stack->top.load(std::memory_order_acquire); node != NULL; node = node->next.load(std::memory_order_relaxed))
+    if (node->canary != NODE_CANARY_CONST + (iog_canary_t) node)
+      return ERR_DEAD_FIRST_DATA_CANARY;
+
+  return OK;
+}
+
+/**
+ * @param[out] stack pointer to stack
+ * @param[in]  level new verify level
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_lf_stack_set_verify_level (IogLfStack_t *stack, IogStackVerifyLevel level) {
+  IOG_RETURN_IF_ERROR( iog_lf_stack_verify(stack) );
+
+  if (level < IOG_VERIFY_DEFAULT || level > IOG_VERIFY_FULL)
+    return ERR_INVALID_VERIFY_LEVEL;
+
+  stack->verifyLevel = level;
+
+  return OK;
+}
+
+//--------------------- PRIVATE FUNCTIONS --------------------------------------------
+
+/**
+ * @param[in] stack pointer to stack
+ * @return stack verify level with default resolved and clamped by IOG_STACK_VERIFY_LEVEL
+ */
+static int iog_lf_stack_level (const IogLfStack_t *stack) {
+  int level = stack->verifyLevel;
+  if (level == IOG_VERIFY_DEFAULT)
+    level = IOG_STACK_DEFAULT_VERIFY_LEVEL;
+
+  if (level > IOG_STACK_VERIFY_LEVEL)
+    level = IOG_STACK_VERIFY_LEVEL;
+
+  return level;
+}
+
+/**
+ * Walking nodes isn't safe while other threads pop, so operations check only
+ * stack canaries and initialization even on full level, node canary is checked by pop.
+ * @param[in] stack pointer to stack
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_lf_stack_check (const IogLfStack_t *stack) {
+  IOG_CHECK_STACK_NULL( stack );
+
+#if IOG_STACK_VERIFY_LEVEL > 1
+  if (iog_lf_stack_level(stack) >= IOG_VERIFY_CANARIES) {
+    if ((stack->firstStackCanary - STACK_CANARY_CONST) != (iog_canary_t) stack)
+      return ERR_DEAD_FIRST_CANARY;
+
+    if ((stack->secondStackCanary - STACK_CANARY_CONST) != (iog_canary_t) stack)
+      return ERR_DEAD_SECOND_CANARY;
+
+    if (!stack->isInitialized)
+      return ERR_STACK_ISNT_INITIALIZED;
+  }
+#endif // IOG_STACK_VERIFY_LEVEL > 1
+
+  return OK;
+}
+
+/**
+ * Takes free index on first call in thread, index is released when thread exits.
+ * @return index of current thread in thread slots (-1 if all IOG_LF_MAX_THREADS are busy)
+ */
+static int iog_lf_thread_index () {
+  if (IOG_LIKELY(IOG_LF_THREAD.index >= 0))
+    return IOG_LF_THREAD.index;
+
+  for (size_t i = 0; i < IOG_LF_MAX_THREADS; i++) {
+    iog_flag_t busy = 0;
+
+    if (IOG_LF_INDEX_BUSY[i].compare_exchange_strong(busy, 1, std::memory_order_acquire)) {
+      IOG_LF_THREAD.index = (int) i;
+      return IOG_LF_THREAD.index;
+    }
+  }
+
+  return -1;
+}
+
+/**
+ * @param[out] slot reclamation state of current thread
+ * @return node from free list or new node (NULL if can't allocate)
+ */
+static IogLfNode_t *iog_lf_node_get (IogLfThreadSlot_t *slot) {
+  IogLfNode_t *node = slot->free;
+
+  if (node != NULL) {
+    slot->free = node->next.load(std::memory_order_relaxed);
+    slot->freeNum--;
+
+    return node;
+  }
+
+  return (IogLfNode_t *) iog_recalloc(NULL, 0, 1, sizeof(IogLfNode_t));
+}
+
+/**
+ * Caches node for next push, frees it if cache is full.
+ * @param[out] slot reclamation state of current thread
+ * @param[in]  node node no other thread can access
+ */
+static void iog_lf_node_put (IogLfThreadSlot_t *slot, IogLfNode_t *node) {
+  if (slot->freeNum >= IOG_LF_MAX_FREE_NODES) {
+    iog_free_sized(node, 1, sizeof(IogLfNode_t));
+    return;
+  }
+
+  node->next.store(slot->free, std::memory_order_relaxed);
+  slot->free = node;
+  slot->freeNum++;
+}
+
+/**
+ * Popped node may still be read by other pops, so it waits in retired list until scan.
+ * @param[in]  stack pointer to stack
+ * @param[out] slot  reclamation state of current thread
+ * @param[in]  node  popped node
+ */
+static void iog_lf_node_retire (IogLfStack_t *stack, IogLfThreadSlot_t *slot, IogLfNode_t *node) {
+  node->next.store(slot->retired, std::memory_order_relaxed);
+  slot->retired = node;
+  slot->retiredNum++;
+
+  if (slot->retiredNum >= IOG_LF_SCAN_THRESHOLD)
+    iog_lf_scan(stack, slot);
+}
+
+/**
+ * Moves retired nodes that no hazard pointer protects to free list.
+ * @param[in]  stack pointer to stack
+ * @param[out] slot  reclamation state of current thread
+ */
+static void iog_lf_scan (IogLfStack_t *stack, IogLfThreadSlot_t *slot) {
+  IogLfNode_t *hazards[IOG_LF_MAX_THREADS] = {};
+  size_t hazards_num = 0;
+
+  for (size_t i = 0; i < IOG_LF_MAX_THREADS; i++) {
+    IogLfNode_t *hazard = stack->threads[i].hazard.load(std::memory_order_seq_cst);
+
+    if (hazard != NULL)
+      hazards[hazards_num++] = hazard;
+  }
+
+  IogLfNode_t *node = slot->retired;
+  slot->retired    = NULL;
+  slot->retiredNum = 0;
+
+  while (node != NULL) {
+    IogLfNode_t *next = node->next.load(std::memory_order_relaxed);
+
+    int protected_node = 0;
+    for (size_t i = 0; i < hazards_num && !protected_node; i++)
+      protected_node = (hazards[i] == node);
+
+    if (protected_node) {
+      node->next.store(slot->retired, std::memory_order_relaxed);
+      slot->retired = node;
+      slot->retiredNum++;
+    } else {
+      iog_lf_node_put(slot, node);
+    }
+
+    node = next;
+  }
+}
+
+/**
+ * @param[in] node first node of list linked by next (can be NULL)
+ */
+static void iog_lf_free_list (IogLfNode_t *node) {
+  while (node != NULL) {
+    IogLfNode_t *next = node->next.load(std::memory_order_relaxed);
+    iog_free_sized(node, 1, sizeof(IogLfNode_t));
+    node = next;
+  }
+}
+
+/**
+ * Offers node in random elimination slot and waits for pop to take it.
+ * Slot keeps taken marker until this push clears it, so node can't be offered twice.
+ * @param[in] stack pointer to stack
+ * @param[in] node  node that push failed to link
+ * @return 1 if pop took node, 0 if push must retry CAS
+ */
+static int iog_lf_eliminate_push (IogLfStack_t *stack, IogLfNode_t *node) {
+  IogLfElimSlot_t *elim = &stack->elim[iog_lf_random_slot()];
+
+  IogLfNode_t *expected = NULL;
+  if (!elim->offer.compare_exchange_strong(expected, node, std::memory_order_release, std::memory_order_relaxed))
+    return 0;
+
+  for (size_t spin = 0; spin < IOG_LF_ELIM_SPINS; spin++)
+    if (elim->offer.load(std::memory_order_acquire) != node)
+      break;
+
+  expected = node;
+  if (elim->offer.compare_exchange_strong(expected, NULL, std::memory_order_acquire, std::memory_order_acquire))
+    return 0;
+
+  elim->offer.store(NULL, std::memory_order_release);
+
+  return 1;
+}
+
+/**
+ * Takes node offered by colliding push, node becomes owned by current thread.
+ * @param[in]  stack pointer to stack
+ * @param[out] slot  reclamation state of current thread
+ * @param[out] value pointer to variable in which want to write
+ * @return 1 if value was taken, 0 if pop must retry CAS
+ */
+static int iog_lf_eliminate_pop (IogLfStack_t *stack, IogLfThreadSlot_t *slot, iog_stack_value_t *value) {
+  IogLfElimSlot_t *elim = &stack->elim[iog_lf_random_slot()];
+
+  IogLfNode_t *node = elim->offer.load(std::memory_order_acquire);
+  if (node == NULL || node == &IOG_LF_TAKEN)
+    return 0;
+
+  if (!elim->offer.compare_exchange_strong(node, &IOG_LF_TAKEN, std::memory_order_acquire, std::memory_order_relaxed))
+    return 0;
+
+  *value = node->value;
+  iog_lf_node_put(slot, node);
+
+  return 1;
+}
+
+/**
+ * Xorshift generator, state is local to thread.
+ * @return random index in elimination array
+ */
+static size_t iog_lf_random_slot () {
+  static thread_local iog_uint64_t state = 0;
+
+  if (state == 0)
+    state = (iog_uint64_t) &state | 1;
+
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+
+  return (size_t) (state % IOG_LF_ELIM_SLOTS);
+}
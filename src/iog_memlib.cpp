@@ -1,35 +1,951 @@
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__unix__) || defined(__APPLE__)
+#define IOG_MEM_USE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #include "iog_memlib.h"
 
+/// Per-thread counters, so updating them needs no synchronization
+static thread_local IogMemStats_t IOG_MEM_STATS = {};
+
+#ifdef IOG_MEM_USE_MMAP
+
+/**
+ * @param[in] bytes size of block
+ * @return bytes rounded up to page size
+ */
+static size_t iog_mem_page_round (size_t bytes) {
+  static size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+
+  return (bytes + page_size - 1) / page_size * page_size;
+}
+
+/**
+ * @param[in] bytes size of block
+ * @return 1 if block of this size lives in its own mapping
+ */
+static int iog_mem_is_mapped (size_t bytes) {
+  return bytes >= IOG_MEM_MAP_THRESHOLD;
+}
+
+/**
+ * @param[in] bytes size of block
+ * @return pointer to zeroed anonymous mapping or NULL
+ */
+static void *iog_mem_map (size_t bytes) {
+  void *ptr = mmap(NULL, iog_mem_page_round(bytes), PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  return (ptr == MAP_FAILED) ? NULL : ptr;
+}
+
+/**
+ * Resizes mapping in place if kernel can, otherwise moves pages without copying.
+ * Fresh pages are zero, only rest of old last page must be cleared.
+ * @param[in] ptr       pointer to mapping
+ * @param[in] old_bytes old size of block
+ * @param[in] new_bytes new size of block
+ * @param[in] zero_tail if 1 then new tail [old_bytes, new_bytes) is zeroed
+ * @return pointer to resized mapping or NULL (then old mapping is untouched)
+ */
+static void *iog_mem_remap (void *ptr, size_t old_bytes, size_t new_bytes, int zero_tail) {
+  size_t old_mapped = iog_mem_page_round(old_bytes);
+  size_t new_mapped = iog_mem_page_round(new_bytes);
+
+  void *new_ptr = ptr;
+
+  if (old_mapped != new_mapped) {
+#ifdef __linux__
+    new_ptr = mremap(ptr, old_mapped, new_mapped, MREMAP_MAYMOVE);
+    if (new_ptr == MAP_FAILED)
+      return NULL;
+#else
+    new_ptr = iog_mem_map(new_bytes);
+    if (new_ptr == NULL)
+      return NULL;
+
+    memcpy(new_ptr, ptr, (old_bytes < new_bytes) ? old_bytes : new_bytes);
+    munmap(ptr, old_mapped);
+    IOG_MEM_STATS.bytesCopied += (old_bytes < new_bytes) ? old_bytes : new_bytes;
+#endif
+  }
+
+  if (zero_tail && new_bytes > old_bytes) {
+    size_t dirty_end = (new_bytes < old_mapped) ? new_bytes : old_mapped;
+    memset((char *) new_ptr + old_bytes, 0, dirty_end - old_bytes);
+  }
+
+  return new_ptr;
+}
+
+/**
+ * @param[in] fd    file descriptor
+ * @param[in] bytes new size of file
+ * @return 0 on success
+ */
+static int iog_file_truncate (int fd, size_t bytes) {
+  return ftruncate(fd, (off_t) bytes);
+}
+
+#endif // IOG_MEM_USE_MMAP
+
+/**
+ * Block of malloc family, realloc copies it only if it can't grow in place.
+ * @param[in] ptr       old pointer to block (can be NULL)
+ * @param[in] old_bytes old size of block
+ * @param[in] new_bytes new size of block (not 0)
+ * @param[in] zero_tail if 1 then new tail [old_bytes, new_bytes) is zeroed
+ * @return new pointer to block (if NULL, then old pointer is still valid)
+ */
+static void *iog_mem_realloc (void *ptr, size_t old_bytes, size_t new_bytes, int zero_tail) {
+  if (ptr == NULL)
+    return zero_tail ? calloc(new_bytes, 1) : malloc(new_bytes);
+
+  void *new_ptr = realloc(ptr, new_bytes);
+  if (new_ptr == NULL)
+    return NULL;
+
+  // realloc that moves block copies old content
+  if (new_ptr != ptr)
+    IOG_MEM_STATS.bytesCopied += (old_bytes < new_bytes) ? old_bytes : new_bytes;
+
+  if (zero_tail && new_bytes > old_bytes)
+    memset((char *) new_ptr + old_bytes, 0, new_bytes - old_bytes);
+
+  return new_ptr;
+}
+
 /**
- * Does new calloc, copies old number of elemnts from old pointer to new pointer and frees old pointer.
+ * Frees block of iog_mem_heap_resize, mapped or from malloc by its size.
+ * @param[in] ptr   pointer to block (can be NULL)
+ * @param[in] bytes size of block
+ */
+static void iog_mem_heap_free (void *ptr, size_t bytes) {
+  if (ptr == NULL)
+    return;
+
+  IOG_MEM_STATS.frees++;
+
+#ifdef IOG_MEM_USE_MMAP
+  if (iog_mem_is_mapped(bytes)) {
+    munmap(ptr, iog_mem_page_round(bytes));
+    return;
+  }
+#endif // IOG_MEM_USE_MMAP
+
+  free(ptr);
+}
+
+/**
+ * Resizes block trying not to copy: small blocks go through realloc,
+ * large blocks (>= IOG_MEM_MAP_THRESHOLD) are page mappings resized by mremap.
+ * Copy happens only if block crosses threshold or realloc can't grow in place.
+ * Block must be freed by iog_mem_heap_free.
+ * @param[in] ptr       old pointer to block (can be NULL)
+ * @param[in] old_bytes old size of block
+ * @param[in] new_bytes new size of block (not 0)
+ * @param[in] zero_tail if 1 then new tail [old_bytes, new_bytes) is zeroed
+ * @return new pointer to block (if NULL, then old pointer is still valid)
+ */
+static void *iog_mem_heap_resize (void *ptr, size_t old_bytes, size_t new_bytes, int zero_tail) {
+  if (ptr == NULL)
+    IOG_MEM_STATS.allocs++;
+  else
+    IOG_MEM_STATS.resizes++;
+
+#ifdef IOG_MEM_USE_MMAP
+  int old_mapped = (ptr != NULL) && iog_mem_is_mapped(old_bytes);
+  int new_mapped = iog_mem_is_mapped(new_bytes);
+
+  // fresh pages of mapping are zero anyway
+  if (old_mapped && new_mapped)
+    return iog_mem_remap(ptr, old_bytes, new_bytes, zero_tail);
+
+  if (old_mapped || new_mapped) {
+    void *new_ptr = new_mapped ? iog_mem_map(new_bytes) :
+                    zero_tail  ? calloc(new_bytes, 1) : malloc(new_bytes);
+    if (new_ptr == NULL)
+      return NULL;
+
+    if (ptr != NULL) {
+      memcpy(new_ptr, ptr, (old_bytes < new_bytes) ? old_bytes : new_bytes);
+      IOG_MEM_STATS.bytesCopied += (old_bytes < new_bytes) ? old_bytes : new_bytes;
+      iog_mem_heap_free(ptr, old_bytes);
+      IOG_MEM_STATS.frees--; // block is moved, not released by user
+    }
+
+    return new_ptr;
+  }
+#endif // IOG_MEM_USE_MMAP
+
+  return iog_mem_realloc(ptr, old_bytes, new_bytes, zero_tail);
+}
+
+/**
+ * Resizes block by realloc, only new tail [old_num, new_num) is zeroed.
+ * Block is never page-mapped, so it can be released by free() as before,
+ * large stack buffers use iog_mem_resize instead.
  * If old pointer is null, then will be just callocation.
  * If new number or size of elements is NULL, then old pointer wiil be released and NULL will be returned.
  * @param[in] ptr       old pointer to data
  * @param[in] old_num   old number of elements
  * @param[in] new_num   new number of elements
  * @param[in] elem_size size of one element in bytes
- * @return new pointer to allocated memory
+ * @return new pointer to allocated memory (if NULL, then old pointer is still valid)
  */
 void *iog_recalloc (void *ptr, size_t old_num,  size_t new_num, size_t elem_size) {
-  if ((new_num * elem_size) == 0) {
+  size_t old_bytes = (ptr != NULL) ? old_num * elem_size : 0;
+  size_t new_bytes = new_num * elem_size;
+
+  if (new_bytes == 0) {
+    iog_free_sized(ptr, old_num, elem_size);
+    return NULL;
+  }
+
+  if (ptr == NULL)
+    IOG_MEM_STATS.allocs++;
+  else
+    IOG_MEM_STATS.resizes++;
+
+  return iog_mem_realloc(ptr, old_bytes, new_bytes, 1);
+}
+
+/**
+ * @param[in] ptr       pointer from iog_recalloc (can be NULL)
+ * @param[in] num       number of elements in block
+ * @param[in] elem_size size of one element in bytes
+ */
+void iog_free_sized (void *ptr, size_t num, size_t elem_size) {
+  if (ptr == NULL)
+    return;
+
+  (void) num;
+  (void) elem_size;
+
+  IOG_MEM_STATS.frees++;
+
+  free(ptr);
+}
+
+/**
+ * Maps [guard page][data pages][guard page] and places block so its last byte
+ * is right before second guard page, so any overrun traps immediately.
+ * First guard page catches underruns bigger than slack at start of data pages.
+ * @param[in] bytes size of block (multiple of 8 keeps block 8-aligned)
+ * @return pointer to zeroed block or NULL
+ */
+void *iog_guarded_alloc (size_t bytes) {
+#ifdef IOG_MEM_USE_MMAP
+  size_t page_size  = iog_mem_page_round(1);
+  size_t data_pages = iog_mem_page_round(bytes);
+
+  char *base = (char *) mmap(NULL, data_pages + 2 * page_size, PROT_NONE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED)
+    return NULL;
+
+  if (mprotect(base + page_size, data_pages, PROT_READ | PROT_WRITE) != 0) {
+    munmap(base, data_pages + 2 * page_size);
+    return NULL;
+  }
+
+  IOG_MEM_STATS.allocs++;
+
+  return base + page_size + (data_pages - bytes);
+#else
+  (void) bytes;
+  return NULL;
+#endif // IOG_MEM_USE_MMAP
+}
+
+/**
+ * Block end is glued to guard page, so block is always moved: allocates new guarded block,
+ * copies common part and frees old one.
+ * @param[in] ptr       pointer from iog_guarded_alloc (can be NULL)
+ * @param[in] old_bytes old size of block
+ * @param[in] new_bytes new size of block
+ * @return pointer to new block (if NULL, then old pointer is still valid)
+ */
+void *iog_guarded_resize (void *ptr, size_t old_bytes, size_t new_bytes) {
+  void *new_ptr = iog_guarded_alloc(new_bytes);
+  if (new_ptr == NULL)
+    return NULL;
+
+  if (ptr != NULL) {
+    memcpy(new_ptr, ptr, (old_bytes < new_bytes) ? old_bytes : new_bytes);
+    iog_guarded_free(ptr, old_bytes);
+
+    // counted as resize of one block, not as alloc and free
+    IOG_MEM_STATS.allocs--;
+    IOG_MEM_STATS.frees--;
+    IOG_MEM_STATS.resizes++;
+    IOG_MEM_STATS.bytesCopied += (old_bytes < new_bytes) ? old_bytes : new_bytes;
+  }
+
+  return new_ptr;
+}
+
+/**
+ * @param[in] ptr   pointer from iog_guarded_alloc (can be NULL)
+ * @param[in] bytes size of block
+ */
+void iog_guarded_free (void *ptr, size_t bytes) {
+#ifdef IOG_MEM_USE_MMAP
+  if (ptr == NULL)
+    return;
+
+  size_t page_size  = iog_mem_page_round(1);
+  size_t data_pages = iog_mem_page_round(bytes);
+
+  char *base = (char *) ptr - (data_pages - bytes) - page_size;
+  munmap(base, data_pages + 2 * page_size);
+
+  IOG_MEM_STATS.frees++;
+#else
+  (void) ptr;
+  (void) bytes;
+#endif // IOG_MEM_USE_MMAP
+}
+
+/**
+ * @param[in]  path  path to file
+ * @param[out] bytes current size of file (0 for new file)
+ * @return file descriptor or -1
+ */
+int iog_file_open (const char *path, size_t *bytes) {
+  *bytes = 0;
+
+#ifdef IOG_MEM_USE_MMAP
+  int fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0)
+    return -1;
+
+  struct stat st = {};
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  *bytes = (size_t) st.st_size;
+
+  return fd;
+#else
+  (void) path;
+  return -1;
+#endif // IOG_MEM_USE_MMAP
+}
+
+/**
+ * Grown part of file reads as zeros, so no memset is needed.
+ * @param[in] fd    descriptor from iog_file_open
+ * @param[in] bytes size of file and mapping
+ * @return pointer to shared mapping of file or NULL
+ */
+void *iog_file_map (int fd, size_t bytes) {
+#ifdef IOG_MEM_USE_MMAP
+  struct stat st = {};
+  if (fstat(fd, &st) != 0)
+    return NULL;
+
+  if ((size_t) st.st_size != bytes && iog_file_truncate(fd, bytes) != 0)
+    return NULL;
+
+  void *ptr = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (ptr == MAP_FAILED)
+    return NULL;
+
+  IOG_MEM_STATS.allocs++;
+
+  return ptr;
+#else
+  (void) fd;
+  (void) bytes;
+  return NULL;
+#endif // IOG_MEM_USE_MMAP
+}
+
+/**
+ * File grows before mapping and shrinks after it, so mapping never covers
+ * pages past end of file.
+ * @param[in] fd        descriptor from iog_file_open
+ * @param[in] ptr       pointer from iog_file_map
+ * @param[in] old_bytes old size of file
+ * @param[in] new_bytes new size of file
+ * @return pointer to new mapping (if NULL, then old mapping is still valid)
+ */
+void *iog_file_remap (int fd, void *ptr, size_t old_bytes, size_t new_bytes) {
+#ifdef IOG_MEM_USE_MMAP
+  if (new_bytes > old_bytes && iog_file_truncate(fd, new_bytes) != 0)
+    return NULL;
+
+#ifdef __linux__
+  void *new_ptr = mremap(ptr, old_bytes, new_bytes, MREMAP_MAYMOVE);
+#else
+  void *new_ptr = mmap(NULL, new_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (new_ptr != MAP_FAILED)
+    munmap(ptr, old_bytes);
+#endif // __linux__
+
+  // if truncate fails, file just keeps unmapped tail, it is cut by next map or resize
+  if (new_ptr == MAP_FAILED) {
+    if (new_bytes > old_bytes)
+      iog_file_truncate(fd, old_bytes);
+
+    return NULL;
+  }
+
+  if (new_bytes < old_bytes)
+    iog_file_truncate(fd, new_bytes);
+
+  IOG_MEM_STATS.resizes++;
+
+  return new_ptr;
+#else
+  (void) fd;
+  (void) ptr;
+  (void) old_bytes;
+  (void) new_bytes;
+  return NULL;
+#endif // IOG_MEM_USE_MMAP
+}
+
+/**
+ * @param[in] ptr   pointer from iog_file_map
+ * @param[in] bytes size of mapping
+ * @return 0 if pages reached file
+ */
+int iog_file_sync (void *ptr, size_t bytes) {
+#ifdef IOG_MEM_USE_MMAP
+  return msync(ptr, bytes, MS_SYNC);
+#else
+  (void) ptr;
+  (void) bytes;
+  return -1;
+#endif // IOG_MEM_USE_MMAP
+}
+
+/**
+ * File is unlinked right after creation, so it disappears when closed or when process dies.
+ * @param[in] dir directory of file (NULL - TMPDIR or /tmp)
+ * @return file descriptor or -1
+ */
+int iog_file_temp (const char *dir) {
+#ifdef IOG_MEM_USE_MMAP
+  if (dir == NULL)
+    dir = getenv("TMPDIR");
+  if (dir == NULL || dir[0] == '\0')
+    dir = "/tmp";
+
+  char path[4096] = "";
+  if ((size_t) snprintf(path, sizeof(path), "%s/iog_stack_XXXXXX", dir) >= sizeof(path))
+    return -1;
+
+  int fd = mkstemp(path);
+  if (fd < 0)
+    return -1;
+
+  unlink(path);
+
+  return fd;
+#else
+  (void) dir;
+  return -1;
+#endif // IOG_MEM_USE_MMAP
+}
+
+/**
+ * Repeats write until all bytes are written, so it is safe to call from other thread.
+ * @param[in] fd     file descriptor
+ * @param[in] ptr    pointer to bytes
+ * @param[in] bytes  amount of bytes
+ * @param[in] offset position in file
+ * @return 0 if all bytes were written
+ */
+int iog_file_write_at (int fd, const void *ptr, size_t bytes, size_t offset) {
+#ifdef IOG_MEM_USE_MMAP
+  const char *cursor = (const char *) ptr;
+
+  while (bytes > 0) {
+    ssize_t written = pwrite(fd, cursor, bytes, (off_t) offset);
+    if (written <= 0)
+      return -1;
+
+    cursor += written;
+    offset += (size_t) written;
+    bytes  -= (size_t) written;
+  }
+
+  return 0;
+#else
+  (void) fd;
+  (void) ptr;
+  (void) bytes;
+  (void) offset;
+  return -1;
+#endif // IOG_MEM_USE_MMAP
+}
+
+/**
+ * @param[in]  fd     file descriptor
+ * @param[out] ptr    pointer to buffer for bytes
+ * @param[in]  bytes  amount of bytes
+ * @param[in]  offset position in file
+ * @return 0 if all bytes were read (end of file is error)
+ */
+int iog_file_read_at (int fd, void *ptr, size_t bytes, size_t offset) {
+#ifdef IOG_MEM_USE_MMAP
+  char *cursor = (char *) ptr;
+
+  while (bytes > 0) {
+    ssize_t got = pread(fd, cursor, bytes, (off_t) offset);
+    if (got <= 0)
+      return -1;
+
+    cursor += got;
+    offset += (size_t) got;
+    bytes  -= (size_t) got;
+  }
+
+  return 0;
+#else
+  (void) fd;
+  (void) ptr;
+  (void) bytes;
+  (void) offset;
+  return -1;
+#endif // IOG_MEM_USE_MMAP
+}
+
+/**
+ * @param[in] fd    descriptor from iog_file_open
+ * @param[in] ptr   pointer from iog_file_map (can be NULL)
+ * @param[in] bytes size of mapping
+ */
+void iog_file_close (int fd, void *ptr, size_t bytes) {
+#ifdef IOG_MEM_USE_MMAP
+  if (ptr != NULL) {
+    munmap(ptr, bytes);
+    IOG_MEM_STATS.frees++;
+  }
+
+  if (fd >= 0)
+    close(fd);
+#else
+  (void) fd;
+  (void) ptr;
+  (void) bytes;
+#endif // IOG_MEM_USE_MMAP
+}
+
+/**
+ * @return counters of memlib calls made by current thread
+ */
+const IogMemStats_t *iog_mem_stats () {
+  return &IOG_MEM_STATS;
+}
+
+void iog_mem_stats_reset () {
+  IOG_MEM_STATS = {};
+}
+
+//--------------------- SIZE CLASSES, POOL AND ARENA ---------------------------------
+
+/** @struct IogMemArenaChunk_t
+ * Header of arena chunk, followed by its bytes.
+ */
+struct alignas(16) IogMemArenaChunk_t {
+  IogMemArenaChunk_t *next; ///< Next chunk in chain
+  size_t bytes;             ///< Bytes after header
+};
+
+/** @struct IogMemPool_t
+ * Free lists of current thread, blocks are released at thread exit.
+ */
+struct IogMemPool_t {
+  void  *lists[IOG_MEM_CLASSES_NUM]; ///< Cached blocks by class (linked through first word)
+  size_t nums [IOG_MEM_CLASSES_NUM]; ///< Amount of cached blocks by class
+
+  ~IogMemPool_t () {
+    iog_pool_trim();
+  }
+};
+
+static thread_local IogMemPool_t   IOG_MEM_POOL        = {};
+static thread_local IogMemArena_t *IOG_MEM_BOUND_ARENA = NULL;
+
+/**
+ * @param[in] bytes size of block
+ * @return index of smallest class that fits bytes
+ */
+static size_t iog_mem_class_index (size_t bytes) {
+  size_t index = 0;
+
+  while ((IOG_MEM_MIN_CLASS_BYTES << index) < bytes)
+    index++;
+
+  return index;
+}
+
+/**
+ * @param[in] bytes size of block
+ * @return IOG_MEM_MIN_CLASS_BYTES * 2^k, the smallest not less than bytes
+ */
+size_t iog_mem_class_bytes (size_t bytes) {
+  return IOG_MEM_MIN_CLASS_BYTES << iog_mem_class_index(bytes);
+}
+
+/**
+ * @param[in] bytes size of block
+ * @return 1 if block of this size is served by thread pool
+ */
+static int iog_mem_is_pooled (size_t bytes) {
+  return IOG_MEM_USE_POOL && bytes <= IOG_MEM_POOL_MAX_BYTES;
+}
+
+/**
+ * Takes cached block of class or allocates new one, doesn't zero and doesn't count it.
+ * @param[in] bytes size of block (at most IOG_MEM_POOL_MAX_BYTES)
+ * @return pointer to block of class size or NULL
+ */
+static void *iog_pool_take (size_t bytes) {
+  size_t index = iog_mem_class_index(bytes);
+  void *ptr = IOG_MEM_POOL.lists[index];
+
+  if (ptr == NULL)
+    return malloc(IOG_MEM_MIN_CLASS_BYTES << index);
+
+  IOG_MEM_POOL.lists[index] = *(void **) ptr;
+  IOG_MEM_POOL.nums[index]--;
+
+  return ptr;
+}
+
+/**
+ * Caches block in free list of its class, or frees it if list is full. Doesn't count it.
+ * @param[in] ptr   pointer to block of pool
+ * @param[in] bytes size of block
+ */
+static void iog_pool_give (void *ptr, size_t bytes) {
+  size_t index = iog_mem_class_index(bytes);
+
+  if (IOG_MEM_POOL.nums[index] >= IOG_MEM_POOL_CACHE_NUM) {
     free(ptr);
+    return;
+  }
+
+  *(void **) ptr = IOG_MEM_POOL.lists[index];
+  IOG_MEM_POOL.lists[index] = ptr;
+  IOG_MEM_POOL.nums[index]++;
+}
+
+/**
+ * Blocks are plain malloc blocks of class size, so block freed by other thread
+ * just joins pool of that thread.
+ * @param[in] bytes size of block (at most IOG_MEM_POOL_MAX_BYTES)
+ * @return pointer to zeroed block or NULL
+ */
+void *iog_pool_alloc (size_t bytes) {
+  void *ptr = iog_pool_take(bytes);
+  if (ptr == NULL)
+    return NULL;
+
+  memset(ptr, 0, iog_mem_class_bytes(bytes));
+  IOG_MEM_STATS.allocs++;
+
+  return ptr;
+}
+
+/**
+ * @param[in] ptr   pointer from iog_pool_alloc (can be NULL)
+ * @param[in] bytes size passed to iog_pool_alloc
+ */
+void iog_pool_free (void *ptr, size_t bytes) {
+  if (ptr == NULL)
+    return;
+
+  iog_pool_give(ptr, bytes);
+  IOG_MEM_STATS.frees++;
+}
+
+void iog_pool_trim () {
+  for (size_t index = 0; index < IOG_MEM_CLASSES_NUM; index++) {
+    while (IOG_MEM_POOL.lists[index] != NULL) {
+      void *ptr = IOG_MEM_POOL.lists[index];
+      IOG_MEM_POOL.lists[index] = *(void **) ptr;
+      free(ptr);
+    }
+
+    IOG_MEM_POOL.nums[index] = 0;
+  }
+}
+
+/**
+ * @param[out] arena       pointer to arena
+ * @param[in]  chunk_bytes size of regular chunk (at least 4 * IOG_MEM_MIN_CLASS_BYTES)
+ */
+void iog_arena_init (IogMemArena_t *arena, size_t chunk_bytes) {
+  *arena = {};
+
+  if (chunk_bytes < 4 * IOG_MEM_MIN_CLASS_BYTES)
+    chunk_bytes = 4 * IOG_MEM_MIN_CLASS_BYTES;
+
+  arena->chunkBytes = chunk_bytes;
+}
+
+/**
+ * @param[in] bytes size of chunk data
+ * @return pointer to new chunk or NULL
+ */
+static IogMemArenaChunk_t *iog_arena_new_chunk (size_t bytes) {
+  IogMemArenaChunk_t *chunk = (IogMemArenaChunk_t *) malloc(sizeof(IogMemArenaChunk_t) + bytes);
+  if (chunk == NULL)
+    return NULL;
+
+  chunk->next  = NULL;
+  chunk->bytes = bytes;
+
+  return chunk;
+}
+
+/**
+ * Reuses released block of class, or bumps cursor, moving to next kept chunk
+ * or allocating new one when current is full. Large blocks get own chunk.
+ * Doesn't zero and doesn't count block.
+ * @param[in] arena pointer to arena
+ * @param[in] bytes size of block
+ * @return pointer to block of class size or NULL
+ */
+static void *iog_arena_take (IogMemArena_t *arena, size_t bytes) {
+  size_t index = iog_mem_class_index(bytes);
+  size_t class_bytes = IOG_MEM_MIN_CLASS_BYTES << index;
+
+  void *ptr = arena->freeLists[index];
+  if (ptr != NULL) {
+    arena->freeLists[index] = *(void **) ptr;
+    return ptr;
+  }
+
+  if (class_bytes > arena->chunkBytes / 4) {
+    IogMemArenaChunk_t *chunk = iog_arena_new_chunk(class_bytes);
+    if (chunk == NULL)
+      return NULL;
+
+    chunk->next  = arena->large;
+    arena->large = chunk;
+
+    return chunk + 1;
+  }
+
+  if (arena->cursor == NULL || (size_t) (arena->end - arena->cursor) < class_bytes) {
+    IogMemArenaChunk_t *chunk = (arena->current != NULL) ? arena->current->next : arena->chunks;
+
+    if (chunk == NULL) {
+      chunk = iog_arena_new_chunk(arena->chunkBytes);
+      if (chunk == NULL)
+        return NULL;
+
+      if (arena->current != NULL)
+        arena->current->next = chunk;
+      else
+        arena->chunks = chunk;
+    }
+
+    arena->current = chunk;
+    arena->cursor  = (char *) (chunk + 1);
+    arena->end     = arena->cursor + chunk->bytes;
+  }
+
+  ptr = arena->cursor;
+  arena->cursor += class_bytes;
+
+  return ptr;
+}
+
+/**
+ * @param[in] arena pointer to arena
+ * @param[in] bytes size of block
+ * @return pointer to zeroed block of class size or NULL
+ */
+void *iog_arena_alloc (IogMemArena_t *arena, size_t bytes) {
+  void *ptr = iog_arena_take(arena, bytes);
+  if (ptr == NULL)
+    return NULL;
+
+  memset(ptr, 0, iog_mem_class_bytes(bytes));
+  IOG_MEM_STATS.allocs++;
+
+  return ptr;
+}
+
+/**
+ * Memory stays in arena, block is reused by next allocation of its class.
+ * @param[in] arena pointer to arena
+ * @param[in] ptr   pointer from iog_arena_alloc (can be NULL)
+ * @param[in] bytes size passed to iog_arena_alloc
+ */
+void iog_arena_free (IogMemArena_t *arena, void *ptr, size_t bytes) {
+  if (ptr == NULL)
+    return;
+
+  size_t index = iog_mem_class_index(bytes);
+
+  *(void **) ptr = arena->freeLists[index];
+  arena->freeLists[index] = ptr;
+
+  IOG_MEM_STATS.frees++;
+}
+
+/**
+ * Rewinds bump pointer to first chunk and forgets released blocks, so cost
+ * doesn't depend on amount of allocated blocks. Regular chunks are kept for reuse,
+ * own chunks of large blocks are freed.
+ * @param[in] arena pointer to arena
+ */
+void iog_arena_reset (IogMemArena_t *arena) {
+  while (arena->large != NULL) {
+    IogMemArenaChunk_t *next = arena->large->next;
+    free(arena->large);
+    arena->large = next;
+  }
+
+  arena->current = arena->chunks;
+  arena->cursor  = (arena->chunks != NULL) ? (char *) (arena->chunks + 1) : NULL;
+  arena->end     = (arena->chunks != NULL) ? arena->cursor + arena->chunks->bytes : NULL;
+
+  memset(arena->freeLists, 0, sizeof(arena->freeLists));
+}
+
+/**
+ * @param[in] arena pointer to arena
+ */
+void iog_arena_destroy (IogMemArena_t *arena) {
+  iog_arena_reset(arena);
+
+  while (arena->chunks != NULL) {
+    IogMemArenaChunk_t *next = arena->chunks->next;
+    free(arena->chunks);
+    arena->chunks = next;
+  }
+
+  iog_arena_init(arena, arena->chunkBytes);
+}
+
+/**
+ * @param[in] arena arena for stacks initialized later by current thread (can be NULL)
+ */
+void iog_mem_bind_arena (IogMemArena_t *arena) {
+  IOG_MEM_BOUND_ARENA = arena;
+}
+
+IogMemArena_t *iog_mem_bound_arena () {
+  return IOG_MEM_BOUND_ARENA;
+}
+
+/**
+ * @param[in] arena arena of block (NULL - pool and heap)
+ * @param[in] bytes requested size of block
+ * @return size of class for arena and pool blocks, bytes for heap blocks
+ */
+size_t iog_mem_usable (const IogMemArena_t *arena, size_t bytes) {
+  if (arena != NULL || iog_mem_is_pooled(bytes))
+    return iog_mem_class_bytes(bytes);
+
+  return bytes;
+}
+
+/**
+ * Allocates, resizes or frees block of arena. If arena is NULL, small blocks
+ * go to thread pool and large ones to heap. Block stays in place
+ * while new size has the same class.
+ * @param[in] arena     arena of block (NULL - pool and heap)
+ * @param[in] ptr       old pointer to block (can be NULL)
+ * @param[in] old_bytes old size of block
+ * @param[in] new_bytes new size of block (if 0 then block is freed)
+ * @param[in] zero_tail if 1 then new tail [old_bytes, new_bytes) is zeroed, else it is left as is
+ * @return new pointer to block (if NULL, then old pointer is still valid)
+ */
+void *iog_mem_resize (IogMemArena_t *arena, void *ptr, size_t old_bytes, size_t new_bytes, int zero_tail) {
+  if (ptr == NULL)
+    old_bytes = 0;
+
+  if (new_bytes == 0) {
+    iog_mem_free(arena, ptr, old_bytes);
     return NULL;
   }
 
-  void *new_ptr = calloc(new_num, elem_size);
+  int old_small = (arena != NULL) || iog_mem_is_pooled(old_bytes);
+  int new_small = (arena != NULL) || iog_mem_is_pooled(new_bytes);
+
+  if (!new_small && (ptr == NULL || !old_small))
+    return iog_mem_heap_resize(ptr, old_bytes, new_bytes, zero_tail);
+
+  if (ptr != NULL && old_small && new_small &&
+      iog_mem_class_index(old_bytes) == iog_mem_class_index(new_bytes)) {
+    if (zero_tail && new_bytes > old_bytes)
+      memset((char *) ptr + old_bytes, 0, new_bytes - old_bytes);
+
+    IOG_MEM_STATS.resizes++;
+    return ptr;
+  }
+
+  void *new_ptr = NULL;
+
+  if (!new_small) {
+    new_ptr = iog_mem_heap_resize(NULL, 0, new_bytes, zero_tail);
+    IOG_MEM_STATS.allocs--; // counted below as resize
+  } else {
+    new_ptr = (arena != NULL) ? iog_arena_take(arena, new_bytes) : iog_pool_take(new_bytes);
+  }
+
+  if (new_ptr == NULL)
+    return NULL;
+
+  size_t common_bytes = (old_bytes < new_bytes) ? old_bytes : new_bytes;
 
   if (ptr != NULL) {
-    if (old_num <= new_num)
-      memcpy(new_ptr, ptr, old_num * elem_size);
-    else
-      memcpy(new_ptr, ptr, new_num * elem_size);
+    memcpy(new_ptr, ptr, common_bytes);
+
+    if (!old_small) {
+      iog_mem_heap_free(ptr, old_bytes);
+      IOG_MEM_STATS.frees--; // block is moved, not released by user
+    } else if (arena != NULL) {
+      size_t index = iog_mem_class_index(old_bytes);
+
+      *(void **) ptr = arena->freeLists[index];
+      arena->freeLists[index] = ptr;
+    } else {
+      iog_pool_give(ptr, old_bytes);
+    }
+
+    IOG_MEM_STATS.resizes++;
+    IOG_MEM_STATS.bytesCopied += common_bytes;
+  } else {
+    IOG_MEM_STATS.allocs++;
   }
-  
-  free(ptr);
-  ptr = NULL;
+
+  if (zero_tail && new_small)
+    memset((char *) new_ptr + common_bytes, 0, new_bytes - common_bytes);
 
   return new_ptr;
 }
+
+/**
+ * @param[in] arena arena of block (NULL - pool and heap)
+ * @param[in] ptr   pointer from iog_mem_resize (can be NULL)
+ * @param[in] bytes size of block
+ */
+void iog_mem_free (IogMemArena_t *arena, void *ptr, size_t bytes) {
+  if (arena != NULL)
+    iog_arena_free(arena, ptr, bytes);
+  else if (iog_mem_is_pooled(bytes))
+    iog_pool_free(ptr, bytes);
+  else
+    iog_mem_heap_free(ptr, bytes);
+}
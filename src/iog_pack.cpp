@@ -0,0 +1,353 @@
+#include <string.h>
+
+#include "iog_assert.h"
+#include "iog_pack.h"
+
+static_assert(sizeof(iog_stack_value_t) == sizeof(iog_uint64_t), "values are coded as 64-bit words");
+
+static const unsigned IOG_PACK_MAX_LEAD = 31; ///< Leading zeros of xor are written in 5 bits
+
+/// Zigzag of delta of delta fits in these bits after prefix of 1, 2, 3, 4 or 5 ones
+static const unsigned IOG_PACK_DELTA_BITS[] = {7, 9, 12, 32, 64};
+
+//--------------------- PRIVATE FUNCTIONS --------------------------------------------
+
+static void iog_pack_put (IogPackWriter_t *writer, iog_uint64_t value, unsigned bits); ///< Write low bits of value
+static iog_uint64_t iog_pack_get (IogPackReader_t *reader, unsigned bits); ///< Read bits (0 if input ended)
+
+static void iog_pack_encode_xor   (IogPackWriter_t *writer, const iog_stack_value_t *data, size_t n); ///< Code data[1..n)
+static void iog_pack_encode_delta (IogPackWriter_t *writer, const iog_stack_value_t *data, size_t n); ///< Code data[1..n)
+
+static void iog_pack_decode_xor   (IogPackReader_t *reader, iog_stack_value_t *data, size_t n); ///< Read data[1..n)
+static void iog_pack_decode_delta (IogPackReader_t *reader, iog_stack_value_t *data, size_t n); ///< Read data[1..n)
+
+static iog_uint64_t iog_pack_bits (iog_stack_value_t value); ///< Bits of value
+
+//--------------------- PUBLIC FUNCTIONS --------------------------------------------
+
+/**
+ * Counts bits of both codings in one pass without writing them.
+ * @param[in]  data pointer to values
+ * @param[in]  n    amount of values
+ * @param[out] mode pointer to variable for smaller coding
+ * @return amount of words
+ */
+size_t iog_pack_size (const iog_stack_value_t *data, size_t n, IogPackMode *mode) {
+  IOG_ASSERT(mode);
+
+  *mode = IOG_PACK_XOR;
+  if (n == 0)
+    return 0;
+
+  size_t xor_bits   = 0;
+  size_t delta_bits = 0;
+
+  iog_uint64_t prev       = iog_pack_bits(data[0]);
+  iog_uint64_t prev_delta = 0;
+  unsigned lead  = 64;
+  unsigned trail = 64;
+
+  for (size_t i = 1; i < n; i++) {
+    iog_uint64_t cur = iog_pack_bits(data[i]);
+
+    iog_uint64_t x = cur ^ prev;
+    if (x == 0) {
+      xor_bits += 1;
+    } else {
+      unsigned l = (unsigned) __builtin_clzll(x);
+      unsigned t = (unsigned) __builtin_ctzll(x);
+      l = (l > IOG_PACK_MAX_LEAD) ? IOG_PACK_MAX_LEAD : l;
+
+      if (l >= lead && t >= trail) {
+        xor_bits += 2 + 64 - lead - trail;
+      } else {
+        xor_bits += 2 + 5 + 6 + 64 - l - t;
+        lead  = l;
+        trail = t;
+      }
+    }
+
+    iog_uint64_t delta = cur - prev;
+    iog_uint64_t dod   = delta - prev_delta;
+    iog_uint64_t zig   = (dod << 1) ^ (iog_uint64_t) ((long long) dod >> 63);
+
+    if (zig == 0)
+      delta_bits += 1;
+    else if (zig < (1ULL << 7))
+      delta_bits += 2 + 7;
+    else if (zig < (1ULL << 9))
+      delta_bits += 3 + 9;
+    else if (zig < (1ULL << 12))
+      delta_bits += 4 + 12;
+    else if (zig < (1ULL << 32))
+      delta_bits += 5 + 32;
+    else
+      delta_bits += 5 + 64;
+
+    prev       = cur;
+    prev_delta = delta;
+  }
+
+  if (delta_bits < xor_bits) {
+    *mode    = IOG_PACK_DELTA;
+    xor_bits = delta_bits;
+  }
+
+  return (1 + 64 + xor_bits + 63) / 64;
+}
+
+/**
+ * @param[in]  data  pointer to values
+ * @param[in]  n     amount of values
+ * @param[in]  mode  coding of values
+ * @param[out] words pointer to output (at least iog_pack_size words)
+ * @return amount of words
+ */
+size_t iog_pack_encode (const iog_stack_value_t *data, size_t n, IogPackMode mode, iog_uint64_t *words) {
+  if (n == 0)
+    return 0;
+
+  IOG_ASSERT(data);
+  IOG_ASSERT(words);
+
+  IogPackWriter_t writer = {words, 0, 0};
+
+  iog_pack_put(&writer, (iog_uint64_t) mode, 1);
+  iog_pack_put(&writer, iog_pack_bits(data[0]), 64);
+
+  if (mode == IOG_PACK_DELTA)
+    iog_pack_encode_delta(&writer, data, n);
+  else
+    iog_pack_encode_xor(&writer, data, n);
+
+  if (writer.bits % 64 != 0)
+    words[writer.bits / 64] = writer.acc;
+
+  return (writer.bits + 63) / 64;
+}
+
+/**
+ * @param[in]  words     pointer to coded stream
+ * @param[in]  words_num amount of words in stream
+ * @param[out] data      pointer to output values
+ * @param[in]  n         amount of values
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_pack_decode (const iog_uint64_t *words, size_t words_num, iog_stack_value_t *data, size_t n) {
+  if (n == 0)
+    return OK;
+
+  IOG_ASSERT(words);
+  IOG_ASSERT(data);
+
+  IogPackReader_t reader = {words, words_num * 64, 0, 0};
+
+  IogPackMode mode = (IogPackMode) iog_pack_get(&reader, 1);
+  iog_uint64_t first = iog_pack_get(&reader, 64);
+  memcpy(data, &first, sizeof(first));
+
+  if (mode == IOG_PACK_DELTA)
+    iog_pack_decode_delta(&reader, data, n);
+  else
+    iog_pack_decode_xor(&reader, data, n);
+
+  if (reader.isBad)
+    return ERR_BAD_IMAGE;
+
+  return OK;
+}
+
+//--------------------- PRIVATE FUNCTIONS --------------------------------------------
+
+/**
+ * @param[out] writer pointer to writer
+ * @param[in]  value  bits to write, higher bits must be zero
+ * @param[in]  bits   amount of bits (1..64)
+ */
+static inline void iog_pack_put (IogPackWriter_t *writer, iog_uint64_t value, unsigned bits) {
+  unsigned used  = (unsigned) (writer->bits % 64);
+  size_t   index = writer->bits / 64;
+
+  writer->bits += bits;
+
+  if (used + bits < 64) {
+    writer->acc |= value << (64 - used - bits);
+    return;
+  }
+
+  // word is finished, rest of value starts next one
+  unsigned rest = used + bits - 64;
+  writer->words[index] = writer->acc | (value >> rest);
+  writer->acc = (rest > 0) ? value << (64 - rest) : 0;
+}
+
+/**
+ * @param[out] reader pointer to reader
+ * @param[in]  bits   amount of bits (1..64)
+ * @return bits as low bits of result
+ */
+static inline iog_uint64_t iog_pack_get (IogPackReader_t *reader, unsigned bits) {
+  if (reader->bits + bits > reader->bitsNum) {
+    reader->isBad = 1;
+    reader->bits  = reader->bitsNum;
+    return 0;
+  }
+
+  unsigned used  = (unsigned) (reader->bits % 64);
+  size_t   index = reader->bits / 64;
+
+  reader->bits += bits;
+
+  iog_uint64_t result = (reader->words[index] << used) >> (64 - bits);
+  if (used + bits > 64)
+    result |= reader->words[index + 1] >> (128 - used - bits);
+
+  return result;
+}
+
+/**
+ * Control bits: 0 - same value, 10 - changed bits fit window of previous value,
+ * 11 - new window as 5 bits of leading zeros and 6 bits of length - 1.
+ * @param[out] writer pointer to writer
+ * @param[in]  data   pointer to values
+ * @param[in]  n      amount of values
+ */
+static void iog_pack_encode_xor (IogPackWriter_t *writer, const iog_stack_value_t *data, size_t n) {
+  iog_uint64_t prev = iog_pack_bits(data[0]);
+  unsigned lead  = 64;
+  unsigned trail = 64;
+
+  for (size_t i = 1; i < n; i++) {
+    iog_uint64_t cur = iog_pack_bits(data[i]);
+    iog_uint64_t x   = cur ^ prev;
+    prev = cur;
+
+    if (x == 0) {
+      iog_pack_put(writer, 0, 1);
+      continue;
+    }
+
+    unsigned l = (unsigned) __builtin_clzll(x);
+    unsigned t = (unsigned) __builtin_ctzll(x);
+    l = (l > IOG_PACK_MAX_LEAD) ? IOG_PACK_MAX_LEAD : l;
+
+    if (l >= lead && t >= trail) {
+      iog_pack_put(writer, 2, 2);
+      iog_pack_put(writer, x >> trail, 64 - lead - trail);
+      continue;
+    }
+
+    unsigned len = 64 - l - t;
+    iog_pack_put(writer, 3, 2);
+    iog_pack_put(writer, l, 5);
+    iog_pack_put(writer, len - 1, 6);
+    iog_pack_put(writer, x >> t, len);
+
+    lead  = l;
+    trail = t;
+  }
+}
+
+/**
+ * Delta of delta is zigzag coded after prefix of ones, prefix length picks
+ * bits from IOG_PACK_DELTA_BITS, 0 - same delta as before.
+ * @param[out] writer pointer to writer
+ * @param[in]  data   pointer to values
+ * @param[in]  n      amount of values
+ */
+static void iog_pack_encode_delta (IogPackWriter_t *writer, const iog_stack_value_t *data, size_t n) {
+  iog_uint64_t prev       = iog_pack_bits(data[0]);
+  iog_uint64_t prev_delta = 0;
+
+  for (size_t i = 1; i < n; i++) {
+    iog_uint64_t cur   = iog_pack_bits(data[i]);
+    iog_uint64_t delta = cur - prev;
+    iog_uint64_t dod   = delta - prev_delta;
+    iog_uint64_t zig   = (dod << 1) ^ (iog_uint64_t) ((long long) dod >> 63);
+
+    prev       = cur;
+    prev_delta = delta;
+
+    if (zig == 0) {
+      iog_pack_put(writer, 0, 1);
+      continue;
+    }
+
+    unsigned prefix = 0;
+    while (prefix < 4 && (zig >> IOG_PACK_DELTA_BITS[prefix]) != 0)
+      prefix++;
+
+    // prefix + 1 ones, zero ends prefix unless it is the longest one
+    if (prefix < 4)
+      iog_pack_put(writer, ((1ULL << (prefix + 1)) - 1) << 1, prefix + 2);
+    else
+      iog_pack_put(writer, 31, 5);
+
+    iog_pack_put(writer, zig, IOG_PACK_DELTA_BITS[prefix]);
+  }
+}
+
+/**
+ * @param[out] reader pointer to reader
+ * @param[out] data   pointer to values, data[0] is already read
+ * @param[in]  n      amount of values
+ */
+static void iog_pack_decode_xor (IogPackReader_t *reader, iog_stack_value_t *data, size_t n) {
+  iog_uint64_t prev = iog_pack_bits(data[0]);
+  unsigned lead = 0;
+  unsigned len  = 0;
+
+  for (size_t i = 1; i < n && !reader->isBad; i++) {
+    if (iog_pack_get(reader, 1) != 0) {
+      if (iog_pack_get(reader, 1) != 0) {
+        lead = (unsigned) iog_pack_get(reader, 5);
+        len  = (unsigned) iog_pack_get(reader, 6) + 1;
+      }
+
+      // window must be set by earlier value and fit the word
+      if (len == 0 || lead + len > 64) {
+        reader->isBad = 1;
+        return;
+      }
+
+      prev ^= iog_pack_get(reader, len) << (64 - lead - len);
+    }
+
+    memcpy(&data[i], &prev, sizeof(prev));
+  }
+}
+
+/**
+ * @param[out] reader pointer to reader
+ * @param[out] data   pointer to values, data[0] is already read
+ * @param[in]  n      amount of values
+ */
+static void iog_pack_decode_delta (IogPackReader_t *reader, iog_stack_value_t *data, size_t n) {
+  iog_uint64_t prev  = iog_pack_bits(data[0]);
+  iog_uint64_t delta = 0;
+
+  for (size_t i = 1; i < n && !reader->isBad; i++) {
+    unsigned prefix = 0;
+    while (prefix < 5 && iog_pack_get(reader, 1) != 0)
+      prefix++;
+
+    if (prefix > 0) {
+      iog_uint64_t zig = iog_pack_get(reader, IOG_PACK_DELTA_BITS[prefix - 1]);
+      delta += (zig >> 1) ^ (0 - (zig & 1));
+    }
+
+    prev += delta;
+    memcpy(&data[i], &prev, sizeof(prev));
+  }
+}
+
+/**
+ * @param[in] value stack value
+ * @return bits of value
+ */
+static inline iog_uint64_t iog_pack_bits (iog_stack_value_t value) {
+  iog_uint64_t bits = 0;
+  memcpy(&bits, &value, sizeof(bits));
+
+  return bits;
+}
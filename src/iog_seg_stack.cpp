@@ -0,0 +1,1404 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <new>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "iog_assert.h"
+#include "iog_seg_stack.h"
+#include "cli_colors.h"
+#include "iog_memlib.h"
+#include "iog_pack.h"
+
+static_assert(offsetof(IogSegBlock_t, firstDataCanary) + sizeof(iog_canary_t) == sizeof(IogSegBlock_t),
+              "first data canary must be right before data, spill slot is read in one call");
+
+/** @enum IogSegSpillJobKind
+ * Defines file operation of spill worker
+ */
+enum IogSegSpillJobKind {
+  IOG_SEG_SPILL_WRITE = 0, ///< Write block to its file slot
+  IOG_SEG_SPILL_READ  = 1, ///< Read block back from its file slot
+};
+
+/** @struct IogSegSpillJob_t
+ * File write or read of one block, done by worker thread
+ */
+struct IogSegSpillJob_t {
+  IogSegSpillJobKind kind;   ///< Write block to file or read it back
+  size_t index;              ///< Block index from bottom
+  IogSegBlock_t *block;      ///< Block written to file or new block that gets data back
+  size_t blockCapacity;      ///< Elements in block
+  int fd;                    ///< Spill file
+  size_t offset;             ///< Slot of block in file
+  iog_canary_t canary;       ///< Canary of slot
+  IogStackReturnCode result; ///< Result set by worker
+};
+
+/** @struct IogSegSpillWorker_t
+ * Background thread with one job slot. Only stack thread gives and applies jobs,
+ * worker only does file calls, so chain and table are never changed by two threads.
+ */
+struct IogSegSpillWorker_t {
+  std::thread thread{};           ///< Worker thread
+  std::mutex mutex{};             ///< Guards fields below
+  std::condition_variable wake{}; ///< Signals new job or stop to worker
+  std::condition_variable done{}; ///< Signals finished job to stack
+  IogSegSpillJob_t job = {};      ///< Current job
+  iog_flag_t busy     = 0;        ///< Job is given and isn't applied yet
+  iog_flag_t finished = 0;        ///< Worker finished current job
+  iog_flag_t stop     = 0;        ///< Worker must exit
+};
+
+/**
+ * @param[in] block pointer to block
+ * @return pointer to data of block
+ */
+static inline iog_stack_value_t *iog_seg_block_data (IogSegBlock_t *block) {
+  return (iog_stack_value_t *) (block + 1);
+}
+
+/**
+ * @param[in] block pointer to block
+ * @return pointer to data of block, for reads and checks
+ */
+static inline const iog_stack_value_t *iog_seg_block_data (const IogSegBlock_t *block) {
+  return (const iog_stack_value_t *) (block + 1);
+}
+
+/**
+ * @param[in] block pointer to compressed block
+ * @return pointer to compressed data of block
+ */
+static inline iog_uint64_t *iog_seg_block_words (IogSegBlock_t *block) {
+  return (iog_uint64_t *) (block + 1);
+}
+
+/**
+ * Compressed block has the same layout with packedWords instead of block_capacity.
+ * @param[in] block          pointer to block
+ * @param[in] block_capacity elements in block
+ * @return pointer to second data canary of block
+ */
+static inline iog_canary_t *iog_seg_block_second_canary (IogSegBlock_t *block, size_t block_capacity) {
+  return (iog_canary_t *) (iog_seg_block_data(block) + block_capacity);
+}
+
+/**
+ * @param[in] block          pointer to block
+ * @param[in] block_capacity elements in block
+ * @return pointer to second data canary of block, for checks
+ */
+static inline const iog_canary_t *iog_seg_block_second_canary (const IogSegBlock_t *block, size_t block_capacity) {
+  return (const iog_canary_t *) (iog_seg_block_data(block) + block_capacity);
+}
+
+/**
+ * @param[in] block_capacity elements in block
+ * @return size of block with header and both canaries in bytes
+ */
+static inline size_t iog_seg_block_bytes (size_t block_capacity) {
+  return sizeof(IogSegBlock_t) + block_capacity * sizeof(iog_stack_value_t) + sizeof(iog_canary_t);
+}
+
+//--------------------- PRIVATE FUNCTIONS --------------------------------------------
+
+static IogStackReturnCode iog_seg_stack_check (const IogSegStack_t *stack); ///< Verify by verify level
+
+static IogStackReturnCode iog_seg_block_verify (const IogSegBlock_t *block, size_t block_capacity); ///< Check block canaries
+
+static IogSegBlock_t *iog_seg_block_get     (IogSegStack_t *stack); ///< Take block from cache or allocate
+static void           iog_seg_block_release (IogSegStack_t *stack, IogSegBlock_t *block); ///< Cache or free block
+
+/// Drop reference to chain, blocks left without references are released
+static void iog_seg_chain_unref (IogSegStack_t *stack, IogSegBlock_t *block, size_t block_capacity);
+static IogStackReturnCode iog_seg_stack_unshare_top (IogSegStack_t *stack); ///< Copy shared top block
+
+static void iog_seg_block_free (IogSegBlock_t *block, size_t block_capacity); ///< Free block, spilled or compressed one
+
+static IogStackReturnCode iog_seg_spill_start (IogSegStack_t *stack, size_t max_resident, const char *dir); ///< Turn budget on
+static IogStackReturnCode iog_seg_spill_stop  (IogSegStack_t *stack); ///< Read all blocks back and turn budget off
+static void iog_seg_spill_free (IogSegStack_t *stack); ///< Stop thread and free budget, spilled blocks stay headers
+
+/// Add new top block to table, spill oldest blocks over budget
+static IogStackReturnCode iog_seg_spill_raise_top (IogSegStack_t *stack);
+/// Make block below top resident and free from worker before pop moves to it
+static IogStackReturnCode iog_seg_spill_lower_top (IogSegStack_t *stack);
+/// Start next write or read if blocks differ from budget, wait while stack is too far over budget
+static IogStackReturnCode iog_seg_spill_balance (IogSegStack_t *stack);
+/// Apply finished job of worker, wait for it if wait is 1
+static IogStackReturnCode iog_seg_spill_poll (IogSegStack_t *stack, int wait);
+static IogStackReturnCode iog_seg_spill_reserve (IogSegStack_t *stack, size_t blocks_num); ///< Grow blocks table
+
+/// Give worker write or read of block index (worker must be idle)
+static IogStackReturnCode iog_seg_spill_schedule (IogSegStack_t *stack, IogSegSpillJobKind kind, size_t index);
+/// Link block read back or replace written block by header
+static IogStackReturnCode iog_seg_spill_apply (IogSegStack_t *stack, const IogSegSpillJob_t *job);
+
+static void iog_seg_spill_worker_run (IogSegSpillWorker_t *worker); ///< Loop of worker thread
+static IogStackReturnCode iog_seg_spill_run_job (IogSegSpillJob_t *job); ///< File calls of one job
+
+static size_t iog_seg_spill_slot_bytes (size_t block_capacity); ///< Bytes of block slot in file
+static iog_canary_t iog_seg_spill_canary (const IogSegSpill_t *spill, size_t offset); ///< Canary of file slot
+
+static IogStackReturnCode iog_seg_block_pack   (IogSegStack_t *stack, IogSegBlock_t *upper); ///< Compress block below upper
+static IogStackReturnCode iog_seg_block_unpack (IogSegStack_t *stack, IogSegBlock_t *upper); ///< Decompress block below upper
+
+//--------------------- PUBLIC FUNCTIONS --------------------------------------------
+
+/**
+ * Allocates first block, turns isInitialized flag to 1.
+ * @param[out] stack          pointer to stack
+ * @param[in]  block_capacity elements in one block (at least INIT_STACK_DATA_CAPACITY)
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_seg_stack_init (IogSegStack_t *stack, size_t block_capacity) {
+  IOG_CHECK_STACK_NULL( stack );
+
+  if (stack->isInitialized)
+    return ERR_STACK_ALREADY_INITIALIZED;
+
+  if (block_capacity < INIT_STACK_DATA_CAPACITY)
+    block_capacity = INIT_STACK_DATA_CAPACITY;
+
+  stack->blockCapacity = block_capacity;
+  stack->size          = 0;
+  stack->topSize       = 0;
+  stack->spare         = NULL;
+  stack->spareNum      = 0;
+  stack->verifyLevel   = IOG_VERIFY_DEFAULT;
+  stack->spill         = NULL;
+  stack->isPacking     = 0;
+  stack->packedNum     = 0;
+  stack->packedWords   = 0;
+
+  stack->top = iog_seg_block_get(stack);
+  if (stack->top == NULL)
+    return ERR_CANT_ALLOCATE_DATA;
+
+  stack->top->prev = NULL;
+  stack->topData   = iog_seg_block_data(stack->top);
+  stack->blocksNum = 1;
+
+  stack->firstStackCanary  = STACK_CANARY_CONST + (iog_canary_t) stack;
+  stack->secondStackCanary = STACK_CANARY_CONST + (iog_canary_t) stack;
+
+  stack->isInitialized = 1;
+
+  IOG_RETURN_IF_ERROR( iog_seg_stack_check(stack) );
+
+  return OK;
+}
+
+/**
+ * Frees cached blocks and blocks not shared with snapshots or forks, resets stack to zero
+ * @param[out] stack pointer to stack
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_seg_stack_destroy (IogSegStack_t *stack) {
+  IOG_CHECK_STACK_NULL( stack );
+
+  iog_seg_spill_free(stack);
+  iog_seg_chain_unref(NULL, stack->top, stack->blockCapacity);
+
+  IogSegBlock_t *block = stack->spare;
+  while (block != NULL) {
+    IogSegBlock_t *prev = block->prev;
+    iog_seg_block_free(block, stack->blockCapacity);
+    block = prev;
+  }
+
+  stack->top      = NULL;
+  stack->topData  = NULL;
+  stack->spare    = NULL;
+  stack->spareNum = 0;
+
+  stack->firstStackCanary  = 0;
+  stack->secondStackCanary = 0;
+
+  stack->size          = 0;
+  stack->topSize       = 0;
+  stack->blocksNum     = 0;
+  stack->isInitialized = 0;
+  stack->verifyLevel   = IOG_VERIFY_DEFAULT;
+
+  return OK;
+}
+
+/**
+ * Adds value to top block, links new block if top one is full. Elements are never moved,
+ * except the first write to top block shared with snapshot or fork copies that block.
+ * With memory budget new block may start write of oldest block to file, with packing
+ * it compresses block that left IOG_SEG_PACK_WARM top ones, so push is O(1) amortized.
+ * @param[out] stack pointer to stack (can't be NULL)
+ * @param[in]  value new stack value
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_seg_stack_push (IogSegStack_t *stack, iog_stack_value_t value) {
+  IOG_RETURN_IF_ERROR( iog_seg_stack_check(stack) );
+
+  if (stack->topSize == stack->blockCapacity) {
+    if (stack->spill != NULL)
+      IOG_RETURN_IF_ERROR( iog_seg_spill_reserve(stack, stack->blocksNum + 1) );
+
+    IogSegBlock_t *block = iog_seg_block_get(stack);
+    if (block == NULL)
+      return ERR_CANT_ALLOCATE_DATA;
+
+    block->prev    = stack->top;
+    stack->top     = block;
+    stack->topData = iog_seg_block_data(block);
+    stack->topSize = 0;
+    stack->blocksNum++;
+
+    if (stack->spill != NULL)
+      IOG_RETURN_IF_ERROR( iog_seg_spill_raise_top(stack) );
+
+    if (stack->isPacking && stack->blocksNum > IOG_SEG_PACK_WARM) {
+      IogSegBlock_t *upper = stack->top;
+      for (size_t i = 1; i < IOG_SEG_PACK_WARM; i++)
+        upper = upper->prev;
+
+      IOG_RETURN_IF_ERROR( iog_seg_block_pack(stack, upper) );
+    }
+  } else if (stack->top->refs > 1) {
+    IOG_RETURN_IF_ERROR( iog_seg_stack_unshare_top(stack) );
+  }
+
+  stack->topData[stack->topSize] = value;
+  stack->topSize++;
+  stack->size++;
+
+  return OK;
+}
+
+/**
+ * Reads and removes top value. Emptied block stays on top until pop needs block below,
+ * then it goes to spare cache, so oscillation on block boundary doesn't allocate.
+ * Shared blocks are only read: popped slot isn't zeroed and block below keeps its owners.
+ * With memory budget pop waits only if block below wasn't read back from file in time,
+ * with packing compressed block below is decompressed when pop reaches it.
+ * @param[out] stack pointer to stack
+ * @param[out] value pointer to variable in which want to write (can't be null)
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_seg_stack_pop (IogSegStack_t *stack, iog_stack_value_t *value) {
+  IOG_ASSERT(value);
+
+  IOG_RETURN_IF_ERROR( iog_seg_stack_check(stack) );
+
+  if (stack->size == 0)
+    return ERR_STACK_UNDERFLOW;
+
+  if (stack->topSize == 0) {
+    if (stack->spill != NULL)
+      IOG_RETURN_IF_ERROR( iog_seg_spill_lower_top(stack) );
+
+    if (stack->isPacking && stack->top->prev->packedWords != 0)
+      IOG_RETURN_IF_ERROR( iog_seg_block_unpack(stack, stack->top) );
+
+    IogSegBlock_t *empty = stack->top;
+
+    stack->top     = empty->prev;
+    stack->topData = iog_seg_block_data(stack->top);
+    stack->topSize = stack->blockCapacity;
+    stack->blocksNum--;
+
+    // block can be written again, so earlier packing result is stale
+    stack->top->isIncompressible = 0;
+
+    // reference of emptied block to block below passes to stack, unless others keep it
+    if (empty->refs > 1) {
+      empty->refs--;
+      stack->top->refs++;
+    } else {
+      iog_seg_block_release(stack, empty);
+    }
+
+    if (stack->spill != NULL)
+      IOG_RETURN_IF_ERROR( iog_seg_spill_balance(stack) );
+  }
+
+  stack->topSize--;
+  stack->size--;
+
+  *value = stack->topData[stack->topSize];
+  if (stack->top->refs == 1)
+    stack->topData[stack->topSize] = 0;
+
+  return OK;
+}
+
+/**
+ * @param[in]  stack pointer to stack (can't be NULL)
+ * @param[out] value pointer to variable in which want to write
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_seg_stack_peek (const IogSegStack_t *stack, iog_stack_value_t *value) {
+  IOG_ASSERT(value);
+
+  const iog_stack_value_t *top = NULL;
+  IOG_RETURN_IF_ERROR( iog_seg_stack_at(stack, 0, &top) );
+
+  *value = *top;
+
+  return OK;
+}
+
+/**
+ * Walks blocks from top, so costs O(depth / blockCapacity). Elements of blocks in spill file
+ * or compressed blocks have no address, for them ERR_BLOCK_SPILLED or ERR_BLOCK_PACKED is returned.
+ * @param[in]  stack pointer to stack
+ * @param[in]  depth distance from top element (0 - top)
+ * @param[out] ptr   pointer to variable for element address
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_seg_stack_at (const IogSegStack_t *stack, size_t depth, const iog_stack_value_t **ptr) {
+  IOG_ASSERT(ptr);
+
+  IOG_RETURN_IF_ERROR( iog_seg_stack_check(stack) );
+
+  if (depth >= stack->size)
+    return ERR_STACK_UNDERFLOW;
+
+  const IogSegBlock_t *block = stack->top;
+  size_t block_size = stack->topSize;
+
+  while (depth >= block_size) {
+    depth -= block_size;
+    block = block->prev;
+    block_size = stack->blockCapacity;
+  }
+
+  if (block->isSpilled)
+    return ERR_BLOCK_SPILLED;
+
+  if (block->packedWords != 0)
+    return ERR_BLOCK_PACKED;
+
+  *ptr = iog_seg_block_data(block) + (block_size - 1 - depth);
+
+  return OK;
+}
+
+/**
+ * Snapshot holds reference to top block, so no block of chain changes until released:
+ * stack copies shared top block before writing to it. Stack with memory budget
+ * or packing owns its blocks alone, so it can't be snapshotted.
+ * @param[in]  stack    pointer to stack
+ * @param[out] snapshot pointer to snapshot
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_seg_stack_snapshot (IogSegStack_t *stack, IogSegSnapshot_t *snapshot) {
+  IOG_ASSERT(snapshot);
+
+  IOG_RETURN_IF_ERROR( iog_seg_stack_check(stack) );
+
+  if (stack->spill != NULL)
+    return ERR_BLOCK_SPILLED;
+
+  if (stack->isPacking)
+    return ERR_BLOCK_PACKED;
+
+  stack->top->refs++;
+
+  snapshot->top           = stack->top;
+  snapshot->topSize       = stack->topSize;
+  snapshot->size          = stack->size;
+  snapshot->blocksNum     = stack->blocksNum;
+  snapshot->blockCapacity = stack->blockCapacity;
+
+  return OK;
+}
+
+/**
+ * Drops current chain (blocks used only by stack are released) and shares chain of snapshot.
+ * @param[out] stack    pointer to stack
+ * @param[in]  snapshot pointer to snapshot of stack with the same block capacity
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_seg_stack_restore (IogSegStack_t *stack, const IogSegSnapshot_t *snapshot) {
+  IOG_ASSERT(snapshot);
+
+  IOG_RETURN_IF_ERROR( iog_seg_stack_check(stack) );
+
+  if (stack->spill != NULL)
+    return ERR_BLOCK_SPILLED;
+
+  if (stack->isPacking)
+    return ERR_BLOCK_PACKED;
+
+  if (snapshot->top == NULL || snapshot->blockCapacity != stack->blockCapacity)
+    return ERR_STACK_DATA_NULLPTR;
+
+  // reference is taken first, so restore to snapshot of current top can't free it
+  snapshot->top->refs++;
+  iog_seg_chain_unref(stack, stack->top, stack->blockCapacity);
+
+  stack->top       = snapshot->top;
+  stack->topData   = iog_seg_block_data(snapshot->top);
+  stack->topSize   = snapshot->topSize;
+  stack->size      = snapshot->size;
+  stack->blocksNum = snapshot->blocksNum;
+
+  IOG_RETURN_IF_ERROR( iog_seg_stack_check(stack) );
+
+  return OK;
+}
+
+/**
+ * @param[out] snapshot pointer to snapshot (zeroed after release)
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_seg_snapshot_release (IogSegSnapshot_t *snapshot) {
+  IOG_ASSERT(snapshot);
+
+  iog_seg_chain_unref(NULL, snapshot->top, snapshot->blockCapacity);
+  *snapshot = {};
+
+  return OK;
+}
+
+/**
+ * Clone shares all blocks of stack and has its own spare cache and verify level copy.
+ * @param[in]  stack pointer to stack
+ * @param[out] clone pointer to not initialized stack
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_seg_stack_fork (IogSegStack_t *stack, IogSegStack_t *clone) {
+  IOG_CHECK_STACK_NULL( clone );
+
+  IOG_RETURN_IF_ERROR( iog_seg_stack_check(stack) );
+
+  if (clone->isInitialized)
+    return ERR_STACK_ALREADY_INITIALIZED;
+
+  if (stack->spill != NULL)
+    return ERR_BLOCK_SPILLED;
+
+  if (stack->isPacking)
+    return ERR_BLOCK_PACKED;
+
+  stack->top->refs++;
+
+  clone->top           = stack->top;
+  clone->topData       = stack->topData;
+  clone->topSize       = stack->topSize;
+  clone->spare         = NULL;
+  clone->spareNum      = 0;
+  clone->size          = stack->size;
+  clone->blockCapacity = stack->blockCapacity;
+  clone->blocksNum     = stack->blocksNum;
+  clone->verifyLevel   = stack->verifyLevel;
+  clone->spill         = NULL;
+  clone->isPacking     = 0;
+  clone->packedNum     = 0;
+  clone->packedWords   = 0;
+
+  clone->firstStackCanary  = STACK_CANARY_CONST + (iog_canary_t) clone;
+  clone->secondStackCanary = STACK_CANARY_CONST + (iog_canary_t) clone;
+
+  clone->isInitialized = 1;
+
+  IOG_RETURN_IF_ERROR( iog_seg_stack_check(clone) );
+
+  return OK;
+}
+
+/**
+ * Budget is counted in whole blocks of chain, at least IOG_SEG_SPILL_MIN_RESIDENT.
+ * Turning budget on needs stack that shares no blocks with snapshots or forks
+ * and isn't packing, turning it off reads every spilled block back.
+ * @param[out] stack        pointer to stack
+ * @param[in]  budget_bytes memory for blocks (0 - no budget)
+ * @param[in]  dir          directory of temporary file (NULL - TMPDIR or /tmp)
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_seg_stack_set_budget (IogSegStack_t *stack, size_t budget_bytes, const char *dir) {
+  IOG_RETURN_IF_ERROR( iog_seg_stack_check(stack) );
+
+  if (budget_bytes == 0)
+    return iog_seg_spill_stop(stack);
+
+  if (stack->isPacking)
+    return ERR_BLOCK_PACKED;
+
+  size_t max_resident = budget_bytes / iog_seg_block_bytes(stack->blockCapacity);
+  if (max_resident < IOG_SEG_SPILL_MIN_RESIDENT)
+    max_resident = IOG_SEG_SPILL_MIN_RESIDENT;
+
+  if (stack->spill != NULL) {
+    stack->spill->maxResident = max_resident;
+    return iog_seg_spill_balance(stack);
+  }
+
+  return iog_seg_spill_start(stack, max_resident, dir);
+}
+
+/**
+ * Turning packing on compresses every block below IOG_SEG_PACK_WARM top ones, it needs
+ * stack that shares no blocks with snapshots or forks and has no memory budget.
+ * Turning it off decompresses every block.
+ * @param[out] stack pointer to stack
+ * @param[in]  on    1 to keep cold blocks compressed
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_seg_stack_set_packing (IogSegStack_t *stack, iog_flag_t on) {
+  IOG_RETURN_IF_ERROR( iog_seg_stack_check(stack) );
+
+  IogSegBlock_t *upper = stack->top;
+
+  if (on) {
+    if (stack->spill != NULL)
+      return ERR_BLOCK_SPILLED;
+
+    for (const IogSegBlock_t *block = stack->top; block != NULL; block = block->prev) {
+      if (block->refs > 1)
+        return ERR_BLOCK_PACKED;
+    }
+
+    stack->isPacking = 1;
+
+    for (size_t i = 1; i < IOG_SEG_PACK_WARM && upper != NULL; i++)
+      upper = upper->prev;
+  }
+
+  for (; upper != NULL && upper->prev != NULL; upper = upper->prev) {
+    if (on) {
+      IOG_RETURN_IF_ERROR( iog_seg_block_pack(stack, upper) );
+    } else if (upper->prev->packedWords != 0) {
+      IOG_RETURN_IF_ERROR( iog_seg_block_unpack(stack, upper) );
+    }
+  }
+
+  stack->isPacking = on ? 1 : 0;
+
+  return OK;
+}
+
+/**
+ * Prints header, every block with canaries and elements of top block.
+ * @param[in]  stack         pointer to stack
+ * @param[out] stream        pointer to stream for prints
+ * @param[in]  stk_name      name of dumping stack
+ * @param[in]  file_name     name of file from that called dump
+ * @param[in]  line_num      number of line from that called dump
+ * @param[in]  function_name name of function from that called dump
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_seg_stack_dump_f (const IogSegStack_t *stack, FILE *stream,
+      const char *stk_name, const char *file_name, int line_num, const char *function_name) {
+  IOG_ASSERT(stream);
+
+  fprintf(stream, BLACK("------------ STACK DUMP ------------" "\n"));
+  fprintf(stream, BLUE("Called from %s:%d: %s\n"), file_name, line_num, function_name);
+
+  if (stack == NULL) {
+    fprintf(stream, BLACK("IogSegStack_t %s (null)") " {}\n", stk_name);
+    return ERR_STACK_NULLPTR;
+  }
+
+  fprintf(stream, BLACK("IogSegStack_t %s (%p) {\n"), stk_name, (const void *) stack);
+
+  fprintf(stream, BLACK("  .firstStackCanary  = 0x%llx")  "\n",  stack->firstStackCanary);
+  fprintf(stream, BLACK("  .isInitialized     = %d")    "\n",  (int) stack->isInitialized);
+  fprintf(stream, BLACK("  .size              = %lu")   "\n",  stack->size);
+  fprintf(stream, BLACK("  .blockCapacity     = %lu")   "\n",  stack->blockCapacity);
+  fprintf(stream, BLACK("  .blocksNum         = %lu")   "\n",  stack->blocksNum);
+  fprintf(stream, BLACK("  .spareNum          = %lu")   "\n",  stack->spareNum);
+  fprintf(stream, BLACK("  .topSize           = %lu")   "\n",  stack->topSize);
+  fprintf(stream, BLACK("  .verifyLevel       = %d")    "\n",  (int) stack->verifyLevel);
+  fprintf(stream, BLACK("  .spill             = %p")    "\n",  (void *) stack->spill);
+  if (stack->spill != NULL) {
+    fprintf(stream, BLACK("   (max resident %lu, spilled %lu, %llu spills, %llu loads, %llu waits)") "\n",
+        stack->spill->maxResident, stack->spill->spilledNum,
+        stack->spill->spills, stack->spill->loads, stack->spill->waits
+    );
+  }
+
+  fprintf(stream, BLACK("  .isPacking         = %d")    "\n",  (int) stack->isPacking);
+  fprintf(stream, BLACK("  .packedNum         = %lu")   "\n",  stack->packedNum);
+  fprintf(stream, BLACK("  .packedWords       = %lu")   "\n",  stack->packedWords);
+
+  size_t block_index = stack->blocksNum;
+  for (const IogSegBlock_t *block = stack->top; block != NULL; block = block->prev) {
+    block_index--;
+
+    if (block->packedWords != 0) {
+      fprintf(stream, BLACK("  block[%lu] (%p, refs %lu): packed into %lu words, canaries = 0x%llx, 0x%llx") "\n",
+          block_index, (const void *) block, block->refs, block->packedWords,
+          block->firstDataCanary, *iog_seg_block_second_canary(block, block->packedWords)
+      );
+      continue;
+    }
+
+    if (block->isSpilled) {
+      fprintf(stream, BLACK("  block[%lu] (%p, refs %lu): spilled, slot canary = 0x%llx") "\n",
+          block_index, (const void *) block, block->refs, block->firstDataCanary
+      );
+      continue;
+    }
+
+    fprintf(stream, BLACK("  block[%lu] (%p, refs %lu): firstDataCanary = 0x%llx, secondDataCanary = 0x%llx") "\n",
+        block_index, (const void *) block, block->refs, block->firstDataCanary,
+        *iog_seg_block_second_canary(block, stack->blockCapacity)
+    );
+
+    if (block == stack->top) {
+      for (size_t i = 0; i < stack->topSize; i++)
+        fprintf(stream, BLACK("    [%lu]: %lg\n"), i, stack->topData[i]);
+    }
+  }
+
+  fprintf(stream, BLACK("  .secondStackCanary = 0x%llx")  "\n",  stack->secondStackCanary);
+  fprintf(stream, BLACK("}\n"));
+  fprintf(stream, BLACK("------------------------------------\n"));
+
+  return OK;
+}
+
+/**
+ * Checks stack canaries, sizes and canaries of top block.
+ * @param[in] stack pointer to stack
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_seg_stack_verify (const IogSegStack_t *stack) {
+  IOG_CHECK_STACK_NULL( stack );
+
+  if ((stack->firstStackCanary - STACK_CANARY_CONST) != (iog_canary_t) stack)
+    return ERR_DEAD_FIRST_CANARY;
+
+  if ((stack->secondStackCanary - STACK_CANARY_CONST) != (iog_canary_t) stack)
+    return ERR_DEAD_SECOND_CANARY;
+
+  if (!stack->isInitialized)
+    return ERR_STACK_ISNT_INITIALIZED;
+
+  if (stack->blockCapacity < INIT_STACK_DATA_CAPACITY)
+    return ERR_STACK_CAPACITY_UNDERFLOW;
+
+  if (stack->topSize > stack->blockCapacity)
+    return ERR_STACK_OVERFLOW;
+
+  if (stack->blocksNum == 0 || stack->size > stack->blocksNum * stack->blockCapacity)
+    return ERR_STACK_OVERFLOW;
+
+  if (stack->top == NULL || stack->topData != iog_seg_block_data(stack->top))
+    return ERR_STACK_DATA_NULLPTR;
+
+  return iog_seg_block_verify(stack->top, stack->blockCapacity);
+}
+
+/**
+ * Full verify plus canaries of every block in chain, costs O(blocksNum).
+ * Spilled blocks are only counted, they are verified when read back.
+ * @param[in] stack pointer to stack
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_seg_stack_verify_all (const IogSegStack_t *stack) {
+  IOG_RETURN_IF_ERROR( iog_seg_stack_verify(stack) );
+
+  size_t blocks_num  = 0;
+  size_t spilled_num = 0;
+  for (const IogSegBlock_t *block = stack->top; block != NULL; block = block->prev) {
+    if (block->isSpilled)
+      spilled_num++;
+    else
+      IOG_RETURN_IF_ERROR( iog_seg_block_verify(block, stack->blockCapacity) );
+
+    blocks_num++;
+  }
+
+  if (blocks_num != stack->blocksNum)
+    return ERR_STACK_OVERFLOW;
+
+  if (spilled_num != ((stack->spill != NULL) ? stack->spill->spilledNum : 0))
+    return ERR_BLOCK_SPILLED;
+
+  return OK;
+}
+
+/**
+ * @param[out] stack pointer to stack
+ * @param[in]  level new verify level
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_seg_stack_set_verify_level (IogSegStack_t *stack, IogStackVerifyLevel level) {
+  IOG_RETURN_IF_ERROR( iog_seg_stack_verify(stack) );
+
+  if (level < IOG_VERIFY_DEFAULT || level > IOG_VERIFY_FULL)
+    return ERR_INVALID_VERIFY_LEVEL;
+
+  stack->verifyLevel = level;
+
+  return OK;
+}
+
+//--------------------- PRIVATE FUNCTIONS --------------------------------------------
+
+/**
+ * Runs checks chosen by stack verify level, see iog_stack_check.
+ * @param[in] stack pointer to stack
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_seg_stack_check (const IogSegStack_t *stack) {
+#if IOG_STACK_VERIFY_LEVEL > 1
+  IOG_CHECK_STACK_NULL( stack );
+
+  int level = stack->verifyLevel;
+  if (level == IOG_VERIFY_DEFAULT)
+    level = IOG_STACK_DEFAULT_VERIFY_LEVEL;
+
+  if (level > IOG_STACK_VERIFY_LEVEL)
+    level = IOG_STACK_VERIFY_LEVEL;
+
+  if (level >= IOG_VERIFY_FULL)
+    return iog_seg_stack_verify(stack);
+
+  if (level == IOG_VERIFY_CANARIES) {
+    if ((stack->firstStackCanary - STACK_CANARY_CONST) != (iog_canary_t) stack)
+      return ERR_DEAD_FIRST_CANARY;
+
+    if ((stack->secondStackCanary - STACK_CANARY_CONST) != (iog_canary_t) stack)
+      return ERR_DEAD_SECOND_CANARY;
+
+    if (stack->top == NULL)
+      return ERR_STACK_DATA_NULLPTR;
+
+    return iog_seg_block_verify(stack->top, stack->blockCapacity);
+  }
+#endif // IOG_STACK_VERIFY_LEVEL > 1
+
+  (void) stack;
+  return OK;
+}
+
+/**
+ * @param[in] block          pointer to block
+ * @param[in] block_capacity elements in block
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_seg_block_verify (const IogSegBlock_t *block, size_t block_capacity) {
+  iog_canary_t expected = DATA_CANARY_CONST + (iog_canary_t) iog_seg_block_data(block);
+  size_t data_words = (block->packedWords != 0) ? block->packedWords : block_capacity;
+
+  if (block->firstDataCanary != expected)
+    return ERR_DEAD_FIRST_DATA_CANARY;
+
+  if (*iog_seg_block_second_canary(block, data_words) != expected)
+    return ERR_DEAD_SECOND_DATA_CANARY;
+
+  return OK;
+}
+
+/**
+ * Takes block from spare cache, or allocates zeroed block with canaries.
+ * @param[in] stack pointer to stack
+ * @return pointer to block (NULL if can't allocate)
+ */
+static IogSegBlock_t *iog_seg_block_get (IogSegStack_t *stack) {
+  IogSegBlock_t *block = stack->spare;
+
+  if (block != NULL) {
+    stack->spare = block->prev;
+    stack->spareNum--;
+    block->refs             = 1;
+    block->isIncompressible = 0;
+
+    return block;
+  }
+
+  block = (IogSegBlock_t *) iog_recalloc(NULL, 0, iog_seg_block_bytes(stack->blockCapacity), 1);
+  if (block == NULL)
+    return NULL;
+
+  block->refs = 1;
+
+  iog_canary_t canary = DATA_CANARY_CONST + (iog_canary_t) iog_seg_block_data(block);
+
+  block->firstDataCanary = canary;
+  *iog_seg_block_second_canary(block, stack->blockCapacity) = canary;
+
+  return block;
+}
+
+/**
+ * Puts emptied block to spare cache or frees it if cache is full.
+ * Popped slots are zeroed unless block was shared, push overwrites them anyway.
+ * @param[in] stack pointer to stack
+ * @param[in] block pointer to empty block
+ */
+static void iog_seg_block_release (IogSegStack_t *stack, IogSegBlock_t *block) {
+  if (stack->spareNum < IOG_SEG_MAX_SPARE_BLOCKS && !block->isSpilled && block->packedWords == 0) {
+    block->prev  = stack->spare;
+    stack->spare = block;
+    stack->spareNum++;
+
+    return;
+  }
+
+  iog_seg_block_free(block, stack->blockCapacity);
+}
+
+/**
+ * Decrements references from block down, stops at first block that still has owners.
+ * @param[in] stack          stack with spare cache for released blocks (NULL - free them)
+ * @param[in] block          top block of chain (can be NULL)
+ * @param[in] block_capacity elements in block
+ */
+static void iog_seg_chain_unref (IogSegStack_t *stack, IogSegBlock_t *block, size_t block_capacity) {
+  while (block != NULL && --block->refs == 0) {
+    IogSegBlock_t *prev = block->prev;
+
+    if (stack != NULL)
+      iog_seg_block_release(stack, block);
+    else
+      iog_seg_block_free(block, block_capacity);
+
+    block = prev;
+  }
+}
+
+/**
+ * Replaces shared top block by private copy of its elements, so only
+ * one block is copied however many snapshots share the chain.
+ * @param[out] stack pointer to stack
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_seg_stack_unshare_top (IogSegStack_t *stack) {
+  IogSegBlock_t *shared = stack->top;
+
+  IogSegBlock_t *copy = iog_seg_block_get(stack);
+  if (copy == NULL)
+    return ERR_CANT_ALLOCATE_DATA;
+
+  memcpy(iog_seg_block_data(copy), stack->topData, stack->topSize * sizeof(iog_stack_value_t));
+
+  copy->prev = shared->prev;
+  if (copy->prev != NULL)
+    copy->prev->refs++;
+
+  shared->refs--;
+
+  stack->top     = copy;
+  stack->topData = iog_seg_block_data(copy);
+
+  return OK;
+}
+
+/**
+ * Header of spilled block has no data after it, compressed block has packedWords of it.
+ * @param[in] block          pointer to block
+ * @param[in] block_capacity elements in block
+ */
+static void iog_seg_block_free (IogSegBlock_t *block, size_t block_capacity) {
+  if (block->isSpilled)
+    iog_free_sized(block, sizeof(IogSegBlock_t), 1);
+  else if (block->packedWords != 0)
+    iog_free_sized(block, iog_seg_block_bytes(block->packedWords), 1);
+  else
+    iog_free_sized(block, iog_seg_block_bytes(block_capacity), 1);
+}
+
+/**
+ * Block is verified before compression, so corruption isn't hidden in compressed data.
+ * Block that doesn't get smaller stays as it is and is marked, so it isn't measured
+ * again until pops make it top. Raw block of packed one goes to spare cache.
+ * @param[out] stack pointer to stack
+ * @param[out] upper block above compressed one
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_seg_block_pack (IogSegStack_t *stack, IogSegBlock_t *upper) {
+  IogSegBlock_t *block = upper->prev;
+  if (block->packedWords != 0 || block->isIncompressible)
+    return OK;
+
+  IOG_RETURN_IF_ERROR( iog_seg_block_verify(block, stack->blockCapacity) );
+
+  IogPackMode mode = IOG_PACK_XOR;
+  size_t words = iog_pack_size(iog_seg_block_data(block), stack->blockCapacity, &mode);
+  if (words >= stack->blockCapacity) {
+    block->isIncompressible = 1;
+    return OK;
+  }
+
+  IogSegBlock_t *packed = (IogSegBlock_t *) iog_recalloc(NULL, 0, iog_seg_block_bytes(words), 1);
+  if (packed == NULL)
+    return ERR_CANT_ALLOCATE_DATA;
+
+  iog_pack_encode(iog_seg_block_data(block), stack->blockCapacity, mode, iog_seg_block_words(packed));
+
+  packed->prev        = block->prev;
+  packed->refs        = block->refs;
+  packed->packedWords = words;
+
+  iog_canary_t canary = DATA_CANARY_CONST + (iog_canary_t) iog_seg_block_data(packed);
+  packed->firstDataCanary = canary;
+  *iog_seg_block_second_canary(packed, words) = canary;
+
+  upper->prev = packed;
+  iog_seg_block_release(stack, block);
+
+  stack->packedNum++;
+  stack->packedWords += words;
+
+  return OK;
+}
+
+/**
+ * Canaries of compressed block are checked before decoding, broken stream gives ERR_BAD_IMAGE.
+ * @param[out] stack pointer to stack
+ * @param[out] upper block above compressed one
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_seg_block_unpack (IogSegStack_t *stack, IogSegBlock_t *upper) {
+  IogSegBlock_t *packed = upper->prev;
+
+  IOG_RETURN_IF_ERROR( iog_seg_block_verify(packed, stack->blockCapacity) );
+
+  IogSegBlock_t *block = iog_seg_block_get(stack);
+  if (block == NULL)
+    return ERR_CANT_ALLOCATE_DATA;
+
+  IogStackReturnCode err = iog_pack_decode(iog_seg_block_words(packed), packed->packedWords,
+                                           iog_seg_block_data(block), stack->blockCapacity);
+  if (err != OK) {
+    iog_seg_block_release(stack, block);
+    return err;
+  }
+
+  block->prev = packed->prev;
+  block->refs = packed->refs;
+  upper->prev = block;
+
+  stack->packedNum--;
+  stack->packedWords -= packed->packedWords;
+  iog_seg_block_free(packed, stack->blockCapacity);
+
+  return OK;
+}
+
+/**
+ * Fills blocks table from chain, opens file and starts worker. Shared blocks can't be
+ * spilled, because snapshots and forks read them without budget.
+ * @param[out] stack        pointer to stack
+ * @param[in]  max_resident blocks of chain allowed in memory
+ * @param[in]  dir          directory of temporary file (NULL - TMPDIR or /tmp)
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_seg_spill_start (IogSegStack_t *stack, size_t max_resident, const char *dir) {
+  for (const IogSegBlock_t *block = stack->top; block != NULL; block = block->prev) {
+    if (block->refs > 1)
+      return ERR_BLOCK_SPILLED;
+  }
+
+  IogSegSpill_t *spill = (IogSegSpill_t *) iog_recalloc(NULL, 0, 1, sizeof(IogSegSpill_t));
+  if (spill == NULL)
+    return ERR_CANT_ALLOCATE_DATA;
+
+  spill->fd          = iog_file_temp(dir);
+  spill->maxResident = max_resident;
+  stack->spill       = spill;
+
+  if (spill->fd < 0) {
+    iog_seg_spill_free(stack);
+    return ERR_CANT_OPEN_FILE;
+  }
+
+  IogStackReturnCode err = iog_seg_spill_reserve(stack, stack->blocksNum);
+  if (err != OK) {
+    iog_seg_spill_free(stack);
+    return err;
+  }
+
+  size_t index = stack->blocksNum;
+  for (IogSegBlock_t *block = stack->top; block != NULL; block = block->prev)
+    spill->blocks[--index] = block;
+
+  spill->worker = new (std::nothrow) IogSegSpillWorker_t();
+  if (spill->worker == NULL) {
+    iog_seg_spill_free(stack);
+    return ERR_CANT_ALLOCATE_DATA;
+  }
+
+  try {
+    spill->worker->thread = std::thread(iog_seg_spill_worker_run, spill->worker);
+  } catch (...) {
+    iog_seg_spill_free(stack);
+    return ERR_TOO_MANY_THREADS;
+  }
+
+  return iog_seg_spill_balance(stack);
+}
+
+/**
+ * @param[out] stack pointer to stack
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_seg_spill_stop (IogSegStack_t *stack) {
+  IogSegSpill_t *spill = stack->spill;
+  if (spill == NULL)
+    return OK;
+
+  while (spill->spilledNum > 0) {
+    IOG_RETURN_IF_ERROR( iog_seg_spill_poll(stack, 1) );
+
+    if (!spill->worker->busy && spill->spilledNum > 0)
+      IOG_RETURN_IF_ERROR( iog_seg_spill_schedule(stack, IOG_SEG_SPILL_READ, spill->spilledNum - 1) );
+  }
+  IOG_RETURN_IF_ERROR( iog_seg_spill_poll(stack, 1) );
+
+  iog_seg_spill_free(stack);
+
+  return OK;
+}
+
+/**
+ * Waits for job in flight, its result is dropped. Works on partly started budget too.
+ * @param[out] stack pointer to stack
+ */
+static void iog_seg_spill_free (IogSegStack_t *stack) {
+  IogSegSpill_t *spill = stack->spill;
+  if (spill == NULL)
+    return;
+
+  IogSegSpillWorker_t *worker = spill->worker;
+  if (worker != NULL) {
+    {
+      std::unique_lock<std::mutex> lock(worker->mutex);
+      worker->done.wait(lock, [worker] { return !worker->busy || worker->finished; });
+
+      // block of read that wasn't applied isn't linked anywhere
+      if (worker->busy && worker->job.kind == IOG_SEG_SPILL_READ)
+        iog_seg_block_free(worker->job.block, stack->blockCapacity);
+
+      worker->busy = 0;
+      worker->stop = 1;
+    }
+    worker->wake.notify_one();
+
+    if (worker->thread.joinable())
+      worker->thread.join();
+
+    delete worker;
+  }
+
+  if (spill->fd >= 0)
+    iog_file_close(spill->fd, NULL, 0);
+
+  iog_free_sized(spill->blocks, spill->blocksCapacity, sizeof(IogSegBlock_t *));
+  iog_free_sized(spill, 1, sizeof(IogSegSpill_t));
+
+  stack->spill = NULL;
+}
+
+/**
+ * Table was reserved before block was linked, so this can fail only on file errors.
+ * @param[out] stack pointer to stack
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_seg_spill_raise_top (IogSegStack_t *stack) {
+  stack->spill->blocks[stack->blocksNum - 1] = stack->top;
+
+  return iog_seg_spill_balance(stack);
+}
+
+/**
+ * Usually block below is already read back by prefetch, so pop waits only
+ * if pops outrun the file or worker still writes that block.
+ * @param[out] stack pointer to stack
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_seg_spill_lower_top (IogSegStack_t *stack) {
+  IogSegSpill_t *spill = stack->spill;
+  size_t below = stack->blocksNum - 2;
+
+  if (spill->worker->busy && spill->worker->job.index == below)
+    IOG_RETURN_IF_ERROR( iog_seg_spill_poll(stack, 1) );
+
+  while (spill->spilledNum > below) {
+    if (!spill->worker->busy)
+      IOG_RETURN_IF_ERROR( iog_seg_spill_schedule(stack, IOG_SEG_SPILL_READ, spill->spilledNum - 1) );
+
+    IOG_RETURN_IF_ERROR( iog_seg_spill_poll(stack, 1) );
+  }
+
+  return OK;
+}
+
+/**
+ * Blocks from top - IOG_SEG_SPILL_PREFETCH up are kept in memory, older ones are written
+ * to file from bottom while chain is over budget. Only one job is in flight, push waits
+ * for it only if chain is more than IOG_SEG_SPILL_SLACK blocks over budget.
+ * @param[out] stack pointer to stack
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_seg_spill_balance (IogSegStack_t *stack) {
+  IogSegSpill_t *spill = stack->spill;
+
+  IOG_RETURN_IF_ERROR( iog_seg_spill_poll(stack, 0) );
+
+  for (;;) {
+    size_t top_index = stack->blocksNum - 1;
+    size_t keep_from = (top_index > IOG_SEG_SPILL_PREFETCH) ? top_index - IOG_SEG_SPILL_PREFETCH : 0;
+    size_t resident  = stack->blocksNum - spill->spilledNum;
+
+    if (spill->spilledNum > keep_from) {
+      if (!spill->worker->busy)
+        return iog_seg_spill_schedule(stack, IOG_SEG_SPILL_READ, spill->spilledNum - 1);
+
+      return OK;
+    }
+
+    if (resident <= spill->maxResident || spill->spilledNum >= keep_from)
+      return OK;
+
+    if (!spill->worker->busy)
+      IOG_RETURN_IF_ERROR( iog_seg_spill_schedule(stack, IOG_SEG_SPILL_WRITE, spill->spilledNum) );
+
+    if (resident <= spill->maxResident + IOG_SEG_SPILL_SLACK)
+      return OK;
+
+    IOG_RETURN_IF_ERROR( iog_seg_spill_poll(stack, 1) );
+  }
+}
+
+/**
+ * @param[out] stack pointer to stack
+ * @param[in]  wait  1 to wait for job in flight, 0 to return if it isn't finished
+ * @return Error code of job (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_seg_spill_poll (IogSegStack_t *stack, int wait) {
+  IogSegSpillWorker_t *worker = stack->spill->worker;
+
+  if (!worker->busy)
+    return OK;
+
+  IogSegSpillJob_t job = {};
+  {
+    std::unique_lock<std::mutex> lock(worker->mutex);
+
+    if (!worker->finished) {
+      if (!wait)
+        return OK;
+
+      stack->spill->waits++;
+      worker->done.wait(lock, [worker] { return worker->finished != 0; });
+    }
+
+    job = worker->job;
+    worker->busy     = 0;
+    worker->finished = 0;
+  }
+
+  return iog_seg_spill_apply(stack, &job);
+}
+
+/**
+ * @param[out] stack      pointer to stack
+ * @param[in]  blocks_num blocks table must hold
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_seg_spill_reserve (IogSegStack_t *stack, size_t blocks_num) {
+  IogSegSpill_t *spill = stack->spill;
+
+  if (blocks_num <= spill->blocksCapacity)
+    return OK;
+
+  size_t new_capacity = (spill->blocksCapacity > 0) ? spill->blocksCapacity : INIT_STACK_DATA_CAPACITY;
+  while (new_capacity < blocks_num)
+    new_capacity *= 2;
+
+  IogSegBlock_t **blocks = (IogSegBlock_t **) iog_recalloc(
+      spill->blocks, spill->blocksCapacity, new_capacity, sizeof(IogSegBlock_t *)
+  );
+  if (blocks == NULL)
+    return ERR_CANT_ALLOCATE_DATA;
+
+  spill->blocks         = blocks;
+  spill->blocksCapacity = new_capacity;
+
+  return OK;
+}
+
+/**
+ * Read gets new block here, so worker never touches blocks linked to chain except
+ * the one it writes, and pops don't reach that one before lower_top waits.
+ * @param[out] stack pointer to stack
+ * @param[in]  kind  write or read
+ * @param[in]  index block index from bottom
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_seg_spill_schedule (IogSegStack_t *stack, IogSegSpillJobKind kind, size_t index) {
+  IogSegSpill_t *spill = stack->spill;
+  IogSegSpillWorker_t *worker = spill->worker;
+
+  IogSegSpillJob_t job = {};
+  job.kind          = kind;
+  job.index         = index;
+  job.blockCapacity = stack->blockCapacity;
+  job.fd            = spill->fd;
+  job.offset        = index * iog_seg_spill_slot_bytes(stack->blockCapacity);
+  job.canary        = iog_seg_spill_canary(spill, job.offset);
+  job.result        = OK;
+
+  if (kind == IOG_SEG_SPILL_READ) {
+    job.block = iog_seg_block_get(stack);
+    if (job.block == NULL)
+      return ERR_CANT_ALLOCATE_DATA;
+  } else {
+    job.block = spill->blocks[index];
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(worker->mutex);
+
+    worker->job      = job;
+    worker->busy     = 1;
+    worker->finished = 0;
+  }
+  worker->wake.notify_one();
+
+  return OK;
+}
+
+/**
+ * Written block is replaced only if it is still next to spill and out of prefetch
+ * window, pops may have come close to it while it was written.
+ * @param[out] stack pointer to stack
+ * @param[in]  job   finished job
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_seg_spill_apply (IogSegStack_t *stack, const IogSegSpillJob_t *job) {
+  IogSegSpill_t *spill = stack->spill;
+  size_t index = job->index;
+
+  if (job->kind == IOG_SEG_SPILL_READ) {
+    IogSegBlock_t *block = job->block;
+
+    if (job->result != OK || index + 1 != spill->spilledNum) {
+      iog_seg_block_free(block, stack->blockCapacity);
+      return job->result;
+    }
+
+    IogSegBlock_t *header = spill->blocks[index];
+    block->prev      = header->prev;
+    block->refs      = header->refs;
+    block->isSpilled = 0;
+
+    iog_canary_t canary = DATA_CANARY_CONST + (iog_canary_t) iog_seg_block_data(block);
+    block->firstDataCanary = canary;
+    *iog_seg_block_second_canary(block, stack->blockCapacity) = canary;
+
+    spill->blocks[index + 1]->prev = block;
+    spill->blocks[index]           = block;
+    iog_seg_block_free(header, stack->blockCapacity);
+
+    spill->spilledNum--;
+    spill->loads++;
+
+    return OK;
+  }
+
+  size_t top_index = stack->blocksNum - 1;
+  size_t keep_from = (top_index > IOG_SEG_SPILL_PREFETCH) ? top_index - IOG_SEG_SPILL_PREFETCH : 0;
+
+  if (job->result != OK || index != spill->spilledNum || index >= keep_from)
+    return job->result;
+
+  IogSegBlock_t *header = (IogSegBlock_t *) iog_recalloc(NULL, 0, sizeof(IogSegBlock_t), 1);
+  if (header == NULL)
+    return ERR_CANT_ALLOCATE_DATA;
+
+  IogSegBlock_t *block = spill->blocks[index];
+  header->prev            = block->prev;
+  header->refs            = block->refs;
+  header->isSpilled       = 1;
+  header->firstDataCanary = job->canary;
+
+  spill->blocks[index + 1]->prev = header;
+  spill->blocks[index]           = header;
+  iog_seg_block_free(block, stack->blockCapacity);
+
+  spill->spilledNum++;
+  spill->spills++;
+
+  return OK;
+}
+
+/**
+ * Worker takes job under lock and does file calls without it.
+ * @param[out] worker pointer to worker
+ */
+static void iog_seg_spill_worker_run (IogSegSpillWorker_t *worker) {
+  std::unique_lock<std::mutex> lock(worker->mutex);
+
+  for (;;) {
+    worker->wake.wait(lock, [worker] { return worker->stop || (worker->busy && !worker->finished); });
+    if (worker->stop)
+      return;
+
+    IogSegSpillJob_t job = worker->job;
+
+    lock.unlock();
+    IogStackReturnCode result = iog_seg_spill_run_job(&job);
+    lock.lock();
+
+    worker->job.result = result;
+    worker->finished   = 1;
+    worker->done.notify_one();
+  }
+}
+
+/**
+ * Slot is written as canary, data, canary. Read fills first canary, data and second canary
+ * of block by one call and checks both canaries against file offset.
+ * @param[in] job pointer to job
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_seg_spill_run_job (IogSegSpillJob_t *job) {
+  size_t data_bytes = job->blockCapacity * sizeof(iog_stack_value_t);
+
+  if (job->kind == IOG_SEG_SPILL_WRITE) {
+    size_t data_offset = job->offset + sizeof(iog_canary_t);
+
+    if (iog_file_write_at(job->fd, &job->canary, sizeof(iog_canary_t), job->offset) != 0 ||
+        iog_file_write_at(job->fd, iog_seg_block_data(job->block), data_bytes, data_offset) != 0 ||
+        iog_file_write_at(job->fd, &job->canary, sizeof(iog_canary_t), data_offset + data_bytes) != 0)
+      return ERR_CANT_WRITE_FILE;
+
+    return OK;
+  }
+
+  if (iog_file_read_at(job->fd, &job->block->firstDataCanary, iog_seg_spill_slot_bytes(job->blockCapacity),
+                       job->offset) != 0)
+    return ERR_BAD_IMAGE;
+
+  if (job->block->firstDataCanary != job->canary)
+    return ERR_DEAD_FIRST_DATA_CANARY;
+
+  if (*iog_seg_block_second_canary(job->block, job->blockCapacity) != job->canary)
+    return ERR_DEAD_SECOND_DATA_CANARY;
+
+  return OK;
+}
+
+/**
+ * @param[in] block_capacity elements in block
+ * @return bytes of slot
+ */
+static size_t iog_seg_spill_slot_bytes (size_t block_capacity) {
+  return 2 * sizeof(iog_canary_t) + block_capacity * sizeof(iog_stack_value_t);
+}
+
+/**
+ * @param[in] spill  pointer to budget
+ * @param[in] offset slot offset in file
+ * @return canary
+ */
+static iog_canary_t iog_seg_spill_canary (const IogSegSpill_t *spill, size_t offset) {
+  return DATA_CANARY_CONST + (iog_canary_t) spill + (iog_canary_t) offset;
+}
@@ -0,0 +1,456 @@
+#include <string.h>
+
+#include <atomic>
+#include <type_traits>
+
+#include "iog_assert.h"
+#include "iog_simd.h"
+
+#if IOG_SIMD && defined(__x86_64__) && defined(__GNUC__)
+#define IOG_SIMD_X86 1 ///< Build has SSE2 and AVX2 kernels
+#include <immintrin.h>
+#else
+#define IOG_SIMD_X86 0
+#endif
+
+//--------------------- SCALAR KERNELS ----------------------------------------------
+
+// every kernel has contract of public function with the same name
+
+static iog_stack_value_t iog_simd_min_scalar (const iog_stack_value_t *data, size_t n) {
+  iog_stack_value_t result = data[0];
+  for (size_t i = 1; i < n; i++)
+    result = (data[i] < result) ? data[i] : result;
+
+  return result;
+}
+
+static iog_stack_value_t iog_simd_max_scalar (const iog_stack_value_t *data, size_t n) {
+  iog_stack_value_t result = data[0];
+  for (size_t i = 1; i < n; i++)
+    result = (data[i] > result) ? data[i] : result;
+
+  return result;
+}
+
+static iog_stack_value_t iog_simd_sum_scalar (const iog_stack_value_t *data, size_t n) {
+  iog_stack_value_t result = 0;
+  for (size_t i = 0; i < n; i++)
+    result += data[i];
+
+  return result;
+}
+
+static size_t iog_simd_find_last_scalar (const iog_stack_value_t *data, size_t n, iog_stack_value_t value) {
+  for (size_t i = n; i > 0; i--) {
+    if (iog_value_equal(data[i - 1], value))
+      return i - 1;
+  }
+
+  return n;
+}
+
+static iog_uint64_t iog_simd_checksum_scalar (const iog_stack_value_t *data, size_t n, size_t first_index) {
+  iog_uint64_t result = 0;
+  for (size_t i = 0; i < n; i++)
+    result += iog_simd_checksum_term(data[i], first_index + i);
+
+  return result;
+}
+
+static const IogSimdKernels_t IOG_SIMD_SCALAR_KERNELS = {
+  IOG_SIMD_SCALAR, iog_simd_min_scalar, iog_simd_max_scalar, iog_simd_sum_scalar, iog_simd_find_last_scalar,
+  iog_simd_checksum_scalar
+};
+
+#if IOG_SIMD_X86
+
+static_assert(std::is_same<iog_stack_value_t, double>::value,
+              "vector kernels read values as double, build with IOG_SIMD=0 for other value types");
+
+//--------------------- SSE2 KERNELS ------------------------------------------------
+
+// four accumulators hide latency of min/add, tail is finished by scalar kernel
+
+static iog_stack_value_t iog_simd_min_sse2 (const iog_stack_value_t *data, size_t n) {
+  __m128d acc0 = _mm_set1_pd(data[0]), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    acc0 = _mm_min_pd(acc0, _mm_loadu_pd(data + i));
+    acc1 = _mm_min_pd(acc1, _mm_loadu_pd(data + i + 2));
+    acc2 = _mm_min_pd(acc2, _mm_loadu_pd(data + i + 4));
+    acc3 = _mm_min_pd(acc3, _mm_loadu_pd(data + i + 6));
+  }
+
+  double lanes[2] = {};
+  _mm_storeu_pd(lanes, _mm_min_pd(_mm_min_pd(acc0, acc1), _mm_min_pd(acc2, acc3)));
+
+  iog_stack_value_t result = (lanes[0] < lanes[1]) ? lanes[0] : lanes[1];
+  if (i < n) {
+    iog_stack_value_t tail = iog_simd_min_scalar(data + i, n - i);
+    result = (tail < result) ? tail : result;
+  }
+
+  return result;
+}
+
+static iog_stack_value_t iog_simd_max_sse2 (const iog_stack_value_t *data, size_t n) {
+  __m128d acc0 = _mm_set1_pd(data[0]), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    acc0 = _mm_max_pd(acc0, _mm_loadu_pd(data + i));
+    acc1 = _mm_max_pd(acc1, _mm_loadu_pd(data + i + 2));
+    acc2 = _mm_max_pd(acc2, _mm_loadu_pd(data + i + 4));
+    acc3 = _mm_max_pd(acc3, _mm_loadu_pd(data + i + 6));
+  }
+
+  double lanes[2] = {};
+  _mm_storeu_pd(lanes, _mm_max_pd(_mm_max_pd(acc0, acc1), _mm_max_pd(acc2, acc3)));
+
+  iog_stack_value_t result = (lanes[0] > lanes[1]) ? lanes[0] : lanes[1];
+  if (i < n) {
+    iog_stack_value_t tail = iog_simd_max_scalar(data + i, n - i);
+    result = (tail > result) ? tail : result;
+  }
+
+  return result;
+}
+
+static iog_stack_value_t iog_simd_sum_sse2 (const iog_stack_value_t *data, size_t n) {
+  __m128d acc0 = _mm_setzero_pd(), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    acc0 = _mm_add_pd(acc0, _mm_loadu_pd(data + i));
+    acc1 = _mm_add_pd(acc1, _mm_loadu_pd(data + i + 2));
+    acc2 = _mm_add_pd(acc2, _mm_loadu_pd(data + i + 4));
+    acc3 = _mm_add_pd(acc3, _mm_loadu_pd(data + i + 6));
+  }
+
+  double lanes[2] = {};
+  _mm_storeu_pd(lanes, _mm_add_pd(_mm_add_pd(acc0, acc1), _mm_add_pd(acc2, acc3)));
+
+  return lanes[0] + lanes[1] + iog_simd_sum_scalar(data + i, n - i);
+}
+
+static size_t iog_simd_find_last_sse2 (const iog_stack_value_t *data, size_t n, iog_stack_value_t value) {
+  __m128d needle = _mm_set1_pd(value);
+
+  size_t i = n;
+  for (; i >= 2; i -= 2) {
+    int mask = _mm_movemask_pd(_mm_cmpeq_pd(_mm_loadu_pd(data + i - 2), needle));
+    if (mask != 0)
+      return (mask & 2) ? i - 1 : i - 2;
+  }
+
+  size_t index = iog_simd_find_last_scalar(data, i, value);
+  return (index == i) ? n : index;
+}
+
+// 64-bit multiply isn't in SSE2/AVX2, so terms use 32x32 multiply and position keys are stepped by adds
+
+static iog_uint64_t iog_simd_checksum_sse2 (const iog_stack_value_t *data, size_t n, size_t first_index) {
+  const __m128i step2 = _mm_set1_epi64x((long long) (2 * IOG_SIMD_CHECKSUM_STEP));
+  const __m128i step4 = _mm_add_epi64(step2, step2);
+  const __m128i key   = _mm_set1_epi64x((long long) IOG_SIMD_CHECKSUM_KEY);
+
+  iog_uint64_t first_key = (iog_uint64_t) first_index * IOG_SIMD_CHECKSUM_STEP;
+  __m128i pos0 = _mm_set_epi64x((long long) (first_key + IOG_SIMD_CHECKSUM_STEP), (long long) first_key);
+  __m128i pos1 = _mm_add_epi64(pos0, step2);
+  __m128i acc0 = _mm_setzero_si128(), acc1 = acc0;
+
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i keyed0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (data + i)), pos0);
+    __m128i keyed1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (data + i + 2)), pos1);
+
+    __m128i halves0 = _mm_add_epi32(keyed0, key);
+    __m128i halves1 = _mm_add_epi32(keyed1, key);
+
+    acc0 = _mm_add_epi64(acc0, _mm_add_epi64(keyed0, _mm_mul_epu32(halves0, _mm_srli_epi64(halves0, 32))));
+    acc1 = _mm_add_epi64(acc1, _mm_add_epi64(keyed1, _mm_mul_epu32(halves1, _mm_srli_epi64(halves1, 32))));
+
+    pos0 = _mm_add_epi64(pos0, step4);
+    pos1 = _mm_add_epi64(pos1, step4);
+  }
+
+  iog_uint64_t lanes[2] = {};
+  _mm_storeu_si128((__m128i *) lanes, _mm_add_epi64(acc0, acc1));
+
+  return lanes[0] + lanes[1] + iog_simd_checksum_scalar(data + i, n - i, first_index + i);
+}
+
+static const IogSimdKernels_t IOG_SIMD_SSE2_KERNELS = {
+  IOG_SIMD_SSE2, iog_simd_min_sse2, iog_simd_max_sse2, iog_simd_sum_sse2, iog_simd_find_last_sse2,
+  iog_simd_checksum_sse2
+};
+
+//--------------------- AVX2 KERNELS ------------------------------------------------
+
+#define IOG_SIMD_AVX2_TARGET __attribute__((target("avx2"))) ///< Compile function for AVX2 only
+
+IOG_SIMD_AVX2_TARGET
+static iog_stack_value_t iog_simd_min_avx2 (const iog_stack_value_t *data, size_t n) {
+  __m256d acc0 = _mm256_set1_pd(data[0]), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    acc0 = _mm256_min_pd(acc0, _mm256_loadu_pd(data + i));
+    acc1 = _mm256_min_pd(acc1, _mm256_loadu_pd(data + i + 4));
+    acc2 = _mm256_min_pd(acc2, _mm256_loadu_pd(data + i + 8));
+    acc3 = _mm256_min_pd(acc3, _mm256_loadu_pd(data + i + 12));
+  }
+
+  double lanes[4] = {};
+  _mm256_storeu_pd(lanes, _mm256_min_pd(_mm256_min_pd(acc0, acc1), _mm256_min_pd(acc2, acc3)));
+
+  iog_stack_value_t result = iog_simd_min_scalar(lanes, 4);
+  if (i < n) {
+    iog_stack_value_t tail = iog_simd_min_scalar(data + i, n - i);
+    result = (tail < result) ? tail : result;
+  }
+
+  return result;
+}
+
+IOG_SIMD_AVX2_TARGET
+static iog_stack_value_t iog_simd_max_avx2 (const iog_stack_value_t *data, size_t n) {
+  __m256d acc0 = _mm256_set1_pd(data[0]), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    acc0 = _mm256_max_pd(acc0, _mm256_loadu_pd(data + i));
+    acc1 = _mm256_max_pd(acc1, _mm256_loadu_pd(data + i + 4));
+    acc2 = _mm256_max_pd(acc2, _mm256_loadu_pd(data + i + 8));
+    acc3 = _mm256_max_pd(acc3, _mm256_loadu_pd(data + i + 12));
+  }
+
+  double lanes[4] = {};
+  _mm256_storeu_pd(lanes, _mm256_max_pd(_mm256_max_pd(acc0, acc1), _mm256_max_pd(acc2, acc3)));
+
+  iog_stack_value_t result = iog_simd_max_scalar(lanes, 4);
+  if (i < n) {
+    iog_stack_value_t tail = iog_simd_max_scalar(data + i, n - i);
+    result = (tail > result) ? tail : result;
+  }
+
+  return result;
+}
+
+IOG_SIMD_AVX2_TARGET
+static iog_stack_value_t iog_simd_sum_avx2 (const iog_stack_value_t *data, size_t n) {
+  __m256d acc0 = _mm256_setzero_pd(), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    acc0 = _mm256_add_pd(acc0, _mm256_loadu_pd(data + i));
+    acc1 = _mm256_add_pd(acc1, _mm256_loadu_pd(data + i + 4));
+    acc2 = _mm256_add_pd(acc2, _mm256_loadu_pd(data + i + 8));
+    acc3 = _mm256_add_pd(acc3, _mm256_loadu_pd(data + i + 12));
+  }
+
+  double lanes[4] = {};
+  _mm256_storeu_pd(lanes, _mm256_add_pd(_mm256_add_pd(acc0, acc1), _mm256_add_pd(acc2, acc3)));
+
+  return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + iog_simd_sum_scalar(data + i, n - i);
+}
+
+IOG_SIMD_AVX2_TARGET
+static size_t iog_simd_find_last_avx2 (const iog_stack_value_t *data, size_t n, iog_stack_value_t value) {
+  __m256d needle = _mm256_set1_pd(value);
+
+  size_t i = n;
+  for (; i >= 4; i -= 4) {
+    int mask = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(data + i - 4), needle, _CMP_EQ_OQ));
+    if (mask != 0)
+      return i - 4 + (size_t) (31 - __builtin_clz((unsigned) mask));
+  }
+
+  size_t index = iog_simd_find_last_scalar(data, i, value);
+  return (index == i) ? n : index;
+}
+
+IOG_SIMD_AVX2_TARGET
+static iog_uint64_t iog_simd_checksum_avx2 (const iog_stack_value_t *data, size_t n, size_t first_index) {
+  const __m256i step4 = _mm256_set1_epi64x((long long) (4 * IOG_SIMD_CHECKSUM_STEP));
+  const __m256i step8 = _mm256_add_epi64(step4, step4);
+  const __m256i key   = _mm256_set1_epi64x((long long) IOG_SIMD_CHECKSUM_KEY);
+
+  iog_uint64_t first_key = (iog_uint64_t) first_index * IOG_SIMD_CHECKSUM_STEP;
+  __m256i pos0 = _mm256_set_epi64x((long long) (first_key + 3 * IOG_SIMD_CHECKSUM_STEP),
+                                   (long long) (first_key + 2 * IOG_SIMD_CHECKSUM_STEP),
+                                   (long long) (first_key + IOG_SIMD_CHECKSUM_STEP), (long long) first_key);
+  __m256i pos1 = _mm256_add_epi64(pos0, step4);
+  __m256i acc0 = _mm256_setzero_si256(), acc1 = acc0;
+
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i keyed0 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (data + i)), pos0);
+    __m256i keyed1 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (data + i + 4)), pos1);
+
+    __m256i halves0 = _mm256_add_epi32(keyed0, key);
+    __m256i halves1 = _mm256_add_epi32(keyed1, key);
+
+    acc0 = _mm256_add_epi64(acc0, _mm256_add_epi64(keyed0, _mm256_mul_epu32(halves0, _mm256_srli_epi64(halves0, 32))));
+    acc1 = _mm256_add_epi64(acc1, _mm256_add_epi64(keyed1, _mm256_mul_epu32(halves1, _mm256_srli_epi64(halves1, 32))));
+
+    pos0 = _mm256_add_epi64(pos0, step8);
+    pos1 = _mm256_add_epi64(pos1, step8);
+  }
+
+  iog_uint64_t lanes[4] = {};
+  _mm256_storeu_si256((__m256i *) lanes, _mm256_add_epi64(acc0, acc1));
+
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] + iog_simd_checksum_scalar(data + i, n - i, first_index + i);
+}
+
+static const IogSimdKernels_t IOG_SIMD_AVX2_KERNELS = {
+  IOG_SIMD_AVX2, iog_simd_min_avx2, iog_simd_max_avx2, iog_simd_sum_avx2, iog_simd_find_last_avx2,
+  iog_simd_checksum_avx2
+};
+
+#undef IOG_SIMD_AVX2_TARGET
+
+#endif // IOG_SIMD_X86
+
+/// Kernels used by public functions, chosen at first call (published with release)
+static std::atomic<const IogSimdKernels_t *> IOG_SIMD_KERNELS(NULL);
+
+//--------------------- PRIVATE FUNCTIONS --------------------------------------------
+
+static const IogSimdKernels_t *iog_simd_kernels (); ///< Chosen kernels, selects best on first call
+static IogSimdIsa iog_simd_supported_isa ();         ///< Best instruction set of this cpu and build
+
+//--------------------- PUBLIC FUNCTIONS --------------------------------------------
+
+/**
+ * @param[in] data pointer to values
+ * @param[in] n    amount of values (at least 1)
+ * @return smallest value
+ */
+iog_stack_value_t iog_simd_min (const iog_stack_value_t *data, size_t n) {
+  IOG_ASSERT(data && n > 0);
+
+  return iog_simd_kernels()->min(data, n);
+}
+
+/**
+ * @param[in] data pointer to values
+ * @param[in] n    amount of values (at least 1)
+ * @return largest value
+ */
+iog_stack_value_t iog_simd_max (const iog_stack_value_t *data, size_t n) {
+  IOG_ASSERT(data && n > 0);
+
+  return iog_simd_kernels()->max(data, n);
+}
+
+/**
+ * @param[in] data pointer to values (may be NULL if n is 0)
+ * @param[in] n    amount of values
+ * @return sum of values
+ */
+iog_stack_value_t iog_simd_sum (const iog_stack_value_t *data, size_t n) {
+  if (n == 0)
+    return 0;
+
+  return iog_simd_kernels()->sum(data, n);
+}
+
+/**
+ * Scans from the end, so on stack data it finds value nearest to top first.
+ * @param[in] data  pointer to values (may be NULL if n is 0)
+ * @param[in] n     amount of values
+ * @param[in] value searched value
+ * @return index of last equal value or n if there is none
+ */
+size_t iog_simd_find_last (const iog_stack_value_t *data, size_t n, iog_stack_value_t value) {
+  if (n == 0)
+    return 0;
+
+  return iog_simd_kernels()->findLast(data, n, value);
+}
+
+/**
+ * @param[in] data        pointer to values (may be NULL if n is 0)
+ * @param[in] n           amount of values
+ * @param[in] first_index stack index of data[0]
+ * @return sum of iog_simd_checksum_term of values mod 2^64
+ */
+iog_uint64_t iog_simd_checksum (const iog_stack_value_t *data, size_t n, size_t first_index) {
+  if (n == 0)
+    return 0;
+
+  return iog_simd_kernels()->checksum(data, n, first_index);
+}
+
+/**
+ * Kernels are published atomically, so threads racing on first call all see
+ * a complete table. Explicit selection (benchmarks and tests use it to compare
+ * kernels) should still be done before threads start.
+ * @param[in] isa highest allowed instruction set
+ * @return instruction set of chosen kernels
+ */
+IogSimdIsa iog_simd_select (IogSimdIsa isa) {
+  IogSimdIsa supported = iog_simd_supported_isa();
+  if (isa > supported)
+    isa = supported;
+
+  const IogSimdKernels_t *kernels = &IOG_SIMD_SCALAR_KERNELS;
+
+#if IOG_SIMD_X86
+  if (isa == IOG_SIMD_AVX2)
+    kernels = &IOG_SIMD_AVX2_KERNELS;
+  else if (isa == IOG_SIMD_SSE2)
+    kernels = &IOG_SIMD_SSE2_KERNELS;
+#endif // IOG_SIMD_X86
+
+  IOG_SIMD_KERNELS.store(kernels, std::memory_order_release);
+
+  return kernels->isa;
+}
+
+/**
+ * @param[in] isa instruction set
+ * @return name of instruction set
+ */
+const char *iog_simd_isa_name (IogSimdIsa isa) {
+  switch (isa) {
+    case IOG_SIMD_AVX2:   return "avx2";
+    case IOG_SIMD_SSE2:   return "sse2";
+    case IOG_SIMD_SCALAR: return "scalar";
+    default:              return "unknown";
+  }
+}
+
+//--------------------- PRIVATE FUNCTIONS --------------------------------------------
+
+/**
+ * Threads racing on first call may all select, they store the same table.
+ * @return kernels used by public functions
+ */
+static const IogSimdKernels_t *iog_simd_kernels () {
+  const IogSimdKernels_t *kernels = IOG_SIMD_KERNELS.load(std::memory_order_acquire);
+  if (IOG_UNLIKELY(kernels == NULL)) {
+    iog_simd_select(IOG_SIMD_AVX2);
+    kernels = IOG_SIMD_KERNELS.load(std::memory_order_acquire);
+  }
+
+  return kernels;
+}
+
+/**
+ * @return best instruction set supported by build and cpu
+ */
+static IogSimdIsa iog_simd_supported_isa () {
+#if IOG_SIMD_X86
+  if (__builtin_cpu_supports("avx2"))
+    return IOG_SIMD_AVX2;
+
+  return IOG_SIMD_SSE2;
+#else
+  return IOG_SIMD_SCALAR;
+#endif // IOG_SIMD_X86
+}
@@ -1,28 +1,147 @@
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <new>
+#include <thread>
 
 #include "iog_assert.h"
 #include "iog_stack.h"
 #include "cli_colors.h"
 #include "iog_memlib.h"
+#include "iog_simd.h"
+
+#if IOG_STACK_STATS > 1 && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#endif
+
+//--------------------- PRIVATE FUNCTIONS --------------------------------------------
+
+/// Reallocates data of stack
+static IogStackReturnCode iog_stack_allocate_data (IogStack_t *stack, size_t new_capacity);
+
+static IogStackReturnCode iog_stack_allocate_more (IogStack_t *stack); ///< Allocates more memory for data
+static IogStackReturnCode iog_stack_free_rest     (IogStack_t *stack); ///< Free all memory after stack size.
+
+/// Capacity after growth that fits min_capacity
+static size_t iog_stack_grown_capacity  (const IogStack_t *stack, size_t min_capacity);
+static size_t iog_stack_shrunk_capacity (const IogStack_t *stack); ///< Capacity after shrink
+
+static size_t iog_stack_data_bytes (size_t capacity); ///< Bytes of data with canaries
+
+static int iog_stack_need_shrink (const IogStack_t *stack); ///< Does policy want to shrink now
+
+/// Verifies stack according to its verify level
+static IogStackReturnCode iog_stack_check (const IogStack_t *stack);
+
+/// Verify level with default resolved and clamped by IOG_STACK_VERIFY_LEVEL
+static int iog_stack_effective_verify_level (const IogStack_t *stack);
+
+static void iog_stack_update_fast_path (IogStack_t *stack); ///< Recalculate fastPath flag
+
+static int iog_stack_is_inline (const IogStack_t *stack); ///< Is data in inline buffer
+
+/// Moves data between inline buffer and heap
+static IogStackReturnCode iog_stack_relocate_data (IogStack_t *stack, size_t new_capacity);
+
+static size_t iog_stack_guarded_bytes (size_t capacity); ///< Bytes of guarded data with canary
+
+/// Sets data pointers and capacity for new buffer
+static void iog_stack_set_buffer (IogStack_t *stack, iog_canary_t *buffer, size_t capacity);
+/// Moves data to new guarded buffer
+static IogStackReturnCode iog_stack_allocate_guarded (IogStack_t *stack, size_t new_capacity);
+
+/// Moves data to other heap buffer
+static IogStackReturnCode iog_stack_allocate_heap (IogStack_t *stack, size_t new_capacity);
+
+static IogStackReturnCode iog_stack_run_verify          (const IogStack_t *stack); ///< All checks without stats
+static IogStackReturnCode iog_stack_run_verify_canaries (const IogStack_t *stack); ///< Canary checks without stats
+
+/// Counts verify call and its result in stack stats, returns err
+static IogStackReturnCode iog_stack_count_verify (const IogStack_t *stack, IogStackReturnCode err,
+                                                  iog_uint64_t start_cycles);
+static iog_uint64_t iog_stack_cycles (); ///< Cycle counter for verify stats (0 if not collected)
+
+/// Capacity that fills heap block allocated for capacity
+static size_t iog_stack_usable_capacity (const IogStack_t *stack, size_t capacity);
+
+static size_t iog_stack_mapped_bytes (size_t capacity); ///< Bytes of mapped file
+
+/// Resizes mapped file and its data
+static IogStackReturnCode iog_stack_allocate_mapped (IogStack_t *stack, size_t new_capacity);
+
+static iog_canary_t iog_stack_data_canary  (const IogStack_t *stack); ///< Expected value of data canaries
+static iog_canary_t iog_stack_super_canary (const IogStackSuperblock_t *superblock); ///< Expected superblock canary
+/// Check superblock of file with file_bytes size
+static IogStackReturnCode iog_stack_superblock_check (const IogStackSuperblock_t *superblock, size_t file_bytes);
+static void iog_stack_superblock_update (IogStack_t *stack); ///< Write size and capacity to superblock
+static void iog_stack_close_mapped (IogStack_t *stack); ///< Unmap and close file
+
+static void iog_stack_update_shrink_size (IogStack_t *stack); ///< Pop threshold of shrink by policy and marks
+
+/// Hash of n values, four lanes so it runs at memory speed
+static iog_uint64_t iog_stack_data_hash   (const iog_stack_value_t *data, size_t n);
+static iog_canary_t iog_stack_image_canary (const IogStackImageHeader_t *header); ///< Expected image head canary
+
+/// Drop aggregates of values above low_size, add aggregates of data[low_size..size)
+static IogStackReturnCode iog_stack_aggregates_sync (IogStack_t *stack, size_t low_size);
+/// Grow aggregate arrays to hold size values, arrays stay unchanged on failure
+static IogStackReturnCode iog_stack_aggregates_reserve (IogStack_t *stack, size_t size);
+static void iog_stack_aggregates_free (IogStack_t *stack); ///< Turn tracking off and free arrays
+
+static void iog_stack_checksum_drop (IogStack_t *stack, size_t low_size); ///< Remove data[low_size..checksumSize) from checksum
+static void iog_stack_checksum_add  (IogStack_t *stack); ///< Add data[checksumSize..size) to checksum
+
+/// Moves data of shared stack to new heap buffer, old one is retired
+static IogStackReturnCode iog_stack_allocate_shared (IogStack_t *stack, size_t new_capacity);
+
+static void iog_stack_share_reclaim (IogStack_t *stack); ///< Free buffers of drained epoch and switch epoch
+static void iog_stack_share_free    (IogStack_t *stack); ///< Free retired buffers and seqlock
+/// Copy counters one by one with relaxed atomic loads and stores
+static void iog_stack_stats_copy (IogStackStats_t *to, const IogStackStats_t *from);
 
 //--------------------- PUBLIC FUNCTIONS --------------------------------------------
 
 /**
- * Allocates stack data with INIT_STACK_DATA_CAPACITY size and null values.
+ * Allocates stack data with max(INIT_STACK_DATA_CAPACITY, policy->minCapacity) size and null values.
  * Turns isInitialized flag to 1.
- * @param[out] stack pointer to stack
+ * @param[out] stack  pointer to stack
+ * @param[in]  policy growth and shrink policy (if NULL then IOG_STACK_DEFAULT_POLICY)
  * @return Error code (if ok return IogStackReturnCode.OK)
  */
-IogStackReturnCode iog_stack_init(IogStack_t *stack) {
+IogStackReturnCode iog_stack_init(IogStack_t *stack, const IogStackPolicy_t *policy) {
   IOG_CHECK_STACK_NULL( stack );
 
   if (stack->isInitialized) {
     return ERR_STACK_ALREADY_INITIALIZED;
   }
 
+  if (policy == NULL)
+    policy = &IOG_STACK_DEFAULT_POLICY;
+
+  IOG_RETURN_IF_ERROR( iog_stack_policy_check(policy) );
+
+  stack->policy = *policy;
+  if (stack->policy.minCapacity < INIT_STACK_DATA_CAPACITY)
+    stack->policy.minCapacity = INIT_STACK_DATA_CAPACITY;
+
+  if (stack->policy.arena == NULL)
+    stack->policy.arena = iog_mem_bound_arena();
+
   stack->size = 0;
+  stack->marksNum = 0;
+  stack->aggregates = NULL;
+  stack->share = NULL;
+  stack->trackChecksum = 0;
+  stack->checksum = 0;
+  stack->checksumSize = 0;
+  stack->superblock = NULL;
+  stack->mapFd = -1;
+  stack->verifyLevel = IOG_VERIFY_DEFAULT;
+  IOG_STACK_STAT( stack->stats = {} );
   
-  IogStackReturnCode alloc_err = iog_stack_allocate_data(stack, INIT_STACK_DATA_CAPACITY);
+  IogStackReturnCode alloc_err = iog_stack_allocate_data(stack, stack->policy.minCapacity);
   if (alloc_err != OK) {
     iog_stack_destroy(stack);
     return alloc_err;
@@ -31,8 +150,9 @@ IogStackReturnCode iog_stack_init(IogStack_t *stack) {
   iog_stack_update_canaries(stack);
 
   stack->isInitialized = 1;
+  iog_stack_update_fast_path(stack);
 
-  IOG_RETURN_IF_ERROR(iog_stack_verify(stack));
+  IOG_RETURN_IF_ERROR(iog_stack_check(stack));
 
   return OK;
 }
@@ -45,7 +165,20 @@ IogStackReturnCode iog_stack_init(IogStack_t *stack) {
 IogStackReturnCode iog_stack_destroy(IogStack_t *stack) {
   IOG_CHECK_STACK_NULL( stack );
 
-  free(stack->firstDataCanary);
+  iog_stack_aggregates_free(stack);
+  iog_stack_share_free(stack);
+
+  // memory goes back to allocator or file, which doesn't know about poisoning
+  iog_stack_poison_slots(stack, stack->size, stack->capacity, 0);
+
+  if (stack->superblock != NULL) {
+    iog_stack_superblock_update(stack);
+    iog_stack_close_mapped(stack);
+  } else if (stack->policy.guardPages) {
+    iog_guarded_free(stack->firstDataCanary, iog_stack_guarded_bytes(stack->capacity));
+  } else if (!iog_stack_is_inline(stack)) {
+    iog_mem_free(stack->policy.arena, stack->firstDataCanary, iog_stack_data_bytes(stack->capacity));
+  }
 
   stack->data = NULL;
   stack->firstDataCanary  = NULL;
@@ -57,50 +190,216 @@ IogStackReturnCode iog_stack_destroy(IogStack_t *stack) {
   stack->size = 0;
   stack->capacity = 0;
   stack->isInitialized = 0;
+  stack->verifyLevel = IOG_VERIFY_DEFAULT;
+  stack->fastPath = 0;
+  stack->shrinkSize = 0;
+  stack->trackChecksum = 0;
+  stack->marksNum = 0;
+
+  return OK;
+}
+
+/**
+ * Maps file as [superblock][first data canary][data][second data canary].
+ * Empty file becomes new stack with policy->minCapacity. Otherwise stack is restored
+ * from superblock in O(1): only superblock and pages of data canaries are read,
+ * other pages are loaded when touched. Restored stack must pass iog_stack_verify.
+ * Mapped stack never uses guard pages or arena.
+ * @param[out] stack  pointer to stack
+ * @param[in]  path   path to file
+ * @param[in]  policy growth and shrink policy (if NULL then IOG_STACK_DEFAULT_POLICY)
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_stack_open_mapped (IogStack_t *stack, const char *path, const IogStackPolicy_t *policy) {
+  IOG_CHECK_STACK_NULL( stack );
+
+  if (stack->isInitialized)
+    return ERR_STACK_ALREADY_INITIALIZED;
+
+  if (path == NULL)
+    return ERR_CANT_OPEN_FILE;
+
+  if (policy == NULL)
+    policy = &IOG_STACK_DEFAULT_POLICY;
+
+  IOG_RETURN_IF_ERROR( iog_stack_policy_check(policy) );
+
+  stack->policy = *policy;
+  if (stack->policy.minCapacity < INIT_STACK_DATA_CAPACITY)
+    stack->policy.minCapacity = INIT_STACK_DATA_CAPACITY;
+
+  stack->policy.guardPages = 0;
+  stack->policy.arena      = NULL;
+
+  stack->size = 0;
+  stack->marksNum = 0;
+  stack->aggregates = NULL;
+  stack->share = NULL;
+  stack->trackChecksum = 0;
+  stack->checksum = 0;
+  stack->checksumSize = 0;
+  stack->superblock = NULL;
+  stack->verifyLevel = IOG_VERIFY_DEFAULT;
+  IOG_STACK_STAT( stack->stats = {} );
+
+  size_t file_bytes = 0;
+  stack->mapFd = iog_file_open(path, &file_bytes);
+  if (stack->mapFd < 0)
+    return ERR_CANT_OPEN_FILE;
+
+  int is_new = (file_bytes == 0);
+  if (is_new)
+    file_bytes = iog_stack_mapped_bytes(stack->policy.minCapacity);
+
+  if (file_bytes < iog_stack_mapped_bytes(INIT_STACK_DATA_CAPACITY)) {
+    iog_file_close(stack->mapFd, NULL, 0);
+    return ERR_BAD_SUPERBLOCK;
+  }
+
+  IogStackSuperblock_t *superblock = (IogStackSuperblock_t *) iog_file_map(stack->mapFd, file_bytes);
+  if (superblock == NULL) {
+    iog_file_close(stack->mapFd, NULL, 0);
+    return ERR_CANT_ALLOCATE_DATA;
+  }
+
+  if (is_new) {
+    superblock->magic      = IOG_STACK_MAP_MAGIC;
+    superblock->version    = IOG_STACK_MAP_VERSION;
+    superblock->valueBytes = sizeof(iog_stack_value_t);
+    superblock->canarySeed = ((iog_canary_t) time(NULL) * DATA_CANARY_CONST) ^ (iog_canary_t) superblock;
+    superblock->capacity   = stack->policy.minCapacity;
+    superblock->superCanary = iog_stack_super_canary(superblock);
+  }
+
+  IogStackReturnCode err = iog_stack_superblock_check(superblock, file_bytes);
+  if (err != OK) {
+    iog_file_close(stack->mapFd, superblock, file_bytes);
+    return err;
+  }
+
+  size_t capacity = (size_t) superblock->capacity;
+
+  // file may keep tail after failed truncate, it is cut off here
+  if (file_bytes != iog_stack_mapped_bytes(capacity)) {
+    void *base = iog_file_remap(stack->mapFd, superblock, file_bytes, iog_stack_mapped_bytes(capacity));
+    if (base == NULL) {
+      iog_file_close(stack->mapFd, superblock, file_bytes);
+      return ERR_CANT_ALLOCATE_DATA;
+    }
+
+    superblock = (IogStackSuperblock_t *) base;
+  }
+
+  stack->superblock = superblock;
+  iog_stack_set_buffer(stack, (iog_canary_t *) ((char *) superblock + IOG_STACK_MAP_HEADER_BYTES), capacity);
+  stack->size = (size_t) superblock->size;
+  iog_stack_poison_slots(stack, stack->size, stack->capacity, 1);
+
+  // data canaries of existing file are checked, not rewritten
+  if (is_new) {
+    iog_stack_update_canaries(stack);
+    iog_stack_superblock_update(stack);
+  } else {
+    stack->firstStackCanary  = STACK_CANARY_CONST + (iog_canary_t) stack;
+    stack->secondStackCanary = STACK_CANARY_CONST + (iog_canary_t) stack;
+  }
+
+  stack->isInitialized = 1;
+  iog_stack_update_fast_path(stack);
+  IOG_STACK_STAT( stack->stats.maxCapacity = stack->capacity );
+
+  err = iog_stack_verify(stack);
+  if (err != OK) {
+    iog_stack_close_mapped(stack);
+    iog_stack_destroy(stack);
+    return err;
+  }
+
+  return OK;
+}
+
+/**
+ * Size of mapped stack reaches superblock only here, on resize and on destroy,
+ * so after crash stack is restored with size of last sync.
+ * @param[in] stack pointer to stack
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_stack_sync (IogStack_t *stack) {
+  IOG_RETURN_IF_ERROR( iog_stack_verify(stack) );
+
+  if (stack->superblock == NULL)
+    return OK;
+
+  iog_stack_superblock_update(stack);
+
+  if (iog_file_sync(stack->superblock, iog_stack_mapped_bytes(stack->capacity)) != 0)
+    return ERR_CANT_SYNC_FILE;
 
   return OK;
 }
 
 /**
- * Adds value to the end of data array and increments size
+ * Adds value to the end of data array and increments size, grows data if it's full.
  * @param[out] stack pointer to stack (can't be NULL)
  * @param[in]  value new stack value
  * @return Error code (if ok return IogStackReturnCode.OK)
  */
-IogStackReturnCode iog_stack_push (IogStack_t *stack, iog_stack_value_t value) {
-  IOG_RETURN_IF_ERROR( iog_stack_verify(stack) );
+IogStackReturnCode iog_stack_push_slow (IogStack_t *stack, iog_stack_value_t value) {
+  IOG_RETURN_IF_ERROR( iog_stack_check(stack) );
 
   if (stack->size == stack->capacity) {
     IOG_RETURN_IF_ERROR( iog_stack_allocate_more(stack) );
   }
 
-  stack->data[stack->size] = value;
-  stack->size++;
+  IOG_RETURN_IF_ERROR( iog_stack_aggregates_reserve(stack, stack->size + 1) );
 
-  IOG_RETURN_IF_ERROR( iog_stack_verify(stack) );
+  int opened = iog_stack_write_begin(stack);
+
+  iog_stack_poison_slots(stack, stack->size, stack->size + 1, 0);
+  iog_relaxed_store(&stack->data[stack->size], value);
+  iog_relaxed_store(&stack->size, stack->size + 1);
+
+  IOG_STACK_STAT_ADD( stack->stats.pushes, 1 );
+  IOG_STACK_STAT_MAX( stack->stats.maxSize, stack->size );
+
+  iog_stack_write_end(stack, opened);
+
+  iog_stack_aggregates_sync(stack, stack->size - 1);
+  iog_stack_checksum_add(stack);
+
+  IOG_RETURN_IF_ERROR( iog_stack_check(stack) );
 
   return OK;
 }
 
 /**
- * If size less 1/4 of capacity then frees rest memory.
+ * If size less or equal capacity / policy.shrinkDivisor then frees rest memory.
  * @param[out] stack pointer to stack
  * @param[out] value pointer to variable in which want to write (can't be null)
  * @return Error code (if ok return IogStackReturnCode.OK)
  */
-IogStackReturnCode iog_stack_pop (IogStack_t *stack, iog_stack_value_t *value) {
+IogStackReturnCode iog_stack_pop_slow (IogStack_t *stack, iog_stack_value_t *value) {
   IOG_ASSERT(value);
 
-  IOG_RETURN_IF_ERROR( iog_stack_verify(stack) );
+  IOG_RETURN_IF_ERROR( iog_stack_check(stack) );
 
   if (stack->size == 0)
     return ERR_STACK_UNDERFLOW;
 
+  int opened = iog_stack_write_begin(stack);
+
   *value = stack->data[stack->size-1];
-  stack->data[stack->size-1] = 0;
-  stack->size--;
+  iog_stack_checksum_drop(stack, stack->size - 1);
+  iog_relaxed_store(&stack->size, stack->size - 1);
+  iog_stack_poison_slots(stack, stack->size, stack->size + 1, 1);
+
+  IOG_STACK_STAT_ADD( stack->stats.pops, 1 );
+
+  iog_stack_write_end(stack, opened);
 
-  if (stack->size <= stack->capacity / 4) {
+  iog_stack_aggregates_sync(stack, stack->size);
+
+  if (iog_stack_need_shrink(stack)) {
     IOG_RETURN_IF_ERROR( iog_stack_free_rest(stack) );
   }
 
@@ -109,248 +408,1831 @@ IogStackReturnCode iog_stack_pop (IogStack_t *stack, iog_stack_value_t *value) {
 
 
 /**
- * @param[out] stack pointer to stack (can't be NULL)
+ * @param[in]  stack pointer to stack (can't be NULL)
  * @param[out] value pointer to variable in which want to write
  * @return Error code (if ok return IogStackReturnCode.OK)
  */
-IogStackReturnCode iog_stack_peek (const IogStack_t *stack, iog_stack_value_t *value) {
+IogStackReturnCode iog_stack_peek_slow (const IogStack_t *stack, iog_stack_value_t *value) {
   IOG_ASSERT(value);
 
-  IOG_RETURN_IF_ERROR( iog_stack_verify(stack) );
+  IOG_RETURN_IF_ERROR( iog_stack_check(stack) );
 
   if (stack->size == 0)
     return ERR_STACK_UNDERFLOW;
    
   *value = stack->data[stack->size-1];
 
-  IOG_RETURN_IF_ERROR( iog_stack_verify(stack) );
+  IOG_RETURN_IF_ERROR( iog_stack_check(stack) );
 
   return OK;
 }
 
 
+
 /**
- * @param[in]  stack         pointer to stack
- * @param[out] stream        pointer to stream for prints
- * @param[in]  stk_name      name of dumping stack
- * @param[in]  file_name     name of file from that called dump
- * @param[in]  line_num      number of line from that called dump
- * @param[in]  function_name name of function from that called dump
+ * Grows capacity by policy until it fits min_capacity elements, never shrinks.
+ * @param[out] stack        pointer to stack
+ * @param[in]  min_capacity required capacity
  * @return Error code (if ok return IogStackReturnCode.OK)
  */
-IogStackReturnCode iog_stack_dump_f (const IogStack_t *stack, FILE *stream,
-      const char *stk_name, const char *file_name, int line_num, const char *function_name) {
-  IOG_ASSERT(stream);
+IogStackReturnCode iog_stack_reserve (IogStack_t *stack, size_t min_capacity) {
+  IOG_RETURN_IF_ERROR( iog_stack_check(stack) );
 
+  if (min_capacity <= stack->capacity)
+    return OK;
 
-  fprintf(stream, BLACK("------------ STACK DUMP ------------" "\n"));
-  fprintf(stream, BLUE("Called from %s:%d: %s\n"),
-     file_name, line_num, function_name
-  );
+  if (iog_stack_allocate_data(stack, iog_stack_grown_capacity(stack, min_capacity)) != OK)
+    return ERR_CANT_ALLOCATE_DATA;
 
-  if (stack == NULL) {
-    fprintf(stream, BLACK("IogStack_t %s (null)") " {}\n", stk_name);
-    return ERR_STACK_NULLPTR;
-  }
+  iog_stack_update_canaries(stack);
 
-  fprintf(stream, BLACK("IogStack_t %s (%p) {\n"), stk_name, stack);
+  IOG_RETURN_IF_ERROR( iog_stack_check(stack) );
 
-  fprintf(stream, BLACK("  .firstStackCanary  = 0x%llx")  "\n",  stack->firstStackCanary);
-  fprintf(stream, BLACK("   (canary - const   = 0x%llx)") "\n",
-      stack->firstStackCanary - STACK_CANARY_CONST
-  );
+  return OK;
+}
 
-  fprintf(stream, BLACK("  .isInitialized     = %d")    "\n",  (int) stack->isInitialized);
-  fprintf(stream, BLACK("  .size              = %lu")   "\n",  stack->size);
-  fprintf(stream, BLACK("  .capacity          = %lu")   "\n",  stack->capacity);
+/**
+ * While any mark is outstanding data isn't shrunk, so rollback never reallocates.
+ * @param[out] stack pointer to stack
+ * @param[out] mark  pointer to savepoint
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_stack_mark (IogStack_t *stack, IogStackMark_t *mark) {
+  IOG_ASSERT(mark);
 
-  fprintf(stream, BLACK("  .firstDataCanary  = %p")  "\n",  stack->firstDataCanary);
-  if (stack->firstDataCanary != NULL) {
-    fprintf(stream, BLACK("  *firstDataCanary  = 0x%llx")  "\n",  *stack->firstDataCanary);
-    fprintf(stream, BLACK("   (canary - const  = 0x%llx)") "\n",
-        *stack->firstDataCanary - DATA_CANARY_CONST
-    );
-  }
+  IOG_RETURN_IF_ERROR( iog_stack_check(stack) );
 
-  fprintf(stream, BLACK("  .data[%lu] (%p)" " = ["),           stack->capacity, stack->data);
+  mark->size  = stack->size;
+  mark->depth = stack->marksNum;
 
-  if (stack->data != NULL) {
-    fprintf(stream, "\n");
-    for (size_t i = 0; i < stack->capacity; i++)
-      fprintf(stream, BLACK("    [%lu]: %lg\n"), i, stack->data[i]);
-  }
+  stack->marksNum++;
+  iog_stack_update_shrink_size(stack);
 
-  fprintf(stream, BLACK("  ]\n"));
+  return OK;
+}
 
-  fprintf(stream, BLACK("  .secondDataCanary  = %p")  "\n",  stack->secondDataCanary);
-  if (stack->secondDataCanary != NULL) {
-    fprintf(stream, BLACK("  *secondDataCanary  = 0x%llx")  "\n",  *stack->secondDataCanary);
-    fprintf(stream, BLACK("   (canary - const   = 0x%llx)") "\n",
-       *stack->secondDataCanary - DATA_CANARY_CONST
-    );
-  }
+/**
+ * Truncates stack to size at mark in O(1) with one check, instead of pop per value.
+ * Tracked aggregates drop only their own entries above mark, checksum subtracts dropped
+ * values in one vectorized pass. Shrink waits for next pop.
+ * @param[out] stack pointer to stack
+ * @param[in]  mark  pointer to outstanding savepoint
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_stack_rollback (IogStack_t *stack, const IogStackMark_t *mark) {
+  IOG_ASSERT(mark);
 
-  fprintf(stream, BLACK("  .secondStackCanary = 0x%llx")  "\n",  stack->secondStackCanary);
-  fprintf(stream, BLACK("   (canary - const   = 0x%llx)") "\n",
-      stack->secondStackCanary - STACK_CANARY_CONST
-  );
+  IOG_RETURN_IF_ERROR( iog_stack_check(stack) );
 
-  fprintf(stream, BLACK("}\n"));
+  if (mark->depth >= stack->marksNum || mark->size > stack->size)
+    return ERR_INVALID_MARK;
 
-  fprintf(stream, BLACK("------------------------------------\n"));
+  int opened = iog_stack_write_begin(stack);
+
+  iog_stack_checksum_drop(stack, mark->size);
+  iog_stack_poison_slots(stack, mark->size, stack->size, 1);
+
+  IOG_STACK_STAT_ADD( stack->stats.pops, stack->size - mark->size );
+  iog_relaxed_store(&stack->size, mark->size);
+
+  iog_stack_write_end(stack, opened);
+  iog_stack_aggregates_sync(stack, stack->size);
+
+  stack->marksNum = mark->depth;
+  iog_stack_update_shrink_size(stack);
 
   return OK;
 }
 
 /**
- * @param[in] stack pointer to stack
+ * @param[out] stack pointer to stack
+ * @param[in]  mark  pointer to outstanding savepoint
  * @return Error code (if ok return IogStackReturnCode.OK)
  */
-IogStackReturnCode iog_stack_dump (const IogStack_t *stack) {
-  return iog_stack_dump_f(stack, stdout, NULL, NULL, 0, NULL);
-}
+IogStackReturnCode iog_stack_commit (IogStack_t *stack, const IogStackMark_t *mark) {
+  IOG_ASSERT(mark);
+
+  IOG_RETURN_IF_ERROR( iog_stack_check(stack) );
+
+  if (mark->depth >= stack->marksNum)
+    return ERR_INVALID_MARK;
 
+  stack->marksNum = mark->depth;
+  iog_stack_update_shrink_size(stack);
+
+  return OK;
+}
 
 /**
- * Checks nullptrs, overflowing, intialization.
- * @param[in] stack pointer to stack
+ * Adds values[0..n) to the end of data array, values[n-1] becomes top.
+ * Reserves memory once and verifies stack only before and after whole batch.
+ * @param[out] stack  pointer to stack (can't be NULL)
+ * @param[in]  values pointer to array of new values (can't be NULL if n > 0)
+ * @param[in]  n      number of values
  * @return Error code (if ok return IogStackReturnCode.OK)
  */
-IogStackReturnCode iog_stack_verify (const IogStack_t *stack) {
-  IOG_CHECK_STACK_NULL( stack );
+IogStackReturnCode iog_stack_push_n (IogStack_t *stack, const iog_stack_value_t *values, size_t n) {
+  IOG_RETURN_IF_ERROR( iog_stack_check(stack) );
 
-  if ((stack->firstStackCanary - STACK_CANARY_CONST) != (iog_canary_t) stack)
-    return ERR_DEAD_FIRST_CANARY;
+  if (n == 0)
+    return OK;
 
-  if ((stack->secondStackCanary - STACK_CANARY_CONST) != (iog_canary_t) stack)
-    return ERR_DEAD_SECOND_CANARY;
+  IOG_ASSERT(values);
 
-  if (!stack->isInitialized)
-    return ERR_STACK_ISNT_INITIALIZED;
-  
-  if (stack->size > stack->capacity)
-    return ERR_STACK_OVERFLOW;
+  if (stack->size + n > stack->capacity) {
+    IOG_RETURN_IF_ERROR( iog_stack_reserve(stack, stack->size + n) );
+  }
 
-  if (stack->capacity < INIT_STACK_DATA_CAPACITY)
-    return ERR_STACK_CAPACITY_UNDERFLOW;
+  IOG_RETURN_IF_ERROR( iog_stack_aggregates_reserve(stack, stack->size + n) );
 
-  if (stack->data == NULL)
-    return ERR_STACK_DATA_NULLPTR;
+  int opened = iog_stack_write_begin(stack);
 
-  if (stack->firstDataCanary == NULL)
-    return ERR_FIRST_DATA_CANARY_NULLPTR;
+  iog_stack_poison_slots(stack, stack->size, stack->size + n, 0);
+  if (stack->share == NULL) {
+    memcpy(stack->data + stack->size, values, n * sizeof(iog_stack_value_t));
+  } else {
+    for (size_t i = 0; i < n; i++)
+      iog_relaxed_store(&stack->data[stack->size + i], values[i]);
+  }
+  iog_relaxed_store(&stack->size, stack->size + n);
 
-  if (stack->secondDataCanary == NULL)
-    return ERR_SECOND_DATA_CANARY_NULLPTR;
+  IOG_STACK_STAT_ADD( stack->stats.pushes, n );
+  IOG_STACK_STAT_MAX( stack->stats.maxSize, stack->size );
 
-  //fprintf(stderr, BLACK("-- verify: %llx %llx\n"), (*stack->firstDataCanary - DATA_CANARY_CONST), (iog_canary_t) stack->data);
-  if ((*stack->firstDataCanary - DATA_CANARY_CONST) != (iog_canary_t) stack->data)
-    return ERR_DEAD_FIRST_DATA_CANARY;
+  iog_stack_write_end(stack, opened);
 
-  if ((*stack->secondDataCanary - DATA_CANARY_CONST) != (iog_canary_t) stack->data)
-    return ERR_DEAD_SECOND_DATA_CANARY;
+  iog_stack_aggregates_sync(stack, stack->size - n);
+  iog_stack_checksum_add(stack);
 
+  IOG_RETURN_IF_ERROR( iog_stack_check(stack) );
 
   return OK;
 }
 
 /**
- * @param[in] stack pointer to stack
+ * Reads and removes n top values. Values are written in stack order:
+ * values[n-1] is old top, so pop_n after push_n returns same array.
+ * Shrinks memory at most once per batch.
+ * @param[out] stack  pointer to stack
+ * @param[out] values pointer to array for n values (can't be NULL if n > 0)
+ * @param[in]  n      number of values
  * @return Error code (if ok return IogStackReturnCode.OK)
  */
-IogStackReturnCode iog_stack_update_canaries (IogStack_t *stack) {
-  IOG_CHECK_STACK_NULL( stack );
+IogStackReturnCode iog_stack_pop_n (IogStack_t *stack, iog_stack_value_t *values, size_t n) {
+  IOG_RETURN_IF_ERROR( iog_stack_check(stack) );
 
-  stack->firstStackCanary  = STACK_CANARY_CONST + (iog_canary_t) stack;
-  stack->secondStackCanary = STACK_CANARY_CONST + (iog_canary_t) stack;
+  if (n == 0)
+    return OK;
 
-  if (stack->data == NULL)
-    return ERR_STACK_DATA_NULLPTR;
+  IOG_ASSERT(values);
 
-  if (stack->firstDataCanary == NULL)
-    return ERR_FIRST_DATA_CANARY_NULLPTR;
+  if (stack->size < n)
+    return ERR_STACK_UNDERFLOW;
 
-  if (stack->secondDataCanary == NULL)
-    return ERR_SECOND_DATA_CANARY_NULLPTR;
+  int opened = iog_stack_write_begin(stack);
 
-  
-  *stack->firstDataCanary  = DATA_CANARY_CONST + (iog_canary_t) stack->data;
-  *stack->secondDataCanary = DATA_CANARY_CONST + (iog_canary_t) stack->data;
+  iog_stack_checksum_drop(stack, stack->size - n);
+  iog_relaxed_store(&stack->size, stack->size - n);
+  memcpy(values, stack->data + stack->size, n * sizeof(iog_stack_value_t));
+  iog_stack_poison_slots(stack, stack->size, stack->size + n, 1);
+
+  IOG_STACK_STAT_ADD( stack->stats.pops, n );
+
+  iog_stack_write_end(stack, opened);
+
+  iog_stack_aggregates_sync(stack, stack->size);
+
+  if (iog_stack_need_shrink(stack)) {
+    IOG_RETURN_IF_ERROR( iog_stack_free_rest(stack) );
+  }
+
+  IOG_RETURN_IF_ERROR( iog_stack_check(stack) );
 
   return OK;
 }
 
-//--------------------- PRIVATE FUNCTIONS --------------------------------------------
-
 /**
- * Allocates max( new_capacity, INIT_STACK_DATA_CAPACITY ).
- * Can't free data, for that use destroy.
- * @param[in] stack        pointer to stack
- * @param[in] new_capacity new capacity of stack data
+ * Reads n top values without removing, order is the same as in iog_stack_pop_n.
+ * @param[in]  stack  pointer to stack
+ * @param[out] values pointer to array for n values (can't be NULL if n > 0)
+ * @param[in]  n      number of values
  * @return Error code (if ok return IogStackReturnCode.OK)
  */
-static IogStackReturnCode iog_stack_allocate_data (IogStack_t *stack, size_t new_capacity) {
-  IOG_CHECK_STACK_NULL(stack);
+IogStackReturnCode iog_stack_peek_n (const IogStack_t *stack, iog_stack_value_t *values, size_t n) {
+  IOG_RETURN_IF_ERROR( iog_stack_check(stack) );
 
-  if (new_capacity < INIT_STACK_DATA_CAPACITY)
-      new_capacity = INIT_STACK_DATA_CAPACITY;
-
-  if (stack->firstDataCanary != NULL)
-    *stack->firstDataCanary = 0;
-
-  if (stack->secondDataCanary != NULL)
-    *stack->secondDataCanary = 0;
+  if (n == 0)
+    return OK;
 
-  iog_canary_t *tmp_ptr = (iog_canary_t *) iog_recalloc (
-      stack->firstDataCanary,
-      2 * sizeof(iog_canary_t) + stack->capacity * sizeof(iog_stack_value_t),
-      2 * sizeof(iog_canary_t) + new_capacity * sizeof(iog_stack_value_t),
-      1
-  );
-
-  if (tmp_ptr == NULL)
-    return ERR_CANT_ALLOCATE_DATA;
+  IOG_ASSERT(values);
 
-  stack->firstDataCanary = tmp_ptr;
-  stack->data = (iog_stack_value_t *) (tmp_ptr + 1);
-  stack->secondDataCanary = (iog_canary_t *) (stack->data + new_capacity);
+  if (stack->size < n)
+    return ERR_STACK_UNDERFLOW;
 
-  stack->capacity = new_capacity;
+  memcpy(values, stack->data + stack->size - n, n * sizeof(iog_stack_value_t));
 
   return OK;
 }
 
 /**
- * Double capacity by allocating more memory
- * @param[in] stack pointer to stack
+ * Tracking makes push and pop take slow path, which updates monotonic min and max stacks
+ * and prefix sums: O(1) amortized per operation and up to three extra values per element.
+ * Turning on builds aggregates of current values in one pass.
+ * Push that can't grow aggregates fails with ERR_CANT_ALLOCATE_DATA before changing stack.
+ * If iog_stack_data_changed can't grow them, tracking is turned off and it returns the same error.
+ * @param[out] stack pointer to stack
+ * @param[in]  on    1 - track aggregates, 0 - free them
  * @return Error code (if ok return IogStackReturnCode.OK)
  */
-static IogStackReturnCode iog_stack_allocate_more (IogStack_t *stack) {
-  IOG_RETURN_IF_ERROR( iog_stack_verify(stack) );
+IogStackReturnCode iog_stack_track_aggregates (IogStack_t *stack, int on) {
+  IOG_RETURN_IF_ERROR( iog_stack_check(stack) );
 
-  if (iog_stack_allocate_data(stack, stack->capacity * 2) != OK)
-    return ERR_CANT_ALLOCATE_DATA;
+  if (!on) {
+    iog_stack_aggregates_free(stack);
+  } else if (stack->aggregates == NULL) {
+    stack->aggregates = (IogStackAggregates_t *) iog_recalloc(NULL, 0, 1, sizeof(IogStackAggregates_t));
+    if (stack->aggregates == NULL)
+      return ERR_CANT_ALLOCATE_DATA;
 
-  iog_stack_update_canaries(stack);
+    IOG_RETURN_IF_ERROR( iog_stack_aggregates_sync(stack, 0) );
+  }
 
-  IOG_RETURN_IF_ERROR( iog_stack_verify(stack) );
+  iog_stack_update_fast_path(stack);
 
   return OK;
 }
 
 /**
- * @param[in] stack pointer to stack
+ * @param[in]  stack pointer to stack
+ * @param[out] value pointer to variable for smallest value
  * @return Error code (if ok return IogStackReturnCode.OK)
  */
-static IogStackReturnCode iog_stack_free_rest (IogStack_t *stack) {
-  IOG_RETURN_IF_ERROR (iog_stack_verify(stack) );
-
-  if (iog_stack_allocate_data(stack, stack->size) != OK)
-    return ERR_CANT_FREE_DATA;
+IogStackReturnCode iog_stack_min (const IogStack_t *stack, iog_stack_value_t *value) {
+  IOG_ASSERT(value);
 
-  iog_stack_update_canaries(stack);
+  IOG_RETURN_IF_ERROR( iog_stack_check(stack) );
+
+  if (stack->size == 0)
+    return ERR_STACK_UNDERFLOW;
+
+  if (stack->aggregates != NULL && stack->aggregates->minsNum > 0)
+    *value = stack->aggregates->mins[stack->aggregates->minsNum - 1].value;
+  else
+    *value = iog_simd_min(stack->data, stack->size);
+
+  return OK;
+}
+
+/**
+ * @param[in]  stack pointer to stack
+ * @param[out] value pointer to variable for largest value
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_stack_max (const IogStack_t *stack, iog_stack_value_t *value) {
+  IOG_ASSERT(value);
+
+  IOG_RETURN_IF_ERROR( iog_stack_check(stack) );
+
+  if (stack->size == 0)
+    return ERR_STACK_UNDERFLOW;
+
+  if (stack->aggregates != NULL && stack->aggregates->maxsNum > 0)
+    *value = stack->aggregates->maxs[stack->aggregates->maxsNum - 1].value;
+  else
+    *value = iog_simd_max(stack->data, stack->size);
+
+  return OK;
+}
+
+/**
+ * Tracked sum is added in push order, scan adds in lanes, so results may differ in last bits.
+ * @param[in]  stack pointer to stack
+ * @param[out] value pointer to variable for sum (0 for empty stack)
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_stack_sum (const IogStack_t *stack, iog_stack_value_t *value) {
+  IOG_ASSERT(value);
+
+  IOG_RETURN_IF_ERROR( iog_stack_check(stack) );
+
+  if (stack->size == 0)
+    *value = 0;
+  else if (stack->aggregates != NULL)
+    *value = stack->aggregates->sums[stack->size - 1];
+  else
+    *value = iog_simd_sum(stack->data, stack->size);
+
+  return OK;
+}
+
+/**
+ * @param[in]  stack pointer to stack
+ * @param[in]  value searched value
+ * @param[out] depth pointer to variable for depth of found value (0 - top)
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_stack_find (const IogStack_t *stack, iog_stack_value_t value, size_t *depth) {
+  IOG_ASSERT(depth);
+
+  IOG_RETURN_IF_ERROR( iog_stack_check(stack) );
+
+  size_t index = iog_simd_find_last(stack->data, stack->size, value);
+  if (index == stack->size)
+    return ERR_VALUE_NOT_FOUND;
+
+  *depth = stack->size - 1 - index;
+
+  return OK;
+}
+
+/**
+ * Turning on sums terms of current values in one vectorized pass. Checksum is kept in
+ * O(1) per push and pop, so it catches stray writes into data between operations.
+ * @param[out] stack pointer to stack
+ * @param[in]  on    1 - track checksum, 0 - stop tracking
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_stack_track_checksum (IogStack_t *stack, int on) {
+  IOG_RETURN_IF_ERROR( iog_stack_check(stack) );
+
+  if (!on) {
+    stack->trackChecksum = 0;
+  } else if (!stack->trackChecksum) {
+    stack->trackChecksum = 1;
+    stack->checksum      = 0;
+    stack->checksumSize  = 0;
+
+    iog_stack_checksum_add(stack);
+  }
+
+  iog_stack_update_fast_path(stack);
+
+  return OK;
+}
+
+/**
+ * Runs checks of iog_stack_verify, then rescans data, which is O(size), so it isn't run
+ * by verify levels. Call and its result are counted in stack stats.
+ * @param[in] stack pointer to stack
+ * @return Error code (if ok return IogStackReturnCode.OK), OK if checksum isn't tracked
+ */
+IogStackReturnCode iog_stack_verify_checksum (const IogStack_t *stack) {
+  IOG_CHECK_STACK_NULL( stack );
+
+  iog_uint64_t start_cycles = iog_stack_cycles();
+
+  IogStackReturnCode err = iog_stack_run_verify(stack);
+  if (err == OK && stack->trackChecksum && (stack->checksumSize > stack->size ||
+      iog_simd_checksum(stack->data, stack->checksumSize, 0) != stack->checksum))
+    err = ERR_BAD_CHECKSUM;
+
+  return iog_stack_count_verify(stack, err, start_cycles);
+}
+
+/**
+ * Values of data[first_changing..size) must be the same as at last stack operation,
+ * they are read once to subtract them from checksum. Does nothing if checksum isn't tracked.
+ * @param[out] stack          pointer to stack
+ * @param[in]  first_changing lowest index that will be popped or written
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_stack_data_changing (IogStack_t *stack, size_t first_changing) {
+  IOG_CHECK_STACK_NULL( stack );
+
+  iog_stack_checksum_drop(stack, first_changing);
+
+  return OK;
+}
+
+/**
+ * For code that writes data and size by itself: values below first_changed must be
+ * the same as at last stack operation, and if checksum is tracked they must have
+ * been announced by iog_stack_data_changing before first write.
+ * @param[out] stack         pointer to stack
+ * @param[in]  first_changed lowest index that was popped or written
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_stack_data_changed (IogStack_t *stack, size_t first_changed) {
+  IOG_CHECK_STACK_NULL( stack );
+
+  iog_stack_checksum_add(stack);
+
+  return iog_stack_aggregates_sync(stack, first_changed);
+}
+
+/**
+ * @param[in] stack pointer to stack (can't be NULL)
+ * @return 1 if stack operations run verify by its verify level, else 0
+ */
+int iog_stack_is_checked (const IogStack_t *stack) {
+  return iog_stack_effective_verify_level(stack) > IOG_VERIFY_OFF;
+}
+
+/**
+ * Shared stack can be read by iog_stack_read_shared from other threads while this one
+ * keeps working with it. Writer pays two version stores per operation, free slots
+ * aren't poisoned while shared. Mapped and guarded data is resized in place, so it
+ * can't be shared. Before turning sharing off all readers must be stopped.
+ * @param[out] stack pointer to stack
+ * @param[in]  on    1 - share stack, 0 - stop sharing and free retired buffers
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_stack_share (IogStack_t *stack, int on) {
+  IOG_RETURN_IF_ERROR( iog_stack_check(stack) );
+
+  if (!on) {
+    iog_stack_share_free(stack);
+    iog_stack_poison_slots(stack, stack->size, stack->capacity, 1);
+
+    return OK;
+  }
+
+  if (stack->share != NULL)
+    return OK;
+
+  if (stack->superblock != NULL || stack->policy.guardPages)
+    return ERR_STACK_NOT_SHARED;
+
+  IogStackShare_t *share = new (std::nothrow) IogStackShare_t();
+  if (share == NULL)
+    return ERR_CANT_ALLOCATE_DATA;
+
+  iog_stack_poison_slots(stack, stack->size, stack->capacity, 0);
+  stack->share = share;
+
+  return OK;
+}
+
+/**
+ * Seqlock read: fields are copied while version is even and the same before and after copy,
+ * otherwise copy is repeated. Top values are copied only after size, capacity and data
+ * are known to be consistent, and buffer isn't freed while epoch of reader has readers,
+ * so copy never leaves the buffer. Reader waits only while writer is inside operation (or whole
+ * iog_vm_run). Shared stack doesn't count verifies, other stats are consistent with size.
+ * @param[in]  stack   pointer to shared stack
+ * @param[out] view    pointer to struct for size, capacity and stats
+ * @param[out] top     pointer to array for top values (can be NULL if top_max is 0)
+ * @param[in]  top_max size of top array
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_stack_read_shared (const IogStack_t *stack, IogStackView_t *view,
+    iog_stack_value_t *top, size_t top_max) {
+  IOG_CHECK_STACK_NULL( stack );
+  IOG_ASSERT(view);
+  IOG_ASSERT(top != NULL || top_max == 0);
+
+  IogStackShare_t *share = stack->share;
+  if (share == NULL)
+    return ERR_STACK_NOT_SHARED;
+
+  for (;;) {
+    iog_uint64_t version = share->version.load(std::memory_order_acquire);
+    if (version & 1) {
+      share->retries.fetch_add(1, std::memory_order_relaxed);
+      std::this_thread::yield();
+      continue;
+    }
+
+    // reader is counted for one attempt only, so retries don't hold epoch that writer waits for
+    unsigned epoch = share->epoch.load(std::memory_order_acquire);
+    share->readers[epoch].fetch_add(1, std::memory_order_seq_cst);
+
+    size_t size     = iog_relaxed_load(&stack->size);
+    size_t capacity = iog_relaxed_load(&stack->capacity);
+    const iog_stack_value_t *data = iog_relaxed_load(&stack->data);
+
+    IogStackStats_t stats = {};
+    IOG_STACK_STAT( iog_stack_stats_copy(&stats, &stack->stats) );
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    int consistent = (share->version.load(std::memory_order_relaxed) == version);
+
+    size_t top_num = (top_max < size) ? top_max : size;
+    if (consistent) {
+      for (size_t i = 0; i < top_num; i++)
+        top[i] = iog_relaxed_load(&data[size - top_num + i]);
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+      consistent = (share->version.load(std::memory_order_relaxed) == version);
+    }
+
+    share->readers[epoch].fetch_sub(1, std::memory_order_release);
+
+    if (!consistent) {
+      share->retries.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+
+    view->version  = version;
+    view->size     = size;
+    view->capacity = capacity;
+    view->topNum   = top_num;
+    view->stats    = stats;
+    break;
+  }
+
+  return OK;
+}
+
+/**
+ * Image holds values only, data is written by one fwrite, so large stacks go
+ * straight to file without passing through stream buffer.
+ * @param[in]  stack  pointer to stack
+ * @param[out] stream pointer to binary stream
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_stack_save_f (const IogStack_t *stack, FILE *stream) {
+  IOG_ASSERT(stream);
 
   IOG_RETURN_IF_ERROR( iog_stack_verify(stack) );
 
+  IogStackImageHeader_t header = {};
+  header.magic      = IOG_STACK_IMAGE_MAGIC;
+  header.version    = IOG_STACK_IMAGE_VERSION;
+  header.valueBytes = sizeof(iog_stack_value_t);
+  header.size       = stack->size;
+  header.dataHash   = iog_stack_data_hash(stack->data, stack->size);
+  header.headCanary = iog_stack_image_canary(&header);
+
+  iog_canary_t tail_canary = DATA_CANARY_CONST + header.dataHash;
+
+  if (fwrite(&header, sizeof(header), 1, stream) != 1 ||
+      fwrite(stack->data, sizeof(iog_stack_value_t), stack->size, stream) != stack->size ||
+      fwrite(&tail_canary, sizeof(tail_canary), 1, stream) != 1)
+    return ERR_CANT_WRITE_FILE;
+
+  return OK;
+}
+
+/**
+ * Data is reserved once and read straight into stack buffer. On error stack
+ * stays uninitialized.
+ * @param[out] stack  pointer to uninitialized stack
+ * @param[in]  stream pointer to binary stream positioned at image
+ * @param[in]  policy pointer to policy of loaded stack (NULL - default policy)
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_stack_load_f (IogStack_t *stack, FILE *stream, const IogStackPolicy_t *policy) {
+  IOG_CHECK_STACK_NULL( stack );
+  IOG_ASSERT(stream);
+
+  if (stack->isInitialized)
+    return ERR_STACK_ALREADY_INITIALIZED;
+
+  IogStackImageHeader_t header = {};
+  if (fread(&header, sizeof(header), 1, stream) != 1)
+    return ERR_BAD_IMAGE;
+
+  if (header.magic != IOG_STACK_IMAGE_MAGIC || header.version != IOG_STACK_IMAGE_VERSION ||
+      header.valueBytes != sizeof(iog_stack_value_t) || header.headCanary != iog_stack_image_canary(&header))
+    return ERR_BAD_IMAGE;
+
+  if (header.size > SIZE_MAX / sizeof(iog_stack_value_t) - 2)
+    return ERR_BAD_IMAGE;
+
+  size_t size = (size_t) header.size;
+
+  IOG_RETURN_IF_ERROR( iog_stack_init(stack, policy) );
+
+  IogStackReturnCode err = iog_stack_reserve(stack, size);
+  if (err != OK) {
+    iog_stack_destroy(stack);
+    return err;
+  }
+
+  iog_stack_poison_slots(stack, 0, size, 0);
+
+  iog_canary_t tail_canary = 0;
+  if (fread(stack->data, sizeof(iog_stack_value_t), size, stream) != size ||
+      fread(&tail_canary, sizeof(tail_canary), 1, stream) != 1) {
+    iog_stack_destroy(stack);
+    return ERR_BAD_IMAGE;
+  }
+
+  stack->size = size;
+  IOG_STACK_STAT( stack->stats.maxSize = size );
+
+  if (tail_canary != DATA_CANARY_CONST + header.dataHash ||
+      iog_stack_data_hash(stack->data, size) != header.dataHash) {
+    iog_stack_destroy(stack);
+    return ERR_BAD_IMAGE;
+  }
+
+  err = iog_stack_verify(stack);
+  if (err != OK) {
+    iog_stack_destroy(stack);
+    return err;
+  }
+
+  return OK;
+}
+
+/**
+ * @param[in]  stack         pointer to stack
+ * @param[out] stream        pointer to stream for prints
+ * @param[in]  stk_name      name of dumping stack
+ * @param[in]  file_name     name of file from that called dump
+ * @param[in]  line_num      number of line from that called dump
+ * @param[in]  function_name name of function from that called dump
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_stack_dump_f (const IogStack_t *stack, FILE *stream,
+      const char *stk_name, const char *file_name, int line_num, const char *function_name) {
+  IOG_ASSERT(stream);
+
+
+  fprintf(stream, BLACK("------------ STACK DUMP ------------" "\n"));
+  fprintf(stream, BLUE("Called from %s:%d: %s\n"),
+     file_name, line_num, function_name
+  );
+
+  if (stack == NULL) {
+    fprintf(stream, BLACK("IogStack_t %s (null)") " {}\n", stk_name);
+    return ERR_STACK_NULLPTR;
+  }
+
+  fprintf(stream, BLACK("IogStack_t %s (%p) {\n"), stk_name, stack);
+
+  fprintf(stream, BLACK("  .firstStackCanary  = 0x%llx")  "\n",  stack->firstStackCanary);
+  fprintf(stream, BLACK("   (canary - const   = 0x%llx)") "\n",
+      stack->firstStackCanary - STACK_CANARY_CONST
+  );
+
+  fprintf(stream, BLACK("  .isInitialized     = %d")    "\n",  (int) stack->isInitialized);
+  fprintf(stream, BLACK("  .size              = %lu")   "\n",  stack->size);
+  fprintf(stream, BLACK("  .capacity          = %lu")   "\n",  stack->capacity);
+  fprintf(stream, BLACK("  .verifyLevel       = %d")    "\n",  (int) stack->verifyLevel);
+  fprintf(stream, BLACK("  .marksNum          = %lu")   "\n",  stack->marksNum);
+  fprintf(stream, BLACK("  .policy            = {grow %lg, shrink 1/%lu, headroom %lu, min %lu%s%s}") "\n",
+      stack->policy.growFactor, stack->policy.shrinkDivisor, stack->policy.shrinkHeadroom,
+      stack->policy.minCapacity, stack->policy.neverShrink ? ", never shrink" : "",
+      stack->policy.guardPages ? ", guard pages" : ""
+  );
+  fprintf(stream, BLACK("  .policy.arena      = %p")  "\n",  (void *) stack->policy.arena);
+  fprintf(stream, BLACK("  .aggregates        = %p")  "\n",  (void *) stack->aggregates);
+  if (stack->aggregates != NULL && stack->aggregates->minsNum > 0 && stack->aggregates->maxsNum > 0) {
+    const IogStackAggregates_t *aggregates = stack->aggregates;
+    fprintf(stream, BLACK("   (min %lg, max %lg, sum %lg, %lu + %lu entries)") "\n",
+        aggregates->mins[aggregates->minsNum - 1].value, aggregates->maxs[aggregates->maxsNum - 1].value,
+        aggregates->sums[aggregates->size - 1], aggregates->minsNum, aggregates->maxsNum
+    );
+  }
+
+  fprintf(stream, BLACK("  .trackChecksum     = %d")  "\n",  (int) stack->trackChecksum);
+  if (stack->trackChecksum) {
+    fprintf(stream, BLACK("   (checksum 0x%llx of %lu values)") "\n", stack->checksum, stack->checksumSize);
+  }
+
+  fprintf(stream, BLACK("  .share             = %p")  "\n",  (void *) stack->share);
+  if (stack->share != NULL) {
+    fprintf(stream, BLACK("   (version %llu, %lu readers, %llu retries, %lu retired, %llu freed)") "\n",
+        stack->share->version.load(), stack->share->readers[0].load() + stack->share->readers[1].load(),
+        stack->share->retries.load(),
+        stack->share->retiredNum, stack->share->freed
+    );
+  }
+
+  fprintf(stream, BLACK("  .firstDataCanary  = %p")  "\n",  stack->firstDataCanary);
+  if (stack->firstDataCanary != NULL) {
+    fprintf(stream, BLACK("  *firstDataCanary  = 0x%llx")  "\n",  *stack->firstDataCanary);
+    fprintf(stream, BLACK("   (canary - const  = 0x%llx)") "\n",
+        *stack->firstDataCanary - DATA_CANARY_CONST
+    );
+  }
+
+  fprintf(stream, BLACK("  .data[%lu] (%p%s)" " = ["),           stack->capacity, stack->data,
+      iog_stack_is_inline(stack) ? ", inline" : "");
+
+  if (stack->data != NULL) {
+    fprintf(stream, "\n");
+    for (size_t i = 0; i < stack->size && i < stack->capacity; i++)
+      fprintf(stream, BLACK("    [%lu]: %lg\n"), i, stack->data[i]);
+
+    // free slots are poisoned in sanitizer builds and hold garbage otherwise, so they aren't read
+    if (stack->size < stack->capacity)
+      fprintf(stream, BLACK("    [%lu..%lu): free\n"), stack->size, stack->capacity);
+  }
+
+  fprintf(stream, BLACK("  ]\n"));
+
+  fprintf(stream, BLACK("  .secondDataCanary  = %p")  "\n",  stack->secondDataCanary);
+  if (stack->secondDataCanary != NULL) {
+    fprintf(stream, BLACK("  *secondDataCanary  = 0x%llx")  "\n",  *stack->secondDataCanary);
+    fprintf(stream, BLACK("   (canary - const   = 0x%llx)") "\n",
+       *stack->secondDataCanary - DATA_CANARY_CONST
+    );
+  }
+
+  fprintf(stream, BLACK("  .secondStackCanary = 0x%llx")  "\n",  stack->secondStackCanary);
+  fprintf(stream, BLACK("   (canary - const   = 0x%llx)") "\n",
+      stack->secondStackCanary - STACK_CANARY_CONST
+  );
+
+  fprintf(stream, BLACK("}\n"));
+
+  fprintf(stream, BLACK("------------------------------------\n"));
+
+  return OK;
+}
+
+/**
+ * Unlike iog_stack_dump_f output doesn't depend on capacity and has no escape codes,
+ * so it fits logs and post-mortem files of huge stacks. Values are read only
+ * if stack passes verify.
+ * @param[in]  stack       pointer to stack
+ * @param[out] stream      pointer to stream for prints
+ * @param[in]  window_size amount of values printed from bottom and from top
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_stack_dump_window_f (const IogStack_t *stack, FILE *stream, size_t window_size) {
+  IOG_ASSERT(stream);
+
+  IogStackReturnCode err = iog_stack_verify(stack);
+  if (err != OK) {
+    fprintf(stream, "IogStack_t (%p) is broken, verify error %d\n", (const void *) stack, (int) err);
+    return err;
+  }
+
+  fprintf(stream, "IogStack_t (%p) size %lu capacity %lu\n", (const void *) stack, stack->size, stack->capacity);
+
+  size_t bottom_end = stack->size;
+  size_t top_begin  = stack->size;
+  if (window_size < stack->size / 2) {
+    bottom_end = window_size;
+    top_begin  = stack->size - window_size;
+  }
+
+  for (size_t i = 0; i < bottom_end; i++)
+    fprintf(stream, "  [%lu]: %lg\n", i, stack->data[i]);
+
+  if (bottom_end < top_begin)
+    fprintf(stream, "  ... %lu values skipped\n", top_begin - bottom_end);
+
+  for (size_t i = top_begin; i < stack->size; i++)
+    fprintf(stream, "  [%lu]: %lg\n", i, stack->data[i]);
+
   return OK;
 }
+
+/**
+ * @param[in] stack pointer to stack
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_stack_dump (const IogStack_t *stack) {
+  return iog_stack_dump_f(stack, stdout, NULL, NULL, 0, NULL);
+}
+
+
+/**
+ * Checks nullptrs, overflowing, intialization. Call and its result are counted in stack stats.
+ * @param[in] stack pointer to stack
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_stack_verify (const IogStack_t *stack) {
+  IOG_CHECK_STACK_NULL( stack );
+
+  iog_uint64_t start_cycles = iog_stack_cycles();
+
+  return iog_stack_count_verify(stack, iog_stack_run_verify(stack), start_cycles);
+}
+
+/**
+ * Checks only stack and data canaries, cheaper than iog_stack_verify.
+ * Stack with guard pages skips data canaries, overruns are caught by hardware.
+ * @param[in] stack pointer to stack
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_stack_verify_canaries (const IogStack_t *stack) {
+  IOG_CHECK_STACK_NULL( stack );
+
+  iog_uint64_t start_cycles = iog_stack_cycles();
+
+  return iog_stack_count_verify(stack, iog_stack_run_verify_canaries(stack), start_cycles);
+}
+
+/**
+ * @param[in]  stack pointer to stack
+ * @param[out] stats pointer to struct for counters (can't be NULL)
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_stack_stats (const IogStack_t *stack, IogStackStats_t *stats) {
+  IOG_CHECK_STACK_NULL( stack );
+  IOG_ASSERT(stats);
+
+#if IOG_STACK_STATS > 0
+  *stats = stack->stats;
+#else
+  *stats = {};
+#endif // IOG_STACK_STATS
+
+  return OK;
+}
+
+/**
+ * @param[out] stack pointer to stack
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_stack_stats_reset (IogStack_t *stack) {
+  IOG_CHECK_STACK_NULL( stack );
+
+  int opened = iog_stack_write_begin(stack);
+  IOG_STACK_STAT( IogStackStats_t zero_stats = {} );
+  IOG_STACK_STAT( iog_stack_stats_copy(&stack->stats, &zero_stats) );
+  iog_stack_write_end(stack, opened);
+
+  return OK;
+}
+
+/**
+ * Prints counters, size and capacity as one JSON object per line,
+ * verifyFailures maps IogStackReturnCode values to number of failures.
+ * @param[in]  stack    pointer to stack
+ * @param[out] stream   pointer to stream for prints
+ * @param[in]  stk_name name of dumping stack (can be NULL)
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_stack_dump_stats_f (const IogStack_t *stack, FILE *stream, const char *stk_name) {
+  IOG_CHECK_STACK_NULL( stack );
+  IOG_ASSERT(stream);
+
+  IogStackStats_t stats = {};
+  iog_stack_stats(stack, &stats);
+
+  if (stk_name != NULL)
+    fprintf(stream, "{\"name\": \"%s\", ", stk_name);
+  else
+    fprintf(stream, "{\"name\": null, ");
+
+  fprintf(stream, "\"size\": %lu, \"capacity\": %lu, ", stack->size, stack->capacity);
+  fprintf(stream, "\"pushes\": %llu, \"pops\": %llu, ", stats.pushes, stats.pops);
+  fprintf(stream, "\"reallocs\": %llu, \"bytesCopied\": %llu, \"shrinks\": %llu, ",
+      stats.reallocs, stats.bytesCopied, stats.shrinks);
+  fprintf(stream, "\"maxSize\": %llu, \"maxCapacity\": %llu, ", stats.maxSize, stats.maxCapacity);
+  fprintf(stream, "\"verifyCalls\": %llu, \"verifyCycles\": %llu, ", stats.verifyCalls, stats.verifyCycles);
+
+  fprintf(stream, "\"verifyFailures\": {");
+  const char *separator = "";
+  for (int code = 0; code < NR_RETURN_CODE; code++) {
+    if (stats.verifyFailures[code] == 0)
+      continue;
+
+    fprintf(stream, "%s\"%d\": %llu", separator, code, stats.verifyFailures[code]);
+    separator = ", ";
+  }
+  fprintf(stream, "}}\n");
+
+  return OK;
+}
+
+/**
+ * Full verify runs before changing level, so stack is known good at this point.
+ * @param[out] stack pointer to stack
+ * @param[in]  level new verify level
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_stack_set_verify_level (IogStack_t *stack, IogStackVerifyLevel level) {
+  IOG_RETURN_IF_ERROR( iog_stack_verify(stack) );
+
+  if (level < IOG_VERIFY_DEFAULT || level > IOG_VERIFY_FULL)
+    return ERR_INVALID_VERIFY_LEVEL;
+
+  stack->verifyLevel = level;
+  iog_stack_update_fast_path(stack);
+
+  return OK;
+}
+
+/**
+ * @param[in] stack pointer to stack
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_stack_update_canaries (IogStack_t *stack) {
+  IOG_CHECK_STACK_NULL( stack );
+
+  stack->firstStackCanary  = STACK_CANARY_CONST + (iog_canary_t) stack;
+  stack->secondStackCanary = STACK_CANARY_CONST + (iog_canary_t) stack;
+
+  if (stack->data == NULL)
+    return ERR_STACK_DATA_NULLPTR;
+
+  if (stack->firstDataCanary == NULL)
+    return ERR_FIRST_DATA_CANARY_NULLPTR;
+
+  *stack->firstDataCanary  = iog_stack_data_canary(stack);
+
+  if (stack->policy.guardPages)
+    return OK;
+
+  if (stack->secondDataCanary == NULL)
+    return ERR_SECOND_DATA_CANARY_NULLPTR;
+
+  *stack->secondDataCanary = iog_stack_data_canary(stack);
+
+  return OK;
+}
+
+/**
+ * Checks that policy grows capacity and that shrink leaves free space for next pushes.
+ * @param[in] policy pointer to policy
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_stack_policy_check (const IogStackPolicy_t *policy) {
+  if (policy == NULL)
+    return ERR_INVALID_POLICY;
+
+  if (!(policy->growFactor > 1))
+    return ERR_INVALID_POLICY;
+
+  if (policy->neverShrink)
+    return OK;
+
+  if (policy->shrinkDivisor < 2 || policy->shrinkHeadroom < 1)
+    return ERR_INVALID_POLICY;
+
+  if (policy->shrinkHeadroom >= policy->shrinkDivisor)
+    return ERR_INVALID_POLICY;
+
+  return OK;
+}
+
+//--------------------- PRIVATE FUNCTIONS --------------------------------------------
+
+/**
+ * Checks nullptrs, overflowing, intialization.
+ * @param[in] stack pointer to stack
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_stack_run_verify (const IogStack_t *stack) {
+  IOG_CHECK_STACK_NULL( stack );
+
+  if ((stack->firstStackCanary - STACK_CANARY_CONST) != (iog_canary_t) stack)
+    return ERR_DEAD_FIRST_CANARY;
+
+  if ((stack->secondStackCanary - STACK_CANARY_CONST) != (iog_canary_t) stack)
+    return ERR_DEAD_SECOND_CANARY;
+
+  if (!stack->isInitialized)
+    return ERR_STACK_ISNT_INITIALIZED;
+  
+  if (stack->size > stack->capacity)
+    return ERR_STACK_OVERFLOW;
+
+  if (stack->capacity < INIT_STACK_DATA_CAPACITY)
+    return ERR_STACK_CAPACITY_UNDERFLOW;
+
+  if (stack->data == NULL)
+    return ERR_STACK_DATA_NULLPTR;
+
+  if (stack->firstDataCanary == NULL)
+    return ERR_FIRST_DATA_CANARY_NULLPTR;
+
+  if (stack->secondDataCanary == NULL && !stack->policy.guardPages)
+    return ERR_SECOND_DATA_CANARY_NULLPTR;
+
+  if (*stack->firstDataCanary != iog_stack_data_canary(stack))
+    return ERR_DEAD_FIRST_DATA_CANARY;
+
+  // with guard pages overrun past data traps in hardware, there is no second canary
+  if (stack->policy.guardPages)
+    return OK;
+
+  if (*stack->secondDataCanary != iog_stack_data_canary(stack))
+    return ERR_DEAD_SECOND_DATA_CANARY;
+
+  return OK;
+}
+
+/**
+ * Checks only stack and data canaries.
+ * @param[in] stack pointer to stack
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_stack_run_verify_canaries (const IogStack_t *stack) {
+  IOG_CHECK_STACK_NULL( stack );
+
+  if ((stack->firstStackCanary - STACK_CANARY_CONST) != (iog_canary_t) stack)
+    return ERR_DEAD_FIRST_CANARY;
+
+  if ((stack->secondStackCanary - STACK_CANARY_CONST) != (iog_canary_t) stack)
+    return ERR_DEAD_SECOND_CANARY;
+
+  if (stack->policy.guardPages)
+    return OK;
+
+  if (stack->firstDataCanary == NULL)
+    return ERR_FIRST_DATA_CANARY_NULLPTR;
+
+  if (stack->secondDataCanary == NULL)
+    return ERR_SECOND_DATA_CANARY_NULLPTR;
+
+  if (*stack->firstDataCanary != iog_stack_data_canary(stack))
+    return ERR_DEAD_FIRST_DATA_CANARY;
+
+  if (*stack->secondDataCanary != iog_stack_data_canary(stack))
+    return ERR_DEAD_SECOND_DATA_CANARY;
+
+  return OK;
+}
+
+/**
+ * @param[in] stack pointer to stack
+ * @return stack verify level with default resolved and clamped by IOG_STACK_VERIFY_LEVEL
+ */
+static int iog_stack_effective_verify_level (const IogStack_t *stack) {
+  int level = stack->verifyLevel;
+  if (level == IOG_VERIFY_DEFAULT)
+    level = IOG_STACK_DEFAULT_VERIFY_LEVEL;
+
+  if (level > IOG_STACK_VERIFY_LEVEL)
+    level = IOG_STACK_VERIFY_LEVEL;
+
+  return level;
+}
+
+/**
+ * Inline operations skip checks only if this flag is set,
+ * must be called after every change of verify level or initialization.
+ * @param[out] stack pointer to stack
+ */
+static void iog_stack_update_fast_path (IogStack_t *stack) {
+  stack->fastPath = stack->isInitialized && iog_stack_effective_verify_level(stack) <= IOG_VERIFY_OFF &&
+                    stack->aggregates == NULL && !stack->trackChecksum;
+}
+
+/**
+ * @param[in] stack        pointer to stack (not NULL)
+ * @param[in] err          result of verify
+ * @param[in] start_cycles iog_stack_cycles() before verify
+ * @return err
+ */
+static IogStackReturnCode iog_stack_count_verify (const IogStack_t *stack, IogStackReturnCode err,
+                                                  iog_uint64_t start_cycles) {
+#if IOG_STACK_STATS > 0
+  // verify is const and its counters aren't in seqlock, so shared stack doesn't count it
+  if (stack->share != NULL)
+    return err;
+
+  stack->stats.verifyCalls++;
+  stack->stats.verifyCycles += iog_stack_cycles() - start_cycles;
+
+  if (err != OK && err < NR_RETURN_CODE)
+    stack->stats.verifyFailures[err]++;
+#else
+  (void) stack;
+  (void) start_cycles;
+#endif // IOG_STACK_STATS
+
+  return err;
+}
+
+/**
+ * Reads time stamp counter where it is cheap (x86 rdtsc, arm64 virtual counter).
+ * @return cycle counter or 0 if IOG_STACK_STATS < 2 or platform has no counter
+ */
+static iog_uint64_t iog_stack_cycles () {
+#if IOG_STACK_STATS > 1 && (defined(__x86_64__) || defined(__i386__))
+  return (iog_uint64_t) __rdtsc();
+#elif IOG_STACK_STATS > 1 && defined(__aarch64__)
+  iog_uint64_t cycles = 0;
+  asm volatile("mrs %0, cntvct_el0" : "=r" (cycles));
+  return cycles;
+#else
+  return 0;
+#endif
+}
+
+/**
+ * Runs checks chosen by stack verify level. NULL stack is rejected at every level,
+ * other checks compile out if IOG_STACK_VERIFY_LEVEL is off.
+ * @param[in] stack pointer to stack
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_stack_check (const IogStack_t *stack) {
+  IOG_CHECK_STACK_NULL( stack );
+
+#if IOG_STACK_VERIFY_LEVEL > 1
+  int level = iog_stack_effective_verify_level(stack);
+
+  if (level >= IOG_VERIFY_FULL)
+    return iog_stack_verify(stack);
+
+  if (level == IOG_VERIFY_CANARIES)
+    return iog_stack_verify_canaries(stack);
+#endif // IOG_STACK_VERIFY_LEVEL > 1
+
+  return OK;
+}
+
+/**
+ * Allocates max( new_capacity, INIT_STACK_DATA_CAPACITY ).
+ * Capacities up to IOG_STACK_INLINE_CAPACITY use inline buffer without heap allocation.
+ * Heap buffer is resized in place when possible, only fresh tail is zeroed,
+ * so this function just moves data pointers, canaries must be updated by caller.
+ * Shared stack always moves data to new buffer, old one is freed after readers leave.
+ * Can't free data, for that use destroy.
+ * @param[in] stack        pointer to stack
+ * @param[in] new_capacity new capacity of stack data
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_stack_allocate_data (IogStack_t *stack, size_t new_capacity) {
+  IOG_CHECK_STACK_NULL(stack);
+
+  if (new_capacity < INIT_STACK_DATA_CAPACITY)
+      new_capacity = INIT_STACK_DATA_CAPACITY;
+
+  IOG_STACK_STAT( size_t old_capacity = stack->capacity );
+  IOG_STACK_STAT( unsigned long long old_copied = iog_mem_stats()->bytesCopied );
+
+  IogStackReturnCode err = OK;
+
+  int opened = iog_stack_write_begin(stack);
+
+  // allocator copies and reuses whole buffer, so it must be addressable
+  iog_stack_poison_slots(stack, stack->size, stack->capacity, 0);
+
+  if (stack->superblock != NULL)
+    err = iog_stack_allocate_mapped(stack, new_capacity);
+  else if (stack->policy.guardPages)
+    err = iog_stack_allocate_guarded(stack, new_capacity);
+  else if (stack->share != NULL)
+    err = iog_stack_allocate_shared(stack, new_capacity);
+  else if (new_capacity <= IOG_STACK_INLINE_CAPACITY || iog_stack_is_inline(stack))
+    err = iog_stack_relocate_data(stack, new_capacity);
+  else
+    err = iog_stack_allocate_heap(stack, new_capacity);
+
+  iog_stack_poison_slots(stack, stack->size, stack->capacity, 1);
+
+  if (err != OK) {
+    iog_stack_write_end(stack, opened);
+    return err;
+  }
+
+  IOG_STACK_STAT_ADD( stack->stats.bytesCopied, iog_mem_stats()->bytesCopied - old_copied );
+  IOG_STACK_STAT_ADD( stack->stats.reallocs, (old_capacity != 0) );
+  IOG_STACK_STAT_MAX( stack->stats.maxCapacity, stack->capacity );
+
+  iog_stack_write_end(stack, opened);
+
+  if (stack->share != NULL)
+    iog_stack_share_reclaim(stack);
+
+  return OK;
+}
+
+/**
+ * Resizes heap buffer by iog_mem_resize, old data stays valid if it fails.
+ * Capacity is rounded up to fill size class of arena or pool block,
+ * so doubling growth keeps every buffer exactly one class.
+ * Free slots are never read, so fresh tail isn't zeroed.
+ * Canaries must be updated by caller.
+ * @param[in] stack        pointer to stack
+ * @param[in] new_capacity new capacity of stack data
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_stack_allocate_heap (IogStack_t *stack, size_t new_capacity) {
+  new_capacity = iog_stack_usable_capacity(stack, new_capacity);
+
+  iog_canary_t *tmp_ptr = (iog_canary_t *) iog_mem_resize (
+      stack->policy.arena,
+      stack->firstDataCanary,
+      iog_stack_data_bytes(stack->capacity),
+      iog_stack_data_bytes(new_capacity),
+      0
+  );
+
+  if (tmp_ptr == NULL)
+    return ERR_CANT_ALLOCATE_DATA;
+
+  iog_stack_set_buffer(stack, tmp_ptr, new_capacity);
+
+  return OK;
+}
+
+/**
+ * Reader may still copy from old buffer, so data is never resized in place:
+ * it is copied to new buffer and old one goes to retired list.
+ * Slot in retired list is taken first, so on failure stack isn't changed.
+ * Canaries must be updated by caller.
+ * @param[in] stack        pointer to shared stack
+ * @param[in] new_capacity new capacity of stack data
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_stack_allocate_shared (IogStack_t *stack, size_t new_capacity) {
+  IogStackShare_t *share = stack->share;
+
+  if (share->retiredNum == share->retiredCapacity) {
+    size_t new_retired = share->retiredCapacity ? share->retiredCapacity * 2 : INIT_STACK_DATA_CAPACITY;
+
+    IogStackRetired_t *retired = (IogStackRetired_t *) iog_recalloc(share->retired, share->retiredCapacity,
+                                                                    new_retired, sizeof(IogStackRetired_t));
+    if (retired == NULL)
+      return ERR_CANT_ALLOCATE_DATA;
+
+    share->retired         = retired;
+    share->retiredCapacity = new_retired;
+  }
+
+  new_capacity = iog_stack_usable_capacity(stack, new_capacity);
+
+  iog_canary_t *new_buffer = (iog_canary_t *) iog_mem_resize(stack->policy.arena, NULL, 0,
+                                                             iog_stack_data_bytes(new_capacity), 0);
+  if (new_buffer == NULL)
+    return ERR_CANT_ALLOCATE_DATA;
+
+  if (stack->size > 0)
+    memcpy(new_buffer + 1, stack->data, stack->size * sizeof(iog_stack_value_t));
+
+  IOG_STACK_STAT_ADD( stack->stats.bytesCopied, stack->size * sizeof(iog_stack_value_t) );
+
+  if (stack->firstDataCanary != NULL && !iog_stack_is_inline(stack))
+    share->retired[share->retiredNum++] = {stack->firstDataCanary, iog_stack_data_bytes(stack->capacity)};
+
+  iog_stack_set_buffer(stack, new_buffer, new_capacity);
+
+  return OK;
+}
+
+/**
+ * Moves data from inline buffer to heap or back. Inline capacity is always
+ * IOG_STACK_INLINE_CAPACITY.
+ * Canaries must be updated by caller.
+ * @param[in] stack        pointer to stack
+ * @param[in] new_capacity new capacity of stack data
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_stack_relocate_data (IogStack_t *stack, size_t new_capacity) {
+#if IOG_STACK_INLINE_CAPACITY > 0
+  iog_canary_t *old_buffer = stack->firstDataCanary;
+  iog_canary_t *new_buffer = stack->inlineBuffer;
+
+  if (new_capacity <= IOG_STACK_INLINE_CAPACITY) {
+    new_capacity = IOG_STACK_INLINE_CAPACITY;
+  } else {
+    new_capacity = iog_stack_usable_capacity(stack, new_capacity);
+    new_buffer = (iog_canary_t *) iog_mem_resize(stack->policy.arena, NULL, 0, iog_stack_data_bytes(new_capacity), 0);
+
+    if (new_buffer == NULL)
+      return ERR_CANT_ALLOCATE_DATA;
+  }
+
+  if (new_buffer != old_buffer) {
+    if (stack->size > 0)
+      memcpy(new_buffer + 1, stack->data, stack->size * sizeof(iog_stack_value_t));
+
+    IOG_STACK_STAT_ADD( stack->stats.bytesCopied, stack->size * sizeof(iog_stack_value_t) );
+
+    if (old_buffer != NULL && old_buffer != stack->inlineBuffer)
+      iog_mem_free(stack->policy.arena, old_buffer, iog_stack_data_bytes(stack->capacity));
+  }
+
+  iog_stack_set_buffer(stack, new_buffer, new_capacity);
+
+  return OK;
+#else
+  (void) stack;
+  (void) new_capacity;
+
+  return ERR_CANT_ALLOCATE_DATA;
+#endif // IOG_STACK_INLINE_CAPACITY
+}
+
+/**
+ * Guarded buffer is [first data canary][data] glued to PROT_NONE page,
+ * so it is moved to new mapping on every resize.
+ * Canaries must be updated by caller.
+ * @param[in] stack        pointer to stack
+ * @param[in] new_capacity new capacity of stack data
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_stack_allocate_guarded (IogStack_t *stack, size_t new_capacity) {
+  iog_canary_t *new_buffer = (iog_canary_t *) iog_guarded_resize (
+      stack->firstDataCanary,
+      (stack->firstDataCanary != NULL) ? iog_stack_guarded_bytes(stack->capacity) : 0,
+      iog_stack_guarded_bytes(new_capacity)
+  );
+
+  if (new_buffer == NULL)
+    return ERR_CANT_ALLOCATE_DATA;
+
+  iog_stack_set_buffer(stack, new_buffer, new_capacity);
+
+  return OK;
+}
+
+/**
+ * File is resized by truncate and remap, so pages are never copied.
+ * Canaries must be updated by caller.
+ * @param[in] stack        pointer to stack
+ * @param[in] new_capacity new capacity of stack data
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_stack_allocate_mapped (IogStack_t *stack, size_t new_capacity) {
+  void *base = iog_file_remap(stack->mapFd, stack->superblock,
+                              iog_stack_mapped_bytes(stack->capacity), iog_stack_mapped_bytes(new_capacity));
+
+  if (base == NULL)
+    return ERR_CANT_ALLOCATE_DATA;
+
+  stack->superblock = (IogStackSuperblock_t *) base;
+  iog_stack_set_buffer(stack, (iog_canary_t *) ((char *) base + IOG_STACK_MAP_HEADER_BYTES), new_capacity);
+  iog_stack_superblock_update(stack);
+
+  return OK;
+}
+
+/**
+ * @param[in] stack pointer to stack
+ * @return constant + data address, or constant + key of mapped file if data is mapped
+ */
+static iog_canary_t iog_stack_data_canary (const IogStack_t *stack) {
+  if (stack->superblock != NULL)
+    return DATA_CANARY_CONST + (stack->superblock->canarySeed ^ (iog_canary_t) stack->capacity);
+
+  return DATA_CANARY_CONST + (iog_canary_t) stack->data;
+}
+
+/**
+ * @param[in] superblock pointer to superblock
+ * @return constant + FNV-1a hash of superblock fields before canary
+ */
+static iog_canary_t iog_stack_super_canary (const IogStackSuperblock_t *superblock) {
+  const iog_uint64_t fields[] = {
+    superblock->magic, superblock->version, superblock->valueBytes,
+    superblock->canarySeed, superblock->size, superblock->capacity
+  };
+
+  iog_uint64_t hash = 0xcbf29ce484222325;
+  for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+    hash ^= fields[i];
+    hash *= 0x100000001b3;
+  }
+
+  return STACK_CANARY_CONST + hash;
+}
+
+/**
+ * @param[in] superblock pointer to superblock
+ * @param[in] file_bytes size of file
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_stack_superblock_check (const IogStackSuperblock_t *superblock, size_t file_bytes) {
+  if (superblock->magic != IOG_STACK_MAP_MAGIC || superblock->version != IOG_STACK_MAP_VERSION ||
+      superblock->valueBytes != sizeof(iog_stack_value_t))
+    return ERR_BAD_SUPERBLOCK;
+
+  if (superblock->superCanary != iog_stack_super_canary(superblock))
+    return ERR_BAD_SUPERBLOCK;
+
+  if (superblock->capacity < INIT_STACK_DATA_CAPACITY ||
+      superblock->capacity > (file_bytes - IOG_STACK_MAP_HEADER_BYTES) / sizeof(iog_stack_value_t) ||
+      iog_stack_mapped_bytes((size_t) superblock->capacity) > file_bytes)
+    return ERR_BAD_SUPERBLOCK;
+
+  if (superblock->size > superblock->capacity)
+    return ERR_STACK_OVERFLOW;
+
+  return OK;
+}
+
+/**
+ * @param[out] stack pointer to mapped stack
+ */
+static void iog_stack_superblock_update (IogStack_t *stack) {
+  stack->superblock->size        = stack->size;
+  stack->superblock->capacity    = stack->capacity;
+  stack->superblock->superCanary = iog_stack_super_canary(stack->superblock);
+}
+
+/**
+ * File stays on disk, data pointers are reset so destroy won't free them.
+ * @param[out] stack pointer to mapped stack
+ */
+static void iog_stack_close_mapped (IogStack_t *stack) {
+  iog_file_close(stack->mapFd, stack->superblock, iog_stack_mapped_bytes(stack->capacity));
+
+  stack->superblock       = NULL;
+  stack->mapFd            = -1;
+  stack->data             = NULL;
+  stack->firstDataCanary  = NULL;
+  stack->secondDataCanary = NULL;
+}
+
+/**
+ * FNV-1a over 64-bit words in four independent lanes, so multiplies don't wait each other.
+ * @param[in] data pointer to values (may be NULL if n is 0)
+ * @param[in] n    amount of values
+ * @return hash of values
+ */
+static iog_uint64_t iog_stack_data_hash (const iog_stack_value_t *data, size_t n) {
+  const iog_uint64_t prime = 0x100000001b3;
+  iog_uint64_t lanes[4] = {0xcbf29ce484222325, 0x84222325cbf29ce4, 0xcbf29ce4, 0x84222325};
+
+  const char *bytes = (const char *) data;
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    iog_uint64_t words[4] = {};
+    memcpy(words, bytes + i * sizeof(iog_stack_value_t), sizeof(words));
+
+    for (size_t lane = 0; lane < 4; lane++)
+      lanes[lane] = (lanes[lane] ^ words[lane]) * prime;
+  }
+
+  for (; i < n; i++) {
+    iog_uint64_t word = 0;
+    memcpy(&word, bytes + i * sizeof(iog_stack_value_t), sizeof(word));
+    lanes[0] = (lanes[0] ^ word) * prime;
+  }
+
+  iog_uint64_t hash = n;
+  for (size_t lane = 0; lane < 4; lane++)
+    hash = (hash ^ lanes[lane]) * prime;
+
+  return hash;
+}
+
+/**
+ * @param[in] header pointer to image header
+ * @return constant + FNV-1a hash of header fields before canary
+ */
+static iog_canary_t iog_stack_image_canary (const IogStackImageHeader_t *header) {
+  const iog_uint64_t fields[] = {
+    header->magic, header->version, header->valueBytes, header->size, header->dataHash
+  };
+
+  iog_uint64_t hash = 0xcbf29ce484222325;
+  for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+    hash ^= fields[i];
+    hash *= 0x100000001b3;
+  }
+
+  return STACK_CANARY_CONST + hash;
+}
+
+/**
+ * Points data and canaries into buffer, updates capacity and shrinkSize.
+ * @param[out] stack    pointer to stack
+ * @param[in]  buffer   pointer to buffer that starts with first data canary
+ * @param[in]  capacity capacity of buffer
+ */
+static void iog_stack_set_buffer (IogStack_t *stack, iog_canary_t *buffer, size_t capacity) {
+  stack->firstDataCanary  = buffer;
+  iog_relaxed_store(&stack->data, (iog_stack_value_t *) (buffer + 1));
+  stack->secondDataCanary = stack->policy.guardPages ? NULL : (iog_canary_t *) (stack->data + capacity);
+
+  iog_relaxed_store(&stack->capacity, capacity);
+  iog_stack_update_shrink_size(stack);
+}
+
+/**
+ * Entries above low_size are dropped by their stored size, then data[low_size..size)
+ * is added. Pushes reserve arrays before changing stack, so sync after them can't fail.
+ * @param[out] stack    pointer to stack
+ * @param[in]  low_size values below it didn't change since last sync
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_stack_aggregates_sync (IogStack_t *stack, size_t low_size) {
+  IogStackAggregates_t *aggregates = stack->aggregates;
+  if (aggregates == NULL)
+    return OK;
+
+  if (low_size > aggregates->size)
+    low_size = aggregates->size;
+
+  while (aggregates->minsNum > 0 && aggregates->mins[aggregates->minsNum - 1].size > low_size)
+    aggregates->minsNum--;
+
+  while (aggregates->maxsNum > 0 && aggregates->maxs[aggregates->maxsNum - 1].size > low_size)
+    aggregates->maxsNum--;
+
+  if (iog_stack_aggregates_reserve(stack, stack->size) != OK) {
+    iog_stack_aggregates_free(stack);
+    iog_stack_update_fast_path(stack);
+    return ERR_CANT_ALLOCATE_DATA;
+  }
+
+  for (size_t i = low_size; i < stack->size; i++) {
+    iog_stack_value_t value = stack->data[i];
+
+    aggregates->sums[i] = (i > 0) ? aggregates->sums[i - 1] + value : value;
+
+    if (aggregates->minsNum == 0 || value <= aggregates->mins[aggregates->minsNum - 1].value)
+      aggregates->mins[aggregates->minsNum++] = {value, i + 1};
+
+    if (aggregates->maxsNum == 0 || value >= aggregates->maxs[aggregates->maxsNum - 1].value)
+      aggregates->maxs[aggregates->maxsNum++] = {value, i + 1};
+  }
+
+  aggregates->size = stack->size;
+
+  return OK;
+}
+
+/**
+ * New arrays are allocated before old ones are released, so failure leaves
+ * aggregates as they were. Arrays grow by doubling and never shrink.
+ * @param[out] stack pointer to stack
+ * @param[in]  size  amount of values aggregates must hold
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_stack_aggregates_reserve (IogStack_t *stack, size_t size) {
+  IogStackAggregates_t *aggregates = stack->aggregates;
+  if (aggregates == NULL || size <= aggregates->capacity)
+    return OK;
+
+  size_t new_capacity = aggregates->capacity ? aggregates->capacity : INIT_STACK_DATA_CAPACITY;
+  while (new_capacity < size)
+    new_capacity *= 2;
+
+  IogStackExtremum_t *mins = (IogStackExtremum_t *) iog_recalloc(NULL, 0, new_capacity, sizeof(IogStackExtremum_t));
+  IogStackExtremum_t *maxs = (IogStackExtremum_t *) iog_recalloc(NULL, 0, new_capacity, sizeof(IogStackExtremum_t));
+  iog_stack_value_t  *sums = (iog_stack_value_t *)  iog_recalloc(NULL, 0, new_capacity, sizeof(iog_stack_value_t));
+
+  if (mins == NULL || maxs == NULL || sums == NULL) {
+    iog_free_sized(mins, new_capacity, sizeof(IogStackExtremum_t));
+    iog_free_sized(maxs, new_capacity, sizeof(IogStackExtremum_t));
+    iog_free_sized(sums, new_capacity, sizeof(iog_stack_value_t));
+    return ERR_CANT_ALLOCATE_DATA;
+  }
+
+  if (aggregates->capacity > 0) {
+    memcpy(mins, aggregates->mins, aggregates->minsNum * sizeof(IogStackExtremum_t));
+    memcpy(maxs, aggregates->maxs, aggregates->maxsNum * sizeof(IogStackExtremum_t));
+    memcpy(sums, aggregates->sums, aggregates->size    * sizeof(iog_stack_value_t));
+  }
+
+  iog_free_sized(aggregates->mins, aggregates->capacity, sizeof(IogStackExtremum_t));
+  iog_free_sized(aggregates->maxs, aggregates->capacity, sizeof(IogStackExtremum_t));
+  iog_free_sized(aggregates->sums, aggregates->capacity, sizeof(iog_stack_value_t));
+
+  aggregates->mins     = mins;
+  aggregates->maxs     = maxs;
+  aggregates->sums     = sums;
+  aggregates->capacity = new_capacity;
+
+  return OK;
+}
+
+/**
+ * Caller updates fastPath.
+ * @param[out] stack pointer to stack
+ */
+static void iog_stack_aggregates_free (IogStack_t *stack) {
+  IogStackAggregates_t *aggregates = stack->aggregates;
+  if (aggregates == NULL)
+    return;
+
+  iog_free_sized(aggregates->mins, aggregates->capacity, sizeof(IogStackExtremum_t));
+  iog_free_sized(aggregates->maxs, aggregates->capacity, sizeof(IogStackExtremum_t));
+  iog_free_sized(aggregates->sums, aggregates->capacity, sizeof(iog_stack_value_t));
+  iog_free_sized(aggregates, 1, sizeof(IogStackAggregates_t));
+
+  stack->aggregates = NULL;
+}
+
+/**
+ * Pending buffers were replaced before epoch was switched to current one, so only
+ * readers of previous epoch can hold them. Reader counts itself before it loads data
+ * pointer, and new pointer is stored before readers are loaded here, so reader that
+ * wasn't counted sees new buffer. When previous epoch is empty, pending buffers are
+ * freed and epoch is switched again, so constant reads don't keep buffers forever.
+ * @param[out] stack pointer to shared stack
+ */
+static void iog_stack_share_reclaim (IogStack_t *stack) {
+  IogStackShare_t *share = stack->share;
+  if (share->retiredNum == 0)
+    return;
+
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+
+  unsigned epoch = share->epoch.load(std::memory_order_relaxed);
+  if (share->readers[epoch ^ 1].load(std::memory_order_seq_cst) != 0)
+    return;
+
+  for (size_t i = 0; i < share->pendingNum; i++)
+    iog_mem_free(stack->policy.arena, share->retired[i].buffer, share->retired[i].bytes);
+
+  share->retiredNum -= share->pendingNum;
+  memmove(share->retired, share->retired + share->pendingNum, share->retiredNum * sizeof(IogStackRetired_t));
+
+  share->freed     += share->pendingNum;
+  share->pendingNum = share->retiredNum;
+
+  share->epoch.store(epoch ^ 1, std::memory_order_seq_cst);
+}
+
+/**
+ * Counters are copied one by one, so copy doesn't race with other thread
+ * that copies or changes them under seqlock.
+ * @param[out] to   pointer to destination counters
+ * @param[in]  from pointer to source counters
+ */
+static void iog_stack_stats_copy (IogStackStats_t *to, const IogStackStats_t *from) {
+  iog_relaxed_store(&to->pushes,       iog_relaxed_load(&from->pushes));
+  iog_relaxed_store(&to->pops,         iog_relaxed_load(&from->pops));
+  iog_relaxed_store(&to->reallocs,     iog_relaxed_load(&from->reallocs));
+  iog_relaxed_store(&to->bytesCopied,  iog_relaxed_load(&from->bytesCopied));
+  iog_relaxed_store(&to->shrinks,      iog_relaxed_load(&from->shrinks));
+  iog_relaxed_store(&to->maxSize,      iog_relaxed_load(&from->maxSize));
+  iog_relaxed_store(&to->maxCapacity,  iog_relaxed_load(&from->maxCapacity));
+  iog_relaxed_store(&to->verifyCalls,  iog_relaxed_load(&from->verifyCalls));
+  iog_relaxed_store(&to->verifyCycles, iog_relaxed_load(&from->verifyCycles));
+
+  for (size_t code = 0; code < NR_RETURN_CODE; code++)
+    iog_relaxed_store(&to->verifyFailures[code], iog_relaxed_load(&from->verifyFailures[code]));
+}
+
+/**
+ * No reader may be inside iog_stack_read_shared.
+ * @param[out] stack pointer to stack
+ */
+static void iog_stack_share_free (IogStack_t *stack) {
+  IogStackShare_t *share = stack->share;
+  if (share == NULL)
+    return;
+
+  for (size_t i = 0; i < share->retiredNum; i++)
+    iog_mem_free(stack->policy.arena, share->retired[i].buffer, share->retired[i].bytes);
+
+  iog_free_sized(share->retired, share->retiredCapacity, sizeof(IogStackRetired_t));
+  delete share;
+
+  stack->share = NULL;
+}
+
+/**
+ * Values must still be addressable, so pops call it before poisoning slots.
+ * Single value of push and pop skips kernel dispatch.
+ * @param[out] stack    pointer to stack
+ * @param[in]  low_size size after values are removed or before they are overwritten
+ */
+static void iog_stack_checksum_drop (IogStack_t *stack, size_t low_size) {
+  if (!stack->trackChecksum || low_size >= stack->checksumSize)
+    return;
+
+  if (low_size + 1 == stack->checksumSize) {
+    stack->checksum -= iog_simd_checksum_term(stack->data[low_size], low_size);
+    stack->checksumSize = low_size;
+    return;
+  }
+
+  stack->checksum -= iog_simd_checksum(stack->data + low_size, stack->checksumSize - low_size, low_size);
+  stack->checksumSize = low_size;
+}
+
+/**
+ * @param[out] stack pointer to stack
+ */
+static void iog_stack_checksum_add (IogStack_t *stack) {
+  if (!stack->trackChecksum || stack->size <= stack->checksumSize)
+    return;
+
+  if (stack->checksumSize + 1 == stack->size) {
+    stack->checksum += iog_simd_checksum_term(stack->data[stack->checksumSize], stack->checksumSize);
+    stack->checksumSize = stack->size;
+    return;
+  }
+
+  stack->checksum += iog_simd_checksum(stack->data + stack->checksumSize, stack->size - stack->checksumSize,
+                                       stack->checksumSize);
+  stack->checksumSize = stack->size;
+}
+
+/**
+ * Pops above shrinkSize take fast path without shrink check, so 0 turns shrink off.
+ * @param[out] stack pointer to stack
+ */
+static void iog_stack_update_shrink_size (IogStack_t *stack) {
+  stack->shrinkSize = (stack->policy.neverShrink || stack->marksNum > 0 ||
+                       stack->capacity <= stack->policy.minCapacity) ?
+                      0 : stack->capacity / stack->policy.shrinkDivisor;
+}
+
+/**
+ * Multiplies capacity by policy.growFactor by allocating more memory.
+ * Caller must check stack before.
+ * @param[in] stack pointer to stack
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_stack_allocate_more (IogStack_t *stack) {
+  if (iog_stack_allocate_data(stack, iog_stack_grown_capacity(stack, stack->capacity + 1)) != OK)
+    return ERR_CANT_ALLOCATE_DATA;
+
+  iog_stack_update_canaries(stack);
+
+  IOG_RETURN_IF_ERROR( iog_stack_check(stack) );
+
+  return OK;
+}
+
+/**
+ * Shrinks capacity to size * policy.shrinkHeadroom (but not less than policy.minCapacity).
+ * Caller must check stack before.
+ * @param[in] stack pointer to stack
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_stack_free_rest (IogStack_t *stack) {
+  size_t new_capacity = iog_stack_shrunk_capacity(stack);
+  if (new_capacity >= stack->capacity)
+    return OK;
+
+  if (iog_stack_allocate_data(stack, new_capacity) != OK)
+    return ERR_CANT_FREE_DATA;
+
+  IOG_STACK_STAT_ADD( stack->stats.shrinks, 1 );
+
+  iog_stack_update_canaries(stack);
+
+  IOG_RETURN_IF_ERROR( iog_stack_check(stack) );
+
+  return OK;
+}
+
+/**
+ * Multiplies capacity by policy.growFactor until it fits min_capacity elements
+ * @param[in] stack        pointer to stack
+ * @param[in] min_capacity required capacity
+ * @return new capacity (at least min_capacity)
+ */
+static size_t iog_stack_grown_capacity (const IogStack_t *stack, size_t min_capacity) {
+  size_t new_capacity = stack->capacity;
+
+  while (new_capacity < min_capacity) {
+    size_t next_capacity = (size_t) ((double) new_capacity * stack->policy.growFactor);
+
+    new_capacity = (next_capacity > new_capacity) ? next_capacity : new_capacity + 1;
+  }
+
+  return new_capacity;
+}
+
+/**
+ * @param[in] stack pointer to stack
+ * @return 1 if policy wants to release memory at current size
+ */
+static int iog_stack_need_shrink (const IogStack_t *stack) {
+  return !stack->policy.neverShrink && stack->marksNum == 0 && stack->capacity > stack->policy.minCapacity &&
+         stack->size <= stack->capacity / stack->policy.shrinkDivisor;
+}
+
+/**
+ * @param[in] stack pointer to stack
+ * @return max(size * policy.shrinkHeadroom, policy.minCapacity)
+ */
+static size_t iog_stack_shrunk_capacity (const IogStack_t *stack) {
+  size_t new_capacity = stack->size * stack->policy.shrinkHeadroom;
+
+  if (new_capacity < stack->policy.minCapacity)
+    new_capacity = stack->policy.minCapacity;
+
+  return new_capacity;
+}
+
+/**
+ * @param[in] stack pointer to stack
+ * @return 1 if data lives in inline buffer of stack
+ */
+static int iog_stack_is_inline (const IogStack_t *stack) {
+#if IOG_STACK_INLINE_CAPACITY > 0
+  return stack->firstDataCanary == stack->inlineBuffer;
+#else
+  (void) stack;
+  return 0;
+#endif // IOG_STACK_INLINE_CAPACITY
+}
+
+/**
+ * @param[in] stack    pointer to stack
+ * @param[in] capacity required capacity of heap data
+ * @return capacity that fills block allocated for required one
+ */
+static size_t iog_stack_usable_capacity (const IogStack_t *stack, size_t capacity) {
+  size_t usable = iog_mem_usable(stack->policy.arena, iog_stack_data_bytes(capacity));
+
+  return (usable - 2 * sizeof(iog_canary_t)) / sizeof(iog_stack_value_t);
+}
+
+/**
+ * @param[in] capacity capacity of stack data
+ * @return size of data buffer with both data canaries in bytes
+ */
+static size_t iog_stack_data_bytes (size_t capacity) {
+  return 2 * sizeof(iog_canary_t) + capacity * sizeof(iog_stack_value_t);
+}
+
+/**
+ * @param[in] capacity capacity of stack data
+ * @return size of mapped file with superblock and data
+ */
+static size_t iog_stack_mapped_bytes (size_t capacity) {
+  return IOG_STACK_MAP_HEADER_BYTES + iog_stack_data_bytes(capacity);
+}
+
+/**
+ * @param[in] capacity capacity of stack data
+ * @return size of guarded data buffer with first data canary in bytes
+ */
+static size_t iog_stack_guarded_bytes (size_t capacity) {
+  return sizeof(iog_canary_t) + capacity * sizeof(iog_stack_value_t);
+}
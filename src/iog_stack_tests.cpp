@@ -1,9 +1,30 @@
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
 
 #include "iog_stack_tests.h"
 #include "iog_stack.h"
 #include "iog_stack_return_codes.h"
 #include "cli_colors.h"
+#include "iog_memlib.h"
+#include "iog_tstack.h"
+#include "iog_seg_stack.h"
+#include "iog_lf_stack.h"
+#include "iog_ws_deque.h"
+#include "iog_vm.h"
+#include "iog_simd.h"
+#include "iog_pack.h"
+
+#include <string>
+#include <thread>
+#include <atomic>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
 
 
 /**
@@ -90,3 +111,1635 @@ IogStackReturnCode iog_check_first_data_canary() {
 IogStackReturnCode iog_check_second_data_canary() {
   return OK;
 }
+
+IogStackReturnCode iog_check_policy_hysteresis() {
+  IogStack_t stk = {};
+  IOG_RETURN_IF_ERROR( iog_stack_init(&stk) );
+
+  iog_stack_value_t value = 0;
+  while (stk.size < 64 || stk.size < stk.capacity)
+    IOG_RETURN_IF_ERROR( iog_stack_push(&stk, (iog_stack_value_t) stk.size) );
+
+  // now size == capacity, so every shrink/grow boundary is one step away
+  size_t reallocs = 0;
+  for (size_t i = 0; i < 1000; i++) {
+    size_t old_capacity = stk.capacity;
+    IOG_RETURN_IF_ERROR( (i % 2) ? iog_stack_pop(&stk, &value) : iog_stack_push(&stk, 1) );
+    reallocs += (stk.capacity != old_capacity);
+  }
+
+  while (stk.size > 16)
+    IOG_RETURN_IF_ERROR( iog_stack_pop(&stk, &value) );
+
+  size_t shrunk_capacity = stk.capacity;
+  for (size_t i = 0; i < 1000; i++) {
+    size_t old_capacity = stk.capacity;
+    IOG_RETURN_IF_ERROR( (i % 2) ? iog_stack_push(&stk, 1) : iog_stack_pop(&stk, &value) );
+    reallocs += (stk.capacity != old_capacity);
+  }
+
+  iog_stack_destroy(&stk);
+
+  if (reallocs > 2 || shrunk_capacity < 32) {
+    fprintf(stderr, RED("POLICY HYSTERESIS TEST FAILED, %lu reallocations\n"), reallocs);
+    return ERR_TEST_FAILED;
+  }
+
+  fprintf(stderr, GREEN("POLICY HYSTERESIS TEST PASSED\n"));
+  return OK;
+}
+
+/**
+ * Resizes one block through sizes that cross IOG_MEM_MAP_THRESHOLD in both directions,
+ * checks that old bytes are kept and new tail is zero.
+ * @param[in] mapped 1 - iog_mem_resize (large blocks are page-mapped), 0 - iog_recalloc
+ * @return 0 if block was right after every resize
+ */
+static int iog_check_resize_tail (int mapped) {
+  const size_t sizes[] = {100, 1000, IOG_MEM_MAP_THRESHOLD + 100, 3 * IOG_MEM_MAP_THRESHOLD, 5000, 40};
+  const size_t sizes_num = sizeof(sizes) / sizeof(sizes[0]);
+
+  unsigned char *block = NULL;
+  size_t old_size = 0;
+  int failed = 0;
+
+  for (size_t i = 0; i < sizes_num && !failed; i++) {
+    unsigned char *new_block = mapped ? (unsigned char *) iog_mem_resize(NULL, block, old_size, sizes[i]) :
+                                        (unsigned char *) iog_recalloc(block, old_size, sizes[i], 1);
+    if (new_block == NULL) {
+      fprintf(stderr, RED("RECALLOC TAIL TEST FAILED, can't allocate %lu bytes\n"), sizes[i]);
+      failed = 1;
+      break;
+    }
+    block = new_block;
+
+    for (size_t j = 0; j < sizes[i]; j++) {
+      unsigned char expected = (j < old_size) ? (unsigned char) (j * 7) : 0;
+      if (block[j] != expected) {
+        fprintf(stderr, RED("RECALLOC TAIL TEST FAILED, byte %lu of %lu is %d\n"), j, sizes[i], block[j]);
+        failed = 1;
+        break;
+      }
+      block[j] = (unsigned char) (j * 7);
+    }
+
+    old_size = sizes[i];
+  }
+
+  if (mapped)
+    iog_mem_free(NULL, block, old_size);
+  else
+    iog_free_sized(block, old_size, 1);
+
+  return failed;
+}
+
+IogStackReturnCode iog_check_recalloc_tail() {
+  if (iog_check_resize_tail(0) || iog_check_resize_tail(1))
+    return ERR_TEST_FAILED;
+
+  fprintf(stderr, GREEN("RECALLOC TAIL TEST PASSED\n"));
+  return OK;
+}
+
+IogStackReturnCode iog_check_bulk_ops() {
+  const size_t chunk = 256;
+  iog_stack_value_t values[chunk] = {};
+  iog_stack_value_t result[chunk] = {};
+
+  for (size_t i = 0; i < chunk; i++)
+    values[i] = (iog_stack_value_t) i;
+
+  IogStack_t stk = {};
+  IOG_RETURN_IF_ERROR( iog_stack_init(&stk) );
+
+  IOG_RETURN_IF_ERROR( iog_stack_push  (&stk, -1) );
+  IOG_RETURN_IF_ERROR( iog_stack_push_n(&stk, values, chunk) );
+
+  iog_stack_value_t top = 0;
+  IOG_RETURN_IF_ERROR( iog_stack_peek  (&stk, &top) );
+  IOG_RETURN_IF_ERROR( iog_stack_peek_n(&stk, result, 10) );
+
+  int failed = (stk.size != chunk + 1) || !iog_value_equal(top, values[chunk - 1]) || !iog_value_equal(result[0], values[chunk - 10]);
+
+  IOG_RETURN_IF_ERROR( iog_stack_pop_n(&stk, result, chunk) );
+  for (size_t i = 0; i < chunk; i++)
+    failed |= !iog_value_equal(result[i], values[i]);
+
+  failed |= (iog_stack_pop_n(&stk, result, 2) != ERR_STACK_UNDERFLOW);
+  failed |= (stk.size != 1) || (stk.capacity > 4 * INIT_STACK_DATA_CAPACITY);
+  failed |= (iog_stack_verify(&stk) != OK);
+
+  iog_stack_destroy(&stk);
+
+  if (failed) {
+    fprintf(stderr, RED("BULK OPERATIONS TEST FAILED\n"));
+    return ERR_TEST_FAILED;
+  }
+
+  fprintf(stderr, GREEN("BULK OPERATIONS TEST PASSED\n"));
+  return OK;
+}
+
+IogStackReturnCode iog_check_verify_levels() {
+  IogStack_t stk = {};
+  IOG_RETURN_IF_ERROR( iog_stack_init(&stk) );
+  IOG_RETURN_IF_ERROR( iog_stack_push(&stk, 1) );
+
+  int failed = (iog_stack_set_verify_level(&stk, (IogStackVerifyLevel) 10) != ERR_INVALID_VERIFY_LEVEL);
+
+  // broken size is seen only by full check
+  IOG_RETURN_IF_ERROR( iog_stack_set_verify_level(&stk, IOG_VERIFY_CANARIES) );
+  stk.size = stk.capacity + 1;
+  failed |= (iog_stack_verify_canaries(&stk) != OK);
+  failed |= (iog_stack_verify(&stk) != ERR_STACK_OVERFLOW);
+  stk.size = 1;
+
+  // dead data canary is seen by canaries level
+  iog_canary_t saved_canary = *stk.secondDataCanary;
+  *stk.secondDataCanary = 0;
+
+  iog_stack_value_t value = 0;
+  failed |= (iog_stack_peek(&stk, &value) != ERR_DEAD_SECOND_DATA_CANARY);
+  *stk.secondDataCanary = saved_canary;
+
+  failed |= (iog_stack_peek(&stk, &value) != OK) || !iog_value_equal(value, 1);
+
+  iog_stack_destroy(&stk);
+
+  if (failed) {
+    fprintf(stderr, RED("VERIFY LEVELS TEST FAILED\n"));
+    return ERR_TEST_FAILED;
+  }
+
+  fprintf(stderr, GREEN("VERIFY LEVELS TEST PASSED\n"));
+  return OK;
+}
+
+/// Payload with alignment different from double for IogTStack_t test
+struct IogTestPoint_t {
+  int  x;
+  char tag;
+};
+
+template <>
+struct IogStackFormat<IogTestPoint_t> {
+  static void print (FILE *stream, const IogTestPoint_t &value) {
+    fprintf(stream, "{%d, '%c'}", value.x, value.tag);
+  }
+};
+
+IogStackReturnCode iog_check_tstack_types() {
+  int failed = 0;
+
+  IogTStack_t<long long> ints = {};
+  IogStackPolicy_t guarded = IOG_STACK_DEFAULT_POLICY;
+  guarded.guardPages = 1;
+  failed |= (iog_tstack_init(&ints, &guarded) != ERR_INVALID_POLICY) || ints.isInitialized;
+
+  IOG_RETURN_IF_ERROR( iog_tstack_init(&ints) );
+  for (long long i = 0; i < 1000; i++)
+    IOG_RETURN_IF_ERROR( iog_tstack_push(&ints, i * 1000000007LL) );
+
+  for (long long i = 999; i >= 0; i--) {
+    long long value = 0;
+    IOG_RETURN_IF_ERROR( iog_tstack_pop(&ints, &value) );
+    failed |= (value != i * 1000000007LL);
+  }
+  failed |= (iog_tstack_verify(&ints) != OK) || (ints.capacity > 4 * INIT_STACK_DATA_CAPACITY);
+  iog_tstack_destroy(&ints);
+
+  IogTStack_t<IogTestPoint_t> points = {};
+  IOG_RETURN_IF_ERROR( iog_tstack_init(&points) );
+  for (int i = 0; i < 5; i++)
+    IOG_RETURN_IF_ERROR( iog_tstack_push(&points, IogTestPoint_t {i, (char) ('a' + i)}) );
+
+  failed |= (sizeof(*points.data) != 8) || (iog_tstack_verify(&points) != OK);
+  IOG_TSTACK_DUMP(&points);
+  iog_tstack_destroy(&points);
+
+  IogTStack_t<std::string> strings = {};
+  IOG_RETURN_IF_ERROR( iog_tstack_init(&strings) );
+  for (int i = 0; i < 100; i++)
+    IOG_RETURN_IF_ERROR( iog_tstack_push(&strings, std::string(40, (char) ('a' + i % 26))) );
+
+  std::string top;
+  IOG_RETURN_IF_ERROR( iog_tstack_pop(&strings, &top) );
+  failed |= (top != std::string(40, 'v')) || (strings.size != 99);
+  iog_tstack_destroy(&strings);
+
+  if (failed) {
+    fprintf(stderr, RED("TEMPLATE STACK TEST FAILED\n"));
+    return ERR_TEST_FAILED;
+  }
+
+  fprintf(stderr, GREEN("TEMPLATE STACK TEST PASSED\n"));
+  return OK;
+}
+
+IogStackReturnCode iog_check_inline_storage() {
+#if IOG_STACK_INLINE_CAPACITY > 0
+  IogStack_t stk = {};
+  IOG_RETURN_IF_ERROR( iog_stack_init(&stk) );
+
+  int failed = (stk.firstDataCanary != stk.inlineBuffer);
+
+  const size_t spill_size = 4 * IOG_STACK_INLINE_CAPACITY;
+  for (size_t i = 0; i < spill_size; i++)
+    IOG_RETURN_IF_ERROR( iog_stack_push(&stk, (iog_stack_value_t) i) );
+
+  failed |= (stk.firstDataCanary == stk.inlineBuffer) || (iog_stack_verify(&stk) != OK);
+
+  iog_stack_value_t value = 0;
+  for (size_t i = spill_size; i > 1; i--) {
+    IOG_RETURN_IF_ERROR( iog_stack_pop(&stk, &value) );
+    failed |= !iog_value_equal(value, (iog_stack_value_t) (i - 1));
+  }
+
+  failed |= (stk.firstDataCanary != stk.inlineBuffer) || (iog_stack_verify(&stk) != OK);
+
+  IOG_RETURN_IF_ERROR( iog_stack_peek(&stk, &value) );
+  failed |= !iog_value_equal(value, 0);
+
+  // overrun of inline data kills data canary, not neighbouring fields
+  stk.data[stk.capacity] = 1;
+  failed |= (iog_stack_verify(&stk) != ERR_DEAD_SECOND_DATA_CANARY);
+  iog_stack_update_canaries(&stk);
+
+  iog_stack_destroy(&stk);
+
+  if (failed) {
+    fprintf(stderr, RED("INLINE STORAGE TEST FAILED\n"));
+    return ERR_TEST_FAILED;
+  }
+
+  fprintf(stderr, GREEN("INLINE STORAGE TEST PASSED\n"));
+#endif // IOG_STACK_INLINE_CAPACITY
+  return OK;
+}
+
+IogStackReturnCode iog_check_seg_stack() {
+  IogSegStack_t stk = {};
+  IOG_RETURN_IF_ERROR( iog_seg_stack_init(&stk, 8) );
+
+  IOG_RETURN_IF_ERROR( iog_seg_stack_push(&stk, 0) );
+
+  const iog_stack_value_t *bottom = NULL;
+  IOG_RETURN_IF_ERROR( iog_seg_stack_at(&stk, 0, &bottom) );
+
+  for (size_t i = 1; i < 100; i++)
+    IOG_RETURN_IF_ERROR( iog_seg_stack_push(&stk, (iog_stack_value_t) i) );
+
+  const iog_stack_value_t *bottom_after = NULL;
+  IOG_RETURN_IF_ERROR( iog_seg_stack_at(&stk, 99, &bottom_after) );
+
+  int failed = (bottom != bottom_after) || (stk.blocksNum != 13) || (iog_seg_stack_verify_all(&stk) != OK);
+
+  iog_stack_value_t value = 0;
+  for (size_t i = 100; i > 1; i--) {
+    IOG_RETURN_IF_ERROR( iog_seg_stack_pop(&stk, &value) );
+    failed |= !iog_value_equal(value, (iog_stack_value_t) (i - 1));
+  }
+
+  failed |= (stk.size != 1) || (stk.spareNum != IOG_SEG_MAX_SPARE_BLOCKS);
+
+  IOG_RETURN_IF_ERROR( iog_seg_stack_peek(&stk, &value) );
+  failed |= !iog_value_equal(value, 0);
+
+  // overrun of top block kills its second canary
+  stk.topData[stk.blockCapacity] = 1;
+  failed |= (iog_seg_stack_push(&stk, 1) != ERR_DEAD_SECOND_DATA_CANARY);
+
+  iog_seg_stack_destroy(&stk);
+
+  if (failed) {
+    fprintf(stderr, RED("SEGMENTED STACK TEST FAILED\n"));
+    return ERR_TEST_FAILED;
+  }
+
+  fprintf(stderr, GREEN("SEGMENTED STACK TEST PASSED\n"));
+  return OK;
+}
+
+IogStackReturnCode iog_check_guard_pages() {
+#if defined(__unix__) || defined(__APPLE__)
+  IogStackPolicy_t policy = IOG_STACK_DEFAULT_POLICY;
+  policy.guardPages = 1;
+
+  IogStack_t stk = {};
+  IOG_RETURN_IF_ERROR( iog_stack_init(&stk, &policy) );
+
+  for (size_t i = 0; i < 1000; i++)
+    IOG_RETURN_IF_ERROR( iog_stack_push(&stk, (iog_stack_value_t) i) );
+
+  iog_stack_value_t value = 0;
+  for (size_t i = 1000; i > 10; i--) {
+    IOG_RETURN_IF_ERROR( iog_stack_pop(&stk, &value) );
+  }
+
+  int failed = !iog_value_equal(value, 10) || (iog_stack_verify(&stk) != OK) || (stk.secondDataCanary != NULL);
+
+  fflush(stderr);
+  pid_t child = fork();
+  if (child == 0) {
+    int dev_null = open("/dev/null", O_WRONLY);
+    dup2(dev_null, STDERR_FILENO);
+    dup2(dev_null, STDOUT_FILENO);
+
+    ((volatile iog_stack_value_t *) stk.data)[stk.capacity] = 1;
+    _exit(0);
+  }
+
+  int status = 0;
+  waitpid(child, &status, 0);
+  failed |= (WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+  iog_stack_destroy(&stk);
+
+  if (failed) {
+    fprintf(stderr, RED("GUARD PAGES TEST FAILED\n"));
+    return ERR_TEST_FAILED;
+  }
+
+  fprintf(stderr, GREEN("GUARD PAGES TEST PASSED\n"));
+#endif // __unix__
+  return OK;
+}
+
+IogStackReturnCode iog_check_stack_stats() {
+#if IOG_STACK_STATS > 0
+  iog_mem_stats_reset();
+
+  IogStack_t stk = {};
+  IOG_RETURN_IF_ERROR( iog_stack_init(&stk) );
+
+  const size_t n = 1000;
+  iog_stack_value_t value = 0;
+
+  for (size_t i = 0; i < n; i++)
+    IOG_RETURN_IF_ERROR( iog_stack_push(&stk, (iog_stack_value_t) i) );
+
+  for (size_t i = 0; i < n; i++)
+    IOG_RETURN_IF_ERROR( iog_stack_pop(&stk, &value) );
+
+  IogStackStats_t stats = {};
+  IOG_RETURN_IF_ERROR( iog_stack_stats(&stk, &stats) );
+
+  int failed = stats.pushes != n || stats.pops != n || stats.maxSize != n ||
+               stats.maxCapacity < n || stats.reallocs == 0 || stats.shrinks == 0 ||
+               iog_mem_stats()->allocs == 0;
+
+  // corrupted canary must be counted by its return code
+  stk.firstStackCanary++;
+  failed |= iog_stack_verify(&stk) != ERR_DEAD_FIRST_CANARY;
+  stk.firstStackCanary--;
+
+  IOG_RETURN_IF_ERROR( iog_stack_stats(&stk, &stats) );
+  failed |= stats.verifyFailures[ERR_DEAD_FIRST_CANARY] != 1 || stats.verifyCalls == 0;
+
+  FILE *stream = tmpfile();
+  if (stream != NULL) {
+    iog_stack_dump_stats_f(&stk, stream, "stk");
+    rewind(stream);
+
+    char line[1024] = "";
+    failed |= fgets(line, sizeof(line), stream) == NULL ||
+              std::string(line).find("\"pushes\": 1000,") == std::string::npos ||
+              std::string(line).find("\"verifyFailures\": {\"10\": 1}}") == std::string::npos;
+    fclose(stream);
+  }
+
+  iog_stack_destroy(&stk);
+
+  if (failed) {
+    fprintf(stderr, RED("STACK STATS TEST FAILED\n"));
+    return ERR_TEST_FAILED;
+  }
+
+  fprintf(stderr, GREEN("STACK STATS TEST PASSED\n"));
+#endif // IOG_STACK_STATS
+  return OK;
+}
+
+static const size_t LF_TEST_THREADS = 4;
+static const size_t LF_TEST_VALUES  = 20000;
+
+/**
+ * Pushes own values and pops the same amount of any values, sums popped values.
+ */
+static void iog_lf_test_worker (IogLfStack_t *stk, size_t thread_num, double *popped_sum, size_t *errors) {
+  iog_stack_value_t value = 0;
+
+  for (size_t i = 0; i < LF_TEST_VALUES; i++) {
+    *errors += iog_lf_stack_push(stk, (iog_stack_value_t) (thread_num * LF_TEST_VALUES + i)) != OK;
+
+    if (i % 2 == 1) {
+      for (size_t j = 0; j < 2; j++) {
+        IogStackReturnCode err = ERR_STACK_UNDERFLOW;
+        while (err == ERR_STACK_UNDERFLOW)
+          err = iog_lf_stack_pop(stk, &value);
+
+        *errors     += err != OK;
+        *popped_sum += value;
+      }
+    }
+  }
+}
+
+IogStackReturnCode iog_check_lf_stack() {
+  static IogLfStack_t stk = {};
+  iog_stack_value_t value = 0;
+  int failed = 0;
+
+  for (iog_flag_t elimination = 0; elimination <= 1; elimination++) {
+    IOG_RETURN_IF_ERROR( iog_lf_stack_init(&stk, elimination) );
+
+    for (size_t i = 0; i < 100; i++)
+      IOG_RETURN_IF_ERROR( iog_lf_stack_push(&stk, (iog_stack_value_t) i) );
+
+    for (size_t i = 100; i > 0; i--) {
+      IOG_RETURN_IF_ERROR( iog_lf_stack_pop(&stk, &value) );
+      failed |= !iog_value_equal(value, (iog_stack_value_t) (i - 1));
+    }
+
+    failed |= iog_lf_stack_pop(&stk, &value) != ERR_STACK_UNDERFLOW;
+
+    std::thread workers[LF_TEST_THREADS];
+    double popped_sum[LF_TEST_THREADS] = {};
+    size_t errors[LF_TEST_THREADS] = {};
+
+    for (size_t t = 0; t < LF_TEST_THREADS; t++)
+      workers[t] = std::thread(iog_lf_test_worker, &stk, t, &popped_sum[t], &errors[t]);
+
+    double total = 0;
+    for (size_t t = 0; t < LF_TEST_THREADS; t++) {
+      workers[t].join();
+
+      total  += popped_sum[t];
+      failed |= errors[t] != 0;
+    }
+
+    // every pushed value must be popped exactly once
+    double expected = (double) (LF_TEST_THREADS * LF_TEST_VALUES) * (double) (LF_TEST_THREADS * LF_TEST_VALUES - 1) / 2;
+    failed |= !iog_value_equal(total, expected);
+    failed |= iog_lf_stack_pop(&stk, &value) != ERR_STACK_UNDERFLOW;
+    failed |= iog_lf_stack_verify(&stk) != OK;
+
+    iog_lf_stack_destroy(&stk);
+  }
+
+  if (failed) {
+    fprintf(stderr, RED("LOCK-FREE STACK TEST FAILED\n"));
+    return ERR_TEST_FAILED;
+  }
+
+  fprintf(stderr, GREEN("LOCK-FREE STACK TEST PASSED\n"));
+  return OK;
+}
+
+static const size_t WS_TEST_THIEVES = 3;
+static const size_t WS_TEST_VALUES  = 100000;
+
+/**
+ * Steals until owner finished and deque is empty, sums stolen values.
+ */
+static void iog_ws_test_thief (IogWsDeque_t *deque, std::atomic<int> *owner_done, double *sum, size_t *count) {
+  iog_stack_value_t value = 0;
+
+  while (true) {
+    IogStackReturnCode err = iog_ws_deque_steal(deque, &value);
+
+    if (err == OK) {
+      *sum += value;
+      (*count)++;
+    } else if (err == ERR_STACK_UNDERFLOW && owner_done->load()) {
+      return;
+    }
+  }
+}
+
+IogStackReturnCode iog_check_ws_deque() {
+  IogWsDeque_t deque = {};
+  iog_stack_value_t value = 0;
+  int failed = 0;
+
+  // owner is LIFO, thief is FIFO, buffer grows from 4 slots
+  IOG_RETURN_IF_ERROR( iog_ws_deque_init(&deque, 4) );
+
+  for (size_t i = 0; i < 100; i++)
+    IOG_RETURN_IF_ERROR( iog_ws_deque_push(&deque, (iog_stack_value_t) i) );
+
+  IOG_RETURN_IF_ERROR( iog_ws_deque_steal(&deque, &value) );
+  failed |= !iog_value_equal(value, 0);
+
+  IOG_RETURN_IF_ERROR( iog_ws_deque_pop(&deque, &value) );
+  failed |= !iog_value_equal(value, 99);
+
+  failed |= iog_ws_deque_size(&deque) != 98;
+  failed |= iog_ws_deque_verify(&deque) != OK;
+
+  for (size_t i = 0; i < 98; i++)
+    IOG_RETURN_IF_ERROR( iog_ws_deque_pop(&deque, &value) );
+
+  failed |= iog_ws_deque_pop(&deque, &value)   != ERR_STACK_UNDERFLOW;
+  failed |= iog_ws_deque_steal(&deque, &value) != ERR_STACK_UNDERFLOW;
+
+  iog_ws_deque_destroy(&deque);
+
+  // owner pushes and pops while thieves steal, every value must be taken once
+  IOG_RETURN_IF_ERROR( iog_ws_deque_init(&deque, 4) );
+
+  std::atomic<int> owner_done(0);
+  std::thread thieves[WS_TEST_THIEVES];
+  double stolen_sum[WS_TEST_THIEVES] = {};
+  size_t stolen_count[WS_TEST_THIEVES] = {};
+
+  for (size_t t = 0; t < WS_TEST_THIEVES; t++)
+    thieves[t] = std::thread(iog_ws_test_thief, &deque, &owner_done, &stolen_sum[t], &stolen_count[t]);
+
+  double total = 0;
+  size_t count = 0;
+
+  for (size_t i = 0; i < WS_TEST_VALUES; i++) {
+    failed |= iog_ws_deque_push(&deque, (iog_stack_value_t) i) != OK;
+
+    if (i % 3 == 0 && iog_ws_deque_pop(&deque, &value) == OK) {
+      total += value;
+      count++;
+    }
+  }
+
+  while (iog_ws_deque_pop(&deque, &value) == OK) {
+    total += value;
+    count++;
+  }
+
+  owner_done.store(1);
+
+  for (size_t t = 0; t < WS_TEST_THIEVES; t++) {
+    thieves[t].join();
+
+    total += stolen_sum[t];
+    count += stolen_count[t];
+  }
+
+  failed |= (count != WS_TEST_VALUES);
+  failed |= !iog_value_equal(total, (double) WS_TEST_VALUES * (double) (WS_TEST_VALUES - 1) / 2);
+  failed |= iog_ws_deque_verify(&deque) != OK;
+
+  iog_ws_deque_destroy(&deque);
+
+  if (failed) {
+    fprintf(stderr, RED("WORK-STEALING DEQUE TEST FAILED\n"));
+    return ERR_TEST_FAILED;
+  }
+
+  fprintf(stderr, GREEN("WORK-STEALING DEQUE TEST PASSED\n"));
+  return OK;
+}
+
+IogStackReturnCode iog_check_mem_arena() {
+  const size_t stacks_num = 64;
+  const size_t n = 100;
+
+  // stacks are too big for test frame, their array comes from heap
+  IogStack_t *stks = (IogStack_t *) iog_recalloc(NULL, 0, stacks_num, sizeof(IogStack_t));
+  if (stks == NULL)
+    return ERR_CANT_ALLOCATE_DATA;
+
+  iog_stack_value_t value = 0;
+
+  int failed = iog_mem_class_bytes(1) != 32 || iog_mem_class_bytes(32) != 32 ||
+               iog_mem_class_bytes(33) != 64;
+
+  // pool gives released block back to the same thread
+  void *block = iog_pool_alloc(100);
+  iog_pool_free(block, 100);
+  failed |= iog_pool_alloc(100) != block;
+  iog_pool_free(block, 100);
+
+  IogMemArena_t arena = {};
+  iog_arena_init(&arena, 16 * 1024);
+
+  void *last_chunk = NULL;
+
+  for (int round = 0; round < 2; round++) {
+    iog_mem_bind_arena(&arena);
+
+    for (size_t i = 0; i < stacks_num; i++) {
+      IOG_RETURN_IF_ERROR( iog_stack_init(&stks[i]) );
+
+      for (size_t j = 0; j < n; j++)
+        IOG_RETURN_IF_ERROR( iog_stack_push(&stks[i], (iog_stack_value_t) (i + j)) );
+    }
+
+    iog_mem_bind_arena(NULL);
+
+    for (size_t i = 0; i < stacks_num; i++) {
+      failed |= stks[i].policy.arena != &arena;
+      // capacity fills its size class, so doubling moves between neighbour classes
+      failed |= iog_mem_class_bytes(stks[i].capacity * sizeof(iog_stack_value_t) + 2 * sizeof(iog_canary_t)) !=
+                stks[i].capacity * sizeof(iog_stack_value_t) + 2 * sizeof(iog_canary_t);
+
+      IOG_RETURN_IF_ERROR( iog_stack_pop(&stks[i], &value) );
+      failed |= !iog_value_equal(value, (iog_stack_value_t) (i + n - 1));
+      failed |= iog_stack_verify(&stks[i]) != OK;
+    }
+
+    // second round must fit into chunks kept by reset
+    if (round == 1)
+      failed |= arena.current != last_chunk;
+
+    last_chunk = arena.current;
+
+    // all stacks are released at once, their memory isn't valid anymore
+    iog_arena_reset(&arena);
+    for (size_t i = 0; i < stacks_num; i++)
+      stks[i] = {};
+  }
+
+  iog_arena_destroy(&arena);
+  failed |= arena.chunks != NULL;
+
+  iog_free_sized(stks, stacks_num, sizeof(IogStack_t));
+
+  if (failed) {
+    fprintf(stderr, RED("MEM ARENA TEST FAILED\n"));
+    return ERR_TEST_FAILED;
+  }
+
+  fprintf(stderr, GREEN("MEM ARENA TEST PASSED\n"));
+  return OK;
+}
+
+IogStackReturnCode iog_check_mapped_stack() {
+#if defined(__unix__) || defined(__APPLE__)
+  char path[] = "/tmp/iog_mapped_stack_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0)
+    return ERR_CANT_OPEN_FILE;
+  close(fd);
+
+  const size_t n = 10000;
+  iog_stack_value_t value = 0;
+  IogStack_t stk = {};
+
+  IOG_RETURN_IF_ERROR( iog_stack_open_mapped(&stk, path) );
+  for (size_t i = 0; i < n; i++)
+    IOG_RETURN_IF_ERROR( iog_stack_push(&stk, (iog_stack_value_t) i) );
+  IOG_RETURN_IF_ERROR( iog_stack_destroy(&stk) );
+
+  // restored stack is the same, even if mapped at other address
+  IOG_RETURN_IF_ERROR( iog_stack_open_mapped(&stk, path) );
+  int failed = stk.size != n || !iog_value_equal(stk.data[n / 2], (iog_stack_value_t) (n / 2));
+
+  for (size_t i = n; i > 10; i--)
+    IOG_RETURN_IF_ERROR( iog_stack_pop(&stk, &value) );
+  failed |= !iog_value_equal(value, 10);
+  IOG_RETURN_IF_ERROR( iog_stack_sync(&stk) );
+  IOG_RETURN_IF_ERROR( iog_stack_destroy(&stk) );
+
+  IOG_RETURN_IF_ERROR( iog_stack_open_mapped(&stk, path) );
+  failed |= stk.size != 10 || iog_stack_peek(&stk, &value) != OK || !iog_value_equal(value, 9);
+
+  // corrupted data canary stays in file and is caught by next open
+  (*stk.firstDataCanary)++;
+  iog_stack_destroy(&stk);
+  failed |= iog_stack_open_mapped(&stk, path) != ERR_DEAD_FIRST_DATA_CANARY;
+  failed |= stk.isInitialized;
+
+  // file of other kind is rejected by superblock
+  FILE *file = fopen(path, "r+");
+  if (file != NULL) {
+    fputs("not a stack", file);
+    fclose(file);
+  }
+  failed |= iog_stack_open_mapped(&stk, path) != ERR_BAD_SUPERBLOCK;
+
+  unlink(path);
+
+  if (failed) {
+    fprintf(stderr, RED("MAPPED STACK TEST FAILED\n"));
+    return ERR_TEST_FAILED;
+  }
+
+  fprintf(stderr, GREEN("MAPPED STACK TEST PASSED\n"));
+#endif // __unix__
+  return OK;
+}
+
+IogStackReturnCode iog_check_seg_snapshot() {
+  const size_t n = 100;
+
+  IogSegStack_t stk = {};
+  IOG_RETURN_IF_ERROR( iog_seg_stack_init(&stk, 16) );
+
+  for (size_t i = 0; i < n; i++)
+    IOG_RETURN_IF_ERROR( iog_seg_stack_push(&stk, (iog_stack_value_t) i) );
+
+  IogSegSnapshot_t snapshot = {};
+  IOG_RETURN_IF_ERROR( iog_seg_stack_snapshot(&stk, &snapshot) );
+
+  // branch goes below snapshot and above it, shared blocks must stay untouched
+  iog_stack_value_t value = 0;
+  for (size_t i = 0; i < 50; i++)
+    IOG_RETURN_IF_ERROR( iog_seg_stack_push(&stk, -1) );
+  for (size_t i = 0; i < 120; i++)
+    IOG_RETURN_IF_ERROR( iog_seg_stack_pop(&stk, &value) );
+  for (size_t i = 0; i < 10; i++)
+    IOG_RETURN_IF_ERROR( iog_seg_stack_push(&stk, -2) );
+
+  IOG_RETURN_IF_ERROR( iog_seg_stack_restore(&stk, &snapshot) );
+
+  int failed = stk.size != n || iog_seg_stack_verify_all(&stk) != OK;
+  for (size_t depth = 0; depth < n; depth++) {
+    const iog_stack_value_t *elem = NULL;
+    IOG_RETURN_IF_ERROR( iog_seg_stack_at(&stk, depth, &elem) );
+    failed |= !iog_value_equal(*elem, (iog_stack_value_t) (n - 1 - depth));
+  }
+
+  // many branches from one snapshot copy at most top block each
+  iog_mem_stats_reset();
+  for (size_t branch = 0; branch < 1000; branch++) {
+    IOG_RETURN_IF_ERROR( iog_seg_stack_restore(&stk, &snapshot) );
+    for (size_t i = 0; i < 3; i++)
+      IOG_RETURN_IF_ERROR( iog_seg_stack_push(&stk, (iog_stack_value_t) branch) );
+  }
+  failed |= iog_mem_stats()->allocs > 4 || stk.size != n + 3;
+
+  IogSegStack_t clone = {};
+  IOG_RETURN_IF_ERROR( iog_seg_stack_fork(&stk, &clone) );
+
+  for (size_t i = 0; i < 40; i++)
+    IOG_RETURN_IF_ERROR( iog_seg_stack_pop(&stk, &value) );
+  IOG_RETURN_IF_ERROR( iog_seg_stack_push(&stk, -3) );
+  IOG_RETURN_IF_ERROR( iog_seg_stack_push(&clone, -4) );
+
+  IOG_RETURN_IF_ERROR( iog_seg_stack_pop(&clone, &value) );
+  failed |= !iog_value_equal(value, -4);
+  IOG_RETURN_IF_ERROR( iog_seg_stack_pop(&clone, &value) );
+  failed |= !iog_value_equal(value, 999) || clone.size != n + 2 || iog_seg_stack_verify_all(&clone) != OK;
+
+  IOG_RETURN_IF_ERROR( iog_seg_snapshot_release(&snapshot) );
+  IOG_RETURN_IF_ERROR( iog_seg_stack_destroy(&clone) );
+
+  for (size_t depth = 1; depth < stk.size; depth++) {
+    const iog_stack_value_t *elem = NULL;
+    IOG_RETURN_IF_ERROR( iog_seg_stack_at(&stk, depth, &elem) );
+    failed |= !iog_value_equal(*elem, (iog_stack_value_t) (stk.size - 1 - depth));
+  }
+
+  iog_seg_stack_destroy(&stk);
+
+  if (failed) {
+    fprintf(stderr, RED("SEG SNAPSHOT TEST FAILED\n"));
+    return ERR_TEST_FAILED;
+  }
+
+  fprintf(stderr, GREEN("SEG SNAPSHOT TEST PASSED\n"));
+  return OK;
+}
+
+IogStackReturnCode iog_check_mark_rollback() {
+  IogStack_t stk = {};
+  IOG_RETURN_IF_ERROR( iog_stack_init(&stk) );
+
+  for (size_t i = 0; i < 10; i++)
+    IOG_RETURN_IF_ERROR( iog_stack_push(&stk, (iog_stack_value_t) i) );
+
+  IogStackMark_t outer = {};
+  IogStackMark_t inner = {};
+  IOG_RETURN_IF_ERROR( iog_stack_mark(&stk, &outer) );
+
+  for (size_t i = 0; i < 1000; i++)
+    IOG_RETURN_IF_ERROR( iog_stack_push(&stk, -1) );
+
+  IOG_RETURN_IF_ERROR( iog_stack_mark(&stk, &inner) );
+  for (size_t i = 0; i < 100; i++)
+    IOG_RETURN_IF_ERROR( iog_stack_push(&stk, -2) );
+
+  // pops under outstanding marks don't shrink data
+  size_t capacity = stk.capacity;
+  iog_stack_value_t value = 0;
+  for (size_t i = 0; i < 1000; i++)
+    IOG_RETURN_IF_ERROR( iog_stack_pop(&stk, &value) );
+
+  int failed = stk.capacity != capacity;
+  failed |= iog_stack_rollback(&stk, &inner) != ERR_INVALID_MARK;
+
+  IOG_RETURN_IF_ERROR( iog_stack_rollback(&stk, &outer) );
+  failed |= stk.size != 10 || stk.capacity != capacity || stk.marksNum != 0;
+  failed |= iog_stack_peek(&stk, &value) != OK || !iog_value_equal(value, 9);
+
+  // released marks can't be used again
+  failed |= iog_stack_rollback(&stk, &outer) != ERR_INVALID_MARK;
+  failed |= iog_stack_commit(&stk, &inner) != ERR_INVALID_MARK;
+
+  IOG_RETURN_IF_ERROR( iog_stack_mark(&stk, &outer) );
+  IOG_RETURN_IF_ERROR( iog_stack_push(&stk, 10) );
+  IOG_RETURN_IF_ERROR( iog_stack_commit(&stk, &outer) );
+  failed |= stk.size != 11 || iog_stack_verify(&stk) != OK;
+
+  // without marks shrink is back
+  IOG_RETURN_IF_ERROR( iog_stack_pop(&stk, &value) );
+  failed |= stk.capacity >= capacity;
+
+  iog_stack_destroy(&stk);
+
+  if (failed) {
+    fprintf(stderr, RED("MARK ROLLBACK TEST FAILED\n"));
+    return ERR_TEST_FAILED;
+  }
+
+  fprintf(stderr, GREEN("MARK ROLLBACK TEST PASSED\n"));
+  return OK;
+}
+
+IogStackReturnCode iog_check_pop_poisoning() {
+  IogStackPolicy_t policy = IOG_STACK_DEFAULT_POLICY;
+  policy.neverShrink = 1;
+
+  IogStack_t stk = {};
+  IOG_RETURN_IF_ERROR( iog_stack_init(&stk, &policy) );
+
+  for (size_t i = 0; i < 100; i++)
+    IOG_RETURN_IF_ERROR( iog_stack_push(&stk, (iog_stack_value_t) i) );
+
+  iog_stack_value_t value = 0;
+  for (size_t i = 0; i < 50; i++)
+    IOG_RETURN_IF_ERROR( iog_stack_pop(&stk, &value) );
+
+  int failed = stk.size != 50 || !iog_value_equal(value, 50);
+
+#if IOG_STACK_POISON
+  // popped and never used slots are poisoned, live slots are not
+  failed |= !IOG_STACK_IS_POISONED(stk.data + stk.size);
+  failed |= !IOG_STACK_IS_POISONED(stk.data + stk.capacity - 1);
+  failed |= IOG_STACK_IS_POISONED(stk.data + stk.size - 1);
+#else
+  // pop doesn't write to freed slot
+  failed |= !iog_value_equal(stk.data[stk.size], 50);
+#endif
+
+  // dump prints live values and doesn't read free slots
+  FILE *null_file = fopen("/dev/null", "w");
+  if (null_file != NULL) {
+    failed |= iog_stack_dump_f(&stk, null_file, "stk", __FILE__, __LINE__, __PRETTY_FUNCTION__) != OK;
+    fclose(null_file);
+  }
+
+  // slots are usable again after push, rollback poisons them back
+  IogStackMark_t mark = {};
+  IOG_RETURN_IF_ERROR( iog_stack_mark(&stk, &mark) );
+  for (size_t i = 0; i < 200; i++)
+    IOG_RETURN_IF_ERROR( iog_stack_push(&stk, -1) );
+
+  IOG_RETURN_IF_ERROR( iog_stack_rollback(&stk, &mark) );
+  failed |= stk.size != 50 || iog_stack_verify(&stk) != OK;
+  failed |= iog_stack_peek(&stk, &value) != OK || !iog_value_equal(value, 49);
+
+#if IOG_STACK_POISON
+  failed |= !IOG_STACK_IS_POISONED(stk.data + stk.size);
+#endif
+
+  iog_stack_destroy(&stk);
+
+  if (failed) {
+    fprintf(stderr, RED("POP POISONING TEST FAILED\n"));
+    return ERR_TEST_FAILED;
+  }
+
+  fprintf(stderr, GREEN("POP POISONING TEST PASSED\n"));
+  return OK;
+}
+
+IogStackReturnCode iog_check_save_load() {
+  IogStack_t stk = {};
+  IOG_RETURN_IF_ERROR( iog_stack_init(&stk) );
+
+  for (size_t i = 0; i < 1000; i++)
+    IOG_RETURN_IF_ERROR( iog_stack_push(&stk, (iog_stack_value_t) i * 0.5) );
+
+  FILE *image = tmpfile();
+  if (image == NULL)
+    return ERR_CANT_OPEN_FILE;
+
+  int failed = iog_stack_save_f(&stk, image) != OK;
+  long image_bytes = ftell(image);
+  rewind(image);
+
+  IogStack_t loaded = {};
+  failed |= iog_stack_load_f(&loaded, image) != OK;
+  failed |= loaded.size != stk.size || iog_stack_verify(&loaded) != OK;
+
+  iog_stack_value_t value = 0;
+  iog_stack_value_t loaded_value = 0;
+  while (!failed && stk.size > 0) {
+    failed |= iog_stack_pop(&stk, &value) != OK;
+    failed |= iog_stack_pop(&loaded, &loaded_value) != OK || !iog_value_equal(value, loaded_value);
+  }
+
+  iog_stack_destroy(&loaded);
+
+  // flipped value is caught by data hash, stack stays uninitialized
+  fseek(image, (long) sizeof(IogStackImageHeader_t) + 8 * (long) sizeof(iog_stack_value_t), SEEK_SET);
+  fputc(0x7f, image);
+  rewind(image);
+  failed |= iog_stack_load_f(&loaded, image) != ERR_BAD_IMAGE || loaded.isInitialized;
+
+  // truncated image
+  rewind(image);
+  failed |= iog_stack_save_f(&stk, image) != OK;
+  rewind(image);
+  IogStackImageHeader_t header = {};
+  failed |= fread(&header, sizeof(header), 1, image) != 1;
+  rewind(image);
+  header.size += 1;
+  fwrite(&header, sizeof(header), 1, image);
+  rewind(image);
+  failed |= iog_stack_load_f(&loaded, image) != ERR_BAD_IMAGE;
+
+  fclose(image);
+
+  // window prints 2 * 3 values of big stack, all values of small one
+  for (size_t i = 0; i < 100; i++)
+    IOG_RETURN_IF_ERROR( iog_stack_push(&stk, (iog_stack_value_t) i) );
+
+  FILE *text = tmpfile();
+  if (text == NULL)
+    return ERR_CANT_OPEN_FILE;
+
+  failed |= iog_stack_dump_window_f(&stk, text, 3) != OK;
+  rewind(text);
+
+  size_t lines = 0;
+  int has_skip = 0;
+  char line[128] = {};
+  while (fgets(line, sizeof(line), text) != NULL) {
+    lines++;
+    has_skip |= strstr(line, "94 values skipped") != NULL;
+    failed |= strchr(line, '\033') != NULL;
+  }
+
+  failed |= lines != 8 || !has_skip || image_bytes <= 1000 * (long) sizeof(iog_stack_value_t);
+  fclose(text);
+
+  iog_stack_destroy(&stk);
+
+  if (failed) {
+    fprintf(stderr, RED("SAVE LOAD TEST FAILED\n"));
+    return ERR_TEST_FAILED;
+  }
+
+  fprintf(stderr, GREEN("SAVE LOAD TEST PASSED\n"));
+  return OK;
+}
+
+IogStackReturnCode iog_check_vm() {
+  const char *loop_source =
+    "  push 0     ; sum\n"
+    "  load 0     ; sum i\n"
+    "loop:\n"
+    "  dup\n"
+    "  jz end\n"
+    "  swap       ; i sum\n"
+    "  over\n"
+    "  add        ; i sum+i\n"
+    "  swap\n"
+    "  push 1\n"
+    "  sub        ; sum i-1\n"
+    "  jmp loop\n"
+    "end:\n"
+    "  pop\n"
+    "  halt\n";
+
+  IogVmProgram_t loop = {};
+  IOG_RETURN_IF_ERROR( iog_vm_program_init(&loop) );
+  IOG_RETURN_IF_ERROR( iog_vm_assemble(&loop, loop_source) );
+
+  IogStack_t stk = {};
+  IOG_RETURN_IF_ERROR( iog_stack_init(&stk) );
+
+  iog_stack_value_t arg = 100;
+  iog_stack_value_t result = 0;
+  int failed = iog_vm_run(&loop, &stk, &arg, 1, &result) != OK || !iog_value_equal(result, 5050) || stk.size != 1;
+
+  // same result when stack is verified at every block
+  IOG_RETURN_IF_ERROR( iog_stack_set_verify_level(&stk, IOG_VERIFY_FULL) );
+  failed |= iog_vm_run(&loop, &stk, &arg, 1, &result) != OK || !iog_value_equal(result, 5050) || stk.size != 2;
+  failed |= iog_stack_verify(&stk) != OK;
+  failed |= iog_vm_run(&loop, &stk, NULL, 0, &result) != ERR_BAD_BYTECODE;
+
+  iog_stack_destroy(&stk);
+  iog_vm_program_destroy(&loop);
+
+  // straight code grows stack past its capacity in one block
+  IogVmProgram_t sum = {};
+  IOG_RETURN_IF_ERROR( iog_vm_program_init(&sum) );
+  for (size_t i = 0; i < 100; i++)
+    IOG_RETURN_IF_ERROR( iog_vm_emit(&sum, IOG_VM_PUSH, 0, 1) );
+  for (size_t i = 1; i < 100; i++)
+    IOG_RETURN_IF_ERROR( iog_vm_emit(&sum, IOG_VM_ADD) );
+  IOG_RETURN_IF_ERROR( iog_vm_link(&sum) );
+
+  failed |= sum.code[0].op != IOG_VM_BLOCK || sum.code[0].index != 0 || sum.code[0].grow != 100;
+  failed |= iog_vm_emit(&sum, IOG_VM_POP) != ERR_BAD_BYTECODE;
+
+  IOG_RETURN_IF_ERROR( iog_stack_init(&stk) );
+  failed |= iog_vm_run(&sum, &stk, NULL, 0, &result) != OK || !iog_value_equal(result, 100);
+  failed |= stk.size != 1 || stk.capacity < 100 || iog_stack_verify(&stk) != OK;
+  failed |= iog_stack_pop(&stk, &result) != OK || !iog_value_equal(result, 100);
+
+  iog_vm_program_destroy(&sum);
+
+  // block needs more values than stack has
+  IogVmProgram_t bad = {};
+  IOG_RETURN_IF_ERROR( iog_vm_assemble(&bad, "push 1\nadd\n") );
+  failed |= iog_vm_run(&bad, &stk, NULL, 0, &result) != ERR_STACK_UNDERFLOW || stk.size != 0;
+  iog_vm_program_destroy(&bad);
+
+  size_t error_line = 0;
+  failed |= iog_vm_assemble(&bad, "push 1\npush\n", &error_line) != ERR_BAD_BYTECODE || error_line != 2;
+  failed |= iog_vm_assemble(&bad, "jmp nowhere\n", &error_line) != ERR_BAD_BYTECODE || error_line != 1;
+  failed |= iog_vm_assemble(&bad, "a:\na:\n", &error_line) != ERR_BAD_BYTECODE || error_line != 2;
+  failed |= iog_vm_assemble(&bad, "push 1 2\n", &error_line) != ERR_BAD_BYTECODE;
+
+  // label after final jmp gets implicit halt
+  IogVmProgram_t tail = {};
+  IOG_RETURN_IF_ERROR( iog_vm_assemble(&tail, "push 1\njz end\npush 2\njmp end\nend:\n") );
+  failed |= iog_vm_run(&tail, &stk, NULL, 0, &result) != OK || !iog_value_equal(result, 2) || iog_stack_pop(&stk, &result) != OK;
+  iog_vm_program_destroy(&tail);
+
+  failed |= iog_stack_verify(&stk) != OK;
+  iog_stack_destroy(&stk);
+
+  if (failed) {
+    fprintf(stderr, RED("VM TEST FAILED\n"));
+    return ERR_TEST_FAILED;
+  }
+
+  fprintf(stderr, GREEN("VM TEST PASSED\n"));
+  return OK;
+}
+
+/**
+ * Compares aggregates of stack with plain loop over its data.
+ * @param[in] stack pointer to stack
+ * @return 1 if any aggregate differs, else 0
+ */
+static int iog_check_aggregates_differ (const IogStack_t *stack) {
+  iog_stack_value_t min = 0, max = 0, sum = 0;
+  int failed = iog_stack_sum(stack, &sum) != OK;
+
+  if (stack->size == 0)
+    return failed || !iog_value_equal(sum, 0) || iog_stack_min(stack, &min) != ERR_STACK_UNDERFLOW;
+
+  failed |= iog_stack_min(stack, &min) != OK || iog_stack_max(stack, &max) != OK;
+
+  iog_stack_value_t real_min = stack->data[0], real_max = stack->data[0], real_sum = 0;
+  for (size_t i = 0; i < stack->size; i++) {
+    real_min = (stack->data[i] < real_min) ? stack->data[i] : real_min;
+    real_max = (stack->data[i] > real_max) ? stack->data[i] : real_max;
+    real_sum += stack->data[i];
+  }
+
+  return failed || !iog_value_equal(min, real_min) || !iog_value_equal(max, real_max) || !iog_value_equal(sum, real_sum);
+}
+
+IogStackReturnCode iog_check_aggregates() {
+  IogStack_t stk = {};
+  IOG_RETURN_IF_ERROR( iog_stack_init(&stk) );
+
+  for (size_t i = 0; i < 10; i++)
+    IOG_RETURN_IF_ERROR( iog_stack_push(&stk, (iog_stack_value_t) ((i * 7) % 10)) );
+
+  iog_flag_t fast_path = stk.fastPath;
+  IOG_RETURN_IF_ERROR( iog_stack_track_aggregates(&stk, 1) );
+  int failed = stk.fastPath || iog_check_aggregates_differ(&stk);
+
+  // pseudo-random mix of every operation that changes size
+  iog_stack_value_t values[8] = {};
+  unsigned state = 12345;
+  for (size_t step = 0; step < 3000 && !failed; step++) {
+    state = state * 1103515245 + 12345;
+    unsigned op = (state >> 16) % 6;
+    iog_stack_value_t value = (iog_stack_value_t) ((int) ((state >> 8) % 201) - 100);
+
+    if (op <= 2) {
+      failed |= iog_stack_push(&stk, value) != OK;
+    } else if (op == 3 && stk.size > 0) {
+      failed |= iog_stack_pop(&stk, &value) != OK;
+    } else if (op == 4) {
+      for (size_t i = 0; i < 8; i++)
+        values[i] = value + (iog_stack_value_t) i;
+      failed |= iog_stack_push_n(&stk, values, 8) != OK;
+    } else if (stk.size >= 5) {
+      failed |= iog_stack_pop_n(&stk, values, 5) != OK;
+    }
+
+    failed |= iog_check_aggregates_differ(&stk);
+  }
+
+  IogStackMark_t mark = {};
+  IOG_RETURN_IF_ERROR( iog_stack_mark(&stk, &mark) );
+  for (size_t i = 0; i < 100; i++)
+    IOG_RETURN_IF_ERROR( iog_stack_push(&stk, -1000 + (iog_stack_value_t) i) );
+  IOG_RETURN_IF_ERROR( iog_stack_rollback(&stk, &mark) );
+  failed |= iog_check_aggregates_differ(&stk);
+
+  // stack machine pops below its entry size and pushes back
+  IogVmProgram_t program = {};
+  IOG_RETURN_IF_ERROR( iog_vm_program_init(&program) );
+  IOG_RETURN_IF_ERROR( iog_vm_assemble(&program, "add\nadd\npush 100000\nhalt\n") );
+  if (stk.size < 3)
+    IOG_RETURN_IF_ERROR( iog_stack_push_n(&stk, values, 3) );
+  failed |= iog_vm_run(&program, &stk, NULL, 0, NULL) != OK || iog_check_aggregates_differ(&stk);
+  iog_vm_program_destroy(&program);
+
+  size_t depth = 0;
+  failed |= iog_stack_find(&stk, 100000, &depth) != OK || depth != 0;
+  failed |= iog_stack_find(&stk, 0.5, &depth) != ERR_VALUE_NOT_FOUND;
+
+  IOG_RETURN_IF_ERROR( iog_stack_track_aggregates(&stk, 0) );
+  failed |= stk.fastPath != fast_path || stk.aggregates != NULL || iog_check_aggregates_differ(&stk);
+
+  iog_stack_destroy(&stk);
+
+  // every kernel set against plain loops, sizes cover vector tails
+  static iog_stack_value_t data[1000] = {};
+  for (size_t i = 0; i < 1000; i++)
+    data[i] = (iog_stack_value_t) ((i * 37) % 101) - 50;
+
+  for (int isa = IOG_SIMD_SCALAR; isa <= IOG_SIMD_AVX2; isa++) {
+    iog_simd_select((IogSimdIsa) isa);
+
+    for (size_t n = 1; n <= 1000; n = (n < 40) ? n + 1 : n * 5) {
+      iog_stack_value_t real_min = data[0], real_max = data[0], real_sum = 0;
+      for (size_t i = 0; i < n; i++) {
+        real_min = (data[i] < real_min) ? data[i] : real_min;
+        real_max = (data[i] > real_max) ? data[i] : real_max;
+        real_sum += data[i];
+      }
+
+      failed |= !iog_value_equal(iog_simd_min(data, n), real_min) || !iog_value_equal(iog_simd_max(data, n), real_max);
+      failed |= !iog_value_equal(iog_simd_sum(data, n), real_sum);
+
+      size_t real_index = n;
+      for (size_t i = 0; i < n; i++)
+        real_index = iog_value_equal(data[i], data[n / 2]) ? i : real_index;
+
+      failed |= iog_simd_find_last(data, n, data[n / 2]) != real_index;
+      failed |= iog_simd_find_last(data, n, 0.25) != n;
+    }
+  }
+
+  iog_simd_select(IOG_SIMD_AVX2);
+
+  if (failed) {
+    fprintf(stderr, RED("AGGREGATES TEST FAILED\n"));
+    return ERR_TEST_FAILED;
+  }
+
+  fprintf(stderr, GREEN("AGGREGATES TEST PASSED\n"));
+  return OK;
+}
+
+IogStackReturnCode iog_check_checksum() {
+  IogStack_t stk = {};
+  IOG_RETURN_IF_ERROR( iog_stack_init(&stk) );
+
+  for (size_t i = 0; i < 100; i++)
+    IOG_RETURN_IF_ERROR( iog_stack_push(&stk, (iog_stack_value_t) i * 0.5) );
+
+  iog_flag_t fast_path = stk.fastPath;
+  IOG_RETURN_IF_ERROR( iog_stack_track_checksum(&stk, 1) );
+  int failed = stk.fastPath || iog_stack_verify_checksum(&stk) != OK;
+
+  // checksum must stay equal to full rescan after every operation
+  iog_stack_value_t values[8] = {};
+  unsigned state = 777;
+  for (size_t step = 0; step < 2000 && !failed; step++) {
+    state = state * 1103515245 + 12345;
+    unsigned op = (state >> 16) % 6;
+    iog_stack_value_t value = (iog_stack_value_t) ((int) ((state >> 8) % 201) - 100);
+
+    if (op <= 2) {
+      failed |= iog_stack_push(&stk, value) != OK;
+    } else if (op == 3 && stk.size > 0) {
+      failed |= iog_stack_pop(&stk, &value) != OK;
+    } else if (op == 4) {
+      for (size_t i = 0; i < 8; i++)
+        values[i] = value + (iog_stack_value_t) i;
+      failed |= iog_stack_push_n(&stk, values, 8) != OK;
+    } else if (stk.size >= 5) {
+      failed |= iog_stack_pop_n(&stk, values, 5) != OK;
+    }
+
+    failed |= stk.checksumSize != stk.size || stk.checksum != iog_simd_checksum(stk.data, stk.size, 0);
+  }
+
+  IogStackMark_t mark = {};
+  IOG_RETURN_IF_ERROR( iog_stack_mark(&stk, &mark) );
+  for (size_t i = 0; i < 100; i++)
+    IOG_RETURN_IF_ERROR( iog_stack_push(&stk, (iog_stack_value_t) i) );
+  IOG_RETURN_IF_ERROR( iog_stack_rollback(&stk, &mark) );
+  failed |= iog_stack_verify_checksum(&stk) != OK;
+
+  // stack machine overwrites values below its entry size
+  IogVmProgram_t program = {};
+  IOG_RETURN_IF_ERROR( iog_vm_program_init(&program) );
+  IOG_RETURN_IF_ERROR( iog_vm_assemble(&program, "add\nadd\ndup\nmul\npush 3\nhalt\n") );
+  if (stk.size < 3)
+    IOG_RETURN_IF_ERROR( iog_stack_push_n(&stk, values, 3) );
+  failed |= iog_vm_run(&program, &stk, NULL, 0, NULL) != OK || iog_stack_verify_checksum(&stk) != OK;
+  iog_vm_program_destroy(&program);
+
+  // stray write, restore and swap of two values
+  size_t middle = stk.size / 2;
+  iog_stack_value_t saved = stk.data[middle];
+  stk.data[middle] += 1;
+  failed |= iog_stack_verify_checksum(&stk) != ERR_BAD_CHECKSUM;
+
+  stk.data[middle] = saved;
+  failed |= iog_stack_verify_checksum(&stk) != OK;
+
+  stk.data[middle]     = stk.data[middle + 1];
+  stk.data[middle + 1] = saved;
+  failed |= !iog_value_equal(saved, stk.data[middle]) && iog_stack_verify_checksum(&stk) != ERR_BAD_CHECKSUM;
+
+  IOG_RETURN_IF_ERROR( iog_stack_track_checksum(&stk, 0) );
+  failed |= stk.fastPath != fast_path || iog_stack_verify_checksum(&stk) != OK;
+
+  iog_stack_destroy(&stk);
+
+  // every kernel set against sum of terms, sizes and offsets cover vector tails
+  iog_stack_value_t data[300] = {};
+  for (size_t i = 0; i < 300; i++)
+    data[i] = (iog_stack_value_t) ((i * 37) % 101) - 50.5;
+
+  for (int isa = IOG_SIMD_SCALAR; isa <= IOG_SIMD_AVX2; isa++) {
+    iog_simd_select((IogSimdIsa) isa);
+
+    for (size_t n = 0; n <= 290; n = (n < 20) ? n + 1 : n * 3) {
+      for (size_t first = 0; first < 10; first += 3) {
+        iog_uint64_t real_checksum = 0;
+        for (size_t i = 0; i < n; i++)
+          real_checksum += iog_simd_checksum_term(data[first + i], first + i);
+
+        failed |= iog_simd_checksum(data + first, n, first) != real_checksum;
+      }
+    }
+  }
+
+  iog_simd_select(IOG_SIMD_AVX2);
+
+  if (failed) {
+    fprintf(stderr, RED("CHECKSUM TEST FAILED\n"));
+    return ERR_TEST_FAILED;
+  }
+
+  fprintf(stderr, GREEN("CHECKSUM TEST PASSED\n"));
+  return OK;
+}
+
+IogStackReturnCode iog_check_seg_spill() {
+#if defined(__unix__) || defined(__APPLE__)
+  const size_t capacity = 64;
+  const size_t n = 6400;
+  iog_stack_value_t value = 0;
+  int failed = 0;
+
+  IogSegStack_t stk = {};
+  IOG_RETURN_IF_ERROR( iog_seg_stack_init(&stk, capacity) );
+  IOG_RETURN_IF_ERROR( iog_seg_stack_set_budget(&stk, 6 * capacity * sizeof(iog_stack_value_t)) );
+
+  IogSegSpill_t *spill = stk.spill;
+  failed |= spill == NULL || spill->maxResident != IOG_SEG_SPILL_MIN_RESIDENT + 1;
+
+  // memory stays in budget while stack grows
+  for (size_t i = 0; i < n && !failed; i++) {
+    failed |= iog_seg_stack_push(&stk, (iog_stack_value_t) i) != OK;
+    failed |= stk.blocksNum - spill->spilledNum > spill->maxResident + IOG_SEG_SPILL_SLACK + 1;
+  }
+  failed |= spill->spilledNum + IOG_SEG_SPILL_PREFETCH + 1 > stk.blocksNum || spill->spills == 0;
+  failed |= iog_seg_stack_verify_all(&stk) != OK;
+
+  const iog_stack_value_t *ptr = NULL;
+  failed |= iog_seg_stack_at(&stk, 10, &ptr) != OK || !iog_value_equal(*ptr, (iog_stack_value_t) (n - 11));
+  failed |= iog_seg_stack_at(&stk, n - 1, &ptr) != ERR_BLOCK_SPILLED;
+
+  IogSegSnapshot_t snapshot = {};
+  IogSegStack_t clone = {};
+  failed |= iog_seg_stack_snapshot(&stk, &snapshot) != ERR_BLOCK_SPILLED;
+  failed |= iog_seg_stack_fork(&stk, &clone) != ERR_BLOCK_SPILLED;
+
+  // pops read blocks back in order
+  for (size_t i = n; i > n / 2 && !failed; i--) {
+    failed |= iog_seg_stack_pop(&stk, &value) != OK || !iog_value_equal(value, (iog_stack_value_t) (i - 1));
+    failed |= stk.blocksNum - spill->spilledNum > spill->maxResident + IOG_SEG_SPILL_SLACK + 1;
+  }
+  failed |= spill->loads == 0 || iog_seg_stack_verify_all(&stk) != OK;
+
+  // budget off reads rest back, budget on spills it again
+  IOG_RETURN_IF_ERROR( iog_seg_stack_set_budget(&stk, 0) );
+  failed |= stk.spill != NULL || iog_seg_stack_verify_all(&stk) != OK;
+  failed |= iog_seg_stack_at(&stk, n / 2 - 1, &ptr) != OK || !iog_value_equal(*ptr, 0);
+
+  IOG_RETURN_IF_ERROR( iog_seg_stack_set_budget(&stk, 1) );
+  spill = stk.spill;
+  failed |= spill == NULL || spill->maxResident != IOG_SEG_SPILL_MIN_RESIDENT;
+  for (size_t i = 0; i < 20 * capacity && !failed; i++)
+    failed |= iog_seg_stack_push(&stk, (iog_stack_value_t) -1) != OK;
+  for (size_t i = 0; i < 20 * capacity && !failed; i++)
+    failed |= iog_seg_stack_pop(&stk, &value) != OK || !iog_value_equal(value, -1);
+
+  // corrupted file slot of bottom block is found when pops reach it
+  IOG_RETURN_IF_ERROR( iog_seg_stack_set_budget(&stk, 0) );
+  for (size_t i = 0; i < 20 * capacity && !failed; i++)
+    failed |= iog_seg_stack_push(&stk, (iog_stack_value_t) -1) != OK;
+  IOG_RETURN_IF_ERROR( iog_seg_stack_set_budget(&stk, 1) );
+  spill = stk.spill;
+
+  iog_canary_t bad_canary = 0;
+  failed |= spill->spilledNum == 0 || iog_file_write_at(spill->fd, &bad_canary, sizeof(bad_canary), 0) != 0;
+
+  IogStackReturnCode err = OK;
+  while (stk.size > 0 && err == OK)
+    err = iog_seg_stack_pop(&stk, &value);
+  failed |= err != ERR_DEAD_FIRST_DATA_CANARY;
+
+  iog_seg_stack_destroy(&stk);
+
+  if (failed) {
+    fprintf(stderr, RED("SEGMENTED SPILL TEST FAILED\n"));
+    return ERR_TEST_FAILED;
+  }
+
+  fprintf(stderr, GREEN("SEGMENTED SPILL TEST PASSED\n"));
+#endif // __unix__
+  return OK;
+}
+
+IogStackReturnCode iog_check_seg_pack() {
+  const size_t n = 256;
+  static iog_stack_value_t data[n] = {};
+  static iog_stack_value_t back[n] = {};
+  static iog_uint64_t words[2 * n] = {};
+  int failed = 0;
+
+  // both codings round trip timestamps, random walk, special values and random bits
+  unsigned state = 12345;
+  for (int kind = 0; kind < 4; kind++) {
+    for (size_t i = 0; i < n; i++) {
+      state = state * 1103515245 + 12345;
+      iog_uint64_t bits = ((iog_uint64_t) state << 32) ^ (state >> 3);
+
+      if (kind == 0)
+        data[i] = 1.7e9 + (iog_stack_value_t) i * 0.25;
+      else if (kind == 1)
+        data[i] = ((i > 0) ? data[i - 1] : 20.0) + (iog_stack_value_t) ((int) (state >> 16) % 3 - 1) * 0.5;
+      else if (kind == 2)
+        data[i] = (i % 3 == 0) ? -0.0 : (i % 3 == 1) ? HUGE_VAL : nan("");
+      else
+        memcpy(&data[i], &bits, sizeof(bits));
+    }
+
+    IogPackMode best = IOG_PACK_XOR;
+    size_t best_words = iog_pack_size(data, n, &best);
+
+    for (int mode = IOG_PACK_XOR; mode <= IOG_PACK_DELTA; mode++) {
+      memset(back, 0, sizeof(back));
+      size_t words_num = iog_pack_encode(data, n, (IogPackMode) mode, words);
+
+      failed |= iog_pack_decode(words, words_num, back, n) != OK || memcmp(data, back, sizeof(data)) != 0;
+      failed |= iog_pack_decode(words, words_num - 1, back, n) != ERR_BAD_IMAGE;
+      failed |= mode == best && words_num != best_words;
+    }
+  }
+
+  // timestamps pack into one bit per value
+  for (size_t i = 0; i < n; i++)
+    data[i] = 1.7e9 + (iog_stack_value_t) i * 0.25;
+  IogPackMode mode = IOG_PACK_XOR;
+  failed |= iog_pack_size(data, n, &mode) > n / 32 || mode != IOG_PACK_DELTA;
+
+  // stack keeps cold blocks compressed
+  IogSegStack_t stk = {};
+  IOG_RETURN_IF_ERROR( iog_seg_stack_init(&stk, n) );
+  for (size_t i = 0; i < 3 * n; i++)
+    IOG_RETURN_IF_ERROR( iog_seg_stack_push(&stk, 1.7e9 + (iog_stack_value_t) i) );
+
+  IOG_RETURN_IF_ERROR( iog_seg_stack_set_packing(&stk, 1) );
+  failed |= stk.packedNum != 1;
+
+  const size_t total = 40 * n;
+  for (size_t i = 3 * n; i < total && !failed; i++)
+    failed |= iog_seg_stack_push(&stk, 1.7e9 + (iog_stack_value_t) i) != OK;
+  failed |= stk.packedNum + IOG_SEG_PACK_WARM != stk.blocksNum || stk.packedWords > stk.packedNum * n / 16;
+  failed |= iog_seg_stack_verify_all(&stk) != OK;
+
+  const iog_stack_value_t *ptr = NULL;
+  IogSegSnapshot_t snapshot = {};
+  failed |= iog_seg_stack_at(&stk, n, &ptr) != OK || iog_seg_stack_at(&stk, 3 * n, &ptr) != ERR_BLOCK_PACKED;
+  failed |= iog_seg_stack_snapshot(&stk, &snapshot) != ERR_BLOCK_PACKED;
+  failed |= iog_seg_stack_set_budget(&stk, 1) != ERR_BLOCK_PACKED;
+
+  // oscillation on block boundary doesn't compress again
+  size_t packed_num = stk.packedNum;
+  iog_stack_value_t value = 0;
+  for (size_t i = 0; i < 10 && !failed; i++) {
+    failed |= iog_seg_stack_pop(&stk, &value) != OK || iog_seg_stack_push(&stk, value) != OK;
+    failed |= stk.packedNum != packed_num;
+  }
+
+  for (size_t i = total; i > total / 2 && !failed; i--)
+    failed |= iog_seg_stack_pop(&stk, &value) != OK || !iog_value_equal(value, 1.7e9 + (iog_stack_value_t) (i - 1));
+  failed |= iog_seg_stack_verify_all(&stk) != OK;
+
+  IOG_RETURN_IF_ERROR( iog_seg_stack_set_packing(&stk, 0) );
+  failed |= stk.packedNum != 0 || stk.packedWords != 0 || iog_seg_stack_verify_all(&stk) != OK;
+  failed |= iog_seg_stack_at(&stk, total / 2 - 1, &ptr) != OK || !iog_value_equal(*ptr, 1.7e9);
+
+  // broken canary of compressed block is found when pops reach it
+  IOG_RETURN_IF_ERROR( iog_seg_stack_set_packing(&stk, 1) );
+  IogSegBlock_t *bottom = stk.top;
+  while (bottom->prev != NULL)
+    bottom = bottom->prev;
+  failed |= bottom->packedWords == 0;
+  bottom->firstDataCanary++;
+
+  IogStackReturnCode pop_err = OK;
+  while (stk.size > 0 && pop_err == OK)
+    pop_err = iog_seg_stack_pop(&stk, &value);
+  failed |= pop_err != ERR_DEAD_FIRST_DATA_CANARY || stk.size != n;
+
+  bottom->firstDataCanary--;
+  failed |= iog_seg_stack_pop(&stk, &value) != OK || !iog_value_equal(value, 1.7e9 + (iog_stack_value_t) (n - 1));
+
+  iog_seg_stack_destroy(&stk);
+
+  // block of random bits is marked once and stays raw, pops make it writable again
+  IogSegStack_t noise = {};
+  IOG_RETURN_IF_ERROR( iog_seg_stack_init(&noise, n) );
+  IOG_RETURN_IF_ERROR( iog_seg_stack_set_packing(&noise, 1) );
+  for (size_t i = 0; i < 3 * n && !failed; i++) {
+    state = state * 1103515245 + 12345;
+    iog_uint64_t bits = ((iog_uint64_t) state << 32) ^ (state >> 3);
+    memcpy(&value, &bits, sizeof(bits));
+    failed |= iog_seg_stack_push(&noise, value) != OK;
+  }
+
+  IogSegBlock_t *raw = noise.top->prev->prev;
+  failed |= noise.packedNum != 0 || raw == NULL || !raw->isIncompressible;
+
+  for (size_t i = 0; i <= 2 * n && !failed; i++)
+    failed |= iog_seg_stack_pop(&noise, &value) != OK;
+  failed |= noise.top != raw || raw->isIncompressible;
+
+  iog_seg_stack_destroy(&noise);
+
+  if (failed) {
+    fprintf(stderr, RED("SEGMENTED PACK TEST FAILED\n"));
+    return ERR_TEST_FAILED;
+  }
+
+  fprintf(stderr, GREEN("SEGMENTED PACK TEST PASSED\n"));
+  return OK;
+}
+
+static const size_t SHARE_TEST_READERS = 3;
+static const size_t SHARE_TEST_ROUNDS  = 200;
+static const size_t SHARE_TEST_TOP     = 8;
+
+/**
+ * Reads shared stack until writer is done. Writer keeps data[i] == i,
+ * so every copy of top values must be a run ending at size - 1.
+ */
+static void iog_share_test_reader (const IogStack_t *stk, std::atomic<int> *writer_done, size_t *reads, size_t *errors) {
+  IogStackView_t view = {};
+  iog_stack_value_t top[SHARE_TEST_TOP] = {};
+
+  while (!writer_done->load()) {
+    if (iog_stack_read_shared(stk, &view, top, SHARE_TEST_TOP) != OK) {
+      (*errors)++;
+      continue;
+    }
+
+    (*reads)++;
+
+    *errors += (view.version & 1) || view.size > view.capacity;
+    *errors += view.topNum != ((view.size < SHARE_TEST_TOP) ? view.size : SHARE_TEST_TOP);
+
+#if IOG_STACK_STATS > 0
+    *errors += view.stats.pushes - view.stats.pops != view.size;
+#endif // IOG_STACK_STATS
+
+    for (size_t j = 0; j < view.topNum; j++)
+      *errors += !iog_value_equal(top[j], (iog_stack_value_t) (view.size - view.topNum + j));
+  }
+}
+
+IogStackReturnCode iog_check_stack_share() {
+  IogStack_t stk = {};
+  IogStackView_t view = {};
+  iog_stack_value_t top[SHARE_TEST_TOP] = {};
+  int failed = 0;
+
+  IogStackPolicy_t policy = IOG_STACK_DEFAULT_POLICY;
+  policy.shrinkDivisor = 4;
+
+  IOG_RETURN_IF_ERROR( iog_stack_init(&stk, &policy) );
+
+  failed |= iog_stack_read_shared(&stk, &view, top, SHARE_TEST_TOP) != ERR_STACK_NOT_SHARED;
+
+  IOG_RETURN_IF_ERROR( iog_stack_share(&stk, 1) );
+  IOG_RETURN_IF_ERROR( iog_stack_push(&stk, 0) );
+  IOG_RETURN_IF_ERROR( iog_stack_push(&stk, 1) );
+
+  failed |= iog_stack_read_shared(&stk, &view, top, SHARE_TEST_TOP) != OK;
+  failed |= view.size != 2 || view.topNum != 2 || !iog_value_equal(top[0], 0) || !iog_value_equal(top[1], 1) || view.version != 4;
+
+  // whole run is one write section, reserve inside it doesn't open another one
+  IogVmProgram_t program = {};
+  IOG_RETURN_IF_ERROR( iog_vm_program_init(&program) );
+  IOG_RETURN_IF_ERROR( iog_vm_assemble(&program, "push 2\npush 3\npush 4\npush 5\npush 6\npush 7\nhalt\n") );
+  failed |= iog_vm_run(&program, &stk, NULL, 0, NULL) != OK;
+  iog_vm_program_destroy(&program);
+
+  failed |= iog_stack_read_shared(&stk, &view, top, 3) != OK;
+  failed |= view.size != 8 || view.topNum != 3 || !iog_value_equal(top[2], 7) || (view.version & 1);
+
+  IogStackMark_t mark = {};
+  iog_stack_value_t values[64] = {};
+
+  IOG_RETURN_IF_ERROR( iog_stack_pop_n(&stk, values, 8) );
+  IOG_RETURN_IF_ERROR( iog_stack_stats_reset(&stk) );
+
+  // writer grows and shrinks data while readers copy it
+  std::atomic<int> writer_done(0);
+  std::thread readers[SHARE_TEST_READERS];
+  size_t reads[SHARE_TEST_READERS]  = {};
+  size_t errors[SHARE_TEST_READERS] = {};
+
+  for (size_t t = 0; t < SHARE_TEST_READERS; t++)
+    readers[t] = std::thread(iog_share_test_reader, &stk, &writer_done, &reads[t], &errors[t]);
+
+  iog_stack_value_t value = 0;
+  for (size_t round = 0; round < SHARE_TEST_ROUNDS && !failed; round++) {
+    size_t depth = 64 + (round % 7) * 300;
+
+    // odd rounds verify stack on every operation, so checks run next to reads
+    failed |= iog_stack_set_verify_level(&stk, (round % 2) ? IOG_VERIFY_FULL : IOG_VERIFY_OFF) != OK;
+    failed |= iog_stack_verify(&stk) != OK || iog_stack_verify_canaries(&stk) != OK;
+
+    for (size_t i = 0; i < depth; i++)
+      failed |= iog_stack_push(&stk, (iog_stack_value_t) i) != OK;
+
+    failed |= iog_stack_mark(&stk, &mark) != OK;
+    for (size_t i = 0; i < 64; i++)
+      values[i] = (iog_stack_value_t) (depth + i);
+    failed |= iog_stack_push_n(&stk, values, 64) != OK;
+    failed |= iog_stack_rollback(&stk, &mark) != OK;
+
+    failed |= iog_stack_pop_n(&stk, values, 32) != OK || !iog_value_equal(values[31], (iog_stack_value_t) (depth - 1));
+
+    for (size_t i = depth - 32; i > 0; i--)
+      failed |= iog_stack_pop(&stk, &value) != OK || !iog_value_equal(value, (iog_stack_value_t) (i - 1));
+  }
+
+  writer_done.store(1);
+
+  size_t total_reads = 0;
+  for (size_t t = 0; t < SHARE_TEST_READERS; t++) {
+    readers[t].join();
+
+    failed |= errors[t] != 0;
+    total_reads += reads[t];
+  }
+
+  failed |= total_reads == 0 || stk.share->freed == 0;
+
+  IogStackStats_t stats = {};
+  failed |= iog_stack_stats(&stk, &stats) != OK || stats.verifyCalls != 0;
+
+  IOG_RETURN_IF_ERROR( iog_stack_share(&stk, 0) );
+  failed |= stk.share != NULL || iog_stack_verify(&stk) != OK;
+
+  iog_stack_destroy(&stk);
+
+#if defined(__unix__) || defined(__APPLE__)
+  // guarded data moves without grace period, so it can't be shared
+  policy.guardPages = 1;
+  IOG_RETURN_IF_ERROR( iog_stack_init(&stk, &policy) );
+  failed |= iog_stack_share(&stk, 1) != ERR_STACK_NOT_SHARED;
+  iog_stack_destroy(&stk);
+#endif
+
+  if (failed) {
+    fprintf(stderr, RED("SHARED STACK TEST FAILED\n"));
+    return ERR_TEST_FAILED;
+  }
+
+  fprintf(stderr, GREEN("SHARED STACK TEST PASSED\n"));
+  return OK;
+}
@@ -0,0 +1,789 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "iog_assert.h"
+#include "iog_vm.h"
+#include "cli_colors.h"
+#include "iog_memlib.h"
+
+/// Mnemonics of assembler, indexed by opcode
+static const char *const IOG_VM_OPCODE_NAMES[IOG_VM_NR_OPCODE] = {
+  "halt", "block", "push", "load", "pop", "dup", "swap", "over",
+  "add", "sub", "mul", "div", "neg", "lt", "eq", "jmp", "jz", "jnz",
+};
+
+//--------------------- PRIVATE FUNCTIONS --------------------------------------------
+
+static int  iog_vm_is_jump       (IogVmOpcode op); ///< Does instruction use index as jump target
+static int  iog_vm_ends_block    (IogVmOpcode op); ///< Is instruction last in its basic block
+static void iog_vm_stack_effect  (IogVmOpcode op, size_t *need, int *delta); ///< Values needed and size change
+
+/// Values needed and added by block of code[begin..end)
+static void iog_vm_block_effect (const IogVmInstr_t *code, size_t begin, size_t end, size_t *need, size_t *grow);
+
+/// One pass of assembler: first collects labels, second emits instructions
+static IogStackReturnCode iog_vm_assemble_pass (IogVmProgram_t *program, const char *source, int emit,
+    IogVmLabel_t **labels, size_t *labels_num, size_t *error_line);
+/// Parse one line without comment, emit instruction if emit is 1
+static IogStackReturnCode iog_vm_assemble_line (IogVmProgram_t *program, char *line, size_t *instr_num, int emit,
+    IogVmLabel_t **labels, size_t *labels_num);
+
+static IogVmOpcode iog_vm_find_opcode (const char *name, size_t len); ///< Opcode by mnemonic (IOG_VM_NR_OPCODE if unknown)
+
+/// Flush registers to stack, drop values from low from checksum, verify stack and reserve grow values
+IOG_COLD static IogStackReturnCode iog_vm_enter_block_slow (IogStack_t *stack, size_t sp,
+    iog_stack_value_t tos, size_t grow, size_t low);
+
+//--------------------- PUBLIC FUNCTIONS --------------------------------------------
+
+/**
+ * @param[out] program pointer to program
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_vm_program_init (IogVmProgram_t *program) {
+  IOG_ASSERT(program);
+
+  *program = {};
+
+  return OK;
+}
+
+/**
+ * Frees code, resets program to zero.
+ * @param[out] program pointer to program
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_vm_program_destroy (IogVmProgram_t *program) {
+  IOG_ASSERT(program);
+
+  iog_free_sized(program->code, program->capacity, sizeof(IogVmInstr_t));
+  *program = {};
+
+  return OK;
+}
+
+/**
+ * @param[out] program pointer to unlinked program
+ * @param[in]  op      opcode (IOG_VM_BLOCK is added only by link)
+ * @param[in]  index   jump target or argument index
+ * @param[in]  value   constant of IOG_VM_PUSH
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_vm_emit (IogVmProgram_t *program, IogVmOpcode op, size_t index, iog_stack_value_t value) {
+  IOG_ASSERT(program);
+
+  if (program->isLinked || op >= IOG_VM_NR_OPCODE || op == IOG_VM_BLOCK)
+    return ERR_BAD_BYTECODE;
+
+  if (program->size == program->capacity) {
+    size_t new_capacity = program->capacity ? program->capacity * 2 : INIT_STACK_DATA_CAPACITY;
+
+    IogVmInstr_t *new_code = (IogVmInstr_t *) iog_recalloc(program->code, program->capacity,
+                                                           new_capacity, sizeof(IogVmInstr_t));
+    if (new_code == NULL)
+      return ERR_CANT_ALLOCATE_DATA;
+
+    program->code     = new_code;
+    program->capacity = new_capacity;
+  }
+
+  program->code[program->size++] = {op, index, 0, value};
+
+  return OK;
+}
+
+/**
+ * Adds HALT if code can run past its end or jumps to its end (label after last
+ * instruction), checks opcodes and jumps,
+ * then inserts IOG_VM_BLOCK before every jump target and after every jump,
+ * jumps are retargeted to these blocks.
+ * @param[out] program pointer to unlinked program
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_vm_link (IogVmProgram_t *program) {
+  IOG_ASSERT(program);
+
+  if (program->isLinked)
+    return ERR_BAD_BYTECODE;
+
+  int open_end = program->size == 0 || (program->code[program->size - 1].op != IOG_VM_HALT &&
+                                         program->code[program->size - 1].op != IOG_VM_JMP);
+
+  for (size_t i = 0; i < program->size && !open_end; i++)
+    open_end = iog_vm_is_jump(program->code[i].op) && program->code[i].index == program->size;
+
+  if (open_end)
+    IOG_RETURN_IF_ERROR( iog_vm_emit(program, IOG_VM_HALT) );
+
+  size_t size = program->size;
+  const IogVmInstr_t *code = program->code;
+
+  // new_index[i] - index of instruction i after blocks are inserted
+  size_t *new_index = (size_t *) iog_recalloc(NULL, 0, size, sizeof(size_t));
+  if (new_index == NULL)
+    return ERR_CANT_ALLOCATE_DATA;
+
+  size_t args_num = 0;
+  IogStackReturnCode err = OK;
+
+  for (size_t i = 0; i < size && err == OK; i++) {
+    if (code[i].op >= IOG_VM_NR_OPCODE || code[i].op == IOG_VM_BLOCK)
+      err = ERR_BAD_BYTECODE;
+    else if (iog_vm_is_jump(code[i].op) && code[i].index >= size)
+      err = ERR_BAD_BYTECODE;
+    else if (code[i].op == IOG_VM_LOAD && code[i].index >= args_num)
+      args_num = code[i].index + 1;
+
+    // new_index is reused as leader flags first
+    if (err == OK && iog_vm_is_jump(code[i].op))
+      new_index[code[i].index] = 1;
+
+    if (err == OK && iog_vm_ends_block(code[i].op) && i + 1 < size)
+      new_index[i + 1] = 1;
+  }
+
+  if (err != OK) {
+    iog_free_sized(new_index, size, sizeof(size_t));
+    return err;
+  }
+
+  new_index[0] = 1;
+
+  size_t linked_size = 0;
+  for (size_t i = 0; i < size; i++) {
+    linked_size += new_index[i];
+    new_index[i] = i + linked_size;
+  }
+
+  linked_size += size;
+
+  IogVmInstr_t *linked = (IogVmInstr_t *) iog_recalloc(NULL, 0, linked_size, sizeof(IogVmInstr_t));
+  if (linked == NULL) {
+    iog_free_sized(new_index, size, sizeof(size_t));
+    return ERR_CANT_ALLOCATE_DATA;
+  }
+
+  for (size_t i = 0; i < size; i++) {
+    if (i == 0 || new_index[i] != new_index[i - 1] + 1)
+      linked[new_index[i] - 1] = {IOG_VM_BLOCK, 0, 0, 0};
+
+    linked[new_index[i]] = code[i];
+
+    // jump target is always leader, so block stands right before it
+    if (iog_vm_is_jump(code[i].op))
+      linked[new_index[i]].index = new_index[code[i].index] - 1;
+  }
+
+  for (size_t block = 0; block < linked_size; ) {
+    size_t end = block + 1;
+    while (end < linked_size && linked[end].op != IOG_VM_BLOCK)
+      end++;
+
+    iog_vm_block_effect(linked, block + 1, end, &linked[block].index, &linked[block].grow);
+    block = end;
+  }
+
+  iog_free_sized(new_index, size, sizeof(size_t));
+  iog_free_sized(program->code, program->capacity, sizeof(IogVmInstr_t));
+
+  program->code     = linked;
+  program->size     = linked_size;
+  program->capacity = linked_size;
+  program->argsNum  = args_num;
+  program->isLinked = 1;
+
+  return OK;
+}
+
+/**
+ * Source has one instruction or label per line: "name:" defines label, "push 2.5",
+ * "load 0" and "jz name" take operand, text after ';' is comment.
+ * @param[out] program    pointer to empty program
+ * @param[in]  source     pointer to source text
+ * @param[out] error_line pointer to line number of first error (may be NULL)
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_vm_assemble (IogVmProgram_t *program, const char *source, size_t *error_line) {
+  IOG_ASSERT(program);
+  IOG_ASSERT(source);
+
+  if (program->isLinked || program->size != 0)
+    return ERR_BAD_BYTECODE;
+
+  IogVmLabel_t *labels = NULL;
+  size_t labels_num = 0;
+
+  IogStackReturnCode err = iog_vm_assemble_pass(program, source, 0, &labels, &labels_num, error_line);
+  if (err == OK)
+    err = iog_vm_assemble_pass(program, source, 1, &labels, &labels_num, error_line);
+
+  iog_free_sized(labels, labels_num, sizeof(IogVmLabel_t));
+
+  if (err == OK)
+    err = iog_vm_link(program);
+
+  if (err != OK)
+    iog_vm_program_destroy(program);
+
+  return err;
+}
+
+#if IOG_VM_THREADED
+// labels as values and computed goto are GNU extensions
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif // IOG_VM_THREADED
+
+/**
+ * Operands are kept in stack data, top value in register, so binary operation is one load.
+ * Checks run only at IOG_VM_BLOCK. Stack isn't shrunk during run, tracked aggregates
+ * are updated once at the end from lowest size reached. With tracked checksum every block
+ * takes slow entry, which removes values the block may overwrite from checksum.
+ * @param[in]  program  pointer to linked program
+ * @param[out] stack    pointer to stack used as operand stack
+ * @param[in]  args     pointer to arguments read by LOAD
+ * @param[in]  args_num amount of arguments (at least program->argsNum)
+ * @param[out] result   pointer to variable for top value at HALT (may be NULL)
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_vm_run (const IogVmProgram_t *program, IogStack_t *stack,
+    const iog_stack_value_t *args, size_t args_num, iog_stack_value_t *result) {
+  IOG_ASSERT(program);
+
+  if (!program->isLinked || args_num < program->argsNum || (args == NULL && program->argsNum > 0))
+    return ERR_BAD_BYTECODE;
+
+  IOG_RETURN_IF_ERROR( iog_stack_verify(stack) );
+
+  // free slots are written without per-push checks, so poison is lifted for run
+  iog_stack_poison_slots(stack, stack->size, stack->capacity, 0);
+
+  // size is kept in register, so readers of shared stack wait for whole run
+  int opened = iog_stack_write_begin(stack);
+
+  const IogVmInstr_t *code = program->code;
+  const IogVmInstr_t *ip   = code;
+
+  iog_stack_value_t *data = stack->data;
+  size_t sp       = stack->size;
+  size_t capacity = stack->capacity;
+  size_t low      = sp;
+  int fast_path   = !iog_stack_is_checked(stack) && !stack->trackChecksum;
+
+  iog_stack_value_t tos = (sp > 0) ? data[sp - 1] : 0;
+  iog_stack_value_t cond = 0;
+
+  IogStackReturnCode err = OK;
+
+#if IOG_VM_THREADED
+  static void *const IOG_VM_LABELS[IOG_VM_NR_OPCODE] = {
+    &&op_HALT, &&op_BLOCK, &&op_PUSH, &&op_LOAD, &&op_POP, &&op_DUP, &&op_SWAP, &&op_OVER,
+    &&op_ADD, &&op_SUB, &&op_MUL, &&op_DIV, &&op_NEG, &&op_LT, &&op_EQ, &&op_JMP, &&op_JZ, &&op_JNZ,
+  };
+
+#define IOG_VM_DISPATCH() goto *IOG_VM_LABELS[ip->op]
+#define IOG_VM_CASE(name) op_##name
+
+  IOG_VM_DISPATCH();
+  {
+#else
+#define IOG_VM_DISPATCH() goto dispatch
+#define IOG_VM_CASE(name) case IOG_VM_##name
+
+dispatch:
+  switch (ip->op) {
+#endif // IOG_VM_THREADED
+
+    IOG_VM_CASE(BLOCK):
+      if (IOG_UNLIKELY(sp < ip->index)) {
+        err = ERR_STACK_UNDERFLOW;
+        goto done;
+      }
+
+      // values below sp - need aren't touched by block
+      if (sp - ip->index < low)
+        low = sp - ip->index;
+
+      if (IOG_UNLIKELY(!fast_path || sp + ip->grow > capacity)) {
+        err = iog_vm_enter_block_slow(stack, sp, tos, ip->grow, low);
+        if (err != OK)
+          goto done;
+
+        data     = stack->data;
+        capacity = stack->capacity;
+      }
+
+      ip++;
+      IOG_VM_DISPATCH();
+
+    IOG_VM_CASE(PUSH):
+      if (sp > 0)
+        iog_relaxed_store(&data[sp - 1], tos);
+      tos = ip->value;
+      sp++;
+      ip++;
+      IOG_VM_DISPATCH();
+
+    IOG_VM_CASE(LOAD):
+      if (sp > 0)
+        iog_relaxed_store(&data[sp - 1], tos);
+      tos = args[ip->index];
+      sp++;
+      ip++;
+      IOG_VM_DISPATCH();
+
+    IOG_VM_CASE(POP):
+      sp--;
+      tos = (sp > 0) ? data[sp - 1] : 0;
+      ip++;
+      IOG_VM_DISPATCH();
+
+    IOG_VM_CASE(DUP):
+      iog_relaxed_store(&data[sp - 1], tos);
+      sp++;
+      ip++;
+      IOG_VM_DISPATCH();
+
+    IOG_VM_CASE(SWAP):
+      cond = data[sp - 2];
+      iog_relaxed_store(&data[sp - 2], tos);
+      tos = cond;
+      ip++;
+      IOG_VM_DISPATCH();
+
+    IOG_VM_CASE(OVER):
+      iog_relaxed_store(&data[sp - 1], tos);
+      tos = data[sp - 2];
+      sp++;
+      ip++;
+      IOG_VM_DISPATCH();
+
+    IOG_VM_CASE(ADD):
+      tos = data[sp - 2] + tos;
+      sp--;
+      ip++;
+      IOG_VM_DISPATCH();
+
+    IOG_VM_CASE(SUB):
+      tos = data[sp - 2] - tos;
+      sp--;
+      ip++;
+      IOG_VM_DISPATCH();
+
+    IOG_VM_CASE(MUL):
+      tos = data[sp - 2] * tos;
+      sp--;
+      ip++;
+      IOG_VM_DISPATCH();
+
+    IOG_VM_CASE(DIV):
+      tos = data[sp - 2] / tos;
+      sp--;
+      ip++;
+      IOG_VM_DISPATCH();
+
+    IOG_VM_CASE(NEG):
+      tos = -tos;
+      ip++;
+      IOG_VM_DISPATCH();
+
+    IOG_VM_CASE(LT):
+      tos = (data[sp - 2] < tos);
+      sp--;
+      ip++;
+      IOG_VM_DISPATCH();
+
+    IOG_VM_CASE(EQ):
+      tos = iog_value_equal(data[sp - 2], tos);
+      sp--;
+      ip++;
+      IOG_VM_DISPATCH();
+
+    IOG_VM_CASE(JMP):
+      ip = code + ip->index;
+      IOG_VM_DISPATCH();
+
+    IOG_VM_CASE(JZ):
+      cond = tos;
+      sp--;
+      tos = (sp > 0) ? data[sp - 1] : 0;
+      ip = iog_value_equal(cond, 0) ? code + ip->index : ip + 1;
+      IOG_VM_DISPATCH();
+
+    IOG_VM_CASE(JNZ):
+      cond = tos;
+      sp--;
+      tos = (sp > 0) ? data[sp - 1] : 0;
+      ip = !iog_value_equal(cond, 0) ? code + ip->index : ip + 1;
+      IOG_VM_DISPATCH();
+
+    IOG_VM_CASE(HALT):
+      if (result != NULL) {
+        if (sp == 0)
+          err = ERR_STACK_UNDERFLOW;
+        else
+          *result = tos;
+      }
+
+      goto done;
+
+#if !IOG_VM_THREADED
+    default:
+      err = ERR_BAD_BYTECODE;
+      goto done;
+#endif // IOG_VM_THREADED
+  }
+
+#undef IOG_VM_DISPATCH
+#undef IOG_VM_CASE
+
+done:
+  if (sp > 0)
+    iog_relaxed_store(&data[sp - 1], tos);
+
+  iog_relaxed_store(&stack->size, sp);
+  IOG_STACK_STAT_MAX( stack->stats.maxSize, sp );
+
+  iog_stack_write_end(stack, opened);
+
+  iog_stack_poison_slots(stack, stack->size, stack->capacity, 1);
+
+  IogStackReturnCode sync_err = iog_stack_data_changed(stack, low);
+
+  return (err != OK) ? err : sync_err;
+}
+
+#if IOG_VM_THREADED
+#pragma GCC diagnostic pop
+#endif // IOG_VM_THREADED
+
+/**
+ * @param[in]  program       pointer to program
+ * @param[out] stream        pointer to stream for prints
+ * @param[in]  prog_name     name of dumping program
+ * @param[in]  file_name     name of file from that called dump
+ * @param[in]  line_num      number of line from that called dump
+ * @param[in]  function_name name of function from that called dump
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_vm_program_dump_f (const IogVmProgram_t *program, FILE *stream,
+      const char *prog_name, const char *file_name, int line_num, const char *function_name) {
+  IOG_ASSERT(stream);
+
+  fprintf(stream, BLACK("------------ VM PROGRAM DUMP ------------" "\n"));
+  fprintf(stream, BLUE("Called from %s:%d: %s\n"),
+     file_name, line_num, function_name
+  );
+
+  if (program == NULL) {
+    fprintf(stream, BLACK("IogVmProgram_t %s (null)") " {}\n", prog_name);
+    return ERR_STACK_NULLPTR;
+  }
+
+  fprintf(stream, BLACK("IogVmProgram_t %s (%p) {\n"), prog_name, (const void *) program);
+
+  fprintf(stream, BLACK("  .size     = %lu") "\n", program->size);
+  fprintf(stream, BLACK("  .capacity = %lu") "\n", program->capacity);
+  fprintf(stream, BLACK("  .argsNum  = %lu") "\n", program->argsNum);
+  fprintf(stream, BLACK("  .isLinked = %d")  "\n", (int) program->isLinked);
+
+  fprintf(stream, BLACK("  .code[%lu] (%p) = [") "\n", program->size, (const void *) program->code);
+
+  for (size_t i = 0; i < program->size; i++) {
+    const IogVmInstr_t *instr = &program->code[i];
+    const char *name = (instr->op < IOG_VM_NR_OPCODE) ? IOG_VM_OPCODE_NAMES[instr->op] : "???";
+
+    if (instr->op == IOG_VM_BLOCK)
+      fprintf(stream, BLACK("    [%lu]: %s need %lu grow %lu\n"), i, name, instr->index, instr->grow);
+    else if (instr->op == IOG_VM_PUSH)
+      fprintf(stream, BLACK("    [%lu]:   %s %lg\n"), i, name, instr->value);
+    else if (instr->op == IOG_VM_LOAD || iog_vm_is_jump(instr->op))
+      fprintf(stream, BLACK("    [%lu]:   %s %lu\n"), i, name, instr->index);
+    else
+      fprintf(stream, BLACK("    [%lu]:   %s\n"), i, name);
+  }
+
+  fprintf(stream, BLACK("  ]\n"));
+  fprintf(stream, BLACK("}\n"));
+
+  fprintf(stream, BLACK("-----------------------------------------\n"));
+
+  return OK;
+}
+
+//--------------------- PRIVATE FUNCTIONS --------------------------------------------
+
+/**
+ * Called at block entry if stack has checks or checksum on or block may outgrow capacity.
+ * Poison is put back while stack may be verified or moved, and lifted from new free slots.
+ * Values below low weren't touched by run, so checksum can still subtract them.
+ * @param[out] stack pointer to stack
+ * @param[in]  sp    size kept by interpreter
+ * @param[in]  tos   top value kept by interpreter
+ * @param[in]  grow  values block may add
+ * @param[in]  low   lowest size reached by run including this block
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_vm_enter_block_slow (IogStack_t *stack, size_t sp,
+    iog_stack_value_t tos, size_t grow, size_t low) {
+  if (sp > 0)
+    iog_relaxed_store(&stack->data[sp - 1], tos);
+
+  iog_stack_data_changing(stack, low);
+
+  iog_relaxed_store(&stack->size, sp);
+  iog_stack_poison_slots(stack, stack->size, stack->capacity, 1);
+
+  IogStackReturnCode err = OK;
+  if (iog_stack_is_checked(stack))
+    err = iog_stack_verify(stack);
+
+  if (err == OK && sp + grow > stack->capacity)
+    err = iog_stack_reserve(stack, sp + grow);
+
+  iog_stack_poison_slots(stack, stack->size, stack->capacity, 0);
+
+  return err;
+}
+
+/**
+ * @param[in] op opcode
+ * @return 1 if index of instruction is jump target, else 0
+ */
+static int iog_vm_is_jump (IogVmOpcode op) {
+  return op == IOG_VM_JMP || op == IOG_VM_JZ || op == IOG_VM_JNZ;
+}
+
+/**
+ * @param[in] op opcode
+ * @return 1 if next instruction starts new basic block, else 0
+ */
+static int iog_vm_ends_block (IogVmOpcode op) {
+  return op == IOG_VM_HALT || iog_vm_is_jump(op);
+}
+
+/**
+ * @param[in]  op    opcode
+ * @param[out] need  values instruction reads from stack
+ * @param[out] delta change of stack size
+ */
+static void iog_vm_stack_effect (IogVmOpcode op, size_t *need, int *delta) {
+  switch (op) {
+    case IOG_VM_PUSH: case IOG_VM_LOAD:
+      *need = 0; *delta = 1;
+      break;
+
+    case IOG_VM_POP: case IOG_VM_JZ: case IOG_VM_JNZ:
+      *need = 1; *delta = -1;
+      break;
+
+    case IOG_VM_DUP:
+      *need = 1; *delta = 1;
+      break;
+
+    case IOG_VM_NEG:
+      *need = 1; *delta = 0;
+      break;
+
+    case IOG_VM_SWAP:
+      *need = 2; *delta = 0;
+      break;
+
+    case IOG_VM_OVER:
+      *need = 2; *delta = 1;
+      break;
+
+    case IOG_VM_ADD: case IOG_VM_SUB: case IOG_VM_MUL: case IOG_VM_DIV:
+    case IOG_VM_LT:  case IOG_VM_EQ:
+      *need = 2; *delta = -1;
+      break;
+
+    case IOG_VM_HALT: case IOG_VM_BLOCK: case IOG_VM_JMP: case IOG_VM_NR_OPCODE:
+    default:
+      *need = 0; *delta = 0;
+      break;
+  }
+}
+
+/**
+ * @param[in]  code  pointer to code
+ * @param[in]  begin first instruction of block
+ * @param[in]  end   instruction after block
+ * @param[out] need  values block reads below its entry size
+ * @param[out] grow  largest size above entry size reached in block
+ */
+static void iog_vm_block_effect (const IogVmInstr_t *code, size_t begin, size_t end, size_t *need, size_t *grow) {
+  long long depth  = 0;
+  long long lowest = 0;
+  long long highest = 0;
+
+  for (size_t i = begin; i < end; i++) {
+    size_t instr_need = 0;
+    int instr_delta = 0;
+    iog_vm_stack_effect(code[i].op, &instr_need, &instr_delta);
+
+    if (depth - (long long) instr_need < lowest)
+      lowest = depth - (long long) instr_need;
+
+    depth += instr_delta;
+
+    if (depth > highest)
+      highest = depth;
+  }
+
+  *need = (size_t) -lowest;
+  *grow = (size_t) highest;
+}
+
+/**
+ * @param[in] name pointer to mnemonic (not null-terminated)
+ * @param[in] len  length of mnemonic
+ * @return opcode or IOG_VM_NR_OPCODE if mnemonic is unknown
+ */
+static IogVmOpcode iog_vm_find_opcode (const char *name, size_t len) {
+  for (int op = 0; op < IOG_VM_NR_OPCODE; op++) {
+    if (op != IOG_VM_BLOCK && strlen(IOG_VM_OPCODE_NAMES[op]) == len &&
+        strncmp(IOG_VM_OPCODE_NAMES[op], name, len) == 0)
+      return (IogVmOpcode) op;
+  }
+
+  return IOG_VM_NR_OPCODE;
+}
+
+/**
+ * Lines are copied to buffer, comment is cut off there.
+ * @param[out] program    pointer to program
+ * @param[in]  source     pointer to source text
+ * @param[in]  emit       0 - collect labels, 1 - emit instructions
+ * @param[out] labels     pointer to array of labels
+ * @param[out] labels_num pointer to amount of labels
+ * @param[out] error_line pointer to line number of error (may be NULL)
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_vm_assemble_pass (IogVmProgram_t *program, const char *source, int emit,
+    IogVmLabel_t **labels, size_t *labels_num, size_t *error_line) {
+  char line[128] = {};
+  size_t instr_num = 0;
+  size_t line_num = 0;
+
+  while (*source != '\0') {
+    line_num++;
+
+    size_t len = strcspn(source, "\n");
+    size_t code_len = strcspn(source, ";\n");
+
+    IogStackReturnCode err = ERR_BAD_BYTECODE;
+    if (code_len < sizeof(line)) {
+      memcpy(line, source, code_len);
+      line[code_len] = '\0';
+
+      err = iog_vm_assemble_line(program, line, &instr_num, emit, labels, labels_num);
+    }
+
+    if (err != OK) {
+      if (error_line != NULL)
+        *error_line = line_num;
+
+      return err;
+    }
+
+    source += len;
+    if (*source == '\n')
+      source++;
+  }
+
+  return OK;
+}
+
+/**
+ * @param[out] program    pointer to program
+ * @param[in]  line       pointer to line without comment (changed by parsing)
+ * @param[out] instr_num  pointer to amount of instructions before line
+ * @param[in]  emit       0 - collect labels, 1 - emit instructions
+ * @param[out] labels     pointer to array of labels
+ * @param[out] labels_num pointer to amount of labels
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_vm_assemble_line (IogVmProgram_t *program, char *line, size_t *instr_num, int emit,
+    IogVmLabel_t **labels, size_t *labels_num) {
+  char *word = line + strspn(line, " \t\r");
+  size_t word_len = strcspn(word, " \t\r:");
+
+  if (word_len == 0)
+    return (word[0] == '\0') ? OK : ERR_BAD_BYTECODE;
+
+  char *rest = word + word_len;
+
+  if (*rest == ':') {
+    rest++;
+    if (rest[strspn(rest, " \t\r")] != '\0' || word_len > IOG_VM_MAX_LABEL_LEN)
+      return ERR_BAD_BYTECODE;
+
+    if (emit)
+      return OK;
+
+    for (size_t i = 0; i < *labels_num; i++) {
+      if (strlen((*labels)[i].name) == word_len && strncmp((*labels)[i].name, word, word_len) == 0)
+        return ERR_BAD_BYTECODE;
+    }
+
+    IogVmLabel_t *new_labels = (IogVmLabel_t *) iog_recalloc(*labels, *labels_num, *labels_num + 1,
+                                                             sizeof(IogVmLabel_t));
+    if (new_labels == NULL)
+      return ERR_CANT_ALLOCATE_DATA;
+
+    memcpy(new_labels[*labels_num].name, word, word_len);
+    new_labels[*labels_num].index = *instr_num;
+
+    *labels = new_labels;
+    (*labels_num)++;
+
+    return OK;
+  }
+
+  IogVmOpcode op = iog_vm_find_opcode(word, word_len);
+  if (op == IOG_VM_NR_OPCODE)
+    return ERR_BAD_BYTECODE;
+
+  char *operand = rest + strspn(rest, " \t\r");
+  size_t operand_len = strcspn(operand, " \t\r");
+  int has_operand = (op == IOG_VM_PUSH || op == IOG_VM_LOAD || iog_vm_is_jump(op));
+
+  if ((operand_len > 0) != has_operand || operand[operand_len + strspn(operand + operand_len, " \t\r")] != '\0')
+    return ERR_BAD_BYTECODE;
+
+  (*instr_num)++;
+
+  if (!emit)
+    return OK;
+
+  operand[operand_len] = '\0';
+  char *end = NULL;
+  size_t index = 0;
+  iog_stack_value_t value = 0;
+
+  if (op == IOG_VM_PUSH) {
+    value = strtod(operand, &end);
+    if (*end != '\0')
+      return ERR_BAD_BYTECODE;
+  } else if (op == IOG_VM_LOAD) {
+    if (!isdigit((unsigned char) operand[0]))
+      return ERR_BAD_BYTECODE;
+
+    index = strtoul(operand, &end, 10);
+    if (*end != '\0')
+      return ERR_BAD_BYTECODE;
+  } else if (has_operand) {
+    size_t label = 0;
+    while (label < *labels_num && strcmp((*labels)[label].name, operand) != 0)
+      label++;
+
+    if (label == *labels_num)
+      return ERR_BAD_BYTECODE;
+
+    index = (*labels)[label].index;
+  }
+
+  return iog_vm_emit(program, op, index, value);
+}
@@ -0,0 +1,412 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "iog_assert.h"
+#include "iog_ws_deque.h"
+#include "cli_colors.h"
+#include "iog_memlib.h"
+
+//--------------------- PRIVATE FUNCTIONS --------------------------------------------
+
+static IogStackReturnCode iog_ws_deque_check (const IogWsDeque_t *deque); ///< Checks by verify level
+static int                iog_ws_deque_level (const IogWsDeque_t *deque); ///< Effective verify level
+
+/// Checks canaries of buffer
+static IogStackReturnCode iog_ws_buffer_verify (const IogWsBuffer_t *buffer);
+
+static IogWsBuffer_t *iog_ws_buffer_alloc (size_t capacity);        ///< Allocate buffer with canaries
+static size_t         iog_ws_buffer_bytes (size_t capacity);        ///< Bytes of buffer with header
+static IogStackReturnCode iog_ws_deque_grow (IogWsDeque_t *deque);  ///< Double buffer, keep old one
+
+//--------------------- PUBLIC FUNCTIONS --------------------------------------------
+
+/**
+ * Allocates buffer, turns isInitialized flag to 1.
+ * @param[out] deque    pointer to deque
+ * @param[in]  capacity initial capacity (rounded up to power of 2, at least INIT_STACK_DATA_CAPACITY)
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_ws_deque_init (IogWsDeque_t *deque, size_t capacity) {
+  IOG_CHECK_STACK_NULL( deque );
+
+  if (deque->isInitialized)
+    return ERR_STACK_ALREADY_INITIALIZED;
+
+  size_t real_capacity = INIT_STACK_DATA_CAPACITY;
+  while (real_capacity < capacity)
+    real_capacity *= 2;
+
+  IogWsBuffer_t *buffer = iog_ws_buffer_alloc(real_capacity);
+  if (buffer == NULL)
+    return ERR_CANT_ALLOCATE_DATA;
+
+  deque->top.store(0, std::memory_order_relaxed);
+  deque->bottom.store(0, std::memory_order_relaxed);
+  deque->buffer.store(buffer, std::memory_order_relaxed);
+
+  deque->verifyLevel = IOG_VERIFY_DEFAULT;
+
+  deque->firstStackCanary  = STACK_CANARY_CONST + (iog_canary_t) deque;
+  deque->secondStackCanary = STACK_CANARY_CONST + (iog_canary_t) deque;
+
+  deque->isInitialized = 1;
+  deque->fastPath = iog_ws_deque_level(deque) <= IOG_VERIFY_OFF;
+
+  std::atomic_thread_fence(std::memory_order_release);
+
+  IOG_RETURN_IF_ERROR( iog_ws_deque_check(deque) );
+
+  return OK;
+}
+
+/**
+ * Frees current and all replaced buffers, resets deque to zero.
+ * @param[out] deque pointer to deque
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_ws_deque_destroy (IogWsDeque_t *deque) {
+  IOG_CHECK_STACK_NULL( deque );
+
+  IogWsBuffer_t *buffer = deque->buffer.load(std::memory_order_acquire);
+
+  while (buffer != NULL) {
+    IogWsBuffer_t *prev = buffer->prev;
+    iog_free_sized(buffer, iog_ws_buffer_bytes(buffer->capacity), 1);
+    buffer = prev;
+  }
+
+  deque->buffer.store(NULL, std::memory_order_relaxed);
+  deque->top.store(0, std::memory_order_relaxed);
+  deque->bottom.store(0, std::memory_order_relaxed);
+
+  deque->firstStackCanary  = 0;
+  deque->secondStackCanary = 0;
+
+  deque->isInitialized = 0;
+  deque->verifyLevel   = IOG_VERIFY_DEFAULT;
+  deque->fastPath      = 0;
+
+  return OK;
+}
+
+/**
+ * Adds value at bottom, doubles buffer if it's full.
+ * @param[out] deque pointer to deque (can't be NULL)
+ * @param[in]  value new value
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_ws_deque_push_slow (IogWsDeque_t *deque, iog_stack_value_t value) {
+  IOG_RETURN_IF_ERROR( iog_ws_deque_check(deque) );
+
+  iog_ws_index_t bottom = deque->bottom.load(std::memory_order_relaxed);
+  iog_ws_index_t top    = deque->top.load(std::memory_order_acquire);
+  IogWsBuffer_t *buffer = deque->buffer.load(std::memory_order_relaxed);
+
+  if (bottom - top >= (iog_ws_index_t) buffer->capacity) {
+    IOG_RETURN_IF_ERROR( iog_ws_deque_grow(deque) );
+    buffer = deque->buffer.load(std::memory_order_relaxed);
+  }
+
+  iog_ws_buffer_data(buffer)[(size_t) bottom & (buffer->capacity - 1)].store(value, std::memory_order_relaxed);
+
+  std::atomic_thread_fence(std::memory_order_release);
+  deque->bottom.store(bottom + 1, std::memory_order_relaxed);
+
+  IOG_RETURN_IF_ERROR( iog_ws_deque_check(deque) );
+
+  return OK;
+}
+
+/**
+ * @param[out] deque pointer to deque
+ * @param[out] value pointer to variable in which want to write (can't be null)
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_ws_deque_pop_slow (IogWsDeque_t *deque, iog_stack_value_t *value) {
+  IOG_ASSERT(value);
+
+  IOG_RETURN_IF_ERROR( iog_ws_deque_check(deque) );
+
+  return iog_ws_deque_take(deque, value);
+}
+
+/**
+ * Reads oldest value and claims it by one CAS on top. Buffer may be replaced
+ * by owner meanwhile, old buffer stays valid so read value is correct if CAS succeeds.
+ * @param[out] deque pointer to deque (can't be NULL)
+ * @param[out] value pointer to variable in which want to write (can't be null)
+ * @return Error code (ERR_STACK_UNDERFLOW if empty, ERR_STEAL_LOST if other thread was first)
+ */
+IogStackReturnCode iog_ws_deque_steal (IogWsDeque_t *deque, iog_stack_value_t *value) {
+  IOG_ASSERT(value);
+
+  IOG_RETURN_IF_ERROR( iog_ws_deque_check(deque) );
+
+  iog_ws_index_t top = deque->top.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  iog_ws_index_t bottom = deque->bottom.load(std::memory_order_acquire);
+
+  if (top >= bottom)
+    return ERR_STACK_UNDERFLOW;
+
+  IogWsBuffer_t *buffer = deque->buffer.load(std::memory_order_acquire);
+  iog_stack_value_t stolen = iog_ws_buffer_data(buffer)[(size_t) top & (buffer->capacity - 1)].load(std::memory_order_relaxed);
+
+  if (!deque->top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+    return ERR_STEAL_LOST;
+
+  *value = stolen;
+
+  return OK;
+}
+
+/**
+ * @param[in] deque pointer to deque
+ * @return bottom - top, or 0 if deque is NULL or they are seen in the middle of operation
+ */
+size_t iog_ws_deque_size (const IogWsDeque_t *deque) {
+  if (deque == NULL)
+    return 0;
+
+  iog_ws_index_t top    = deque->top.load(std::memory_order_acquire);
+  iog_ws_index_t bottom = deque->bottom.load(std::memory_order_acquire);
+
+  return (bottom > top) ? (size_t) (bottom - top) : 0;
+}
+
+/**
+ * @param[in]  deque         pointer to deque
+ * @param[out] stream        pointer to stream for prints
+ * @param[in]  dq_name       name of dumping deque
+ * @param[in]  file_name     name of file from that called dump
+ * @param[in]  line_num      number of line from that called dump
+ * @param[in]  function_name name of function from that called dump
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_ws_deque_dump_f (const IogWsDeque_t *deque, FILE *stream,
+      const char *dq_name, const char *file_name, int line_num, const char *function_name) {
+  IOG_ASSERT(stream);
+
+  fprintf(stream, BLACK("------------ DEQUE DUMP ------------" "\n"));
+  fprintf(stream, BLUE("Called from %s:%d: %s\n"),
+     file_name, line_num, function_name
+  );
+
+  if (deque == NULL) {
+    fprintf(stream, BLACK("IogWsDeque_t %s (null)") " {}\n", dq_name);
+    return ERR_STACK_NULLPTR;
+  }
+
+  iog_ws_index_t top    = deque->top.load(std::memory_order_acquire);
+  iog_ws_index_t bottom = deque->bottom.load(std::memory_order_acquire);
+  const IogWsBuffer_t *buffer = deque->buffer.load(std::memory_order_acquire);
+
+  fprintf(stream, BLACK("IogWsDeque_t %s (%p) {\n"), dq_name, (const void *) deque);
+
+  fprintf(stream, BLACK("  .firstStackCanary  = 0x%llx")  "\n",  deque->firstStackCanary);
+  fprintf(stream, BLACK("  .isInitialized     = %d")    "\n",  (int) deque->isInitialized);
+  fprintf(stream, BLACK("  .top               = %lld")  "\n",  top);
+  fprintf(stream, BLACK("  .bottom            = %lld")  "\n",  bottom);
+  fprintf(stream, BLACK("  .verifyLevel       = %d")    "\n",  (int) deque->verifyLevel);
+
+  for (const IogWsBuffer_t *old = buffer; old != NULL; old = old->prev)
+    fprintf(stream, BLACK("  buffer (%p): capacity = %lu, firstDataCanary = 0x%llx%s") "\n",
+        (const void *) old, old->capacity, old->firstDataCanary, (old == buffer) ? ", current" : "");
+
+  if (buffer != NULL) {
+    for (iog_ws_index_t i = top; i < bottom; i++)
+      fprintf(stream, BLACK("    [%lld]: %lg\n"), i,
+          iog_ws_buffer_data(buffer)[(size_t) i & (buffer->capacity - 1)].load(std::memory_order_relaxed));
+  }
+
+  fprintf(stream, BLACK("  .secondStackCanary = 0x%llx")  "\n",  deque->secondStackCanary);
+  fprintf(stream, BLACK("}\n"));
+  fprintf(stream, BLACK("------------------------------------\n"));
+
+  return OK;
+}
+
+/**
+ * Checks canaries, indexes and every buffer. Exact only if no thread modifies deque.
+ * @param[in] deque pointer to deque
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_ws_deque_verify (const IogWsDeque_t *deque) {
+  IOG_CHECK_STACK_NULL( deque );
+
+  if ((deque->firstStackCanary - STACK_CANARY_CONST) != (iog_canary_t) deque)
+    return ERR_DEAD_FIRST_CANARY;
+
+  if ((deque->secondStackCanary - STACK_CANARY_CONST) != (iog_canary_t) deque)
+    return ERR_DEAD_SECOND_CANARY;
+
+  if (!deque->isInitialized)
+    return ERR_STACK_ISNT_INITIALIZED;
+
+  const IogWsBuffer_t *buffer = deque->buffer.load(std::memory_order_acquire);
+  if (buffer == NULL)
+    return ERR_STACK_DATA_NULLPTR;
+
+  iog_ws_index_t top    = deque->top.load(std::memory_order_acquire);
+  iog_ws_index_t bottom = deque->bottom.load(std::memory_order_acquire);
+
+  if (bottom - top > (iog_ws_index_t) buffer->capacity)
+    return ERR_STACK_OVERFLOW;
+
+  if (bottom < top)
+    return ERR_STACK_UNDERFLOW;
+
+  for (; buffer != NULL; buffer = buffer->prev) {
+    if (buffer->capacity < INIT_STACK_DATA_CAPACITY || (buffer->capacity & (buffer->capacity - 1)) != 0)
+      return ERR_STACK_CAPACITY_UNDERFLOW;
+
+    IOG_RETURN_IF_ERROR( iog_ws_buffer_verify(buffer) );
+  }
+
+  return OK;
+}
+
+/**
+ * @param[out] deque pointer to deque
+ * @param[in]  level new verify level
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+IogStackReturnCode iog_ws_deque_set_verify_level (IogWsDeque_t *deque, IogStackVerifyLevel level) {
+  IOG_RETURN_IF_ERROR( iog_ws_deque_verify(deque) );
+
+  if (level < IOG_VERIFY_DEFAULT || level > IOG_VERIFY_FULL)
+    return ERR_INVALID_VERIFY_LEVEL;
+
+  deque->verifyLevel = level;
+  deque->fastPath    = iog_ws_deque_level(deque) <= IOG_VERIFY_OFF;
+
+  return OK;
+}
+
+//--------------------- PRIVATE FUNCTIONS --------------------------------------------
+
+/**
+ * @param[in] deque pointer to deque
+ * @return deque verify level with default resolved and clamped by IOG_STACK_VERIFY_LEVEL
+ */
+static int iog_ws_deque_level (const IogWsDeque_t *deque) {
+  int level = deque->verifyLevel;
+  if (level == IOG_VERIFY_DEFAULT)
+    level = IOG_STACK_DEFAULT_VERIFY_LEVEL;
+
+  if (level > IOG_STACK_VERIFY_LEVEL)
+    level = IOG_STACK_VERIFY_LEVEL;
+
+  return level;
+}
+
+/**
+ * Deque canaries and buffer canaries never change after init or growth,
+ * so both levels are safe while other threads steal. Full level adds index checks of current buffer.
+ * @param[in] deque pointer to deque
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_ws_deque_check (const IogWsDeque_t *deque) {
+  IOG_CHECK_STACK_NULL( deque );
+
+#if IOG_STACK_VERIFY_LEVEL > 1
+  int level = iog_ws_deque_level(deque);
+
+  if (level >= IOG_VERIFY_CANARIES) {
+    if ((deque->firstStackCanary - STACK_CANARY_CONST) != (iog_canary_t) deque)
+      return ERR_DEAD_FIRST_CANARY;
+
+    if ((deque->secondStackCanary - STACK_CANARY_CONST) != (iog_canary_t) deque)
+      return ERR_DEAD_SECOND_CANARY;
+
+    if (!deque->isInitialized)
+      return ERR_STACK_ISNT_INITIALIZED;
+
+    const IogWsBuffer_t *buffer = deque->buffer.load(std::memory_order_acquire);
+    if (buffer == NULL)
+      return ERR_STACK_DATA_NULLPTR;
+
+    IOG_RETURN_IF_ERROR( iog_ws_buffer_verify(buffer) );
+
+    if (level >= IOG_VERIFY_FULL && iog_ws_deque_size(deque) > buffer->capacity)
+      return ERR_STACK_OVERFLOW;
+  }
+#endif // IOG_STACK_VERIFY_LEVEL > 1
+
+  return OK;
+}
+
+/**
+ * @param[in] buffer pointer to buffer
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_ws_buffer_verify (const IogWsBuffer_t *buffer) {
+  iog_canary_t expected = DATA_CANARY_CONST + (iog_canary_t) iog_ws_buffer_data(buffer);
+
+  if (buffer->firstDataCanary != expected)
+    return ERR_DEAD_FIRST_DATA_CANARY;
+
+  const iog_canary_t *second = (const iog_canary_t *) (iog_ws_buffer_data(buffer) + buffer->capacity);
+  if (*second != expected)
+    return ERR_DEAD_SECOND_DATA_CANARY;
+
+  return OK;
+}
+
+/**
+ * @param[in] capacity slots in buffer
+ * @return size of buffer with header and second data canary in bytes
+ */
+static size_t iog_ws_buffer_bytes (size_t capacity) {
+  return sizeof(IogWsBuffer_t) + capacity * sizeof(iog_ws_slot_t) + sizeof(iog_canary_t);
+}
+
+/**
+ * @param[in] capacity slots in buffer, power of 2
+ * @return pointer to zeroed buffer with canaries (NULL if can't allocate)
+ */
+static IogWsBuffer_t *iog_ws_buffer_alloc (size_t capacity) {
+  IogWsBuffer_t *buffer = (IogWsBuffer_t *) iog_recalloc(NULL, 0, iog_ws_buffer_bytes(capacity), 1);
+  if (buffer == NULL)
+    return NULL;
+
+  buffer->prev     = NULL;
+  buffer->capacity = capacity;
+
+  iog_canary_t canary = DATA_CANARY_CONST + (iog_canary_t) iog_ws_buffer_data(buffer);
+
+  buffer->firstDataCanary = canary;
+  *(iog_canary_t *) (iog_ws_buffer_data(buffer) + capacity) = canary;
+
+  return buffer;
+}
+
+/**
+ * Copies live elements [top, bottom) to buffer of double capacity and publishes it.
+ * Thieves may still read old buffer, so it is kept in chain and freed by destroy.
+ * Called only by owner.
+ * @param[out] deque pointer to deque
+ * @return Error code (if ok return IogStackReturnCode.OK)
+ */
+static IogStackReturnCode iog_ws_deque_grow (IogWsDeque_t *deque) {
+  IogWsBuffer_t *old_buffer = deque->buffer.load(std::memory_order_relaxed);
+  IogWsBuffer_t *new_buffer = iog_ws_buffer_alloc(old_buffer->capacity * 2);
+  if (new_buffer == NULL)
+    return ERR_CANT_ALLOCATE_DATA;
+
+  iog_ws_index_t top    = deque->top.load(std::memory_order_acquire);
+  iog_ws_index_t bottom = deque->bottom.load(std::memory_order_relaxed);
+
+  iog_ws_slot_t *old_data = iog_ws_buffer_data(old_buffer);
+  iog_ws_slot_t *new_data = iog_ws_buffer_data(new_buffer);
+
+  for (iog_ws_index_t i = top; i < bottom; i++)
+    new_data[(size_t) i & (new_buffer->capacity - 1)].store(
+        old_data[(size_t) i & (old_buffer->capacity - 1)].load(std::memory_order_relaxed),
+        std::memory_order_relaxed);
+
+  new_buffer->prev = old_buffer;
+  deque->buffer.store(new_buffer, std::memory_order_release);
+
+  return OK;
+}